@@ -0,0 +1,244 @@
+/**
+ * @file _projanitor.c
+ * @brief CPython binding of the libprojanitor engine, used by projanitor.py.
+ *
+ * Exposes a single scan() call. The scan itself runs with the GIL released;
+ * results are then copied straight from the engine's iterators into Python
+ * lists and dicts (paths decoded with the filesystem encoding), so nothing is
+ * formatted or parsed as text in between.
+ *
+ * To Compile (or run `make python` in the repository root), once
+ * classifier_table.h has been generated (see libprojanitor.c):
+ * gcc -std=c99 -O2 -shared -fPIC $(python3-config --includes) \
+ *     -o _projanitor$(python3-config --extension-suffix) _projanitor.c libprojanitor.c -lpthread
+ */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "projanitor.h"
+
+static const char *const type_names[PJ_TYPE_COUNT] = {
+    ".c", ".h", "CMakeLists.txt", ".cmake", ".sh", ".json", ".py", ".md"
+};
+
+// Runs without the GIL, so it must not touch Python objects.
+static void log_to_stderr(void *user, pj_log_level level, const char *message) {
+    (void)user;
+    static const char *const prefixes[] = {"Info", "Warning", "Error"};
+    fprintf(stderr, "%s: %s\n", prefixes[level], message);
+}
+
+typedef pj_status (*ListSetter)(ProjanitorContext *ctx, const char *const *items, size_t count);
+
+// Pass an iterable of str to one of the pj_set_* list setters.
+static int set_list(ProjanitorContext *ctx, ListSetter setter, PyObject *iterable, const char *what) {
+    if (!iterable || iterable == Py_None) return 0;
+    PyObject *seq = PySequence_Fast(iterable, what);
+    if (!seq) return -1;
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(seq);
+    const char **items = (const char **)PyMem_Malloc((count + 1) * sizeof(char *));
+    if (!items) {
+        Py_DECREF(seq);
+        PyErr_NoMemory();
+        return -1;
+    }
+    int rc = 0;
+    for (Py_ssize_t i = 0; i < count && rc == 0; i++) {
+        items[i] = PyUnicode_AsUTF8(PySequence_Fast_GET_ITEM(seq, i));
+        if (!items[i]) rc = -1;
+    }
+    if (rc == 0 && setter(ctx, items, (size_t)count) != PJ_OK) {
+        PyErr_SetString(PyExc_MemoryError, pj_last_error(ctx));
+        rc = -1;
+    }
+    PyMem_Free(items);
+    Py_DECREF(seq);
+    return rc;
+}
+
+static PyObject *decode_path(const char *path) {
+    return PyUnicode_DecodeFSDefault(path);
+}
+
+// [name, ...] for the plain path results.
+static PyObject *result_list(const ProjanitorContext *ctx, pj_result_kind kind) {
+    PyObject *list = PyList_New((Py_ssize_t)pj_result_count(ctx, kind));
+    if (!list) return NULL;
+    pj_iter it = pj_iter_begin(ctx, kind);
+    pj_entry entry;
+    for (Py_ssize_t i = 0; pj_iter_next(&it, &entry); i++) {
+        PyObject *item = decode_path(entry.name);
+        if (!item) {
+            Py_DECREF(list);
+            return NULL;
+        }
+        PyList_SET_ITEM(list, i, item);
+    }
+    return list;
+}
+
+// {name: [path, ...]} for the grouped results.
+static PyObject *result_dict(const ProjanitorContext *ctx, pj_result_kind kind) {
+    PyObject *dict = PyDict_New();
+    if (!dict) return NULL;
+    pj_iter it = pj_iter_begin(ctx, kind);
+    pj_entry entry;
+    while (pj_iter_next(&it, &entry)) {
+        PyObject *paths = PyList_New((Py_ssize_t)entry.path_count);
+        PyObject *key = decode_path(entry.name);
+        if (!paths || !key) goto fail;
+        for (size_t j = 0; j < entry.path_count; j++) {
+            PyObject *item = decode_path(entry.paths[j]);
+            if (!item) goto fail;
+            PyList_SET_ITEM(paths, (Py_ssize_t)j, item);
+        }
+        int rc = PyDict_SetItem(dict, key, paths);
+        Py_DECREF(key);
+        Py_DECREF(paths);
+        if (rc < 0) {
+            Py_DECREF(dict);
+            return NULL;
+        }
+        continue;
+    fail:
+        Py_XDECREF(paths);
+        Py_XDECREF(key);
+        Py_DECREF(dict);
+        return NULL;
+    }
+    return dict;
+}
+
+static PyObject *type_counts(const ProjanitorContext *ctx) {
+    PyObject *dict = PyDict_New();
+    if (!dict) return NULL;
+    for (int t = 0; t < PJ_TYPE_COUNT; t++) {
+        PyObject *count = PyLong_FromSize_t(pj_file_type_count(ctx, (pj_file_type)t));
+        int rc = count ? PyDict_SetItemString(dict, type_names[t], count) : -1;
+        Py_XDECREF(count);
+        if (rc < 0) {
+            Py_DECREF(dict);
+            return NULL;
+        }
+    }
+    return dict;
+}
+
+static int set_item(PyObject *dict, const char *key, PyObject *value) {
+    if (!value) return -1;
+    int rc = PyDict_SetItemString(dict, key, value);
+    Py_DECREF(value);
+    return rc;
+}
+
+static PyObject *build_result(const ProjanitorContext *ctx, bool root_found) {
+    PyObject *result = PyDict_New();
+    if (!result) return NULL;
+    if (set_item(result, "root", decode_path(pj_root_path(ctx))) < 0 ||
+        set_item(result, "root_found", PyBool_FromLong(root_found)) < 0 ||
+        set_item(result, "project_name", PyUnicode_DecodeUTF8(pj_project_name(ctx), strlen(pj_project_name(ctx)), "replace")) < 0 ||
+        set_item(result, "files", result_list(ctx, PJ_RESULT_FILES)) < 0 ||
+        set_item(result, "orphans", result_list(ctx, PJ_RESULT_ORPHANS)) < 0 ||
+        set_item(result, "subfolders", result_list(ctx, PJ_RESULT_SUBFOLDERS)) < 0 ||
+        set_item(result, "directories", result_list(ctx, PJ_RESULT_DIRECTORIES)) < 0 ||
+        set_item(result, "excluded", result_list(ctx, PJ_RESULT_EXCLUDED)) < 0 ||
+        set_item(result, "referenced", result_dict(ctx, PJ_RESULT_REFERENCED)) < 0 ||
+        set_item(result, "basenames", result_dict(ctx, PJ_RESULT_BASENAMES)) < 0 ||
+        set_item(result, "missing", result_dict(ctx, PJ_RESULT_MISSING)) < 0 ||
+        set_item(result, "duplicates", result_dict(ctx, PJ_RESULT_DUPLICATES)) < 0 ||
+        set_item(result, "counts", type_counts(ctx)) < 0) {
+        Py_DECREF(result);
+        return NULL;
+    }
+    return result;
+}
+
+PyDoc_STRVAR(scan_doc,
+"scan(root=None, start_dir=None, extensions=None, exclude_dirs=None,\n"
+"     marker_files=None, verbose=False) -> dict\n\n"
+"Scan a project with the C engine. Without root, the root is discovered from\n"
+"start_dir (default: the working directory) using marker_files. Lists take\n"
+"the same items as the C tool (\".c\", \"CMakeLists.txt\", ...). The dict holds\n"
+"root, root_found, project_name, files, orphans, subfolders, directories,\n"
+"excluded, counts and the name -> paths maps referenced, basenames, missing\n"
+"and duplicates.");
+
+static PyObject *projanitor_scan(PyObject *self, PyObject *args, PyObject *kwargs) {
+    (void)self;
+    static char *kwlist[] = {"root", "start_dir", "extensions", "exclude_dirs", "marker_files", "verbose", NULL};
+    PyObject *root = Py_None, *start_dir = Py_None;
+    PyObject *extensions = NULL, *exclude_dirs = NULL, *marker_files = NULL;
+    int verbose = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|OOOOOp:scan", kwlist, &root, &start_dir,
+                                     &extensions, &exclude_dirs, &marker_files, &verbose)) {
+        return NULL;
+    }
+
+    ProjanitorContext *ctx = pj_context_new();
+    if (!ctx) return PyErr_NoMemory();
+    pj_set_log_callback(ctx, log_to_stderr, NULL);
+    pj_set_verbose(ctx, verbose);
+
+    PyObject *root_bytes = NULL, *start_bytes = NULL, *result = NULL;
+    if (set_list(ctx, pj_set_extensions, extensions, "extensions must be a sequence of str") < 0 ||
+        set_list(ctx, pj_set_exclude_dirs, exclude_dirs, "exclude_dirs must be a sequence of str") < 0 ||
+        set_list(ctx, pj_set_marker_files, marker_files, "marker_files must be a sequence of str") < 0) {
+        goto done;
+    }
+    if (root != Py_None) {
+        if (!PyUnicode_FSConverter(root, &root_bytes)) goto done;
+        if (pj_set_root(ctx, PyBytes_AS_STRING(root_bytes)) != PJ_OK) {
+            PyErr_SetString(PyExc_FileNotFoundError, pj_last_error(ctx));
+            goto done;
+        }
+    } else if (start_dir != Py_None) {
+        if (!PyUnicode_FSConverter(start_dir, &start_bytes)) goto done;
+        if (pj_set_start_dir(ctx, PyBytes_AS_STRING(start_bytes)) != PJ_OK) {
+            PyErr_SetString(PyExc_FileNotFoundError, pj_last_error(ctx));
+            goto done;
+        }
+    }
+
+    pj_status root_status, status;
+    Py_BEGIN_ALLOW_THREADS
+    root_status = pj_discover_root(ctx);
+    status = pj_scan(ctx);
+    Py_END_ALLOW_THREADS
+
+    if (status == PJ_ERR_NOMEM) {
+        PyErr_SetString(PyExc_MemoryError, pj_last_error(ctx));
+    } else if (status != PJ_OK) {
+        PyErr_SetString(PyExc_OSError, pj_last_error(ctx));
+    } else {
+        result = build_result(ctx, root_status == PJ_OK);
+    }
+
+done:
+    Py_XDECREF(root_bytes);
+    Py_XDECREF(start_bytes);
+    pj_context_free(ctx);
+    return result;
+}
+
+static PyMethodDef projanitor_methods[] = {
+    {"scan", (PyCFunction)(void (*)(void))projanitor_scan, METH_VARARGS | METH_KEYWORDS, scan_doc},
+    {NULL, NULL, 0, NULL}
+};
+
+static struct PyModuleDef projanitor_module = {
+    PyModuleDef_HEAD_INIT,
+    "_projanitor",
+    "Native scanning engine for projanitor.py.",
+    -1,
+    projanitor_methods,
+    NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit__projanitor(void) {
+    PyObject *module = PyModule_Create(&projanitor_module);
+    if (module && PyModule_AddStringConstant(module, "__version__", PJ_VERSION) < 0) {
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
+}
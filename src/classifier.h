@@ -0,0 +1,36 @@
+/**
+ * @file classifier.h
+ * @brief File-name classification shared by libprojanitor.c and gen_classifier,
+ *        the build tool that turns the default lists into a perfect-hash table
+ *        (classifier_table.h).
+ */
+#ifndef PJ_CLASSIFIER_H
+#define PJ_CLASSIFIER_H
+
+#include <stdint.h>
+
+#include "projanitor.h"
+
+enum {
+    CLASS_EXTENSION = 1u << 0,  // scanned: a ".ext" suffix or a whole file name
+    CLASS_EXCLUDED = 1u << 1    // directory name skipped by the scan
+};
+
+typedef struct {
+    const char *key;    // NULL for an empty slot
+    uint8_t type;       // pj_file_type statistics bucket, PJ_TYPE_COUNT if none
+    uint8_t flags;      // CLASS_*
+} ClassEntry;
+
+// Seeded FNV-1a with a final fold, so the low bits used as the slot index
+// depend on every byte.
+static inline uint32_t classifier_hash(const char *key, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h ^ (h >> 16);
+}
+
+#endif // PJ_CLASSIFIER_H
@@ -0,0 +1,117 @@
+/**
+ * @file gen_classifier.c
+ * @brief Build tool: writes classifier_table.h, the engine's default lists and
+ *        a collision-free hash table over them.
+ *
+ * The table maps every default extension, file name and excluded directory to
+ * its CLASS_* flags and pj_file_type bucket. Its size is the smallest power of
+ * two for which some seed gives every key its own slot, so a lookup is one
+ * hash, one slot and one strcmp.
+ *
+ * To Compile (or run `make`, which regenerates the header when this changes):
+ * gcc -std=c99 -O2 -o gen_classifier gen_classifier.c && ./gen_classifier > classifier_table.h
+ */
+#include "classifier.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SEED 1000000u
+
+typedef struct {
+    const char *key;
+    const char *type;   // pj_file_type enumerator
+} TypedKey;
+
+// The default --extensions, with the statistics bucket of each.
+static const TypedKey extensions[] = {
+    {".c", "PJ_TYPE_C"},
+    {".h", "PJ_TYPE_H"},
+    {".json", "PJ_TYPE_JSON"},
+    {".py", "PJ_TYPE_PY"},
+    {".cmake", "PJ_TYPE_CMAKE"},
+    {".md", "PJ_TYPE_MD"},
+    {".sh", "PJ_TYPE_SH"},
+    {"CMakeLists.txt", "PJ_TYPE_CMAKELISTS"}
+};
+static const char *const exclude_dirs[] = {".git", "build", "build_logs", "doc"};
+static const char *const marker_files[] = {"LICENSE", "sdkconfig", "dependencies.lock", "CMakeLists.txt"};
+
+#define COUNT(a) (sizeof(a) / sizeof(*(a)))
+
+typedef struct {
+    const char *key;
+    const char *type;
+    unsigned flags;
+} Key;
+
+static void print_list(const char *name, const char *const *items, size_t count) {
+    printf("static const char *const %s[] = {", name);
+    for (size_t i = 0; i < count; i++) printf("%s\"%s\"", i ? ", " : "", items[i]);
+    printf("};\n");
+}
+
+// Slot of every key under `seed`, or false on the first collision.
+static bool place_keys(const Key *keys, size_t key_count, uint32_t size, uint32_t seed, int *slots) {
+    for (uint32_t s = 0; s < size; s++) slots[s] = -1;
+    for (size_t k = 0; k < key_count; k++) {
+        uint32_t s = classifier_hash(keys[k].key, seed) & (size - 1);
+        if (slots[s] >= 0) return false;
+        slots[s] = (int)k;
+    }
+    return true;
+}
+
+int main(void) {
+    Key keys[COUNT(extensions) + COUNT(exclude_dirs)];
+    size_t key_count = 0;
+    for (size_t i = 0; i < COUNT(extensions); i++) {
+        keys[key_count++] = (Key){extensions[i].key, extensions[i].type, CLASS_EXTENSION};
+    }
+    for (size_t i = 0; i < COUNT(exclude_dirs); i++) {
+        size_t k = 0;
+        while (k < key_count && strcmp(keys[k].key, exclude_dirs[i]) != 0) k++;
+        if (k == key_count) keys[key_count++] = (Key){exclude_dirs[i], "PJ_TYPE_COUNT", 0};
+        keys[k].flags |= CLASS_EXCLUDED;
+    }
+
+    uint32_t size = 1, seed = 0;
+    while (size < key_count) size *= 2;
+    int *slots = NULL;
+    for (; size <= 1024; size *= 2) {
+        slots = (int *)realloc(slots, size * sizeof(int));
+        if (!slots) return 1;
+        for (seed = 1; seed < MAX_SEED && !place_keys(keys, key_count, size, seed, slots); seed++) {}
+        if (seed < MAX_SEED) break;
+    }
+    if (size > 1024) {
+        fprintf(stderr, "gen_classifier: no collision-free seed for %zu keys\n", key_count);
+        return 1;
+    }
+
+    printf("// Generated by gen_classifier.c; do not edit.\n\n");
+    const char *extension_keys[COUNT(extensions)];
+    for (size_t i = 0; i < COUNT(extensions); i++) extension_keys[i] = extensions[i].key;
+    print_list("default_extensions", extension_keys, COUNT(extensions));
+    print_list("default_exclude_dirs", exclude_dirs, COUNT(exclude_dirs));
+    print_list("default_marker_files", marker_files, COUNT(marker_files));
+    printf("\n#define CLASSIFIER_SEED %uu\n", seed);
+    printf("#define CLASSIFIER_MASK %uu\n", size - 1);
+    size_t max_len = 0;
+    for (size_t k = 0; k < key_count; k++) {
+        if (strlen(keys[k].key) > max_len) max_len = strlen(keys[k].key);
+    }
+    printf("#define CLASSIFIER_MAX_KEY_LEN %zu\n\n", max_len);
+    printf("static const ClassEntry classifier_table[%u] = {\n", size);
+    for (uint32_t s = 0; s < size; s++) {
+        if (slots[s] < 0) continue;
+        const Key *key = &keys[slots[s]];
+        printf("    [%u] = {\"%s\", %s, %s},\n", s, key->key, key->type,
+               key->flags == (CLASS_EXTENSION | CLASS_EXCLUDED) ? "CLASS_EXTENSION | CLASS_EXCLUDED"
+               : key->flags == CLASS_EXTENSION ? "CLASS_EXTENSION" : "CLASS_EXCLUDED");
+    }
+    printf("};\n");
+    free(slots);
+    return 0;
+}
@@ -0,0 +1,7895 @@
+/**
+ * @file libprojanitor.c
+ * @brief The projanitor engine: project root discovery, file cataloging,
+ *        reference analysis and the optional include/symbol analyses.
+ *
+ * Everything a scan produces lives in a ProjanitorContext (see projanitor.h),
+ * so the engine is reentrant: separate contexts can be used from separate
+ * threads. Nothing here exits the process or writes to stdout; diagnostics go
+ * through pj_log() and reports go to the FILE * the caller passes in.
+ *
+ * Allocation failure calls pj_out_of_memory(), which unwinds to the public
+ * entry point that is currently running on this thread (a per-thread jmp_buf)
+ * and turns into PJ_ERR_NOMEM. Temporaries owned by the interrupted call are
+ * leaked; the context itself is left consistent.
+ *
+ * To Compile (or use the top-level Makefile), after generating the default
+ * classification table with gen_classifier.c:
+ * gcc -std=c99 -Wall -O2 -fPIC -c libprojanitor.c
+ */
+#define _GNU_SOURCE       // statx() and d_type for the network-filesystem scan
+#define _XOPEN_SOURCE 700 // Enable POSIX extensions for strdup, strtok_r, lstat
+#define _POSIX_C_SOURCE 200809L
+
+#include "projanitor.h"
+#include "classifier.h"
+#include "classifier_table.h"   // generated by gen_classifier.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <libgen.h>
+#include <limits.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <time.h>
+#ifdef PJ_WITH_SQLITE
+#include "sqlite3.h"    // amalgamation vendored by `make sqlite`
+#endif
+
+#define MAX_PATH_LEN 4096
+#define MAX_LINE_LEN 2048
+#define INITIAL_ARRAY_CAPACITY 64
+#define HASH_MAP_SIZE 1024
+#define VALUE_INLINE_CAPACITY 2 // most basenames have one path, most headers few referrers
+#define MAX_SEARCH_DEPTH 3
+#define MAX_SRC_BUFFER (MAX_LINE_LEN * 100) // Further increased buffer for safety
+#define MAX_ERROR_LEN 256
+#define PP_CACHE_MAGIC "projanitor-pp 1"
+#define TRIGRAM_INDEX_MAGIC "PJTRI001"
+
+// --- Data Structures ---
+
+typedef struct {
+    char **items;
+    int count;
+    int capacity;
+    bool borrowed;  // items is storage owned by someone else (a Node's inline slots)
+} StringArray;
+
+// One allocation per key: the value list starts in inline_values and only
+// moves to the heap when it outgrows them.
+typedef struct Node {
+    struct Node *next;
+    StringArray values;
+    char *inline_values[VALUE_INLINE_CAPACITY];
+    char key[];
+} Node;
+
+typedef struct {
+    Node **buckets;
+    int size;
+} HashMap;
+
+// Strings that live exactly as long as their table, packed into chunks of
+// one huge page. The first bytes of each chunk link to the previous one.
+typedef struct {
+    char *chunk;
+    size_t used;
+    size_t size;
+} StringArena;
+
+typedef enum {
+    REF_INCLUDE,    // #include "name" in C sources and headers
+    REF_CMAKE_SRC   // source listed in a CMake SRC block
+} RefKind;
+
+// A reference as written in a file.
+typedef struct {
+    int from;       // file id of the referring file
+    char *name;
+    int line;
+    RefKind kind;
+} Reference;
+
+typedef struct {
+    Reference *items;
+    int count;
+    int capacity;
+    StringArena names;
+} ReferenceArray;
+
+// String -> int index, open addressing. Keys are borrowed, not copied.
+typedef struct {
+    const char **keys;
+    int *values;
+    int size;
+    int count;
+} IdMap;
+
+typedef enum {
+    GUARD_NOT_HEADER,
+    GUARD_PRAGMA_ONCE,
+    GUARD_MACRO,        // canonical #ifndef X / #define X ... #endif
+    GUARD_BROKEN,       // guard-like, but defeats the multiple-include optimization
+    GUARD_NONE
+} GuardKind;
+
+enum {
+    FILE_REFERENCED = 1u << 0   // some reference names its basename
+};
+
+// The scanned files, one array per attribute, indexed by file id (scan order).
+// The table owns the paths; references, graphs, indexes and results refer to
+// files by id, so per-file passes are loops over contiguous columns.
+typedef struct {
+    int count;
+    int capacity;
+    char **paths;
+    int32_t *dir_ids;           // into dir_paths
+    int32_t *name_ids;          // into names
+    int32_t *next_same_name;    // next id with the same basename in sorted order, -1 at the end
+    uint8_t *types;             // pj_file_type, PJ_TYPE_COUNT if not counted
+    uint8_t *flags;             // FILE_*
+    uint8_t *guards;            // GuardKind
+    const char **guard_issues;  // static strings, set for GUARD_BROKEN
+    int64_t *sizes;
+    int64_t *mtimes;
+    uint64_t *inodes;
+    int *sorted;                // ids in compare_paths order, once the scan ends
+
+    const char **dir_paths;     // borrowed: the root path and the directories entries
+    int dir_count;
+    int dir_capacity;
+
+    const char **names;         // distinct basenames, borrowed from paths
+    int32_t *name_heads;        // first id of each name in sorted order
+    int32_t *name_sizes;        // files per name
+    int name_count;
+    int name_capacity;
+    IdMap name_index;           // basename -> name id
+    StringArena strings;        // the paths
+} FileTable;
+
+// Interned identifier with project-wide definition/use counts.
+typedef struct {
+    const char *name;       // interned in the table's arena
+    int defs;
+    int uses;
+    bool is_function;
+    unsigned int hash;      // of the name, checked before comparing names
+    const char *def_path;   // borrowed file table path of the first definition
+    int def_line;
+} Symbol;
+
+typedef struct {
+    Symbol *items;
+    int *slots;  // open-addressed, -1 = empty
+    int count;
+    int capacity;
+    int slot_count;
+    StringArena names;
+} SymbolTable;
+
+// Resolved reference graph in CSR form: the edges of file i are
+// edge_targets[edge_offsets[i] .. edge_offsets[i + 1]), in source order.
+typedef struct {
+    int file_count;
+    const char **paths;   // sorted, borrowed from the file table
+    int *file_ids;        // file table id of each node
+    IdMap path_ids;
+    int edge_count;
+    int *edge_offsets;
+    int *edge_targets;
+    int *edge_refs;       // index into the ReferenceArray for each edge
+    int *rev_offsets;     // reverse CSR, built on first use
+    int *rev_sources;
+} IncludeGraph;
+
+// Posting list of one trigram, delta-varint encoded while the scan runs.
+// File ids are file table ids, so they only ever increase.
+typedef struct {
+    uint32_t trigram;     // three bytes, first byte highest
+    uint32_t count;       // files containing it; 0 = empty slot
+    uint32_t last;        // last file id appended + 1
+    uint8_t *bytes;
+    size_t len;
+    size_t capacity;
+} TrigramPosting;
+
+// trigram -> posting list, open addressing.
+typedef struct {
+    TrigramPosting *slots;
+    uint32_t slot_count;  // power of two
+    uint32_t count;
+} TrigramTable;
+
+// One row of the MISSING or DUPLICATES results. `paths` is sorted.
+typedef struct {
+    char *name;
+    StringArray paths;
+} ResultGroup;
+
+typedef struct {
+    ResultGroup *items;
+    int count;
+    int capacity;
+} ResultGroupArray;
+
+// An object or dependency file under build/.
+typedef struct {
+    char *path;         // relative to build/
+    int64_t size;
+} BuildArtifact;
+
+typedef struct {
+    BuildArtifact *items;
+    int count;
+    int capacity;
+} BuildArtifactArray;
+
+// Phases of a scan, timed for pj_write_metrics().
+enum {
+    PHASE_DISCOVER,         // finding the project root
+    PHASE_BUILD_FILES,      // listing build/
+    PHASE_TREE,             // walking and parsing the tree
+    PHASE_RESULTS,          // orphans, duplicates, missing names
+    PHASE_GRAPH,            // include graph, built on first use
+    PHASE_COUNT
+};
+
+// Cost of the last scan. Filesystem calls are counted where the scan makes
+// them; read() calls come from the kernel's per-process count.
+typedef struct {
+    double phase_seconds[PHASE_COUNT];
+    uint64_t bytes_read;        // contents of the files parsed
+    uint64_t stat_calls;        // stat, lstat and statx
+    uint64_t opendir_calls;
+    uint64_t open_calls;        // files opened for parsing
+    int64_t read_calls;         // -1 where /proc/self/io is unavailable
+} ScanStats;
+
+struct ProjanitorContext {
+    // Configuration
+    StringArray extensions;
+    StringArray exclude_dirs;
+    StringArray marker_files;
+    bool verbose;
+    unsigned features;
+    int jobs;
+    int network_fs;                 // scan threads for a network filesystem, 0 = off
+    bool huge_pages;                // back large tables with huge pages
+    char start_dir[MAX_PATH_LEN];   // empty: the working directory at discovery
+    char root_path[MAX_PATH_LEN];
+    bool root_known;
+    pj_log_fn log_fn;
+    void *log_user;
+    char error[MAX_ERROR_LEN];
+
+    // Scan results
+    bool scanned;
+    char *project_name;
+    StringArray build_files;
+    IdMap build_file_set;           // build_files by name
+    BuildArtifactArray artifacts;   // for report_stale_artifacts()
+    IdMap class_overrides;          // name -> CLASS_* for non-default lists, during a scan
+    bool custom_classes;
+    FileTable files;
+    HashMap *referenced_files;
+    ReferenceArray references;
+    SymbolTable symbols;
+    TrigramTable trigrams;          // PJ_FEATURE_TRIGRAMS only
+    IncludeGraph graph;             // built on first use
+    bool graph_built;
+    ScanStats stats;
+    bool stats_discovered;          // stats hold a discovery not yet followed by a scan
+
+    // Derived results, sorted for the iterators
+    StringArray subfolders;
+    StringArray directories;
+    StringArray excluded;
+    StringArray orphans;
+    ResultGroupArray missing;
+    ResultGroupArray duplicates;
+    ResultGroupArray referenced;
+    ResultGroupArray basenames;
+    size_t type_counts[PJ_TYPE_COUNT];
+};
+
+// --- Forward Declarations ---
+static void init_string_array(StringArray *arr);
+static void add_to_string_array(StringArray *arr, const char *item);
+static void free_string_array(StringArray *arr);
+static int compare_paths(const void *a, const void *b);
+
+static unsigned int hash(const char *key, int size);
+static HashMap* create_hash_map(int size);
+static void add_to_hash_map(HashMap *map, const char *key, const char *value);
+static StringArray* get_from_hash_map(const HashMap *map, const char *key);
+static void free_hash_map(HashMap *map);
+
+static void init_reference_array(ReferenceArray *refs);
+static void add_reference(ReferenceArray *refs, int from, const char *name, int line, RefKind kind);
+static void free_reference_array(ReferenceArray *refs);
+static void init_file_table(FileTable *files);
+static int add_dir(FileTable *files, const char *path);
+static int add_file(FileTable *files, const char *path, int dir_id, const struct stat *st);
+static void sort_file_table(FileTable *files);
+static void free_file_table(FileTable *files);
+static void add_result_group(ResultGroupArray *groups, const char *name, const StringArray *paths);
+static void free_result_groups(ResultGroupArray *groups);
+static void add_file_group(ResultGroupArray *groups, const FileTable *files, int name_id);
+
+static void init_id_map(IdMap *map, int expected);
+static int id_map_get(const IdMap *map, const char *key);
+static void id_map_put(IdMap *map, const char *key, int value);
+static void free_id_map(IdMap *map);
+
+static void init_symbol_table(SymbolTable *table);
+static void free_symbol_table(SymbolTable *table);
+static void free_include_graph(IncludeGraph *graph);
+static void init_trigram_table(TrigramTable *table);
+static void free_trigram_table(TrigramTable *table);
+static void ensure_include_graph(ProjanitorContext *ctx);
+
+// --- Error Handling and Logging ---
+
+static pthread_key_t oom_key;
+static pthread_once_t oom_once = PTHREAD_ONCE_INIT;
+
+static void create_oom_key(void) {
+    pthread_key_create(&oom_key, NULL);
+}
+
+// Unwind target of the public call running on this thread. Guards nest, so an
+// entry point may call another one. Install with oom_enter(&g) followed by
+// `if (setjmp(g.env) != 0)` on its own, the only forms C99 allows setjmp in.
+typedef struct {
+    jmp_buf env;
+    void *prev;
+    bool huge_pages;    // large tables of this call may use huge pages
+} OomGuard;
+
+static void oom_enter(OomGuard *guard) {
+    pthread_once(&oom_once, create_oom_key);
+    guard->prev = pthread_getspecific(oom_key);
+    guard->huge_pages = guard->prev && ((OomGuard *)guard->prev)->huge_pages;
+    pthread_setspecific(oom_key, guard);
+}
+
+static void oom_leave(OomGuard *guard) {
+    pthread_setspecific(oom_key, guard->prev);
+}
+
+static void pj_out_of_memory(void) {
+    pthread_once(&oom_once, create_oom_key);
+    OomGuard *guard = (OomGuard *)pthread_getspecific(oom_key);
+    if (!guard) {
+        fputs("projanitor: out of memory\n", stderr);
+        abort();
+    }
+    longjmp(guard->env, 1);
+}
+
+static void pj_log(const ProjanitorContext *ctx, pj_log_level level, const char *fmt, ...) {
+    if (!ctx->log_fn || (level == PJ_LOG_INFO && !ctx->verbose)) return;
+    char message[MAX_LINE_LEN];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(message, sizeof(message), fmt, ap);
+    va_end(ap);
+    ctx->log_fn(ctx->log_user, level, message);
+}
+
+// Record the message for pj_last_error() and return the status.
+static pj_status fail(ProjanitorContext *ctx, pj_status status, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(ctx->error, sizeof(ctx->error), fmt, ap);
+    va_end(ap);
+    return status;
+}
+
+// Close `file`, written as tmp_path, and rename it over `path`. A write,
+// close or rename error removes the temporary and fails with PJ_ERR_IO.
+static pj_status commit_temp_file(ProjanitorContext *ctx, FILE *file, const char *tmp_path, const char *path) {
+    bool ok = !ferror(file);
+    int err = errno;
+    if (fclose(file) != 0 && ok) {
+        ok = false;
+        err = errno;
+    }
+    if (ok && rename(tmp_path, path) != 0) {
+        ok = false;
+        err = errno;
+    }
+    if (!ok) {
+        unlink(tmp_path);
+        return fail(ctx, PJ_ERR_IO, "Cannot write %s: %s", path, strerror(err));
+    }
+    return PJ_OK;
+}
+
+// --- Large Tables ---
+//
+// Tables that grow with the project (id maps, symbol and trigram slots, file
+// table columns, references, graph arrays) and the strings they point into
+// come from here. Every block starts with a header recording its capacity and
+// how it was allocated, so all blocks resize and free the same way; failure
+// unwinds like any other allocation.
+//
+// With pj_set_huge_pages(), blocks of a huge page or more are mapped on 2 MB
+// boundaries and backed by huge pages, so lookups scattered over a table of a
+// million entries stop missing the TLB: reserved hugetlbfs pages if there are
+// any, else transparent huge pages through madvise(MADV_HUGEPAGE), else plain
+// pages. Smaller blocks, and all blocks without the option, use malloc.
+
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+#define LARGE_HEADER_SIZE 64    // keeps mapped payloads cache-line aligned
+
+typedef struct {
+    size_t capacity;    // usable bytes after the header
+    size_t map_len;     // length of the mapping, 0 if from malloc
+} LargeHeader;
+
+static bool huge_pages_enabled(void) {
+    pthread_once(&oom_once, create_oom_key);
+    const OomGuard *guard = (const OomGuard *)pthread_getspecific(oom_key);
+    return guard && guard->huge_pages;
+}
+
+// `len` is a multiple of HUGE_PAGE_SIZE. NULL if nothing could be mapped.
+static void *map_huge_pages(size_t len) {
+#ifdef MAP_HUGETLB
+    void *reserved = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (reserved != MAP_FAILED) return reserved;
+#endif
+    // Over-map by one huge page, then trim to a 2 MB boundary
+    char *raw = (char *)mmap(NULL, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) return NULL;
+    char *start = (char *)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+    if (start > raw) munmap(raw, (size_t)(start - raw));
+    munmap(start + len, (size_t)(raw + HUGE_PAGE_SIZE - start));
+#ifdef MADV_HUGEPAGE
+    madvise(start, len, MADV_HUGEPAGE);  // best effort: THP may be disabled
+#endif
+    return start;
+}
+
+static LargeHeader *large_header(void *block) {
+    return (LargeHeader *)((char *)block - LARGE_HEADER_SIZE);
+}
+
+static bool wants_huge_pages(size_t size) {
+    return size + LARGE_HEADER_SIZE >= HUGE_PAGE_SIZE && huge_pages_enabled();
+}
+
+// A zeroed block of at least `size` bytes.
+static void *large_alloc(size_t size) {
+    LargeHeader *header = NULL;
+    size_t map_len = 0;
+    if (wants_huge_pages(size)) {
+        map_len = (size + LARGE_HEADER_SIZE + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+        header = (LargeHeader *)map_huge_pages(map_len);
+        if (!header) map_len = 0;
+    }
+    if (!header) header = (LargeHeader *)calloc(1, size + LARGE_HEADER_SIZE);
+    if (!header) pj_out_of_memory();
+    header->capacity = map_len ? map_len - LARGE_HEADER_SIZE : size;
+    header->map_len = map_len;
+    return (char *)header + LARGE_HEADER_SIZE;
+}
+
+static void large_free(void *block) {
+    if (!block) return;
+    LargeHeader *header = large_header(block);
+    if (header->map_len) {
+        munmap(header, header->map_len);
+    } else {
+        free(header);
+    }
+}
+
+// Like realloc(): contents are kept up to the smaller size, and bytes past the
+// old size are unspecified.
+static void *large_realloc(void *block, size_t size) {
+    if (!block) return large_alloc(size);
+    LargeHeader *header = large_header(block);
+    if (header->map_len && size <= header->capacity) return block;
+    if (!header->map_len && !wants_huge_pages(size)) {
+        header = (LargeHeader *)realloc(header, size + LARGE_HEADER_SIZE);
+        if (!header) pj_out_of_memory();
+        header->capacity = size;
+        return (char *)header + LARGE_HEADER_SIZE;
+    }
+    void *moved = large_alloc(size);
+    memcpy(moved, block, header->capacity < size ? header->capacity : size);
+    large_free(block);
+    return moved;
+}
+
+#define ARENA_CHUNK_SIZE (HUGE_PAGE_SIZE - LARGE_HEADER_SIZE)
+
+static char *arena_strdup(StringArena *arena, const char *s) {
+    size_t len = strlen(s) + 1;
+    if (!arena->chunk || arena->used + len > arena->size) {
+        size_t size = sizeof(char *) + len > ARENA_CHUNK_SIZE ? sizeof(char *) + len : ARENA_CHUNK_SIZE;
+        char *chunk = (char *)large_alloc(size);
+        memcpy(chunk, &arena->chunk, sizeof(char *));
+        arena->chunk = chunk;
+        arena->used = sizeof(char *);
+        arena->size = size;
+    }
+    char *copy = arena->chunk + arena->used;
+    memcpy(copy, s, len);
+    arena->used += len;
+    return copy;
+}
+
+static void free_string_arena(StringArena *arena) {
+    while (arena->chunk) {
+        char *prev;
+        memcpy(&prev, arena->chunk, sizeof(char *));
+        large_free(arena->chunk);
+        arena->chunk = prev;
+    }
+    arena->used = arena->size = 0;
+}
+
+// --- Utility: Safe string 'ends_with' check ---
+static bool ends_with(const char *str, const char *suffix) {
+    if (!str || !suffix) return false;
+    size_t len_str = strlen(str);
+    size_t len_suffix = strlen(suffix);
+    if (len_suffix > len_str) return false;
+    return strcmp(str + len_str - len_suffix, suffix) == 0;
+}
+
+// --- Utility: Path comparison for sorting ---
+static int compare_paths(const void *a, const void *b) {
+    const char *path1 = *(const char **)a;
+    const char *path2 = *(const char **)b;
+    if (!path1 || !path2) return path1 ? 1 : (path2 ? -1 : 0);
+    char *path1_copy = strdup(path1);
+    char *path2_copy = strdup(path2);
+    char *dir1 = strdup(path1);
+    char *dir2 = strdup(path2);
+    if (!path1_copy || !path2_copy || !dir1 || !dir2) {
+        free(path1_copy);
+        free(path2_copy);
+        free(dir1);
+        free(dir2);
+        return strcmp(path1, path2);
+    }
+    char *dir1_copy = dirname(dir1);
+    char *dir2_copy = dirname(dir2);
+    char *base1 = basename(path1_copy);
+    char *base2 = basename(path2_copy);
+    int result;
+    if (!dir1_copy || !dir2_copy || !base1 || !base2) {
+        result = strcmp(path1, path2);
+    } else {
+        int dir_cmp = strcmp(dir1_copy, dir2_copy);
+        result = dir_cmp ? dir_cmp : strcmp(base1, base2);
+    }
+    free(path1_copy);
+    free(path2_copy);
+    free(dir1);
+    free(dir2);
+    return result;
+}
+
+static int compare_result_groups(const void *a, const void *b) {
+    const ResultGroup *g1 = (const ResultGroup *)a;
+    const ResultGroup *g2 = (const ResultGroup *)b;
+    return compare_paths(&g1->name, &g2->name);
+}
+
+// --- File Classification ---
+//
+// The default lists come from classifier_table.h, a perfect hash generated at
+// build time; custom --extensions/--exclude-dirs are hashed into an IdMap once
+// per scan. Either way a name costs one lookup for the whole name plus one per
+// later '.' in it, since ".ext" entries match any name ending in them.
+
+static const ClassEntry *lookup_default_class(const char *name) {
+    if (strnlen(name, CLASSIFIER_MAX_KEY_LEN + 1) > CLASSIFIER_MAX_KEY_LEN) return NULL;
+    const ClassEntry *entry = &classifier_table[classifier_hash(name, CLASSIFIER_SEED) & CLASSIFIER_MASK];
+    return entry->key && strcmp(entry->key, name) == 0 ? entry : NULL;
+}
+
+static bool same_list(const StringArray *arr, const char *const *items, size_t count) {
+    if (arr->count != (int)count) return false;
+    for (size_t i = 0; i < count; i++) {
+        if (strcmp(arr->items[i], items[i]) != 0) return false;
+    }
+    return true;
+}
+
+static void init_classes(ProjanitorContext *ctx) {
+    ctx->custom_classes = !same_list(&ctx->extensions, default_extensions, sizeof(default_extensions) / sizeof(*default_extensions)) ||
+                          !same_list(&ctx->exclude_dirs, default_exclude_dirs, sizeof(default_exclude_dirs) / sizeof(*default_exclude_dirs));
+    if (!ctx->custom_classes) return;
+    init_id_map(&ctx->class_overrides, ctx->extensions.count + ctx->exclude_dirs.count);
+    for (int i = 0; i < ctx->extensions.count; i++) {
+        id_map_put(&ctx->class_overrides, ctx->extensions.items[i], CLASS_EXTENSION);
+    }
+    for (int i = 0; i < ctx->exclude_dirs.count; i++) {
+        const char *name = ctx->exclude_dirs.items[i];
+        int flags = id_map_get(&ctx->class_overrides, name);
+        id_map_put(&ctx->class_overrides, name, (flags < 0 ? 0 : flags) | CLASS_EXCLUDED);
+    }
+}
+
+static void free_classes(ProjanitorContext *ctx) {
+    free_id_map(&ctx->class_overrides);
+    ctx->custom_classes = false;
+}
+
+static unsigned name_classes(const ProjanitorContext *ctx, const char *name) {
+    if (ctx->custom_classes) {
+        int flags = id_map_get(&ctx->class_overrides, name);
+        return flags < 0 ? 0 : (unsigned)flags;
+    }
+    const ClassEntry *entry = lookup_default_class(name);
+    return entry ? entry->flags : 0;
+}
+
+static bool has_valid_extension(const ProjanitorContext *ctx, const char *filename) {
+    if (name_classes(ctx, filename) & CLASS_EXTENSION) return true;
+    for (const char *dot = strchr(filename + 1, '.'); dot; dot = strchr(dot + 1, '.')) {
+        if (name_classes(ctx, dot) & CLASS_EXTENSION) return true;
+    }
+    return false;
+}
+
+static bool is_excluded_dir(const ProjanitorContext *ctx, const char *name) {
+    return (name_classes(ctx, name) & CLASS_EXCLUDED) != 0;
+}
+
+static bool is_system_file(const ProjanitorContext *ctx, const char *filename) {
+    return id_map_get(&ctx->build_file_set, filename) >= 0;
+}
+
+// Short name of each pj_file_type, for exports.
+static const char *const file_type_names[PJ_TYPE_COUNT] = {
+    "c", "h", "CMakeLists.txt", "cmake", "sh", "json", "py", "md"
+};
+
+// --- Core Logic ---
+
+static bool check_marker_files(ProjanitorContext *ctx, const char *path) {
+    const StringArray *marker_files = &ctx->marker_files;
+    struct stat st;
+    int found_count = 0;
+    char missing[MAX_LINE_LEN] = "";
+    size_t missing_len = 0;
+
+    for (int i = 0; i < marker_files->count; i++) {
+        if (!marker_files->items[i]) continue;
+        char marker_path[MAX_PATH_LEN];
+        if (strlen(path) + strlen(marker_files->items[i]) + 1 >= sizeof(marker_path)) {
+            if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "Path too long for marker: %s/%s", path, marker_files->items[i]);
+            continue;
+        }
+        snprintf(marker_path, sizeof(marker_path), "%s/%s", path, marker_files->items[i]);
+        ctx->stats.stat_calls++;
+        if (stat(marker_path, &st) == 0 && S_ISREG(st.st_mode)) {
+            found_count++;
+            pj_log(ctx, PJ_LOG_INFO, "Found marker %s in %s", marker_files->items[i], path);
+        } else if (missing_len < sizeof(missing)) {
+            missing_len += snprintf(missing + missing_len, sizeof(missing) - missing_len, "%s%s",
+                                    missing_len ? ", " : "", marker_files->items[i]);
+        }
+    }
+
+    if (found_count < marker_files->count) {
+        pj_log(ctx, PJ_LOG_INFO, "Directory %s missing markers: %s", path, missing);
+    }
+    return found_count == marker_files->count;
+}
+
+static bool find_project_root(ProjanitorContext *ctx, char *root_path) {
+    char current_path[MAX_PATH_LEN];
+    if (ctx->start_dir[0]) {
+        snprintf(current_path, sizeof(current_path), "%s", ctx->start_dir);
+    } else if (getcwd(current_path, sizeof(current_path)) == NULL) {
+        pj_log(ctx, PJ_LOG_ERROR, "getcwd() failed: %s", strerror(errno));
+        return false;
+    }
+
+    // Search order: current, up 1-3, down 1-3
+    StringArray search_paths;
+    init_string_array(&search_paths);
+    add_to_string_array(&search_paths, current_path);
+    pj_log(ctx, PJ_LOG_INFO, "Checking directory %s", current_path);
+
+    // Up 1-3 levels
+    char temp_path[MAX_PATH_LEN];
+    strcpy(temp_path, current_path);
+    for (int i = 1; i <= MAX_SEARCH_DEPTH; i++) {
+        char *last_slash = strrchr(temp_path, '/');
+        if (last_slash == temp_path) {
+            temp_path[1] = '\0';
+        } else if (last_slash != NULL) {
+            *last_slash = '\0';
+            add_to_string_array(&search_paths, temp_path);
+            pj_log(ctx, PJ_LOG_INFO, "Checking directory %s", temp_path);
+        } else {
+            break;
+        }
+    }
+
+    // Down 1-3 levels
+    StringArray down_paths;
+    init_string_array(&down_paths);
+    add_to_string_array(&down_paths, current_path);
+    for (int depth = 1; depth <= MAX_SEARCH_DEPTH; depth++) {
+        for (int i = 0; i < down_paths.count; i++) {
+            if (!down_paths.items[i]) continue;
+            ctx->stats.opendir_calls++;
+            DIR *dir = opendir(down_paths.items[i]);
+            if (!dir) {
+                if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "Cannot open directory %s: %s", down_paths.items[i], strerror(errno));
+                continue;
+            }
+            struct dirent *entry;
+            while ((entry = readdir(dir)) != NULL) {
+                if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+                char full_path[MAX_PATH_LEN];
+                if (strlen(down_paths.items[i]) + strlen(entry->d_name) + 1 >= sizeof(full_path)) {
+                    if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "Path too long: %s/%s", down_paths.items[i], entry->d_name);
+                    continue;
+                }
+                snprintf(full_path, sizeof(full_path), "%s/%s", down_paths.items[i], entry->d_name);
+                // d_type spares a stat per entry; links and unknown types
+                // still need one to see what they point to
+                mode_t type = DTTOIF(entry->d_type);
+                if (type == 0 || S_ISLNK(type)) {
+                    struct stat st;
+                    ctx->stats.stat_calls++;
+                    if (stat(full_path, &st) != 0) {
+                        if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "Cannot stat %s: %s", full_path, strerror(errno));
+                        continue;
+                    }
+                    type = st.st_mode;
+                }
+                if (S_ISDIR(type)) {
+                    add_to_string_array(&search_paths, full_path);
+                    pj_log(ctx, PJ_LOG_INFO, "Checking directory %s", full_path);
+                    if (depth < MAX_SEARCH_DEPTH) {
+                        add_to_string_array(&down_paths, full_path);
+                    }
+                }
+            }
+            closedir(dir);
+        }
+    }
+    free_string_array(&down_paths);
+
+    // Check each path for all marker files
+    for (int i = 0; i < search_paths.count; i++) {
+        if (!search_paths.items[i]) continue;
+        if (check_marker_files(ctx, search_paths.items[i])) {
+            strcpy(root_path, search_paths.items[i]);
+            free_string_array(&search_paths);
+            return true;
+        }
+    }
+
+    strcpy(root_path, current_path);
+    free_string_array(&search_paths);
+    return false;
+}
+
+static char* get_project_name(ProjanitorContext *ctx, const char *root_path) {
+    char cmake_path[MAX_PATH_LEN];
+    if (snprintf(cmake_path, sizeof(cmake_path), "%s/CMakeLists.txt", root_path) >= (int)sizeof(cmake_path)) {
+        pj_log(ctx, PJ_LOG_WARNING, "Path too long for CMakeLists.txt: %s", root_path);
+        return NULL;
+    }
+    FILE *file = fopen(cmake_path, "r");
+    if (!file) {
+        pj_log(ctx, PJ_LOG_WARNING, "Could not open %s: %s", cmake_path, strerror(errno));
+        return NULL;
+    }
+
+    char line[MAX_LINE_LEN];
+    while (fgets(line, sizeof(line), file)) {
+        char *project_pos = strstr(line, "project(");
+        if (project_pos) {
+            char *start = project_pos + strlen("project(");
+            char *end = strchr(start, ')');
+            if (end) {
+                size_t len = end - start;
+                char *name = (char *)malloc(len + 1);
+                if (!name) {
+                    fclose(file);
+                    pj_out_of_memory();
+                }
+                strncpy(name, start, len);
+                name[len] = '\0';
+                fclose(file);
+                return name;
+            }
+        }
+    }
+    fclose(file);
+    return NULL;
+}
+
+// Object and dependency files, as compilers name them.
+static bool is_build_artifact(const char *name) {
+    return ends_with(name, ".o") || ends_with(name, ".obj") || ends_with(name, ".d");
+}
+
+static void add_build_artifact(BuildArtifactArray *arr, const char *path, int64_t size) {
+    if (arr->count == arr->capacity) {
+        int capacity = arr->capacity ? arr->capacity * 2 : 256;
+        BuildArtifact *items = (BuildArtifact *)realloc(arr->items, capacity * sizeof(BuildArtifact));
+        if (!items) pj_out_of_memory();
+        arr->items = items;
+        arr->capacity = capacity;
+    }
+    char *copy = strdup(path);
+    if (!copy) pj_out_of_memory();
+    arr->items[arr->count].path = copy;
+    arr->items[arr->count].size = size;
+    arr->count++;
+}
+
+// Type and size of a build/ entry, following links. Returns 0 or errno.
+static int build_entry_stat(const char *path, mode_t *type, int64_t *size) {
+#if defined(__linux__) && defined(STATX_TYPE)
+    struct statx stx;
+    if (statx(AT_FDCWD, path, AT_STATX_DONT_SYNC, STATX_TYPE | STATX_SIZE, &stx) != 0) return errno;
+    *type = stx.stx_mode & S_IFMT;
+    *size = (int64_t)stx.stx_size;
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) return errno;
+    *type = st.st_mode & S_IFMT;
+    *size = (int64_t)st.st_size;
+#endif
+    return 0;
+}
+
+// Lists build/ (`rel` is the path below it): the basename of every regular
+// file, to keep generated files out of the results, and the object and
+// dependency files with their sizes for report_stale_artifacts(). d_type
+// spares the stat of most entries; an artifact, link or unknown type takes one
+// statx() for everything needed.
+static void collect_build_files(ProjanitorContext *ctx, const char *build_path, const char *rel) {
+    ctx->stats.opendir_calls++;
+    DIR *dir = opendir(build_path);
+    if (!dir) {
+        if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "Cannot open build directory %s: %s", build_path, strerror(errno));
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        char full_path[MAX_PATH_LEN];
+        char rel_path[MAX_PATH_LEN];
+        if (strlen(build_path) + strlen(entry->d_name) + 1 >= sizeof(full_path)) {
+            if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "Path too long: %s/%s", build_path, entry->d_name);
+            continue;
+        }
+        snprintf(full_path, sizeof(full_path), "%s/%s", build_path, entry->d_name);
+        snprintf(rel_path, sizeof(rel_path), "%s%s%s", rel, rel[0] ? "/" : "", entry->d_name);
+        mode_t type = DTTOIF(entry->d_type);
+        int64_t size = -1;
+        bool artifact = (type == 0 || S_ISREG(type) || S_ISLNK(type)) && is_build_artifact(entry->d_name);
+        if (type == 0 || S_ISLNK(type) || artifact) {
+            ctx->stats.stat_calls++;
+            int error = build_entry_stat(full_path, &type, &size);
+            if (error) {
+                if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "Cannot stat %s: %s", full_path, strerror(error));
+                continue;
+            }
+        }
+        if (S_ISREG(type)) {
+            add_to_string_array(&ctx->build_files, entry->d_name);
+            if (artifact) add_build_artifact(&ctx->artifacts, rel_path, size);
+            pj_log(ctx, PJ_LOG_INFO, "Added build file %s", entry->d_name);
+        } else if (S_ISDIR(type)) {
+            collect_build_files(ctx, full_path, rel_path);
+        }
+    }
+    closedir(dir);
+}
+
+// --- Symbol Index ---
+//
+// A lightweight C tokenizer fed the same lines as the reference scan. It
+// records external (non-static) function and variable definitions at file
+// scope and every identifier use elsewhere into one interned table, so
+// definitions that are never used anywhere in the project can be reported.
+// Declarations (prototypes, extern, typedef) are neither uses nor definitions.
+
+typedef struct {
+    const char *path;
+    int line;
+    bool in_comment;
+    bool in_directive;       // inside a (possibly continued) preprocessor line
+    int depth;               // brace depth; 0 = file scope
+    int paren;               // paren depth within the current top-level statement
+    int transparent;         // open extern "C" { blocks
+    // Current file-scope statement
+    char last_ident[128];
+    char func_name[128];
+    int last_ident_line;
+    int func_line;
+    bool has_params;
+    bool is_static;
+    bool is_extern;
+    bool is_typedef;
+    bool expect_tag;         // after struct/union/enum: the next identifier is a tag
+    bool in_initializer;
+    bool extern_string;
+    int body_kind;           // what the outermost open brace belongs to
+} SymbolScanner;
+
+enum { BODY_NONE, BODY_FUNCTION, BODY_AGGREGATE, BODY_INITIALIZER, BODY_ENUM };
+
+// C keywords (and `bool`, `defined`) by length. A lookup measures the word,
+// giving up past the longest keyword, and compares first characters before
+// any strcmp, so most identifiers cost a few byte compares. Rows are NULL
+// terminated.
+#define C_KEYWORD_MAX_LEN 14
+static const char *const c_keywords[C_KEYWORD_MAX_LEN + 1][10] = {
+    [2] = {"do", "if"},
+    [3] = {"for", "int"},
+    [4] = {"auto", "bool", "case", "char", "else", "enum", "goto", "long", "void"},
+    [5] = {"_Bool", "break", "const", "float", "short", "union", "while"},
+    [6] = {"double", "extern", "inline", "return", "signed", "sizeof", "static", "struct", "switch"},
+    [7] = {"_Atomic", "default", "defined", "typedef"},
+    [8] = {"_Alignas", "_Alignof", "_Complex", "_Generic", "continue", "register", "restrict", "unsigned", "volatile"},
+    [9] = {"_Noreturn"},
+    [10] = {"_Imaginary"},
+    [13] = {"_Thread_local"},
+    [14] = {"_Static_assert"},
+};
+
+static bool is_c_keyword(const char *word) {
+    size_t len = 0;
+    while (word[len]) {
+        if (++len > C_KEYWORD_MAX_LEN) return false;
+    }
+    for (const char *const *k = c_keywords[len]; *k; k++) {
+        if ((*k)[0] == word[0] && strcmp(*k + 1, word + 1) == 0) return true;
+    }
+    return false;
+}
+
+static void init_symbol_table(SymbolTable *table) {
+    table->count = 0;
+    table->capacity = INITIAL_ARRAY_CAPACITY;
+    table->slot_count = INITIAL_ARRAY_CAPACITY * 2;
+    memset(&table->names, 0, sizeof(table->names));
+    table->items = (Symbol *)large_alloc(table->capacity * sizeof(Symbol));
+    table->slots = (int *)large_alloc(table->slot_count * sizeof(int));
+    memset(table->slots, -1, table->slot_count * sizeof(int));
+}
+
+static void free_symbol_table(SymbolTable *table) {
+    if (!table || !table->items) return;
+    free_string_arena(&table->names);
+    large_free(table->items);
+    large_free(table->slots);
+    memset(table, 0, sizeof(*table));
+}
+
+// Probes compare the stored hashes first, so a collision rarely costs a trip
+// to the name arena, and growing the slots never rehashes a name.
+static Symbol* intern_symbol(SymbolTable *table, const char *name) {
+    unsigned int mask = table->slot_count - 1;
+    unsigned int h = hash(name, INT_MAX);
+    unsigned int i = h & mask;
+    while (table->slots[i] >= 0) {
+        Symbol *sym = &table->items[table->slots[i]];
+        if (sym->hash == h && strcmp(sym->name, name) == 0) return sym;
+        i = (i + 1) & mask;
+    }
+    if ((table->count + 1) * 2 > table->slot_count) {
+        int new_slot_count = table->slot_count * 2;
+        int *new_slots = (int *)large_alloc(new_slot_count * sizeof(int));
+        memset(new_slots, -1, new_slot_count * sizeof(int));
+        for (int k = 0; k < table->count; k++) {
+            unsigned int j = table->items[k].hash & (new_slot_count - 1);
+            while (new_slots[j] >= 0) j = (j + 1) & (new_slot_count - 1);
+            new_slots[j] = k;
+        }
+        large_free(table->slots);
+        table->slots = new_slots;
+        table->slot_count = new_slot_count;
+        return intern_symbol(table, name);
+    }
+    if (table->count >= table->capacity) {
+        table->capacity *= 2;
+        table->items = (Symbol *)large_realloc(table->items, table->capacity * sizeof(Symbol));
+    }
+    Symbol *sym = &table->items[table->count];
+    memset(sym, 0, sizeof(*sym));
+    sym->name = arena_strdup(&table->names, name);
+    sym->hash = h;
+    table->slots[i] = table->count++;
+    return sym;
+}
+
+static void init_symbol_scanner(SymbolScanner *sc, const char *path) {
+    memset(sc, 0, sizeof(*sc));
+    sc->path = path;
+}
+
+static void reset_statement(SymbolScanner *sc) {
+    sc->last_ident[0] = '\0';
+    sc->func_name[0] = '\0';
+    sc->has_params = false;
+    sc->is_static = false;
+    sc->is_extern = false;
+    sc->is_typedef = false;
+    sc->expect_tag = false;
+    sc->in_initializer = false;
+    sc->extern_string = false;
+    sc->paren = 0;
+}
+
+static void define_symbol(SymbolTable *table, SymbolScanner *sc, const char *name, int line, bool is_function) {
+    if (!name[0] || sc->is_static || sc->is_extern || sc->is_typedef) return;
+    Symbol *sym = intern_symbol(table, name);
+    if (sym->defs++ == 0) {
+        sym->def_path = sc->path;
+        sym->def_line = line;
+        sym->is_function = is_function;
+    }
+}
+
+// End of a file-scope declarator (',' or ';' or '='): a variable definition
+// unless the declarator had a parameter list (prototype).
+static void end_declarator(SymbolTable *table, SymbolScanner *sc) {
+    if (!sc->has_params && !sc->in_initializer) {
+        define_symbol(table, sc, sc->last_ident, sc->last_ident_line, false);
+    }
+    sc->last_ident[0] = '\0';
+}
+
+static void symbol_identifier(SymbolTable *table, SymbolScanner *sc, const char *word) {
+    if (sc->in_directive || sc->depth > 0 || sc->in_initializer) {
+        if (!is_c_keyword(word)) intern_symbol(table, word)->uses++;
+        return;
+    }
+    if (sc->paren > 0) return;  // parameter names and types
+    if (strcmp(word, "static") == 0) sc->is_static = true;
+    else if (strcmp(word, "extern") == 0) sc->is_extern = true;
+    else if (strcmp(word, "typedef") == 0) sc->is_typedef = true;
+    else if (strcmp(word, "struct") == 0 || strcmp(word, "union") == 0 || strcmp(word, "enum") == 0) sc->expect_tag = true;
+    else if (sc->expect_tag) sc->expect_tag = false;
+    else if (!is_c_keyword(word)) {
+        snprintf(sc->last_ident, sizeof(sc->last_ident), "%s", word);
+        sc->last_ident_line = sc->line;
+    }
+}
+
+static void symbol_punct(SymbolTable *table, SymbolScanner *sc, char c) {
+    if (sc->depth > 0) {
+        if (c == '{') sc->depth++;
+        else if (c == '}' && --sc->depth == 0) {
+            if (sc->body_kind == BODY_FUNCTION) reset_statement(sc);
+            else sc->last_ident[0] = '\0';
+            sc->body_kind = BODY_NONE;
+        }
+        return;
+    }
+    switch (c) {
+        case '(':
+            if (sc->paren++ == 0 && !sc->in_initializer && !sc->func_name[0] && sc->last_ident[0]) {
+                snprintf(sc->func_name, sizeof(sc->func_name), "%s", sc->last_ident);
+                sc->func_line = sc->last_ident_line;
+                sc->has_params = true;
+            }
+            break;
+        case ')':
+            if (sc->paren > 0) sc->paren--;
+            break;
+        case '{':
+            if (sc->paren > 0) break;
+            if (sc->is_extern && sc->extern_string) {
+                sc->transparent++;  // extern "C" { ... }
+                reset_statement(sc);
+                break;
+            }
+            if (sc->in_initializer) {
+                sc->body_kind = BODY_INITIALIZER;
+            } else if (sc->has_params && !sc->is_typedef) {
+                define_symbol(table, sc, sc->func_name, sc->func_line, true);
+                sc->body_kind = BODY_FUNCTION;
+            } else {
+                sc->body_kind = BODY_AGGREGATE;
+                sc->expect_tag = false;
+            }
+            sc->depth = 1;
+            break;
+        case '}':
+            if (sc->transparent > 0) sc->transparent--;
+            reset_statement(sc);
+            break;
+        case '=':
+            if (sc->paren > 0 || sc->in_initializer) break;
+            end_declarator(table, sc);
+            sc->in_initializer = true;
+            break;
+        case ',':
+            if (sc->paren > 0) break;
+            if (!sc->in_initializer) end_declarator(table, sc);
+            sc->in_initializer = false;
+            sc->has_params = false;
+            sc->func_name[0] = '\0';
+            break;
+        case ';':
+            if (sc->paren > 0) break;
+            if (!sc->in_initializer) end_declarator(table, sc);
+            reset_statement(sc);
+            break;
+        default:
+            break;
+    }
+}
+
+static void symbol_scan_line(SymbolTable *table, SymbolScanner *sc, const char *line, int line_no) {
+    sc->line = line_no;
+    const char *p = line;
+    if (!sc->in_comment && !sc->in_directive) {
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '#') {
+            p++;
+            while (isspace((unsigned char)*p)) p++;
+            if (strncmp(p, "include", 7) == 0) return;
+            bool is_define = strncmp(p, "define", 6) == 0;
+            while (isalpha((unsigned char)*p)) p++;  // directive name
+            if (is_define) {
+                while (isspace((unsigned char)*p)) p++;
+                while (isalnum((unsigned char)*p) || *p == '_') p++;  // macro name
+            }
+            sc->in_directive = true;
+        }
+    }
+    size_t len = strlen(line);
+    bool continued = len > 0 && line[len - 1] == '\\';
+
+    char word[128];
+    while (*p) {
+        if (sc->in_comment) {
+            if (p[0] == '*' && p[1] == '/') { sc->in_comment = false; p += 2; }
+            else p++;
+            continue;
+        }
+        if (p[0] == '/' && p[1] == '/') break;
+        if (p[0] == '/' && p[1] == '*') { sc->in_comment = true; p += 2; continue; }
+        if (*p == '"' || *p == '\'') {
+            char quote = *p++;
+            while (*p && *p != quote) {
+                if (*p == '\\' && p[1]) p++;
+                p++;
+            }
+            if (*p) p++;
+            if (quote == '"' && sc->is_extern && sc->depth == 0) sc->extern_string = true;
+            continue;
+        }
+        if (isalpha((unsigned char)*p) || *p == '_') {
+            size_t n = 0;
+            while (isalnum((unsigned char)*p) || *p == '_') {
+                if (n + 1 < sizeof(word)) word[n++] = *p;
+                p++;
+            }
+            word[n] = '\0';
+            symbol_identifier(table, sc, word);
+            continue;
+        }
+        if (isdigit((unsigned char)*p)) {
+            while (isalnum((unsigned char)*p) || *p == '.' || *p == '_') p++;
+            continue;
+        }
+        if (!sc->in_directive) symbol_punct(table, sc, *p);
+        p++;
+    }
+    if (sc->in_directive && !continued) sc->in_directive = false;
+}
+
+static int compare_symbols_by_location(const void *a, const void *b) {
+    const Symbol *s1 = *(const Symbol *const *)a;
+    const Symbol *s2 = *(const Symbol *const *)b;
+    int cmp = strcmp(s1->def_path, s2->def_path);
+    if (cmp) return cmp;
+    return s1->def_line - s2->def_line;
+}
+
+static void report_unused_symbols(const SymbolTable *table, FILE *out) {
+    fprintf(out, "\n=== Unused Symbols ===\n");
+    const Symbol **unused = (const Symbol **)malloc((table->count + 1) * sizeof(Symbol *));
+    if (!unused) pj_out_of_memory();
+    int defined = 0, count = 0;
+    for (int i = 0; i < table->count; i++) {
+        const Symbol *sym = &table->items[i];
+        if (sym->defs == 0) continue;
+        defined++;
+        if (sym->uses == 0 && strcmp(sym->name, "main") != 0) unused[count++] = sym;
+    }
+    qsort(unused, count, sizeof(Symbol *), compare_symbols_by_location);
+    fprintf(out, "External definitions: %d, never used: %d (identifiers indexed: %d)\n", defined, count, table->count);
+    if (count == 0) fprintf(out, "(None)\n");
+    for (int i = 0; i < count; i++) {
+        fprintf(out, "- %s:%d: %s (%s%s)\n", unused[i]->def_path, unused[i]->def_line, unused[i]->name,
+               unused[i]->is_function ? "function" : "variable", unused[i]->defs > 1 ? ", defined more than once" : "");
+    }
+    free(unused);
+}
+
+// --- Include Guard Scanner ---
+//
+// Fed the trimmed lines of a header during the reference scan. A header only
+// qualifies for the compilers' multiple-include optimization when, comments
+// aside, it is #pragma once or exactly "#ifndef X / #define X ... #endif" with
+// nothing outside the conditional and no #else/#elif at the top level.
+
+typedef enum {
+    GS_START,
+    GS_EXPECT_DEFINE,
+    GS_INSIDE,
+    GS_AFTER_ENDIF,
+    GS_DONE
+} GuardStage;
+
+typedef struct {
+    GuardStage stage;
+    GuardKind result;         // set once stage reaches GS_DONE
+    const char *issue;
+    char macro[128];
+    int depth;
+    bool in_comment;
+    bool pragma_once;
+} GuardScanner;
+
+static void init_guard_scanner(GuardScanner *gs) {
+    memset(gs, 0, sizeof(*gs));
+    gs->stage = GS_START;
+}
+
+// Copy `line` to `code` without comments; carries /* */ state across lines.
+static void strip_comments(const char *line, char *code, size_t code_len, bool *in_comment) {
+    size_t n = 0;
+    char quote = 0;
+    for (const char *p = line; *p && n + 1 < code_len; p++) {
+        if (*in_comment) {
+            if (p[0] == '*' && p[1] == '/') { *in_comment = false; p++; }
+            continue;
+        }
+        if (quote) {
+            if (*p == '\\' && p[1]) { code[n++] = *p++; }
+            else if (*p == quote) quote = 0;
+        } else if (*p == '"' || *p == '\'') {
+            quote = *p;
+        } else if (p[0] == '/' && p[1] == '/') {
+            break;
+        } else if (p[0] == '/' && p[1] == '*') {
+            *in_comment = true;
+            p++;
+            if (n > 0 && code[n - 1] != ' ') code[n++] = ' ';
+            continue;
+        }
+        code[n++] = *p;
+    }
+    while (n > 0 && isspace((unsigned char)code[n - 1])) n--;
+    code[n] = '\0';
+}
+
+// Split "#  directive  rest" into the directive word and its first argument.
+static bool parse_directive(const char *code, char *directive, size_t dir_len, char *arg, size_t arg_len) {
+    const char *p = code;
+    while (isspace((unsigned char)*p)) p++;
+    if (*p != '#') return false;
+    p++;
+    while (isspace((unsigned char)*p)) p++;
+    size_t n = 0;
+    while ((isalnum((unsigned char)*p) || *p == '_') && n + 1 < dir_len) directive[n++] = *p++;
+    directive[n] = '\0';
+    while (isspace((unsigned char)*p)) p++;
+    if (strncmp(p, "!defined", 8) == 0) {
+        p += 8;
+        while (isspace((unsigned char)*p) || *p == '(') p++;
+    }
+    n = 0;
+    while ((isalnum((unsigned char)*p) || *p == '_') && n + 1 < arg_len) arg[n++] = *p++;
+    arg[n] = '\0';
+    return true;
+}
+
+static void guard_broken(GuardScanner *gs, const char *issue) {
+    gs->stage = GS_DONE;
+    gs->result = GUARD_BROKEN;
+    gs->issue = issue;
+}
+
+static void guard_scan_line(GuardScanner *gs, const char *line) {
+    char code[MAX_LINE_LEN];
+    strip_comments(line, code, sizeof(code), &gs->in_comment);
+    if (code[0] == '\0') return;
+
+    char directive[32] = "", arg[128] = "";
+    bool is_directive = parse_directive(code, directive, sizeof(directive), arg, sizeof(arg));
+    if (is_directive && strcmp(directive, "pragma") == 0 && strcmp(arg, "once") == 0) {
+        gs->pragma_once = true;
+        return;
+    }
+
+    switch (gs->stage) {
+        case GS_START:
+            if (is_directive && strcmp(directive, "ifndef") == 0 && arg[0]) {
+                snprintf(gs->macro, sizeof(gs->macro), "%s", arg);
+                gs->stage = GS_EXPECT_DEFINE;
+            } else if (is_directive && strcmp(directive, "if") == 0 && strstr(code, "!defined") && arg[0]) {
+                snprintf(gs->macro, sizeof(gs->macro), "%s", arg);
+                gs->stage = GS_EXPECT_DEFINE;
+            } else {
+                gs->stage = GS_DONE;
+                gs->result = GUARD_NONE;
+            }
+            break;
+        case GS_EXPECT_DEFINE:
+            if (!is_directive || strcmp(directive, "define") != 0) {
+                guard_broken(gs, "#ifndef is not followed by #define");
+            } else if (strcmp(arg, gs->macro) != 0) {
+                guard_broken(gs, "#define does not match the #ifndef macro");
+            } else {
+                gs->stage = GS_INSIDE;
+                gs->depth = 1;
+            }
+            break;
+        case GS_INSIDE:
+            if (!is_directive) break;
+            if (strncmp(directive, "if", 2) == 0) {
+                gs->depth++;
+            } else if (strcmp(directive, "endif") == 0) {
+                if (--gs->depth == 0) gs->stage = GS_AFTER_ENDIF;
+            } else if (gs->depth == 1 && (strcmp(directive, "else") == 0 || strncmp(directive, "elif", 4) == 0)) {
+                guard_broken(gs, "#else/#elif on the guard conditional");
+            }
+            break;
+        case GS_AFTER_ENDIF:
+            guard_broken(gs, "code after the closing #endif");
+            break;
+        case GS_DONE:
+            break;
+    }
+}
+
+static GuardKind guard_scan_finish(GuardScanner *gs) {
+    if (gs->pragma_once) return GUARD_PRAGMA_ONCE;
+    switch (gs->stage) {
+        case GS_START: return GUARD_NONE;  // empty after comments
+        case GS_EXPECT_DEFINE: guard_broken(gs, "#ifndef is not followed by #define"); break;
+        case GS_INSIDE: guard_broken(gs, "guard conditional is never closed"); break;
+        case GS_AFTER_ENDIF: return GUARD_MACRO;
+        case GS_DONE: break;
+    }
+    return gs->result;
+}
+
+// --- Trigram Index ---
+//
+// With PJ_FEATURE_TRIGRAMS the reference pass also feeds every line through
+// trigram_feed(), which appends the file to the posting list of each byte
+// trigram it contains. Trigrams never span a newline.
+
+typedef struct {
+    uint32_t window;   // last three bytes, oldest highest
+    int filled;        // bytes in the window since the last newline (max 3)
+} TrigramCursor;
+
+static void init_trigram_table(TrigramTable *table) {
+    table->slot_count = 1u << 12;
+    table->count = 0;
+    table->slots = (TrigramPosting *)large_alloc(table->slot_count * sizeof(TrigramPosting));
+}
+
+static void free_trigram_table(TrigramTable *table) {
+    if (!table->slots) return;
+    for (uint32_t i = 0; i < table->slot_count; i++) free(table->slots[i].bytes);
+    large_free(table->slots);
+    table->slots = NULL;
+    table->slot_count = 0;
+    table->count = 0;
+}
+
+static TrigramPosting* trigram_lookup(TrigramTable *table, uint32_t trigram) {
+    uint32_t mask = table->slot_count - 1;
+    uint32_t h = trigram * 0x9E3779B1u;
+    uint32_t i = (h ^ (h >> 16)) & mask;
+    while (table->slots[i].count && table->slots[i].trigram != trigram) i = (i + 1) & mask;
+    return &table->slots[i];
+}
+
+static void grow_trigram_table(TrigramTable *table) {
+    TrigramTable grown = {0};
+    grown.slot_count = table->slot_count * 2;
+    grown.count = table->count;
+    grown.slots = (TrigramPosting *)large_alloc(grown.slot_count * sizeof(TrigramPosting));
+    for (uint32_t i = 0; i < table->slot_count; i++) {
+        if (table->slots[i].count) *trigram_lookup(&grown, table->slots[i].trigram) = table->slots[i];
+    }
+    large_free(table->slots);
+    *table = grown;
+}
+
+// LEB128: seven bits per byte, high bit set on all but the last.
+static void put_varint(TrigramPosting *posting, uint32_t value) {
+    if (posting->len + 5 > posting->capacity) {
+        size_t capacity = posting->capacity ? posting->capacity * 2 : 8;
+        uint8_t *bytes = (uint8_t *)realloc(posting->bytes, capacity);
+        if (!bytes) pj_out_of_memory();
+        posting->bytes = bytes;
+        posting->capacity = capacity;
+    }
+    while (value >= 0x80) {
+        posting->bytes[posting->len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    posting->bytes[posting->len++] = (uint8_t)value;
+}
+
+static void trigram_add(TrigramTable *table, uint32_t trigram, uint32_t file_id) {
+    TrigramPosting *posting = trigram_lookup(table, trigram);
+    if (posting->count == 0) {
+        if ((table->count + 1) * 2 > table->slot_count) {
+            grow_trigram_table(table);
+            posting = trigram_lookup(table, trigram);
+        }
+        posting->trigram = trigram;
+        table->count++;
+    } else if (posting->last == file_id + 1) {
+        return; // already listed for this file
+    }
+    put_varint(posting, file_id + 1 - posting->last);
+    posting->last = file_id + 1;
+    posting->count++;
+}
+
+static void trigram_feed(TrigramTable *table, TrigramCursor *cursor, const char *text, uint32_t file_id) {
+    for (const unsigned char *c = (const unsigned char *)text; *c; c++) {
+        if (*c == '\n') {
+            cursor->filled = 0;
+            continue;
+        }
+        cursor->window = ((cursor->window << 8) | *c) & 0xFFFFFFu;
+        if (cursor->filled < 3) cursor->filled++;
+        if (cursor->filled == 3) trigram_add(table, cursor->window, file_id);
+    }
+}
+
+// --- CMake Source Lists ---
+//
+// Sources are taken from the commands that list them: set(SRC...),
+// target_sources(), add_executable(), add_library() and ESP-IDF's
+// idf_component_register(SRCS ...), each possibly spanning several lines.
+
+typedef enum {
+    CMAKE_SET_SRC,          // set(SRC... <files>)
+    CMAKE_TARGET_SOURCES,   // target_sources(<target> PRIVATE <files>)
+    CMAKE_ADD_TARGET,       // add_executable/add_library(<target> [options] <files>)
+    CMAKE_IDF_COMPONENT     // idf_component_register(SRCS <files> INCLUDE_DIRS ...)
+} CMakeCommand;
+
+static const struct {
+    const char *name;
+    CMakeCommand command;
+} cmake_source_commands[] = {
+    {"set", CMAKE_SET_SRC},
+    {"target_sources", CMAKE_TARGET_SOURCES},
+    {"add_executable", CMAKE_ADD_TARGET},
+    {"add_library", CMAKE_ADD_TARGET},
+    {"idf_component_register", CMAKE_IDF_COMPONENT},
+};
+
+// The command a trimmed line opens, or -1.
+static int cmake_source_command(const char *line) {
+    for (size_t i = 0; i < sizeof(cmake_source_commands) / sizeof(*cmake_source_commands); i++) {
+        size_t len = strlen(cmake_source_commands[i].name);
+        if (strncmp(line, cmake_source_commands[i].name, len) != 0) continue;
+        const char *p = line + len;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p != '(') continue;
+        // set() lists sources only for SRC* variables
+        if (cmake_source_commands[i].command == CMAKE_SET_SRC && strncmp(p + 1 + strspn(p + 1, " \t"), "SRC", 3) != 0) continue;
+        return (int)cmake_source_commands[i].command;
+    }
+    return -1;
+}
+
+// Cut a '#' comment (outside quotes) off a CMake line.
+static void strip_cmake_comment(char *line) {
+    bool quoted = false;
+    for (char *c = line; *c; c++) {
+        if (*c == '"') quoted = !quoted;
+        else if (*c == '#' && !quoted) {
+            *c = '\0';
+            break;
+        }
+    }
+}
+
+// Upper-case words such as PRIVATE, STATIC, WIN32 or INCLUDE_DIRS.
+static bool is_cmake_keyword(const char *token) {
+    for (const char *c = token; *c; c++) {
+        if (!isupper((unsigned char)*c) && !isdigit((unsigned char)*c) && *c != '_') return false;
+    }
+    return true;
+}
+
+// A source argument as a path relative to the CMake file's directory, or NULL
+// for variables and generator expressions.
+static const char *cmake_source_path(char *token) {
+    size_t len = strlen(token);
+    if (len >= 2 && token[0] == '"' && token[len - 1] == '"') {
+        token[len - 1] = '\0';
+        token++;
+    }
+    static const char *const dir_vars[] = {"${CMAKE_CURRENT_SOURCE_DIR}/", "${CMAKE_CURRENT_LIST_DIR}/"};
+    for (size_t i = 0; i < sizeof(dir_vars) / sizeof(*dir_vars); i++) {
+        size_t prefix = strlen(dir_vars[i]);
+        if (strncmp(token, dir_vars[i], prefix) == 0) token += prefix;
+    }
+    return token[0] && !strchr(token, '$') ? token : NULL;
+}
+
+// Record the sources of one complete command. The reference keeps the path
+// for the graph; the name map gets the basename, which the orphan and
+// missing checks compare against.
+static void add_cmake_sources(ProjanitorContext *ctx, int file_id, char *buffer, int line_no) {
+    const char *file_path = ctx->files.paths[file_id];
+    int command = cmake_source_command(buffer);
+    char *saveptr;
+    strtok_r(buffer, " \t\n()", &saveptr);                         // the command
+    char *token = strtok_r(NULL, " \t\n()", &saveptr);
+    if (command != CMAKE_IDF_COMPONENT && token) token = strtok_r(NULL, " \t\n()", &saveptr);  // variable or target
+    bool listing = command != CMAKE_IDF_COMPONENT;
+    for (; token; token = strtok_r(NULL, " \t\n()", &saveptr)) {
+        if (is_cmake_keyword(token)) {
+            if (command == CMAKE_IDF_COMPONENT) listing = strcmp(token, "SRCS") == 0;
+            // Imported and alias targets name no sources
+            if (command == CMAKE_ADD_TARGET && (strcmp(token, "IMPORTED") == 0 || strcmp(token, "ALIAS") == 0)) break;
+            continue;
+        }
+        const char *name = listing ? cmake_source_path(token) : NULL;
+        if (!name) continue;
+        const char *base = strrchr(name, '/');
+        add_to_hash_map(ctx->referenced_files, base ? base + 1 : name, file_path);
+        add_reference(&ctx->references, file_id, name, line_no, REF_CMAKE_SRC);
+        pj_log(ctx, PJ_LOG_INFO, "Found SRC reference %s in %s", name, file_path);
+    }
+}
+
+// Lines of a file being parsed: from stdio, or from a buffer holding the whole
+// file (network-filesystem scan). Both split lines exactly like fgets().
+typedef struct {
+    FILE *file;
+    const char *data;
+    size_t len;
+    size_t pos;
+} LineSource;
+
+static bool next_line(LineSource *src, char *line, size_t size) {
+    if (src->file) return fgets(line, (int)size, src->file) != NULL;
+    if (src->pos >= src->len) return false;
+    size_t avail = src->len - src->pos;
+    size_t n = avail < size - 1 ? avail : size - 1;
+    const char *newline = (const char *)memchr(src->data + src->pos, '\n', n);
+    if (newline) n = (size_t)(newline - (src->data + src->pos)) + 1;
+    memcpy(line, src->data + src->pos, n);
+    line[n] = '\0';
+    src->pos += n;
+    return true;
+}
+
+// Returns the bytes the source read.
+static size_t close_line_source(LineSource *src) {
+    if (!src->file) return src->len;
+    long read = ftell(src->file);
+    fclose(src->file);
+    src->file = NULL;
+    return read > 0 ? (size_t)read : 0;
+}
+
+// Parse one file; `data` is its whole contents, or NULL to read it with stdio.
+static void parse_file_for_references(ProjanitorContext *ctx, int file_id, const char *data, size_t len) {
+    FileTable *files = &ctx->files;
+    const char *file_path = files->paths[file_id];
+    HashMap *referenced_files = ctx->referenced_files;
+    ReferenceArray *references = &ctx->references;
+    SymbolTable *symbols = (ctx->features & PJ_FEATURE_SYMBOLS) ? &ctx->symbols : NULL;
+    TrigramTable *trigrams = (ctx->features & PJ_FEATURE_TRIGRAMS) ? &ctx->trigrams : NULL;
+    pj_log(ctx, PJ_LOG_INFO, "Parsing file %s", file_path);
+    LineSource src = {NULL, data, len, 0};
+    if (!data) {
+        ctx->stats.open_calls++;
+        src.file = fopen(file_path, "r");
+        if (!src.file) {
+            if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "Could not open file %s: %s", file_path, strerror(errno));
+            return;
+        }
+    }
+
+    char line[MAX_LINE_LEN];
+    bool in_src_block = false;
+    char src_buffer[MAX_SRC_BUFFER] = {0};
+    size_t src_len = 0;
+    int src_depth = 0;
+    int line_no = 0;
+    int src_block_line = 0;
+    bool is_header = files->types[file_id] == PJ_TYPE_H;
+    GuardScanner guard;
+    init_guard_scanner(&guard);
+    bool scan_symbols = symbols && (is_header || files->types[file_id] == PJ_TYPE_C);
+    SymbolScanner sym_scanner;
+    init_symbol_scanner(&sym_scanner, file_path);
+    TrigramCursor tri_cursor = {0, 0};
+
+    while (next_line(&src, line, sizeof(line))) {
+        line_no++;
+        if (trigrams) trigram_feed(trigrams, &tri_cursor, line, file_id);
+        // Strip leading/trailing whitespace
+        char *trimmed = line;
+        while (isspace(*trimmed)) trimmed++;
+        char *end = trimmed + strlen(trimmed) - 1;
+        while (end > trimmed && isspace(*end)) *end-- = '\0';
+
+        if (is_header && !guard.pragma_once) guard_scan_line(&guard, trimmed);
+        if (scan_symbols) symbol_scan_line(symbols, &sym_scanner, trimmed, line_no);
+
+        // Handle C/C++ includes
+        if (!in_src_block && strstr(trimmed, "#include \"")) {
+            char *start = strstr(trimmed, "#include \"") + strlen("#include \"");
+            char *end_quote = strchr(start, '"');
+            if (end_quote) {
+                size_t len = end_quote - start;
+                if (len > 0 && len < MAX_PATH_LEN && !strchr(start, '<')) { // Exclude <*.h>
+                    char *ref_name = (char *)malloc(len + 1);
+                    if (!ref_name) {
+                        close_line_source(&src);
+                        pj_out_of_memory();
+                    }
+                    strncpy(ref_name, start, len);
+                    ref_name[len] = '\0';
+                    add_to_hash_map(referenced_files, ref_name, file_path);
+                    add_reference(references, file_id, ref_name, line_no, REF_INCLUDE);
+                    pj_log(ctx, PJ_LOG_INFO, "Found include reference %s in %s", ref_name, file_path);
+                    free(ref_name);
+                }
+            }
+        }
+        // Handle CMake source lists
+        else if (ends_with(file_path, "CMakeLists.txt") || ends_with(file_path, ".cmake")) {
+            strip_cmake_comment(trimmed);
+            if (!in_src_block && cmake_source_command(trimmed) >= 0) {
+                in_src_block = true;
+                src_len = 0;
+                src_depth = 0;
+                src_block_line = line_no;
+                src_buffer[0] = '\0';
+                pj_log(ctx, PJ_LOG_INFO, "Started SRC block in %s", file_path);
+            }
+            if (in_src_block) {
+                if (src_len + strlen(trimmed) + 1 < sizeof(src_buffer)) {
+                    if (src_len > 0) src_buffer[src_len++] = ' ';
+                    strcpy(src_buffer + src_len, trimmed);
+                    src_len += strlen(trimmed);
+                } else {
+                    if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "SRC buffer overflow in %s", file_path);
+                    in_src_block = false;
+                }
+            }
+            // The block may close on the line that opened it
+            if (in_src_block) {
+                for (const char *c = trimmed; *c; c++) {
+                    if (*c == '(') src_depth++;
+                    else if (*c == ')') src_depth--;
+                }
+                if (src_depth <= 0) {
+                    in_src_block = false;
+                    add_cmake_sources(ctx, file_id, src_buffer, src_block_line);
+                    pj_log(ctx, PJ_LOG_INFO, "Ended SRC block in %s", file_path);
+                }
+            }
+        }
+    }
+    ctx->stats.bytes_read += close_line_source(&src);
+    if (is_header) {
+        files->guards[file_id] = (uint8_t)guard_scan_finish(&guard);
+        files->guard_issues[file_id] = guard.issue;
+    }
+}
+
+static void analyze_project_files(ProjanitorContext *ctx, const char *base_path, int dir_id) {
+    pj_log(ctx, PJ_LOG_INFO, "Analyzing directory %s", base_path);
+    ctx->stats.opendir_calls++;
+    DIR *dir = opendir(base_path);
+    if (!dir) {
+        if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "Cannot open directory %s: %s", base_path, strerror(errno));
+        return;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        if (!entry->d_name) {
+            if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "Null directory entry in %s", base_path);
+            continue;
+        }
+        char full_path[MAX_PATH_LEN];
+        if (strlen(base_path) + strlen(entry->d_name) + 1 >= sizeof(full_path)) {
+            if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "Path too long: %s/%s", base_path, entry->d_name);
+            continue;
+        }
+        snprintf(full_path, sizeof(full_path), "%s/%s", base_path, entry->d_name);
+
+        struct stat st;
+        ctx->stats.stat_calls++;
+        if (lstat(full_path, &st) != 0) {
+            if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "Cannot stat %s: %s", full_path, strerror(errno));
+            continue;
+        }
+
+        if (S_ISDIR(st.st_mode)) {
+            if (is_excluded_dir(ctx, entry->d_name) && strcmp(entry->d_name, "build") != 0) {
+                pj_log(ctx, PJ_LOG_INFO, "Skipping excluded directory: %s", full_path);
+                add_to_string_array(&ctx->excluded, full_path);
+                continue;
+            }
+            add_to_string_array(&ctx->directories, full_path);
+            const char *stored_dir = ctx->directories.items[ctx->directories.count - 1];
+            analyze_project_files(ctx, stored_dir, add_dir(&ctx->files, stored_dir));
+        } else if (S_ISREG(st.st_mode)) {
+            if (has_valid_extension(ctx, entry->d_name) && !is_system_file(ctx, entry->d_name)) {
+                pj_log(ctx, PJ_LOG_INFO, "Processing file %s", full_path);
+                parse_file_for_references(ctx, add_file(&ctx->files, full_path, dir_id, &st), NULL, 0);
+            }
+        } else if (S_ISLNK(st.st_mode) && ctx->verbose) {
+            pj_log(ctx, PJ_LOG_WARNING, "Skipping symlink: %s", full_path);
+        }
+    }
+    closedir(dir);
+}
+
+// --- Network-Filesystem Scan ---
+//
+// On NFS every stat and open is a round trip, so analyze_project_files() is
+// bound by per-call latency. With pj_set_network_fs() a pool of threads walks
+// the tree instead: listing a directory is one task, and its entries that
+// need attributes are statted in batches by the other workers. d_type sorts
+// most entries without any stat; statx() asks only for the fields the file
+// table keeps and, with AT_STATX_DONT_SYNC, takes the attributes the client
+// cached while listing. The listings are then replayed in readdir order, so
+// file ids and results match the serial scan, and the same number of threads
+// reads the files ahead, one read() each, while this thread parses them.
+//
+// Workers neither log nor unwind: they record errno (ENOMEM included) and the
+// calling thread reports it afterwards.
+
+#define WALK_STAT_BATCH 16
+#define READ_AHEAD_PER_THREAD 4
+
+typedef enum {
+    WALK_SKIP,      // not of interest, or the path is too long
+    WALK_UNKNOWN,   // no d_type; statted to find out
+    WALK_FILE,      // file of interest, statted for the file table
+    WALK_DIR,
+    WALK_EXCLUDED,
+    WALK_LINK,
+    WALK_FAILED     // the stat failed
+} WalkKind;
+
+typedef struct WalkDir WalkDir;
+
+typedef struct {
+    char *name;
+    uint8_t kind;           // WalkKind
+    bool statted;           // for the scan's call counts
+    int error;              // errno, for WALK_FAILED
+    int64_t size;
+    int64_t mtime;
+    uint64_t inode;
+    WalkDir *dir;           // WALK_DIR: its listing
+} WalkEntry;
+
+struct WalkDir {
+    char *path;
+    int error;              // errno of a failed opendir, else 0
+    WalkEntry *entries;     // readdir order
+    int count;
+    int capacity;
+};
+
+typedef struct {
+    WalkDir *dir;
+    int begin;              // entries to stat, or -1 to list the directory
+    int end;
+} WalkTask;
+
+typedef struct {
+    const ProjanitorContext *ctx;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    WalkTask *tasks;        // a stack, so the walk stays roughly depth first
+    int task_count;
+    int task_capacity;
+    int active;             // workers running a task
+    bool failed;            // a worker ran out of memory
+} Walk;
+
+static WalkDir *new_walk_dir(const char *path) {
+    WalkDir *dir = (WalkDir *)calloc(1, sizeof(WalkDir));
+    if (!dir) return NULL;
+    dir->path = strdup(path);
+    if (!dir->path) {
+        free(dir);
+        return NULL;
+    }
+    return dir;
+}
+
+static void free_walk_dir(WalkDir *dir) {
+    if (!dir) return;
+    for (int i = 0; i < dir->count; i++) {
+        free(dir->entries[i].name);
+        free_walk_dir(dir->entries[i].dir);
+    }
+    free(dir->entries);
+    free(dir->path);
+    free(dir);
+}
+
+static void walk_fail(Walk *walk) {
+    pthread_mutex_lock(&walk->lock);
+    walk->failed = true;
+    pthread_mutex_unlock(&walk->lock);
+}
+
+static void walk_push(Walk *walk, WalkDir *dir, int begin, int end) {
+    pthread_mutex_lock(&walk->lock);
+    if (walk->task_count >= walk->task_capacity) {
+        int capacity = walk->task_capacity ? walk->task_capacity * 2 : INITIAL_ARRAY_CAPACITY;
+        WalkTask *grown = (WalkTask *)realloc(walk->tasks, capacity * sizeof(WalkTask));
+        if (!grown) {
+            walk->failed = true;
+            pthread_mutex_unlock(&walk->lock);
+            return;
+        }
+        walk->tasks = grown;
+        walk->task_capacity = capacity;
+    }
+    walk->tasks[walk->task_count++] = (WalkTask){dir, begin, end};
+    pthread_cond_signal(&walk->changed);
+    pthread_mutex_unlock(&walk->lock);
+}
+
+// Sort an entry by its file type bits (S_IFMT, 0 if unknown), queueing the
+// listing of subdirectories.
+static void walk_classify(Walk *walk, WalkDir *dir, WalkEntry *entry, mode_t type) {
+    const ProjanitorContext *ctx = walk->ctx;
+    if (type == 0) {
+        entry->kind = WALK_UNKNOWN;
+    } else if (S_ISDIR(type)) {
+        if (is_excluded_dir(ctx, entry->name) && strcmp(entry->name, "build") != 0) {
+            entry->kind = WALK_EXCLUDED;
+            return;
+        }
+        char path[MAX_PATH_LEN];
+        snprintf(path, sizeof(path), "%s/%s", dir->path, entry->name);
+        entry->dir = new_walk_dir(path);
+        if (!entry->dir) {
+            walk_fail(walk);
+            return;
+        }
+        entry->kind = WALK_DIR;
+        walk_push(walk, entry->dir, -1, -1);
+    } else if (S_ISREG(type)) {
+        entry->kind = has_valid_extension(ctx, entry->name) && !is_system_file(ctx, entry->name) ? WALK_FILE : WALK_SKIP;
+    } else {
+        entry->kind = S_ISLNK(type) ? WALK_LINK : WALK_SKIP;
+    }
+}
+
+static void walk_list(Walk *walk, WalkDir *dir) {
+    DIR *handle = opendir(dir->path);
+    if (!handle) {
+        dir->error = errno;
+        return;
+    }
+    struct dirent *entry;
+    int to_stat = 0;
+    while ((entry = readdir(handle)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        if (dir->count >= dir->capacity) {
+            int capacity = dir->capacity ? dir->capacity * 2 : 16;
+            WalkEntry *grown = (WalkEntry *)realloc(dir->entries, capacity * sizeof(WalkEntry));
+            if (!grown) break;
+            dir->entries = grown;
+            dir->capacity = capacity;
+        }
+        WalkEntry *item = &dir->entries[dir->count];
+        memset(item, 0, sizeof(*item));
+        item->name = strdup(entry->d_name);
+        if (!item->name) break;
+        item->inode = (uint64_t)entry->d_ino;
+        dir->count++;
+        if (strlen(dir->path) + strlen(entry->d_name) + 1 >= MAX_PATH_LEN) continue;  // WALK_SKIP
+        walk_classify(walk, dir, item, DTTOIF(entry->d_type));
+        if (item->kind == WALK_FILE || item->kind == WALK_UNKNOWN) to_stat++;
+    }
+    if (entry) walk_fail(walk);  // stopped early: out of memory
+    closedir(handle);
+
+    // Hand out the stats in batches, so one large directory keeps every
+    // worker busy.
+    int begin = 0, batched = 0;
+    for (int i = 0; i < dir->count && to_stat > 0; i++) {
+        if (dir->entries[i].kind != WALK_FILE && dir->entries[i].kind != WALK_UNKNOWN) continue;
+        to_stat--;
+        if (++batched == WALK_STAT_BATCH || to_stat == 0) {
+            walk_push(walk, dir, begin, i + 1);
+            begin = i + 1;
+            batched = 0;
+        }
+    }
+}
+
+// Attributes of one entry, without following symlinks. Returns 0 or errno.
+static int walk_stat(const char *path, WalkEntry *entry, mode_t *type) {
+#if defined(__linux__) && defined(STATX_TYPE)
+    struct statx stx;
+    unsigned mask = STATX_SIZE | STATX_MTIME | (entry->kind == WALK_UNKNOWN ? STATX_TYPE : 0);
+    if (statx(AT_FDCWD, path, AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC, mask, &stx) != 0) return errno;
+    *type = stx.stx_mode & S_IFMT;
+    entry->size = (int64_t)stx.stx_size;
+    entry->mtime = (int64_t)stx.stx_mtime.tv_sec;
+#else
+    struct stat st;
+    if (lstat(path, &st) != 0) return errno;
+    *type = st.st_mode & S_IFMT;
+    entry->size = (int64_t)st.st_size;
+    entry->mtime = (int64_t)st.st_mtime;
+#endif
+    return 0;
+}
+
+static void walk_stat_range(Walk *walk, WalkDir *dir, int begin, int end) {
+    char path[MAX_PATH_LEN];
+    for (int i = begin; i < end; i++) {
+        WalkEntry *entry = &dir->entries[i];
+        if (entry->kind != WALK_FILE && entry->kind != WALK_UNKNOWN) continue;
+        snprintf(path, sizeof(path), "%s/%s", dir->path, entry->name);
+        mode_t type = 0;
+        entry->error = walk_stat(path, entry, &type);
+        entry->statted = true;
+        if (entry->error) {
+            entry->kind = WALK_FAILED;
+        } else if (entry->kind == WALK_UNKNOWN) {
+            walk_classify(walk, dir, entry, type ? type : S_IFIFO);  // never unknown twice
+        }
+    }
+}
+
+static void *walk_worker(void *arg) {
+    Walk *walk = (Walk *)arg;
+    pthread_mutex_lock(&walk->lock);
+    for (;;) {
+        while (walk->task_count == 0 && walk->active > 0) pthread_cond_wait(&walk->changed, &walk->lock);
+        if (walk->task_count == 0) break;
+        WalkTask task = walk->tasks[--walk->task_count];
+        walk->active++;
+        pthread_mutex_unlock(&walk->lock);
+        if (task.begin < 0) {
+            walk_list(walk, task.dir);
+        } else {
+            walk_stat_range(walk, task.dir, task.begin, task.end);
+        }
+        pthread_mutex_lock(&walk->lock);
+        if (--walk->active == 0 && walk->task_count == 0) pthread_cond_broadcast(&walk->changed);
+    }
+    pthread_mutex_unlock(&walk->lock);
+    return NULL;
+}
+
+// Start up to `count` threads running `fn`; returns how many started.
+static int start_workers(pthread_t *workers, int count, void *(*fn)(void *), void *arg) {
+    int started = 0;
+    while (started < count && pthread_create(&workers[started], NULL, fn, arg) == 0) started++;
+    return started;
+}
+
+static void join_workers(pthread_t *workers, int count) {
+    for (int i = 0; i < count; i++) pthread_join(workers[i], NULL);
+}
+
+// The listing of the whole tree under root_path, walked by `threads` threads
+// including the calling one.
+static WalkDir *walk_tree(const ProjanitorContext *ctx, const char *root_path, int threads) {
+    Walk walk = {0};
+    walk.ctx = ctx;
+    pthread_mutex_init(&walk.lock, NULL);
+    pthread_cond_init(&walk.changed, NULL);
+    WalkDir *root = new_walk_dir(root_path);
+    pthread_t *workers = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    if (root && workers) {
+        walk_push(&walk, root, -1, -1);
+        int started = start_workers(workers, threads - 1, walk_worker, &walk);
+        walk_worker(&walk);
+        join_workers(workers, started);
+    }
+    pthread_mutex_destroy(&walk.lock);
+    pthread_cond_destroy(&walk.changed);
+    free(walk.tasks);
+    free(workers);
+    if (!root || !workers || walk.failed) {
+        free_walk_dir(root);
+        pj_out_of_memory();
+    }
+    return root;
+}
+
+// analyze_project_files() over a finished listing, minus the parsing.
+static void replay_walk(ProjanitorContext *ctx, const WalkDir *dir, int dir_id) {
+    pj_log(ctx, PJ_LOG_INFO, "Analyzing directory %s", dir->path);
+    ctx->stats.opendir_calls++;
+    if (dir->error) {
+        if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "Cannot open directory %s: %s", dir->path, strerror(dir->error));
+        return;
+    }
+    for (int i = 0; i < dir->count; i++) {
+        const WalkEntry *entry = &dir->entries[i];
+        if (entry->statted) ctx->stats.stat_calls++;
+        char full_path[MAX_PATH_LEN];
+        if (strlen(dir->path) + strlen(entry->name) + 1 >= sizeof(full_path)) {
+            if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "Path too long: %s/%s", dir->path, entry->name);
+            continue;
+        }
+        snprintf(full_path, sizeof(full_path), "%s/%s", dir->path, entry->name);
+
+        if (entry->kind == WALK_FAILED) {
+            if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "Cannot stat %s: %s", full_path, strerror(entry->error));
+        } else if (entry->kind == WALK_EXCLUDED) {
+            pj_log(ctx, PJ_LOG_INFO, "Skipping excluded directory: %s", full_path);
+            add_to_string_array(&ctx->excluded, full_path);
+        } else if (entry->kind == WALK_DIR) {
+            add_to_string_array(&ctx->directories, full_path);
+            const char *stored_dir = ctx->directories.items[ctx->directories.count - 1];
+            replay_walk(ctx, entry->dir, add_dir(&ctx->files, stored_dir));
+        } else if (entry->kind == WALK_FILE) {
+            pj_log(ctx, PJ_LOG_INFO, "Processing file %s", full_path);
+            struct stat st;
+            memset(&st, 0, sizeof(st));
+            st.st_size = (off_t)entry->size;
+            st.st_mtime = (time_t)entry->mtime;
+            st.st_ino = (ino_t)entry->inode;
+            add_file(&ctx->files, full_path, dir_id, &st);
+        } else if (entry->kind == WALK_LINK && ctx->verbose) {
+            pj_log(ctx, PJ_LOG_WARNING, "Skipping symlink: %s", full_path);
+        }
+    }
+}
+
+typedef struct {
+    char *data;             // the whole file, always allocated on success
+    size_t len;
+    int error;              // errno of a failed read, else 0
+    bool ready;
+} ReadSlot;
+
+typedef struct {
+    const FileTable *files;
+    pthread_mutex_t lock;
+    pthread_cond_t room;    // the parser moved on: readers may read further
+    pthread_cond_t ready;   // a slot was filled: the parser may go on
+    ReadSlot *slots;        // one per file id
+    int next;               // next id to read
+    int parsed;             // ids below this are consumed
+    int window;             // files read ahead of the parser at most
+    bool stop;
+    pthread_t *workers;
+    int started;
+} ReadAhead;
+
+// Read a whole file, in a single read() while it still has the size the walk
+// saw. Returns 0 or errno.
+static int read_whole_file(const char *path, int64_t size_hint, char **out, size_t *out_len) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return errno;
+    size_t capacity = (size_hint > 0 ? (size_t)size_hint : 0) + 1;
+    char *data = (char *)malloc(capacity);
+    size_t len = 0;
+    int error = data ? 0 : ENOMEM;
+    while (!error) {
+        ssize_t n = read(fd, data + len, capacity - len);
+        if (n < 0) {
+            if (errno != EINTR) error = errno;
+            continue;
+        }
+        len += (size_t)n;
+        if (len < capacity) break;  // a short read of a regular file ends it
+        char *grown = (char *)realloc(data, capacity * 2);
+        if (!grown) {
+            error = ENOMEM;
+        } else {
+            data = grown;
+            capacity *= 2;
+        }
+    }
+    close(fd);
+    if (error) {
+        free(data);
+        return error;
+    }
+    *out = data;
+    *out_len = len;
+    return 0;
+}
+
+static void *read_worker(void *arg) {
+    ReadAhead *ra = (ReadAhead *)arg;
+    pthread_mutex_lock(&ra->lock);
+    for (;;) {
+        while (!ra->stop && ra->next < ra->files->count && ra->next >= ra->parsed + ra->window) {
+            pthread_cond_wait(&ra->room, &ra->lock);
+        }
+        if (ra->stop || ra->next >= ra->files->count) break;
+        int id = ra->next++;
+        pthread_mutex_unlock(&ra->lock);
+        char *data = NULL;
+        size_t len = 0;
+        int error = read_whole_file(ra->files->paths[id], ra->files->sizes[id], &data, &len);
+        pthread_mutex_lock(&ra->lock);
+        ra->slots[id] = (ReadSlot){data, len, error, true};
+        if (id == ra->parsed) pthread_cond_signal(&ra->ready);
+    }
+    pthread_mutex_unlock(&ra->lock);
+    return NULL;
+}
+
+static void finish_read_ahead(ReadAhead *ra) {
+    pthread_mutex_lock(&ra->lock);
+    ra->stop = true;
+    pthread_cond_broadcast(&ra->room);
+    pthread_mutex_unlock(&ra->lock);
+    join_workers(ra->workers, ra->started);
+    for (int i = 0; i < ra->files->count; i++) free(ra->slots[i].data);
+    pthread_mutex_destroy(&ra->lock);
+    pthread_cond_destroy(&ra->room);
+    pthread_cond_destroy(&ra->ready);
+    free(ra->slots);
+    free(ra->workers);
+    free(ra);
+}
+
+static void parse_read_ahead(ProjanitorContext *ctx, ReadAhead *ra) {
+    for (int id = 0; id < ctx->files.count; id++) {
+        pthread_mutex_lock(&ra->lock);
+        while (!ra->slots[id].ready) pthread_cond_wait(&ra->ready, &ra->lock);
+        pthread_mutex_unlock(&ra->lock);
+        ReadSlot *slot = &ra->slots[id];
+        ctx->stats.open_calls++;
+        if (slot->error == ENOMEM) pj_out_of_memory();
+        if (slot->error) {
+            if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "Could not open file %s: %s", ctx->files.paths[id], strerror(slot->error));
+        } else {
+            parse_file_for_references(ctx, id, slot->data, slot->len);
+        }
+        free(slot->data);
+        slot->data = NULL;
+        pthread_mutex_lock(&ra->lock);
+        ra->parsed = id + 1;
+        pthread_cond_signal(&ra->room);
+        pthread_mutex_unlock(&ra->lock);
+    }
+}
+
+// Parse every file of the table in id order while `threads` workers read
+// ahead. The readers are stopped and joined before an out-of-memory unwind
+// passes through here.
+static void parse_files_read_ahead(ProjanitorContext *ctx, int threads) {
+    ReadAhead *ra = (ReadAhead *)calloc(1, sizeof(ReadAhead));
+    if (!ra) pj_out_of_memory();
+    ra->files = &ctx->files;
+    ra->slots = (ReadSlot *)calloc(ctx->files.count + 1, sizeof(ReadSlot));
+    ra->workers = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    if (!ra->slots || !ra->workers) {
+        free(ra->slots);
+        free(ra->workers);
+        free(ra);
+        pj_out_of_memory();
+    }
+    ra->window = threads * READ_AHEAD_PER_THREAD;
+    pthread_mutex_init(&ra->lock, NULL);
+    pthread_cond_init(&ra->room, NULL);
+    pthread_cond_init(&ra->ready, NULL);
+    ra->started = start_workers(ra->workers, threads, read_worker, ra);
+    if (ra->started == 0) {
+        finish_read_ahead(ra);
+        for (int id = 0; id < ctx->files.count; id++) parse_file_for_references(ctx, id, NULL, 0);
+        return;
+    }
+    OomGuard guard;
+    oom_enter(&guard);
+    if (setjmp(guard.env) != 0) {
+        oom_leave(&guard);
+        finish_read_ahead(ra);
+        pj_out_of_memory();
+    }
+    parse_read_ahead(ctx, ra);
+    oom_leave(&guard);
+    finish_read_ahead(ra);
+}
+
+static void scan_network_fs(ProjanitorContext *ctx, const char *root_path, int root_id) {
+    WalkDir *root = walk_tree(ctx, root_path, ctx->network_fs);
+    replay_walk(ctx, root, root_id);
+    free_walk_dir(root);
+    parse_files_read_ahead(ctx, ctx->network_fs);
+}
+
+// --- Preprocessed-Size Profiler ---
+//
+// Runs each translation unit of compile_commands.json through the compiler's
+// preprocessor and attributes the expanded output to the headers it came from,
+// using the "# <line> \"<file>\" <flags>" line markers emitted by -E. Results
+// are cached per TU, keyed by a hash of the command and TU contents, and are
+// revalidated against the content hash of every header they recorded.
+
+typedef struct {
+    char *directory;
+    char *file;
+    StringArray args;
+} CompileCommand;
+
+typedef struct {
+    CompileCommand *items;
+    int count;
+    int capacity;
+} CompileCommandArray;
+
+typedef struct {
+    char *path;
+    uint64_t content_hash;
+    unsigned long long self_bytes;  // bytes emitted from this header's own lines
+    unsigned long long incl_bytes;  // self bytes plus everything it includes
+    int depth;                      // shallowest include depth (TU = 0)
+    int entries;                    // times the header was entered
+    int tus;                        // TUs that pulled the header in (aggregate only)
+} PPHeaderStat;
+
+typedef struct {
+    PPHeaderStat *items;
+    int *slots;  // open-addressed path index, -1 = empty
+    int count;
+    int capacity;
+    int slot_count;
+} PPStatTable;
+
+static uint64_t fnv1a_update(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+#define FNV1A_INIT 14695981039346656037ULL
+
+static bool hash_file_contents(const char *path, uint64_t *out) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return false;
+    char buf[65536];
+    uint64_t h = FNV1A_INIT;
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        h = fnv1a_update(h, buf, n);
+    }
+    bool ok = !ferror(file);
+    fclose(file);
+    *out = h;
+    return ok;
+}
+
+static void init_pp_stat_table(PPStatTable *table) {
+    table->count = 0;
+    table->capacity = INITIAL_ARRAY_CAPACITY;
+    table->slot_count = INITIAL_ARRAY_CAPACITY * 2;
+    table->items = (PPHeaderStat *)malloc(table->capacity * sizeof(PPHeaderStat));
+    table->slots = (int *)malloc(table->slot_count * sizeof(int));
+    if (!table->items || !table->slots) pj_out_of_memory();
+    memset(table->slots, -1, table->slot_count * sizeof(int));
+}
+
+static void free_pp_stat_table(PPStatTable *table) {
+    for (int i = 0; i < table->count; i++) free(table->items[i].path);
+    free(table->items);
+    free(table->slots);
+    table->items = NULL;
+    table->slots = NULL;
+    table->count = table->capacity = table->slot_count = 0;
+}
+
+static PPHeaderStat* pp_stat_lookup(PPStatTable *table, const char *path) {
+    unsigned int mask = table->slot_count - 1;
+    unsigned int i = (unsigned int)fnv1a_update(FNV1A_INIT, path, strlen(path)) & mask;
+    while (table->slots[i] >= 0) {
+        PPHeaderStat *stat = &table->items[table->slots[i]];
+        if (strcmp(stat->path, path) == 0) return stat;
+        i = (i + 1) & mask;
+    }
+
+    if ((table->count + 1) * 2 > table->slot_count) {
+        int new_slot_count = table->slot_count * 2;
+        int *new_slots = (int *)malloc(new_slot_count * sizeof(int));
+        if (!new_slots) pj_out_of_memory();
+        memset(new_slots, -1, new_slot_count * sizeof(int));
+        for (int k = 0; k < table->count; k++) {
+            const char *key = table->items[k].path;
+            unsigned int j = (unsigned int)fnv1a_update(FNV1A_INIT, key, strlen(key)) & (new_slot_count - 1);
+            while (new_slots[j] >= 0) j = (j + 1) & (new_slot_count - 1);
+            new_slots[j] = k;
+        }
+        free(table->slots);
+        table->slots = new_slots;
+        table->slot_count = new_slot_count;
+        return pp_stat_lookup(table, path);
+    }
+    if (table->count >= table->capacity) {
+        table->capacity *= 2;
+        PPHeaderStat *new_items = (PPHeaderStat *)realloc(table->items, table->capacity * sizeof(PPHeaderStat));
+        if (!new_items) pj_out_of_memory();
+        table->items = new_items;
+    }
+    PPHeaderStat *stat = &table->items[table->count];
+    memset(stat, 0, sizeof(*stat));
+    stat->path = strdup(path);
+    if (!stat->path) pj_out_of_memory();
+    stat->depth = -1;
+    table->slots[i] = table->count++;
+    return stat;
+}
+
+// Minimal JSON reader covering the compile_commands.json schema: an array of
+// objects whose interesting members are strings or arrays of strings.
+static void json_skip_ws(const char **p) {
+    while (**p && isspace((unsigned char)**p)) (*p)++;
+}
+
+static char* json_parse_string(const char **p) {
+    if (**p != '"') return NULL;
+    (*p)++;
+    size_t cap = 64, len = 0;
+    char *out = (char *)malloc(cap);
+    if (!out) return NULL;
+    while (**p && **p != '"') {
+        char c = *(*p)++;
+        if (c == '\\') {
+            char esc = *(*p)++;
+            switch (esc) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case 'r': c = '\r'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'u': c = '?'; *p += (strlen(*p) >= 4) ? 4 : strlen(*p); break;
+                case '\0': free(out); return NULL;
+                default: c = esc; break;
+            }
+        }
+        if (len + 1 >= cap) {
+            cap *= 2;
+            char *grown = (char *)realloc(out, cap);
+            if (!grown) { free(out); return NULL; }
+            out = grown;
+        }
+        out[len++] = c;
+    }
+    if (**p != '"') { free(out); return NULL; }
+    (*p)++;
+    out[len] = '\0';
+    return out;
+}
+
+static bool json_skip_value(const char **p) {
+    json_skip_ws(p);
+    if (**p == '"') {
+        char *s = json_parse_string(p);
+        if (!s) return false;
+        free(s);
+        return true;
+    }
+    if (**p == '[' || **p == '{') {
+        char close = (**p == '[') ? ']' : '}';
+        (*p)++;
+        json_skip_ws(p);
+        if (**p == close) { (*p)++; return true; }
+        while (**p) {
+            if (close == '}') {
+                char *key = json_parse_string(p);
+                if (!key) return false;
+                free(key);
+                json_skip_ws(p);
+                if (**p != ':') return false;
+                (*p)++;
+            }
+            if (!json_skip_value(p)) return false;
+            json_skip_ws(p);
+            if (**p == ',') { (*p)++; json_skip_ws(p); continue; }
+            if (**p == close) { (*p)++; return true; }
+            return false;
+        }
+        return false;
+    }
+    while (**p && !strchr(",]} \t\r\n", **p)) (*p)++;
+    return true;
+}
+
+// Split a shell-style command line into arguments (quotes and backslashes).
+static void split_command_line(const char *cmd, StringArray *out) {
+    size_t cap = strlen(cmd) + 1;
+    char *arg = (char *)malloc(cap);
+    if (!arg) pj_out_of_memory();
+    const char *p = cmd;
+    while (*p) {
+        while (*p && isspace((unsigned char)*p)) p++;
+        if (!*p) break;
+        size_t len = 0;
+        char quote = 0;
+        while (*p && (quote || !isspace((unsigned char)*p))) {
+            if (quote) {
+                if (*p == quote) { quote = 0; p++; continue; }
+                if (quote == '"' && *p == '\\' && p[1]) p++;
+            } else if (*p == '"' || *p == '\'') {
+                quote = *p++;
+                continue;
+            } else if (*p == '\\' && p[1]) {
+                p++;
+            }
+            arg[len++] = *p++;
+        }
+        arg[len] = '\0';
+        add_to_string_array(out, arg);
+    }
+    free(arg);
+}
+
+static void free_compile_commands(CompileCommandArray *cmds) {
+    for (int i = 0; i < cmds->count; i++) {
+        free(cmds->items[i].directory);
+        free(cmds->items[i].file);
+        free_string_array(&cmds->items[i].args);
+    }
+    free(cmds->items);
+    cmds->items = NULL;
+    cmds->count = cmds->capacity = 0;
+}
+
+static bool load_compile_commands(ProjanitorContext *ctx, const char *db_path, CompileCommandArray *cmds) {
+    FILE *file = fopen(db_path, "rb");
+    if (!file) {
+        pj_log(ctx, PJ_LOG_WARNING, "Could not open %s: %s", db_path, strerror(errno));
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = (size >= 0) ? (char *)malloc((size_t)size + 1) : NULL;
+    if (!text || fread(text, 1, (size_t)size, file) != (size_t)size) {
+        pj_log(ctx, PJ_LOG_WARNING, "Could not read %s", db_path);
+        free(text);
+        fclose(file);
+        return false;
+    }
+    text[size] = '\0';
+    fclose(file);
+
+    cmds->count = 0;
+    cmds->capacity = INITIAL_ARRAY_CAPACITY;
+    cmds->items = (CompileCommand *)malloc(cmds->capacity * sizeof(CompileCommand));
+    if (!cmds->items) pj_out_of_memory();
+
+    const char *p = text;
+    bool ok = false;
+    json_skip_ws(&p);
+    if (*p != '[') goto done;
+    p++;
+    json_skip_ws(&p);
+    while (*p == '{') {
+        p++;
+        CompileCommand cc = {0};
+        char *command = NULL;
+        init_string_array(&cc.args);
+        json_skip_ws(&p);
+        while (*p == '"') {
+            char *key = json_parse_string(&p);
+            json_skip_ws(&p);
+            if (!key || *p != ':') { free(key); free(command); goto bad_entry; }
+            p++;
+            json_skip_ws(&p);
+            if (strcmp(key, "directory") == 0 && *p == '"') {
+                free(cc.directory);
+                cc.directory = json_parse_string(&p);
+            } else if (strcmp(key, "file") == 0 && *p == '"') {
+                free(cc.file);
+                cc.file = json_parse_string(&p);
+            } else if (strcmp(key, "command") == 0 && *p == '"') {
+                free(command);
+                command = json_parse_string(&p);
+            } else if (strcmp(key, "arguments") == 0 && *p == '[') {
+                p++;
+                json_skip_ws(&p);
+                while (*p == '"') {
+                    char *arg = json_parse_string(&p);
+                    if (!arg) break;
+                    add_to_string_array(&cc.args, arg);
+                    free(arg);
+                    json_skip_ws(&p);
+                    if (*p == ',') { p++; json_skip_ws(&p); }
+                }
+                if (*p == ']') p++;
+            } else if (!json_skip_value(&p)) {
+                free(key);
+                free(command);
+                goto bad_entry;
+            }
+            free(key);
+            json_skip_ws(&p);
+            if (*p == ',') { p++; json_skip_ws(&p); }
+        }
+        if (*p != '}') { free(command); goto bad_entry; }
+        p++;
+        if (cc.args.count == 0 && command) split_command_line(command, &cc.args);
+        free(command);
+        if (!cc.directory || !cc.file || cc.args.count == 0) {
+            if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "Skipping incomplete entry in %s", db_path);
+            free(cc.directory);
+            free(cc.file);
+            free_string_array(&cc.args);
+        } else {
+            if (cmds->count >= cmds->capacity) {
+                cmds->capacity *= 2;
+                CompileCommand *grown = (CompileCommand *)realloc(cmds->items, cmds->capacity * sizeof(CompileCommand));
+                if (!grown) pj_out_of_memory();
+                cmds->items = grown;
+            }
+            cmds->items[cmds->count++] = cc;
+        }
+        json_skip_ws(&p);
+        if (*p == ',') { p++; json_skip_ws(&p); }
+        continue;
+
+    bad_entry:
+        free(cc.directory);
+        free(cc.file);
+        free_string_array(&cc.args);
+        pj_log(ctx, PJ_LOG_WARNING, "Malformed entry in %s", db_path);
+        goto done;
+    }
+    ok = (*p == ']');
+    if (!ok) pj_log(ctx, PJ_LOG_WARNING, "Malformed compile database %s", db_path);
+
+done:
+    free(text);
+    if (!ok && cmds->count == 0) {
+        free_compile_commands(cmds);
+        return false;
+    }
+    return true;
+}
+
+// Build the argv for "<compiler> -E" from a compile command: drop the object
+// output, -c, and dependency-file generation so nothing is written to disk.
+static void build_preprocess_args(const StringArray *args, StringArray *pp_args) {
+    for (int i = 0; i < args->count; i++) {
+        const char *a = args->items[i];
+        if (i > 0) {
+            if (strcmp(a, "-c") == 0 || strcmp(a, "-MD") == 0 || strcmp(a, "-MMD") == 0 || strcmp(a, "-MP") == 0) continue;
+            if (strcmp(a, "-o") == 0 || strcmp(a, "-MF") == 0 || strcmp(a, "-MT") == 0 || strcmp(a, "-MQ") == 0) { i++; continue; }
+            if (strncmp(a, "-o", 2) == 0 || strncmp(a, "-MF", 3) == 0 || strncmp(a, "-MT", 3) == 0 || strncmp(a, "-MQ", 3) == 0) continue;
+        }
+        add_to_string_array(pp_args, a);
+    }
+    add_to_string_array(pp_args, "-E");
+}
+
+static uint64_t compile_command_key(const CompileCommand *cc) {
+    uint64_t h = fnv1a_update(FNV1A_INIT, cc->directory, strlen(cc->directory) + 1);
+    for (int i = 0; i < cc->args.count; i++) {
+        h = fnv1a_update(h, cc->args.items[i], strlen(cc->args.items[i]) + 1);
+    }
+    char tu_path[MAX_PATH_LEN];
+    if (cc->file[0] == '/') snprintf(tu_path, sizeof(tu_path), "%s", cc->file);
+    else snprintf(tu_path, sizeof(tu_path), "%s/%s", cc->directory, cc->file);
+    uint64_t content = 0;
+    if (hash_file_contents(tu_path, &content)) h = fnv1a_update(h, &content, sizeof(content));
+    return h;
+}
+
+// False when the path does not fit; the TU is then preprocessed uncached.
+static bool pp_cache_path(const char *cache_dir, uint64_t key, char *out, size_t out_len) {
+    return snprintf(out, out_len, "%s/%016llx.pp", cache_dir, (unsigned long long)key) < (int)out_len;
+}
+
+// Parse line-marker annotated -E output into per-header stats.
+static void collect_pp_stats(FILE *stream, const char *directory, PPStatTable *stats) {
+    enum { MAX_PP_DEPTH = 256 };
+    PPHeaderStat *stack[MAX_PP_DEPTH];
+    unsigned long long entry_total[MAX_PP_DEPTH];
+    int top = -1;
+    unsigned long long total = 0;
+    char line[MAX_LINE_LEN];
+    char path[MAX_PATH_LEN];
+
+    while (fgets(line, sizeof(line), stream)) {
+        if (line[0] == '#' && line[1] == ' ' && isdigit((unsigned char)line[2])) {
+            char *q = strchr(line, '"');
+            char *q_end = q ? strrchr(q + 1, '"') : NULL;
+            if (!q || !q_end) continue;
+            *q_end = '\0';
+            const char *name = q + 1;
+            int flag = atoi(q_end + 1);
+            if (name[0] == '<') {
+                // <built-in> / <command-line> stand in for the TU itself;
+                // returning to them closes anything forced in via -include.
+                if (flag == 2) {
+                    while (top > 0) {
+                        stack[top]->incl_bytes += total - entry_total[top];
+                        top--;
+                    }
+                }
+                continue;
+            }
+            if (name[0] == '/') snprintf(path, sizeof(path), "%s", name);
+            else snprintf(path, sizeof(path), "%s/%s", directory, name);
+
+            if (flag == 1 && top + 1 < MAX_PP_DEPTH) {
+                PPHeaderStat *stat = pp_stat_lookup(stats, path);
+                stack[++top] = stat;
+                entry_total[top] = total;
+                stat->entries++;
+                if (stat->depth < 0 || top < stat->depth) stat->depth = top;
+            } else if (flag == 2) {
+                while (top > 0 && strcmp(stack[top]->path, path) != 0) {
+                    stack[top]->incl_bytes += total - entry_total[top];
+                    top--;
+                }
+            } else if (top < 0) {
+                PPHeaderStat *stat = pp_stat_lookup(stats, path);
+                stack[++top] = stat;
+                entry_total[top] = total;
+                stat->entries++;
+                stat->depth = 0;
+            }
+            continue;
+        }
+        size_t len = strlen(line);
+        total += len;
+        if (top >= 0) stack[top]->self_bytes += len;
+    }
+    while (top >= 0) {
+        stack[top]->incl_bytes += total - entry_total[top];
+        top--;
+    }
+}
+
+// One TU of the pool. The argv is built by the calling thread before any
+// worker starts; `pid` and `stream` are only set while the compiler runs.
+typedef struct {
+    const CompileCommand *cc;
+    StringArray args;
+    char **argv;            // args.items plus the terminating NULL
+    char cache_path[MAX_PATH_LEN];
+    pid_t pid;
+    FILE *stream;
+    bool ok;                // a fresh cache entry was written
+} PPJob;
+
+typedef struct {
+    ProjanitorContext *ctx;
+    PPJob *jobs;
+    int count;
+    pthread_mutex_t lock;   // also held across pipe() + spawn, see spawn_preprocessor()
+    int next;
+    bool out_of_memory;
+} PPPool;
+
+#if (defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 29)) || defined(__APPLE__)
+#define PJ_HAVE_SPAWN_CHDIR 1
+#endif
+
+static void build_preprocess_job(const CompileCommand *cc, PPJob *job) {
+    init_string_array(&job->args);
+#ifndef PJ_HAVE_SPAWN_CHDIR
+    // No posix_spawn chdir action: let a shell enter the directory and exec.
+    add_to_string_array(&job->args, "/bin/sh");
+    add_to_string_array(&job->args, "-c");
+    add_to_string_array(&job->args, "cd -- \"$0\" && exec \"$@\"");
+    add_to_string_array(&job->args, cc->directory);
+#endif
+    build_preprocess_args(&cc->args, &job->args);
+    job->argv = (char **)malloc((job->args.count + 1) * sizeof(char *));
+    if (!job->argv) pj_out_of_memory();
+    memcpy(job->argv, job->args.items, job->args.count * sizeof(char *));
+    job->argv[job->args.count] = NULL;
+    job->cc = cc;
+    job->pid = -1;
+    job->stream = NULL;
+    job->ok = false;
+}
+
+// Wait for one child of ours; never reaps anyone else's. True when it exited 0.
+static bool reap_child(pid_t pid) {
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Start "<compiler> -E" in the TU's directory with stdout on job->stream.
+// Pipes are created close-on-exec under the pool lock, so a compiler spawned
+// by another worker never holds this pipe open.
+static bool spawn_preprocessor(PPPool *pool, PPJob *job) {
+    ProjanitorContext *ctx = pool->ctx;
+    posix_spawn_file_actions_t actions;
+    if (posix_spawn_file_actions_init(&actions) != 0) return false;
+    int fds[2] = {-1, -1};
+    int error = 0;
+    pthread_mutex_lock(&pool->lock);
+    if (pipe(fds) != 0) {
+        error = errno;
+    } else {
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+        if (!ctx->verbose) posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+#ifdef PJ_HAVE_SPAWN_CHDIR
+        posix_spawn_file_actions_addchdir_np(&actions, job->cc->directory);
+#endif
+        error = posix_spawnp(&job->pid, job->argv[0], &actions, NULL, job->argv, environ);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    posix_spawn_file_actions_destroy(&actions);
+    if (fds[1] >= 0) close(fds[1]);
+    if (error) {
+        pj_log(ctx, PJ_LOG_WARNING, "Cannot preprocess %s: %s", job->cc->file, strerror(error));
+        if (fds[0] >= 0) close(fds[0]);
+        job->pid = -1;
+        return false;
+    }
+    job->stream = fdopen(fds[0], "r");
+    if (!job->stream) {
+        close(fds[0]);
+        reap_child(job->pid);
+        job->pid = -1;
+        return false;
+    }
+    return true;
+}
+
+// Close the pipe and reap the compiler; true when it succeeded.
+static bool finish_preprocessor(PPJob *job) {
+    if (job->stream) fclose(job->stream);
+    job->stream = NULL;
+    bool ok = job->pid > 0 && reap_child(job->pid);
+    job->pid = -1;
+    return ok;
+}
+
+// Preprocess one TU and write its cache entry. Runs on a pool thread.
+static bool run_preprocess_job(PPPool *pool, PPJob *job) {
+    ProjanitorContext *ctx = pool->ctx;
+    const CompileCommand *cc = job->cc;
+    pj_log(ctx, PJ_LOG_INFO, "Preprocessing %s", cc->file);
+    if (!spawn_preprocessor(pool, job)) return false;
+    // Named after the compiler's pid: unique even when two commands share a key.
+    char tmp_path[MAX_PATH_LEN];
+    bool named = snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", job->cache_path, (long)job->pid) < (int)sizeof(tmp_path);
+
+    PPStatTable stats;
+    init_pp_stat_table(&stats);
+    collect_pp_stats(job->stream, cc->directory, &stats);
+    if (!finish_preprocessor(job)) {
+        pj_log(ctx, PJ_LOG_WARNING, "Preprocessing %s failed", cc->file);
+        free_pp_stat_table(&stats);
+        return false;
+    }
+    if (!named) {
+        pj_log(ctx, PJ_LOG_WARNING, "Cache path too long: %s", job->cache_path);
+        free_pp_stat_table(&stats);
+        return false;
+    }
+    FILE *out = fopen(tmp_path, "w");
+    if (!out) {
+        pj_log(ctx, PJ_LOG_WARNING, "Cannot write cache entry %s: %s", tmp_path, strerror(errno));
+        free_pp_stat_table(&stats);
+        return false;
+    }
+    fprintf(out, "%s\n", PP_CACHE_MAGIC);
+    for (int i = 0; i < stats.count; i++) {
+        PPHeaderStat *stat = &stats.items[i];
+        uint64_t content = 0;
+        hash_file_contents(stat->path, &content);
+        fprintf(out, "%016llx %llu %llu %d %d %s\n", (unsigned long long)content, stat->self_bytes, stat->incl_bytes, stat->depth, stat->entries, stat->path);
+    }
+    bool ok = (fclose(out) == 0) && rename(tmp_path, job->cache_path) == 0;
+    if (!ok) unlink(tmp_path);
+    free_pp_stat_table(&stats);
+    return ok;
+}
+
+static PPJob *next_pp_job(PPPool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    PPJob *job = (!pool->out_of_memory && pool->next < pool->count) ? &pool->jobs[pool->next++] : NULL;
+    pthread_mutex_unlock(&pool->lock);
+    return job;
+}
+
+// Pool thread. Running out of memory stops this thread after reaping its
+// compiler; the caller unwinds once every thread has been joined.
+static void *pp_worker(void *arg) {
+    PPPool *pool = (PPPool *)arg;
+    PPJob *job;
+    while ((job = next_pp_job(pool)) != NULL) {
+        OomGuard guard;
+        oom_enter(&guard);
+        if (setjmp(guard.env) != 0) {
+            oom_leave(&guard);
+            finish_preprocessor(job);
+            pthread_mutex_lock(&pool->lock);
+            pool->out_of_memory = true;
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        job->ok = run_preprocess_job(pool, job);
+        oom_leave(&guard);
+    }
+    return NULL;
+}
+
+// Load a cache entry, checking every recorded header against its current
+// content hash. Returns false (and leaves stats untouched) on a stale entry.
+static bool load_pp_cache_entry(const char *cache_path, HashMap *hash_memo, PPStatTable *stats) {
+    FILE *file = fopen(cache_path, "r");
+    if (!file) return false;
+    char line[MAX_PATH_LEN + 128];
+    if (!fgets(line, sizeof(line), file) || strncmp(line, PP_CACHE_MAGIC, strlen(PP_CACHE_MAGIC)) != 0) {
+        fclose(file);
+        return false;
+    }
+    PPStatTable entry;
+    init_pp_stat_table(&entry);
+    bool valid = true;
+    while (valid && fgets(line, sizeof(line), file)) {
+        unsigned long long content, self_bytes, incl_bytes;
+        int depth, entries, offset = 0;
+        if (sscanf(line, "%llx %llu %llu %d %d %n", &content, &self_bytes, &incl_bytes, &depth, &entries, &offset) < 5 || offset == 0) {
+            valid = false;
+            break;
+        }
+        char *path = line + offset;
+        path[strcspn(path, "\n")] = '\0';
+
+        char hex[17];
+        StringArray *memo = get_from_hash_map(hash_memo, path);
+        if (!memo) {
+            uint64_t current = 0;
+            if (!hash_file_contents(path, &current)) current = 0;
+            snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)current);
+            add_to_hash_map(hash_memo, path, hex);
+            memo = get_from_hash_map(hash_memo, path);
+        }
+        snprintf(hex, sizeof(hex), "%016llx", content);
+        if (strcmp(memo->items[0], hex) != 0) {
+            valid = false;
+            break;
+        }
+        PPHeaderStat *stat = pp_stat_lookup(&entry, path);
+        stat->self_bytes = self_bytes;
+        stat->incl_bytes = incl_bytes;
+        stat->depth = depth;
+        stat->entries = entries;
+    }
+    fclose(file);
+
+    if (valid) {
+        for (int i = 0; i < entry.count; i++) {
+            PPHeaderStat *src = &entry.items[i];
+            PPHeaderStat *dst = pp_stat_lookup(stats, src->path);
+            dst->self_bytes += src->self_bytes;
+            dst->incl_bytes += src->incl_bytes;
+            dst->entries += src->entries;
+            dst->tus++;
+            if (dst->depth < 0 || src->depth < dst->depth) dst->depth = src->depth;
+        }
+    }
+    free_pp_stat_table(&entry);
+    return valid;
+}
+
+static int compare_pp_stats(const void *a, const void *b) {
+    const PPHeaderStat *s1 = (const PPHeaderStat *)a;
+    const PPHeaderStat *s2 = (const PPHeaderStat *)b;
+    if (s1->incl_bytes != s2->incl_bytes) return s1->incl_bytes < s2->incl_bytes ? 1 : -1;
+    return strcmp(s1->path, s2->path);
+}
+
+static bool make_directories(const char *path) {
+    char tmp[MAX_PATH_LEN];
+    if (snprintf(tmp, sizeof(tmp), "%s", path) >= (int)sizeof(tmp)) return false;
+    for (char *p = tmp + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(tmp, 0755) != 0 && errno != EEXIST) return false;
+        *p = '/';
+    }
+    return mkdir(tmp, 0755) == 0 || errno == EEXIST;
+}
+
+static pj_status profile_preprocessed_sizes(ProjanitorContext *ctx, const char *compile_db, const char *pp_cache_dir, int top, FILE *out) {
+    const char *root_path = ctx->root_path;
+    char db_path[MAX_PATH_LEN];
+    int len;
+    if (compile_db) {
+        len = snprintf(db_path, sizeof(db_path), "%s", compile_db);
+    } else {
+        struct stat st;
+        len = snprintf(db_path, sizeof(db_path), "%s/build/compile_commands.json", root_path);
+        if (len < (int)sizeof(db_path) && stat(db_path, &st) != 0) {
+            len = snprintf(db_path, sizeof(db_path), "%s/compile_commands.json", root_path);
+        }
+    }
+    if (len >= (int)sizeof(db_path)) return fail(ctx, PJ_ERR_INVALID, "Compile database path too long");
+    // Room for "/<16 hex digits>.pp.<pid>.tmp" below the directory
+    char cache_dir[MAX_PATH_LEN - 48];
+    if (pp_cache_dir) len = snprintf(cache_dir, sizeof(cache_dir), "%s", pp_cache_dir);
+    else len = snprintf(cache_dir, sizeof(cache_dir), "%s/.projanitor_cache/pp", root_path);
+    if (len >= (int)sizeof(cache_dir)) return fail(ctx, PJ_ERR_INVALID, "Preprocessing cache directory path too long");
+
+    fprintf(out, "\n=== Preprocessed Size ===\n");
+    CompileCommandArray cmds = {0};
+    if (!load_compile_commands(ctx, db_path, &cmds)) {
+        fprintf(out, "(Skipped: no usable compile database at %s)\n", db_path);
+        return PJ_OK;
+    }
+    if (!make_directories(cache_dir)) {
+        pj_log(ctx, PJ_LOG_WARNING, "Cannot create cache directory %s: %s", cache_dir, strerror(errno));
+    }
+
+    // Pass 1: reuse valid cache entries, queue the rest.
+    HashMap *hash_memo = create_hash_map(HASH_MAP_SIZE);
+    PPStatTable totals;
+    init_pp_stat_table(&totals);
+    PPJob *jobs = (PPJob *)calloc(cmds.count + 1, sizeof(PPJob));
+    if (!jobs) pj_out_of_memory();
+    int pending_count = 0, cached = 0, failed = 0;
+    char cache_path[MAX_PATH_LEN];
+    for (int i = 0; i < cmds.count; i++) {
+        uint64_t key = compile_command_key(&cmds.items[i]);
+        if (!pp_cache_path(cache_dir, key, cache_path, sizeof(cache_path))) {
+            pj_log(ctx, PJ_LOG_WARNING, "Cache path too long for %s", cmds.items[i].file);
+            failed++;
+        } else if (load_pp_cache_entry(cache_path, hash_memo, &totals)) {
+            cached++;
+            pj_log(ctx, PJ_LOG_INFO, "Cached preprocessing result for %s", cmds.items[i].file);
+        } else {
+            PPJob *job = &jobs[pending_count++];
+            build_preprocess_job(&cmds.items[i], job);
+            memcpy(job->cache_path, cache_path, sizeof(cache_path));
+        }
+    }
+
+    // Pass 2: `jobs` threads, the calling one included, each spawning and
+    // reaping its own compiler. Nothing runs between fork and exec but the
+    // spawn itself, and an embedding process keeps its other children's status.
+    fflush(out);
+    PPPool pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.ctx = ctx;
+    pool.jobs = jobs;
+    pool.count = pending_count;
+    int threads = pending_count < ctx->jobs ? pending_count : ctx->jobs;
+    pthread_t *workers = (pthread_t *)malloc((threads + 1) * sizeof(pthread_t));
+    if (!workers) pj_out_of_memory();
+    pthread_mutex_init(&pool.lock, NULL);
+    int started = threads > 1 ? start_workers(workers, threads - 1, pp_worker, &pool) : 0;
+    pp_worker(&pool);
+    join_workers(workers, started);
+    pthread_mutex_destroy(&pool.lock);
+    free(workers);
+    for (int k = 0; k < pending_count; k++) {
+        free(jobs[k].argv);
+        free_string_array(&jobs[k].args);
+    }
+    if (pool.out_of_memory) pj_out_of_memory();
+
+    // Pass 3: fold the fresh entries in; header hashes were just recorded.
+    for (int k = 0; k < pending_count; k++) {
+        if (!jobs[k].ok || !load_pp_cache_entry(jobs[k].cache_path, hash_memo, &totals)) failed++;
+    }
+
+    unsigned long long tu_bytes = 0;
+    int header_count = 0;
+    for (int i = 0; i < totals.count; i++) {
+        if (totals.items[i].depth == 0) tu_bytes += totals.items[i].incl_bytes;
+        else header_count++;
+    }
+    fprintf(out, "Translation units: %d (%d cached, %d preprocessed, %d failed)\n", cmds.count, cached, cmds.count - cached - failed, failed);
+    fprintf(out, "Total preprocessed bytes: %llu\n", tu_bytes);
+    fprintf(out, "Distinct headers: %d\n", header_count);
+    fprintf(out, "Top headers by expanded size (bytes incl. nested includes, own bytes, TUs, min depth):\n");
+
+    free(totals.slots);  // the index is unusable once items are reordered
+    totals.slots = NULL;
+    qsort(totals.items, totals.count, sizeof(PPHeaderStat), compare_pp_stats);
+    int shown = 0;
+    for (int i = 0; i < totals.count && shown < top; i++) {
+        PPHeaderStat *stat = &totals.items[i];
+        if (stat->depth == 0) continue;
+        fprintf(out, "  %12llu %10llu %6d %3d  %s\n", stat->incl_bytes, stat->self_bytes, stat->tus, stat->depth, stat->path);
+        shown++;
+    }
+    if (shown == 0) fprintf(out, "  (None)\n");
+
+    free(jobs);
+    free_pp_stat_table(&totals);
+    free_hash_map(hash_memo);
+    free_compile_commands(&cmds);
+    return PJ_OK;
+}
+
+// --- Include Graph ---
+
+// Collapse "//", "/./" and "/../" segments in place (purely lexical).
+static void normalize_path(char *path) {
+    char *segments[MAX_PATH_LEN / 2];
+    int count = 0;
+    bool absolute = (path[0] == '/');
+    char *saveptr;
+    char *copy = strdup(path);
+    if (!copy) return;
+    for (char *seg = strtok_r(copy, "/", &saveptr); seg; seg = strtok_r(NULL, "/", &saveptr)) {
+        if (strcmp(seg, ".") == 0) continue;
+        if (strcmp(seg, "..") == 0 && count > 0 && strcmp(segments[count - 1], "..") != 0) {
+            count--;
+            continue;
+        }
+        segments[count++] = seg;
+    }
+    char *out = path;
+    if (absolute) *out++ = '/';
+    for (int i = 0; i < count; i++) {
+        size_t len = strlen(segments[i]);
+        memmove(out, segments[i], len);
+        out += len;
+        if (i < count - 1) *out++ = '/';
+    }
+    *out = '\0';
+    free(copy);
+}
+
+static int compare_strings(const void *a, const void *b) {
+    return strcmp(*(const char **)a, *(const char **)b);
+}
+
+// Map a reference to a scanned file: relative to the referring file first,
+// then to the project root, then by a unique basename/path-suffix match
+// (covers -I include directories). Ambiguous names stay unresolved.
+static int resolve_reference(const IncludeGraph *graph, const char *root_path, const FileTable *files, const int *node_of, const char *from, const char *name) {
+    char candidate[MAX_PATH_LEN];
+    int id;
+    if (name[0] == '/') {
+        snprintf(candidate, sizeof(candidate), "%s", name);
+    } else {
+        const char *slash = strrchr(from, '/');
+        int dir_len = slash ? (int)(slash - from) : 0;
+        snprintf(candidate, sizeof(candidate), "%.*s/%s", dir_len, from, name);
+    }
+    normalize_path(candidate);
+    if ((id = id_map_get(&graph->path_ids, candidate)) >= 0) return id;
+
+    if (name[0] != '/') {
+        snprintf(candidate, sizeof(candidate), "%s/%s", root_path, name);
+        normalize_path(candidate);
+        if ((id = id_map_get(&graph->path_ids, candidate)) >= 0) return id;
+    }
+
+    const char *base = strrchr(name, '/') ? strrchr(name, '/') + 1 : name;
+    int name_id = id_map_get(&files->name_index, base);
+    if (name_id < 0) return -1;
+    size_t name_len = strlen(name);
+    int found = -1;
+    for (int file = files->name_heads[name_id]; file >= 0; file = files->next_same_name[file]) {
+        const char *path = files->paths[file];
+        size_t path_len = strlen(path);
+        if (base != name && !(path_len > name_len && path[path_len - name_len - 1] == '/' && strcmp(path + path_len - name_len, name) == 0)) {
+            continue;
+        }
+        if (found >= 0) return -1;
+        found = node_of[file];
+    }
+    return found;
+}
+
+static void build_include_graph(ProjanitorContext *ctx, IncludeGraph *graph, const char *root_path, const FileTable *files, const ReferenceArray *references) {
+    memset(graph, 0, sizeof(*graph));
+    int n = files->count;
+    graph->file_count = n;
+    graph->paths = (const char **)large_alloc((n + 1) * sizeof(char *));
+    graph->file_ids = (int *)large_alloc((n + 1) * sizeof(int));
+    graph->edge_offsets = (int *)large_alloc((n + 1) * sizeof(int));
+    int *node_of = (int *)malloc((n + 1) * sizeof(int));
+    int *sources = (int *)malloc((references->count + 1) * sizeof(int));
+    int *targets = (int *)malloc((references->count + 1) * sizeof(int));
+    if (!node_of || !sources || !targets) pj_out_of_memory();
+    for (int i = 0; i < n; i++) graph->paths[i] = files->paths[i];
+    qsort(graph->paths, n, sizeof(char *), compare_strings);
+    init_id_map(&graph->path_ids, n);
+    for (int i = 0; i < n; i++) id_map_put(&graph->path_ids, graph->paths[i], i);
+    for (int i = 0; i < n; i++) {
+        node_of[i] = id_map_get(&graph->path_ids, files->paths[i]);
+        graph->file_ids[node_of[i]] = i;
+    }
+
+    int unresolved = 0;
+    for (int r = 0; r < references->count; r++) {
+        const Reference *ref = &references->items[r];
+        sources[r] = node_of[ref->from];
+        targets[r] = resolve_reference(graph, root_path, files, node_of, files->paths[ref->from], ref->name);
+        if (targets[r] >= 0) {
+            graph->edge_offsets[sources[r] + 1]++;
+            graph->edge_count++;
+        } else {
+            unresolved++;
+        }
+    }
+    for (int i = 0; i < n; i++) graph->edge_offsets[i + 1] += graph->edge_offsets[i];
+
+    graph->edge_targets = (int *)large_alloc((graph->edge_count + 1) * sizeof(int));
+    graph->edge_refs = (int *)large_alloc((graph->edge_count + 1) * sizeof(int));
+    int *fill = (int *)malloc((n + 1) * sizeof(int));
+    if (!fill) pj_out_of_memory();
+    memcpy(fill, graph->edge_offsets, n * sizeof(int));
+    for (int r = 0; r < references->count; r++) {
+        if (targets[r] < 0) continue;
+        int slot = fill[sources[r]]++;
+        graph->edge_targets[slot] = targets[r];
+        graph->edge_refs[slot] = r;
+    }
+    pj_log(ctx, PJ_LOG_INFO, "Include graph has %d files, %d edges, %d unresolved references", n, graph->edge_count, unresolved);
+    free(fill);
+    free(node_of);
+    free(sources);
+    free(targets);
+}
+
+static void free_include_graph(IncludeGraph *graph) {
+    if (!graph) return;
+    large_free(graph->paths);
+    large_free(graph->file_ids);
+    large_free(graph->edge_offsets);
+    large_free(graph->edge_targets);
+    large_free(graph->edge_refs);
+    large_free(graph->rev_offsets);
+    large_free(graph->rev_sources);
+    free_id_map(&graph->path_ids);
+    memset(graph, 0, sizeof(*graph));
+}
+
+// --- Redundant Include Detection ---
+
+// Strongly connected components of the #include subgraph, or of the whole
+// reference graph (iterative Tarjan). Components are numbered in reverse
+// topological order: every component a component reaches has a smaller number.
+static int include_sccs(const IncludeGraph *graph, const ReferenceArray *references, bool includes_only, int *scc) {
+    int n = graph->file_count;
+    int *index = (int *)malloc((n + 1) * sizeof(int));
+    int *low = (int *)malloc((n + 1) * sizeof(int));
+    int *stack = (int *)malloc((n + 1) * sizeof(int));
+    int *call_node = (int *)malloc((n + 1) * sizeof(int));
+    int *call_edge = (int *)malloc((n + 1) * sizeof(int));
+    bool *on_stack = (bool *)calloc(n + 1, sizeof(bool));
+    if (!index || !low || !stack || !call_node || !call_edge || !on_stack) pj_out_of_memory();
+    for (int i = 0; i < n; i++) index[i] = -1;
+    int next_index = 0, sp = 0, scc_count = 0;
+
+    for (int root = 0; root < n; root++) {
+        if (index[root] >= 0) continue;
+        int depth = 0;
+        call_node[0] = root;
+        call_edge[0] = graph->edge_offsets[root];
+        index[root] = low[root] = next_index++;
+        stack[sp++] = root;
+        on_stack[root] = true;
+        while (depth >= 0) {
+            int v = call_node[depth];
+            if (call_edge[depth] < graph->edge_offsets[v + 1]) {
+                int e = call_edge[depth]++;
+                if (includes_only && references->items[graph->edge_refs[e]].kind != REF_INCLUDE) continue;
+                int w = graph->edge_targets[e];
+                if (index[w] < 0) {
+                    index[w] = low[w] = next_index++;
+                    stack[sp++] = w;
+                    on_stack[w] = true;
+                    depth++;
+                    call_node[depth] = w;
+                    call_edge[depth] = graph->edge_offsets[w];
+                } else if (on_stack[w] && index[w] < low[v]) {
+                    low[v] = index[w];
+                }
+                continue;
+            }
+            if (low[v] == index[v]) {
+                int w;
+                do {
+                    w = stack[--sp];
+                    on_stack[w] = false;
+                    scc[w] = scc_count;
+                } while (w != v);
+                scc_count++;
+            }
+            depth--;
+            if (depth >= 0 && low[v] < low[call_node[depth]]) low[call_node[depth]] = low[v];
+        }
+    }
+    free(index);
+    free(low);
+    free(stack);
+    free(call_node);
+    free(call_edge);
+    free(on_stack);
+    return scc_count;
+}
+
+// Group files by component so each component is folded once: the members of
+// component c are members[start[c] .. start[c + 1]).
+static void group_components(int n, const int *scc, int scc_count, int **start_out, int **members_out) {
+    int *start = (int *)calloc(scc_count + 2, sizeof(int));
+    int *members = (int *)malloc((n + 1) * sizeof(int));
+    int *fill = (int *)malloc((scc_count + 1) * sizeof(int));
+    if (!start || !members || !fill) pj_out_of_memory();
+    for (int v = 0; v < n; v++) start[scc[v] + 1]++;
+    for (int c = 0; c < scc_count; c++) start[c + 1] += start[c];
+    memcpy(fill, start, scc_count * sizeof(int));
+    for (int v = 0; v < n; v++) members[fill[scc[v]]++] = v;
+    free(fill);
+    *start_out = start;
+    *members_out = members;
+}
+
+// The #include'd files every file reaches through #include edges, as one
+// bitset per strongly connected component.
+typedef struct {
+    int *bit_of;        // bit of each #include'd file, -1 for the rest
+    int *scc;
+    int scc_count;
+    size_t words;
+    uint64_t **reach;   // per component; NULL when it includes nothing
+} IncludeReach;
+
+static void build_include_reach(const IncludeGraph *graph, const ReferenceArray *references, IncludeReach *ir) {
+    int n = graph->file_count;
+    // Bits are only needed for files that are actually #include'd.
+    int *bit_of = (int *)malloc((n + 1) * sizeof(int));
+    int *scc = (int *)malloc((n + 1) * sizeof(int));
+    if (!bit_of || !scc) pj_out_of_memory();
+    for (int i = 0; i < n; i++) bit_of[i] = -1;
+    int bit_count = 0;
+    for (int e = 0; e < graph->edge_count; e++) {
+        int t = graph->edge_targets[e];
+        if (references->items[graph->edge_refs[e]].kind == REF_INCLUDE && bit_of[t] < 0) bit_of[t] = bit_count++;
+    }
+    int scc_count = include_sccs(graph, references, true, scc);
+    int *scc_start, *members;
+    group_components(n, scc, scc_count, &scc_start, &members);
+
+    // reach[c]: bits of every included file reachable from component c.
+    // Components come out of Tarjan in reverse topological order, so each
+    // successor is complete before it is OR'ed in. Members of a cycle reach
+    // each other through their own edges within the component.
+    size_t words = ((size_t)bit_count + 63) / 64;
+    uint64_t **reach = (uint64_t **)calloc(scc_count + 1, sizeof(uint64_t *));
+    if (!reach) pj_out_of_memory();
+    for (int c = 0; c < scc_count; c++) {
+        for (int m = scc_start[c]; m < scc_start[c + 1]; m++) {
+            int v = members[m];
+            for (int e = graph->edge_offsets[v]; e < graph->edge_offsets[v + 1]; e++) {
+                if (references->items[graph->edge_refs[e]].kind != REF_INCLUDE) continue;
+                int w = graph->edge_targets[e];
+                if (!reach[c]) {
+                    reach[c] = (uint64_t *)calloc(words ? words : 1, sizeof(uint64_t));
+                    if (!reach[c]) pj_out_of_memory();
+                }
+                reach[c][bit_of[w] / 64] |= 1ULL << (bit_of[w] % 64);
+                if (scc[w] != c && reach[scc[w]]) {
+                    for (size_t k = 0; k < words; k++) reach[c][k] |= reach[scc[w]][k];
+                }
+            }
+        }
+    }
+    free(scc_start);
+    free(members);
+    ir->bit_of = bit_of;
+    ir->scc = scc;
+    ir->scc_count = scc_count;
+    ir->words = words;
+    ir->reach = reach;
+}
+
+// Whether `from` reaches the file `to` through #include edges.
+static bool include_reaches(const IncludeReach *ir, int from, int to) {
+    const uint64_t *reach = ir->reach[ir->scc[from]];
+    int bit = ir->bit_of[to];
+    return reach && bit >= 0 && (reach[bit / 64] & (1ULL << (bit % 64)));
+}
+
+static void free_include_reach(IncludeReach *ir) {
+    for (int c = 0; c < ir->scc_count; c++) free(ir->reach[c]);
+    free(ir->reach);
+    free(ir->bit_of);
+    free(ir->scc);
+    memset(ir, 0, sizeof(*ir));
+}
+
+static void report_redundant_includes(const IncludeGraph *graph, const ReferenceArray *references, FILE *out) {
+    int n = graph->file_count;
+    fprintf(out, "\n=== Redundant Includes ===\n");
+    IncludeReach ir;
+    build_include_reach(graph, references, &ir);
+
+    // Per file: duplicates first, then includes implied by a sibling include.
+    StringArray findings;
+    init_string_array(&findings);
+    int duplicates = 0, implied = 0;
+    int *seen_in = (int *)malloc((n + 1) * sizeof(int));
+    int *seen_line = (int *)malloc((n + 1) * sizeof(int));
+    int *distinct = (int *)malloc((graph->edge_count + 1) * sizeof(int));
+    if (!seen_in || !seen_line || !distinct) pj_out_of_memory();
+    for (int i = 0; i < n; i++) seen_in[i] = -1;
+    char finding[MAX_PATH_LEN * 2];
+    for (int f = 0; f < n; f++) {
+        int k = 0;
+        for (int e = graph->edge_offsets[f]; e < graph->edge_offsets[f + 1]; e++) {
+            const Reference *ref = &references->items[graph->edge_refs[e]];
+            if (ref->kind != REF_INCLUDE) continue;
+            int t = graph->edge_targets[e];
+            if (seen_in[t] == f) {
+                snprintf(finding, sizeof(finding), "- %s:%d: #include \"%s\" duplicates line %d", graph->paths[f], ref->line, ref->name, seen_line[t]);
+                add_to_string_array(&findings, finding);
+                duplicates++;
+                continue;
+            }
+            seen_in[t] = f;
+            seen_line[t] = ref->line;
+            distinct[k++] = e;
+        }
+        for (int i = 0; i < k; i++) {
+            int t = graph->edge_targets[distinct[i]];
+            const Reference *ref_t = &references->items[graph->edge_refs[distinct[i]]];
+            for (int j = 0; j < k; j++) {
+                if (i == j) continue;
+                int u = graph->edge_targets[distinct[j]];
+                if (!include_reaches(&ir, u, t)) continue;
+                // Mutually including headers: keep the first, flag the later one.
+                const Reference *ref_u = &references->items[graph->edge_refs[distinct[j]]];
+                if (include_reaches(&ir, t, u) && ref_u->line > ref_t->line) continue;
+                snprintf(finding, sizeof(finding), "- %s:%d: #include \"%s\" already provided by \"%s\" (line %d)", graph->paths[f], ref_t->line, ref_t->name, ref_u->name, ref_u->line);
+                add_to_string_array(&findings, finding);
+                implied++;
+                break;
+            }
+        }
+    }
+
+    fprintf(out, "Redundant #include lines: %d (duplicates: %d, transitively implied: %d)\n", duplicates + implied, duplicates, implied);
+    if (findings.count == 0) fprintf(out, "(None)\n");
+    for (int i = 0; i < findings.count; i++) fprintf(out, "%s\n", findings.items[i]);
+
+    free_string_array(&findings);
+    free_include_reach(&ir);
+    free(seen_in);
+    free(seen_line);
+    free(distinct);
+}
+
+// --- Unused Include Detection ---
+//
+// One pass over the C sources and headers, shared by --jobs threads: each
+// file is tokenized once into the names it declares, if it is a header
+// (functions, variables, typedef names, tags, enumerators, macros), and the
+// identifiers it uses. The declarations form one project-wide table, name ->
+// declaring headers, and an #include is used when the includer uses a name
+// declared by the header or by anything the header includes. Conditional
+// compilation is ignored, so a name counts wherever it appears.
+//
+// Workers neither log nor unwind: they record errno (ENOMEM included) and the
+// calling thread reports it afterwards.
+
+#define TOKEN_BATCH 64
+
+// Distinct identifiers, NUL-separated in `text`; slots hold offset + 1.
+typedef struct {
+    char *text;
+    size_t len;
+    size_t capacity;
+    uint32_t *slots;
+    int slot_count;
+    int count;
+    bool failed;
+} NameSet;
+
+// Returns whether the name was new.
+static bool name_set_add(NameSet *set, const char *name) {
+    if (set->failed) return false;
+    if ((set->count + 1) * 2 > set->slot_count) {
+        int slot_count = set->slot_count ? set->slot_count * 2 : 64;
+        uint32_t *slots = (uint32_t *)calloc(slot_count, sizeof(uint32_t));
+        if (!slots) {
+            set->failed = true;
+            return false;
+        }
+        for (int i = 0; i < set->slot_count; i++) {
+            if (!set->slots[i]) continue;
+            unsigned int j = hash(set->text + set->slots[i] - 1, slot_count);
+            while (slots[j]) j = (j + 1) & (slot_count - 1);
+            slots[j] = set->slots[i];
+        }
+        free(set->slots);
+        set->slots = slots;
+        set->slot_count = slot_count;
+    }
+    unsigned int i = hash(name, set->slot_count);
+    while (set->slots[i]) {
+        if (strcmp(set->text + set->slots[i] - 1, name) == 0) return false;
+        i = (i + 1) & (set->slot_count - 1);
+    }
+    size_t n = strlen(name) + 1;
+    if (set->len + n > set->capacity) {
+        size_t capacity = set->capacity ? set->capacity * 2 : 1024;
+        while (capacity < set->len + n) capacity *= 2;
+        char *text = (char *)realloc(set->text, capacity);
+        if (!text) {
+            set->failed = true;
+            return false;
+        }
+        set->text = text;
+        set->capacity = capacity;
+    }
+    memcpy(set->text + set->len, name, n);
+    set->slots[i] = (uint32_t)set->len + 1;
+    set->len += n;
+    set->count++;
+    return true;
+}
+
+static void free_name_set(NameSet *set) {
+    free(set->text);
+    free(set->slots);
+    memset(set, 0, sizeof(*set));
+}
+
+// What one file declares and uses.
+typedef struct {
+    NameSet decls;          // headers only
+    NameSet uses;
+    int macros;             // decls that are macro names
+    int error;              // errno of a failed read, else 0
+} FileTokens;
+
+// File-scope declaration state of a header, fed the tokens outside directives.
+typedef struct {
+    int depth;              // brace depth; 0 = file scope
+    int paren;              // within the current statement, or the enum body
+    int bracket;
+    int body_kind;          // what the outermost open brace belongs to
+    bool in_initializer;
+    bool is_extern;
+    bool extern_string;
+    bool has_params;
+    bool expect_tag;        // after struct/union/enum
+    bool is_enum;
+    bool expect_enumerator;
+    char tag[128];          // declared if a '{' or a lone ';' follows
+    char last_ident[128];
+    char func_name[128];
+    char paren_ident[128];  // a parenthesized declarator: (*name)
+} DeclScanner;
+
+static void reset_decl_statement(DeclScanner *sc) {
+    sc->paren = 0;
+    sc->bracket = 0;
+    sc->in_initializer = false;
+    sc->is_extern = false;
+    sc->extern_string = false;
+    sc->has_params = false;
+    sc->expect_tag = false;
+    sc->is_enum = false;
+    sc->tag[0] = '\0';
+    sc->last_ident[0] = '\0';
+    sc->func_name[0] = '\0';
+    sc->paren_ident[0] = '\0';
+}
+
+static void end_decl_declarator(DeclScanner *sc, NameSet *decls) {
+    const char *name = sc->func_name[0] ? sc->func_name : sc->last_ident[0] ? sc->last_ident : sc->paren_ident;
+    if (name[0]) name_set_add(decls, name);
+    sc->last_ident[0] = '\0';
+    sc->paren_ident[0] = '\0';
+}
+
+static void decl_identifier(DeclScanner *sc, NameSet *decls, const char *word) {
+    if (sc->depth > 0) {
+        if (sc->body_kind == BODY_ENUM && sc->depth == 1 && sc->expect_enumerator) {
+            name_set_add(decls, word);
+            sc->expect_enumerator = false;
+        }
+        return;
+    }
+    if (sc->in_initializer || sc->bracket > 0) return;
+    if (sc->paren > 0) {
+        if (sc->paren == 1 && !sc->func_name[0] && !sc->paren_ident[0] && !is_c_keyword(word)) {
+            snprintf(sc->paren_ident, sizeof(sc->paren_ident), "%s", word);
+        }
+        return;
+    }
+    // __attribute__, __declspec, __extension__ and the like name nothing.
+    if (word[0] == '_' && word[1] == '_') return;
+    sc->tag[0] = '\0';
+    if (strcmp(word, "extern") == 0) {
+        sc->is_extern = true;
+    } else if (strcmp(word, "struct") == 0 || strcmp(word, "union") == 0 || strcmp(word, "enum") == 0) {
+        sc->expect_tag = true;
+        sc->is_enum = word[0] == 'e';
+    } else if (sc->expect_tag) {
+        sc->expect_tag = false;
+        snprintf(sc->tag, sizeof(sc->tag), "%s", word);
+    } else if (!is_c_keyword(word)) {
+        snprintf(sc->last_ident, sizeof(sc->last_ident), "%s", word);
+    }
+}
+
+// `next` is the next non-blank character, to tell (*name) from a parameter list.
+static void decl_punct(DeclScanner *sc, NameSet *decls, char c, char next) {
+    if (sc->depth > 0) {
+        if (c == '{') {
+            sc->depth++;
+        } else if (c == '}') {
+            if (--sc->depth > 0) return;
+            if (sc->body_kind == BODY_FUNCTION) reset_decl_statement(sc);
+            else sc->last_ident[0] = '\0';
+            sc->paren = 0;
+            sc->body_kind = BODY_NONE;
+        } else if (sc->body_kind == BODY_ENUM && sc->depth == 1) {
+            if (c == '(') sc->paren++;
+            else if (c == ')' && sc->paren > 0) sc->paren--;
+            else if (c == ',' && sc->paren == 0) sc->expect_enumerator = true;
+        }
+        return;
+    }
+    switch (c) {
+        case '(':
+            if (sc->paren++ == 0 && !sc->in_initializer && !sc->func_name[0] && sc->last_ident[0] && next != '*') {
+                snprintf(sc->func_name, sizeof(sc->func_name), "%s", sc->last_ident);
+                sc->has_params = true;
+            }
+            break;
+        case ')':
+            if (sc->paren > 0) sc->paren--;
+            break;
+        case '[':
+            sc->bracket++;
+            break;
+        case ']':
+            if (sc->bracket > 0) sc->bracket--;
+            break;
+        case '{':
+            if (sc->paren > 0) break;
+            if (sc->is_extern && sc->extern_string) {
+                reset_decl_statement(sc);  // extern "C" { ... }
+                break;
+            }
+            if (sc->in_initializer) {
+                sc->body_kind = BODY_INITIALIZER;
+            } else if (sc->has_params) {
+                name_set_add(decls, sc->func_name);
+                sc->body_kind = BODY_FUNCTION;
+            } else {
+                if (sc->tag[0]) name_set_add(decls, sc->tag);
+                sc->body_kind = sc->is_enum ? BODY_ENUM : BODY_AGGREGATE;
+                sc->expect_enumerator = true;
+                sc->expect_tag = false;
+                sc->tag[0] = '\0';
+            }
+            sc->depth = 1;
+            break;
+        case '}':
+            reset_decl_statement(sc);  // end of an extern "C" block
+            break;
+        case '=':
+            if (sc->paren > 0 || sc->in_initializer) break;
+            end_decl_declarator(sc, decls);
+            sc->in_initializer = true;
+            break;
+        case ',':
+            if (sc->paren > 0) break;
+            if (!sc->in_initializer) end_decl_declarator(sc, decls);
+            sc->in_initializer = false;
+            sc->has_params = false;
+            sc->func_name[0] = '\0';
+            break;
+        case ';':
+            if (sc->paren > 0) break;
+            if (sc->tag[0]) name_set_add(decls, sc->tag);  // struct name;
+            else if (!sc->in_initializer) end_decl_declarator(sc, decls);
+            reset_decl_statement(sc);
+            break;
+        default:
+            break;
+    }
+}
+
+static const char *skip_blanks(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\f' || *p == '\v')) p++;
+    return p;
+}
+
+static const char *read_word(const char *p, const char *end, char *word, size_t size) {
+    size_t n = 0;
+    while (p < end && (isalnum((unsigned char)*p) || *p == '_')) {
+        if (n + 1 < size) word[n++] = *p;
+        p++;
+    }
+    word[n] = '\0';
+    return p;
+}
+
+static void tokenize_for_includes(const char *data, size_t len, bool is_header, FileTokens *ft) {
+    DeclScanner sc;
+    memset(&sc, 0, sizeof(sc));
+    const char *p = data, *end = data + len;
+    bool line_start = true, in_directive = false;
+    char word[128];
+    while (p < end) {
+        char c = *p;
+        if (c == '\n') {
+            const char *q = p;
+            while (q > data && q[-1] == '\r') q--;
+            if (!(q > data && q[-1] == '\\')) in_directive = false;
+            line_start = true;
+            p++;
+            continue;
+        }
+        if (isspace((unsigned char)c)) {
+            p++;
+            continue;
+        }
+        if (c == '/' && p + 1 < end && p[1] == '/') {
+            while (p < end && *p != '\n') p++;
+            continue;
+        }
+        if (c == '/' && p + 1 < end && p[1] == '*') {
+            p += 2;
+            while (p + 1 < end && !(p[0] == '*' && p[1] == '/')) p++;
+            p = p + 1 < end ? p + 2 : end;
+            continue;
+        }
+        bool at_line_start = line_start;
+        line_start = false;
+        if (c == '#' && at_line_start && !in_directive) {
+            p = read_word(skip_blanks(p + 1, end), end, word, sizeof(word));
+            if (strcmp(word, "include") == 0 || strcmp(word, "import") == 0) {
+                while (p < end && *p != '\n') p++;
+                continue;
+            }
+            in_directive = true;
+            if (strcmp(word, "define") == 0) {
+                p = read_word(skip_blanks(p, end), end, word, sizeof(word));
+                if (is_header && word[0] && name_set_add(&ft->decls, word)) ft->macros++;
+            }
+            continue;
+        }
+        if (c == '"' || c == '\'') {
+            p++;
+            while (p < end && *p != c && *p != '\n') {
+                if (*p == '\\' && p + 1 < end) p++;
+                p++;
+            }
+            if (p < end && *p == c) p++;
+            if (c == '"' && is_header && !in_directive && sc.is_extern && sc.depth == 0) sc.extern_string = true;
+            continue;
+        }
+        if (isalpha((unsigned char)c) || c == '_') {
+            p = read_word(p, end, word, sizeof(word));
+            if (!is_c_keyword(word)) name_set_add(&ft->uses, word);
+            if (is_header && !in_directive) decl_identifier(&sc, &ft->decls, word);
+            continue;
+        }
+        if (isdigit((unsigned char)c)) {
+            while (p < end && (isalnum((unsigned char)*p) || *p == '.' || *p == '_')) p++;
+            continue;
+        }
+        p++;
+        if (is_header && !in_directive) {
+            const char *q = p;
+            while (q < end && isspace((unsigned char)*q)) q++;
+            decl_punct(&sc, &ft->decls, c, q < end ? *q : '\0');
+        }
+    }
+}
+
+typedef struct {
+    const IncludeGraph *graph;
+    const FileTable *files;
+    const int *nodes;       // the C sources and headers
+    int count;
+    FileTokens *tokens;     // per node
+    pthread_mutex_t lock;
+    int next;
+} TokenPass;
+
+static void *token_worker(void *arg) {
+    TokenPass *pass = (TokenPass *)arg;
+    for (;;) {
+        pthread_mutex_lock(&pass->lock);
+        int begin = pass->next;
+        if (begin < pass->count) pass->next += TOKEN_BATCH;
+        pthread_mutex_unlock(&pass->lock);
+        if (begin >= pass->count) break;
+        int end = begin + TOKEN_BATCH < pass->count ? begin + TOKEN_BATCH : pass->count;
+        for (int i = begin; i < end; i++) {
+            int node = pass->nodes[i];
+            int file = pass->graph->file_ids[node];
+            FileTokens *ft = &pass->tokens[node];
+            char *data = NULL;
+            size_t len = 0;
+            ft->error = read_whole_file(pass->files->paths[file], pass->files->sizes[file], &data, &len);
+            if (ft->error) continue;
+            tokenize_for_includes(data, len, pass->files->types[file] == PJ_TYPE_H, ft);
+            free(data);
+            if (ft->decls.failed || ft->uses.failed) ft->error = ENOMEM;
+            // Only the text is needed from here on.
+            free(ft->decls.slots);
+            free(ft->uses.slots);
+            ft->decls.slots = ft->uses.slots = NULL;
+        }
+    }
+    return NULL;
+}
+
+static void free_file_tokens(FileTokens *tokens, int count) {
+    for (int i = 0; i < count; i++) {
+        free_name_set(&tokens[i].decls);
+        free_name_set(&tokens[i].uses);
+    }
+    free(tokens);
+}
+
+static void report_unused_includes(ProjanitorContext *ctx, FILE *out) {
+    const IncludeGraph *graph = &ctx->graph;
+    const FileTable *files = &ctx->files;
+    const ReferenceArray *references = &ctx->references;
+    int n = graph->file_count;
+    fprintf(out, "\n=== Unused Includes ===\n");
+
+    TokenPass pass;
+    memset(&pass, 0, sizeof(pass));
+    pass.graph = graph;
+    pass.files = files;
+    int *nodes = (int *)malloc((n + 1) * sizeof(int));
+    pass.tokens = (FileTokens *)calloc(n + 1, sizeof(FileTokens));
+    if (!nodes || !pass.tokens) pj_out_of_memory();
+    for (int v = 0; v < n; v++) {
+        uint8_t type = files->types[graph->file_ids[v]];
+        if (type == PJ_TYPE_C || type == PJ_TYPE_H) nodes[pass.count++] = v;
+    }
+    pass.nodes = nodes;
+    int threads = (pass.count + TOKEN_BATCH - 1) / TOKEN_BATCH;
+    if (threads > ctx->jobs) threads = ctx->jobs;
+    pthread_t *workers = (pthread_t *)malloc((threads + 1) * sizeof(pthread_t));
+    if (!workers) pj_out_of_memory();
+    pthread_mutex_init(&pass.lock, NULL);
+    int started = start_workers(workers, threads - 1, token_worker, &pass);
+    token_worker(&pass);
+    join_workers(workers, started);
+    pthread_mutex_destroy(&pass.lock);
+    free(workers);
+
+    int unreadable = 0, headers = 0, decl_count = 0;
+    bool out_of_memory = false;
+    for (int i = 0; i < pass.count; i++) {
+        int v = nodes[i];
+        const FileTokens *ft = &pass.tokens[v];
+        if (ft->error == ENOMEM) {
+            out_of_memory = true;
+        } else if (ft->error) {
+            unreadable++;
+            if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "Could not open file %s: %s", graph->paths[v], strerror(ft->error));
+        } else if (files->types[graph->file_ids[v]] == PJ_TYPE_H) {
+            headers++;
+            decl_count += ft->decls.count;
+        }
+    }
+    if (out_of_memory) {
+        free_file_tokens(pass.tokens, n);
+        free(nodes);
+        pj_out_of_memory();
+    }
+
+    // The declaration table: name -> symbol id -> declaring headers (CSR).
+    IdMap names;
+    init_id_map(&names, decl_count);
+    int *pair_symbol = (int *)malloc((decl_count + 1) * sizeof(int));
+    int *pair_node = (int *)malloc((decl_count + 1) * sizeof(int));
+    if (!pair_symbol || !pair_node) pj_out_of_memory();
+    int symbol_count = 0, pairs = 0;
+    for (int i = 0; i < pass.count; i++) {
+        int v = nodes[i];
+        const FileTokens *ft = &pass.tokens[v];
+        const char *name = ft->decls.text;
+        for (int k = 0; k < ft->decls.count; k++, name += strlen(name) + 1) {
+            int symbol = id_map_get(&names, name);
+            if (symbol < 0) id_map_put(&names, name, symbol = symbol_count++);
+            pair_symbol[pairs] = symbol;
+            pair_node[pairs++] = v;
+        }
+    }
+    int *decl_offsets = (int *)calloc(symbol_count + 2, sizeof(int));
+    int *decl_nodes = (int *)malloc((pairs + 1) * sizeof(int));
+    if (!decl_offsets || !decl_nodes) pj_out_of_memory();
+    for (int k = 0; k < pairs; k++) decl_offsets[pair_symbol[k] + 2]++;
+    for (int s = 0; s < symbol_count; s++) decl_offsets[s + 2] += decl_offsets[s + 1];
+    for (int k = 0; k < pairs; k++) decl_nodes[decl_offsets[pair_symbol[k] + 1]++] = pair_node[k];
+    free(pair_symbol);
+    free(pair_node);
+
+    IncludeReach ir;
+    build_include_reach(graph, references, &ir);
+
+    // Per includer: its distinct includes of readable headers, each marked
+    // used once some name the includer uses is declared within its reach.
+    StringArray findings;
+    init_string_array(&findings);
+    int *seen_in = (int *)malloc((n + 1) * sizeof(int));
+    int *pending = (int *)malloc((graph->edge_count + 1) * sizeof(int));
+    bool *used = (bool *)malloc((graph->edge_count + 1) * sizeof(bool));
+    if (!seen_in || !pending || !used) pj_out_of_memory();
+    for (int v = 0; v < n; v++) seen_in[v] = -1;
+    int checked = 0, reexporters = 0;
+    char finding[MAX_PATH_LEN * 2];
+    for (int i = 0; i < pass.count; i++) {
+        int f = nodes[i];
+        const FileTokens *ft = &pass.tokens[f];
+        if (ft->error) continue;
+        int k = 0;
+        for (int e = graph->edge_offsets[f]; e < graph->edge_offsets[f + 1]; e++) {
+            int t = graph->edge_targets[e];
+            if (references->items[graph->edge_refs[e]].kind != REF_INCLUDE) continue;
+            if (files->types[graph->file_ids[t]] != PJ_TYPE_H || pass.tokens[t].error || seen_in[t] == f) continue;
+            seen_in[t] = f;
+            pending[k] = e;
+            used[k++] = false;
+        }
+        if (k == 0) continue;
+        // A header declaring nothing but its guard only passes its includes on.
+        if (files->types[graph->file_ids[f]] == PJ_TYPE_H && ft->decls.count == ft->macros && ft->macros <= 1) {
+            reexporters++;
+            continue;
+        }
+        checked += k;
+        int left = k;
+        const char *name = ft->uses.text;
+        for (int u = 0; u < ft->uses.count && left > 0; u++, name += strlen(name) + 1) {
+            int symbol = id_map_get(&names, name);
+            if (symbol < 0) continue;
+            for (int d = decl_offsets[symbol]; d < decl_offsets[symbol + 1] && left > 0; d++) {
+                int declarer = decl_nodes[d];
+                for (int j = 0; j < k; j++) {
+                    if (used[j]) continue;
+                    int t = graph->edge_targets[pending[j]];
+                    if (t == declarer || include_reaches(&ir, t, declarer)) {
+                        used[j] = true;
+                        left--;
+                    }
+                }
+            }
+        }
+        for (int j = 0; j < k; j++) {
+            if (used[j]) continue;
+            const Reference *ref = &references->items[graph->edge_refs[pending[j]]];
+            snprintf(finding, sizeof(finding), "- %s:%d: #include \"%s\" is unused: nothing it declares, or its includes declare, is used here",
+                     graph->paths[f], ref->line, ref->name);
+            add_to_string_array(&findings, finding);
+        }
+    }
+
+    fprintf(out, "Headers indexed: %d (%d distinct names declared); #include lines checked: %d, unused: %d\n",
+            headers, symbol_count, checked, findings.count);
+    if (reexporters > 0) fprintf(out, "Skipped %d header(s) that only pass their includes on\n", reexporters);
+    if (unreadable > 0) fprintf(out, "Skipped %d unreadable file(s)\n", unreadable);
+    if (findings.count == 0) fprintf(out, "(None)\n");
+    for (int i = 0; i < findings.count; i++) fprintf(out, "%s\n", findings.items[i]);
+
+    free_string_array(&findings);
+    free_include_reach(&ir);
+    free(seen_in);
+    free(pending);
+    free(used);
+    free(decl_offsets);
+    free(decl_nodes);
+    free_id_map(&names);
+    free_file_tokens(pass.tokens, n);
+    free(nodes);
+}
+
+// --- Include Guard Report ---
+
+typedef struct {
+    int id;
+    long long repeats;
+    long long relex_bytes;
+} GuardCost;
+
+static int compare_guard_costs(const void *a, const void *b) {
+    const GuardCost *c1 = (const GuardCost *)a;
+    const GuardCost *c2 = (const GuardCost *)b;
+    if (c1->relex_bytes != c2->relex_bytes) return c1->relex_bytes < c2->relex_bytes ? 1 : -1;
+    return c1->id - c2->id;
+}
+
+static void report_include_guards(const IncludeGraph *graph, const ReferenceArray *references, const FileTable *files, FILE *out) {
+    int n = graph->file_count;
+    int *included = (int *)calloc(n + 1, sizeof(int));
+    long long *repeats = (long long *)calloc(n + 1, sizeof(long long));
+    int *visited = (int *)malloc((n + 1) * sizeof(int));
+    int *hit_stamp = (int *)malloc((n + 1) * sizeof(int));
+    int *hits = (int *)malloc((n + 1) * sizeof(int));
+    int *queue = (int *)malloc((n + 1) * sizeof(int));
+    int *touched = (int *)malloc((n + 1) * sizeof(int));
+    if (!included || !repeats || !visited || !hit_stamp || !hits || !queue || !touched) pj_out_of_memory();
+
+    int kind_counts[GUARD_NONE + 1] = {0};
+    for (int i = 0; i < files->count; i++) kind_counts[files->guards[i]]++;
+    for (int e = 0; e < graph->edge_count; e++) {
+        if (references->items[graph->edge_refs[e]].kind == REF_INCLUDE) included[graph->edge_targets[e]]++;
+    }
+
+    // Per TU: every include edge into an unprotected header from a file in the
+    // TU's include closure lexes that header again. Guarded intermediates are
+    // entered once per TU, so this counts repeats for the common case and is a
+    // lower bound when unprotected headers include each other.
+    for (int v = 0; v < n; v++) {
+        visited[v] = -1;
+        hit_stamp[v] = -1;
+    }
+    for (int tu = 0; tu < n; tu++) {
+        if (!ends_with(graph->paths[tu], ".c")) continue;
+        int head = 0, tail = 0, touched_count = 0;
+        queue[tail++] = tu;
+        visited[tu] = tu;
+        while (head < tail) {
+            int v = queue[head++];
+            for (int e = graph->edge_offsets[v]; e < graph->edge_offsets[v + 1]; e++) {
+                if (references->items[graph->edge_refs[e]].kind != REF_INCLUDE) continue;
+                int w = graph->edge_targets[e];
+                GuardKind kind = (GuardKind)files->guards[graph->file_ids[w]];
+                if (kind == GUARD_NONE || kind == GUARD_BROKEN) {
+                    if (hit_stamp[w] != tu) {
+                        hit_stamp[w] = tu;
+                        hits[w] = 0;
+                        touched[touched_count++] = w;
+                    }
+                    hits[w]++;
+                }
+                if (visited[w] != tu) {
+                    visited[w] = tu;
+                    queue[tail++] = w;
+                }
+            }
+        }
+        for (int i = 0; i < touched_count; i++) {
+            if (hits[touched[i]] > 1) repeats[touched[i]] += hits[touched[i]] - 1;
+        }
+    }
+
+    GuardCost *costs = (GuardCost *)malloc((n + 1) * sizeof(GuardCost));
+    if (!costs) pj_out_of_memory();
+    int cost_count = 0;
+    long long total_relex = 0;
+    for (int v = 0; v < n; v++) {
+        int file = graph->file_ids[v];
+        if (files->guards[file] != GUARD_NONE && files->guards[file] != GUARD_BROKEN) continue;
+        costs[cost_count].id = v;
+        costs[cost_count].repeats = repeats[v];
+        costs[cost_count].relex_bytes = repeats[v] * files->sizes[file];
+        total_relex += costs[cost_count].relex_bytes;
+        cost_count++;
+    }
+    qsort(costs, cost_count, sizeof(GuardCost), compare_guard_costs);
+
+    int headers = kind_counts[GUARD_PRAGMA_ONCE] + kind_counts[GUARD_MACRO] + kind_counts[GUARD_BROKEN] + kind_counts[GUARD_NONE];
+    fprintf(out, "\n=== Include Guards ===\n");
+    fprintf(out, "Headers: %d (#pragma once: %d, guard macro: %d, broken guard: %d, none: %d)\n",
+           headers, kind_counts[GUARD_PRAGMA_ONCE], kind_counts[GUARD_MACRO], kind_counts[GUARD_BROKEN], kind_counts[GUARD_NONE]);
+    fprintf(out, "Estimated bytes re-lexed by repeated inclusion: %lld\n", total_relex);
+    fprintf(out, "Unprotected headers (re-lexed bytes, repeat inclusions across TUs, direct includes, size):\n");
+    if (cost_count == 0) fprintf(out, "  (None)\n");
+    for (int i = 0; i < cost_count; i++) {
+        int file = graph->file_ids[costs[i].id];
+        fprintf(out, "  %10lld %6lld %6d %8lld  %s", costs[i].relex_bytes, costs[i].repeats, included[costs[i].id], (long long)files->sizes[file], files->paths[file]);
+        if (files->guards[file] == GUARD_BROKEN) fprintf(out, "  [broken: %s]\n", files->guard_issues[file] ? files->guard_issues[file] : "unrecognized guard");
+        else fprintf(out, "  [no guard]\n");
+    }
+
+    free(costs);
+    free(included);
+    free(repeats);
+    free(visited);
+    free(hit_stamp);
+    free(hits);
+    free(queue);
+    free(touched);
+}
+
+// --- Layering Rules ---
+//
+// Rules file format (one directive per line, '#' starts a comment):
+//   layer <name> <dir> [<dir> ...]   directories relative to the project root
+//   allow <from> -> <to> [<to> ...]  '*' matches every layer
+// Files under no layer are unconstrained; a layer may always use itself.
+
+typedef struct {
+    StringArray names;
+    StringArray dirs;        // one entry per directory prefix
+    int *dir_layer;          // layer id of dirs.items[i]
+    int dir_capacity;
+    uint64_t *allowed;       // allowed[from * words + to / 64] bit (to % 64)
+    int words;
+} LayerRules;
+
+static int find_layer(const LayerRules *rules, const char *name) {
+    for (int i = 0; i < rules->names.count; i++) {
+        if (strcmp(rules->names.items[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+static void free_layer_rules(LayerRules *rules) {
+    free_string_array(&rules->names);
+    free_string_array(&rules->dirs);
+    free(rules->dir_layer);
+    free(rules->allowed);
+    memset(rules, 0, sizeof(*rules));
+}
+
+static void allow_layers(LayerRules *rules, int from, int to) {
+    for (int f = 0; f < rules->names.count; f++) {
+        if (from >= 0 && f != from) continue;
+        for (int t = 0; t < rules->names.count; t++) {
+            if (to >= 0 && t != to) continue;
+            rules->allowed[(size_t)f * rules->words + t / 64] |= 1ULL << (t % 64);
+        }
+    }
+}
+
+// Any malformed directive rejects the whole file: a partial rule set would
+// pass includes the author meant to forbid.
+static pj_status load_layer_rules(ProjanitorContext *ctx, const char *rules_path, LayerRules *rules) {
+    memset(rules, 0, sizeof(*rules));
+    init_string_array(&rules->names);
+    init_string_array(&rules->dirs);
+    FILE *file = fopen(rules_path, "r");
+    if (!file) return fail(ctx, PJ_ERR_IO, "Cannot open layer rules %s: %s", rules_path, strerror(errno));
+    pj_status status = PJ_OK;
+
+    // Two passes: layers first so allow lines may reference later layers.
+    char line[MAX_LINE_LEN];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_no++;
+        char *hash_pos = strchr(line, '#');
+        if (hash_pos) *hash_pos = '\0';
+        char *saveptr;
+        char *word = strtok_r(line, " \t\r\n", &saveptr);
+        if (!word || strcmp(word, "layer") != 0) continue;
+        char *name = strtok_r(NULL, " \t\r\n", &saveptr);
+        if (!name) {
+            status = fail(ctx, PJ_ERR_INVALID, "%s:%d: layer without a name", rules_path, line_no);
+            break;
+        }
+        int id = find_layer(rules, name);
+        if (id < 0) {
+            id = rules->names.count;
+            add_to_string_array(&rules->names, name);
+        }
+        for (char *dir = strtok_r(NULL, " \t\r\n", &saveptr); dir; dir = strtok_r(NULL, " \t\r\n", &saveptr)) {
+            size_t len = strlen(dir);
+            while (len > 1 && dir[len - 1] == '/') dir[--len] = '\0';
+            if (strncmp(dir, "./", 2) == 0) dir += 2;
+            if (rules->dirs.count >= rules->dir_capacity) {
+                rules->dir_capacity = rules->dir_capacity ? rules->dir_capacity * 2 : INITIAL_ARRAY_CAPACITY;
+                int *grown = (int *)realloc(rules->dir_layer, rules->dir_capacity * sizeof(int));
+                if (!grown) pj_out_of_memory();
+                rules->dir_layer = grown;
+            }
+            rules->dir_layer[rules->dirs.count] = id;
+            add_to_string_array(&rules->dirs, dir);
+        }
+    }
+
+    rules->words = (rules->names.count + 63) / 64;
+    rules->allowed = (uint64_t *)calloc((size_t)rules->names.count * rules->words + 1, sizeof(uint64_t));
+    if (!rules->allowed) pj_out_of_memory();
+    for (int g = 0; g < rules->names.count; g++) allow_layers(rules, g, g);
+
+    rewind(file);
+    line_no = 0;
+    while (status == PJ_OK && fgets(line, sizeof(line), file)) {
+        line_no++;
+        char *hash_pos = strchr(line, '#');
+        if (hash_pos) *hash_pos = '\0';
+        char *saveptr;
+        char *word = strtok_r(line, " \t\r\n", &saveptr);
+        if (!word || strcmp(word, "layer") == 0) continue;
+        if (strcmp(word, "allow") != 0) {
+            status = fail(ctx, PJ_ERR_INVALID, "%s:%d: unknown directive '%s'", rules_path, line_no, word);
+            break;
+        }
+        char *from_name = strtok_r(NULL, " \t\r\n", &saveptr);
+        char *arrow = strtok_r(NULL, " \t\r\n", &saveptr);
+        if (!from_name || !arrow || strcmp(arrow, "->") != 0) {
+            status = fail(ctx, PJ_ERR_INVALID, "%s:%d: expected 'allow <from> -> <to>...'", rules_path, line_no);
+            break;
+        }
+        int from = strcmp(from_name, "*") == 0 ? -1 : find_layer(rules, from_name);
+        if (from == -1 && strcmp(from_name, "*") != 0) {
+            status = fail(ctx, PJ_ERR_INVALID, "%s:%d: unknown layer '%s'", rules_path, line_no, from_name);
+            break;
+        }
+        char *to_name = strtok_r(NULL, " \t\r\n,", &saveptr);
+        if (!to_name) {
+            status = fail(ctx, PJ_ERR_INVALID, "%s:%d: expected 'allow <from> -> <to>...'", rules_path, line_no);
+            break;
+        }
+        for (; to_name; to_name = strtok_r(NULL, " \t\r\n,", &saveptr)) {
+            int to = strcmp(to_name, "*") == 0 ? -1 : find_layer(rules, to_name);
+            if (to == -1 && strcmp(to_name, "*") != 0) {
+                status = fail(ctx, PJ_ERR_INVALID, "%s:%d: unknown layer '%s'", rules_path, line_no, to_name);
+                break;
+            }
+            allow_layers(rules, from, to);
+        }
+    }
+    if (status == PJ_OK && ferror(file)) status = fail(ctx, PJ_ERR_IO, "Cannot read layer rules %s", rules_path);
+    if (status == PJ_OK && rules->names.count == 0) status = fail(ctx, PJ_ERR_INVALID, "No layers defined in %s", rules_path);
+    fclose(file);
+    return status;
+}
+
+// Layer of a file: the longest directory prefix that contains it, or -1.
+static int layer_of_path(const LayerRules *rules, const char *root_path, const char *path) {
+    size_t root_len = strlen(root_path);
+    const char *rel = path;
+    if (strncmp(path, root_path, root_len) == 0 && path[root_len] == '/') rel = path + root_len + 1;
+    int best = -1;
+    size_t best_len = 0;
+    for (int i = 0; i < rules->dirs.count; i++) {
+        const char *dir = rules->dirs.items[i];
+        size_t len = strlen(dir);
+        if (strcmp(dir, ".") == 0) len = 0;
+        else if (strncmp(rel, dir, len) != 0 || rel[len] != '/') continue;
+        if (best < 0 || len > best_len) {
+            best = rules->dir_layer[i];
+            best_len = len;
+        }
+    }
+    return best;
+}
+
+// Stores the number of violating edges; fails on a missing or malformed rules file.
+static pj_status check_layering(ProjanitorContext *ctx, const IncludeGraph *graph, const ReferenceArray *references, const char *root_path, const char *rules_path, FILE *out, size_t *found) {
+    LayerRules rules;
+    pj_status status = load_layer_rules(ctx, rules_path, &rules);
+    if (status != PJ_OK) {
+        free_layer_rules(&rules);
+        return status;
+    }
+    fprintf(out, "\n=== Layering ===\n");
+
+    int n = graph->file_count;
+    int *group = (int *)malloc((n + 1) * sizeof(int));
+    if (!group) pj_out_of_memory();
+    int assigned = 0;
+    for (int v = 0; v < n; v++) {
+        group[v] = layer_of_path(&rules, root_path, graph->paths[v]);
+        if (group[v] >= 0) assigned++;
+    }
+
+    // One linear pass over the edges; each check is a single bit test.
+    int violations = 0, checked = 0;
+    for (int v = 0; v < n; v++) {
+        int from = group[v];
+        if (from < 0) continue;
+        const uint64_t *row = rules.allowed + (size_t)from * rules.words;
+        for (int e = graph->edge_offsets[v]; e < graph->edge_offsets[v + 1]; e++) {
+            const Reference *ref = &references->items[graph->edge_refs[e]];
+            if (ref->kind != REF_INCLUDE) continue;
+            int to = group[graph->edge_targets[e]];
+            if (to < 0) continue;
+            checked++;
+            if (row[to / 64] & (1ULL << (to % 64))) continue;
+            if (violations == 0) fprintf(out, "Violations:\n");
+            fprintf(out, "- %s:%d: #include \"%s\" (%s -> %s)\n", graph->paths[v], ref->line, ref->name, rules.names.items[from], rules.names.items[to]);
+            violations++;
+        }
+    }
+    fprintf(out, "Layers: %d, files assigned: %d, includes checked: %d, violations: %d\n", rules.names.count, assigned, checked, violations);
+    if (violations == 0) fprintf(out, "(None)\n");
+
+    free(group);
+    free_layer_rules(&rules);
+    *found = (size_t)violations;
+    return PJ_OK;
+}
+
+
+// --- Reachability ---
+//
+// Build roots are the CMake files (CMakeLists.txt, *.cmake): the edges of
+// their source lists (add_executable, add_library, ...) lead to sources and
+// the include edges of those lead to headers. A file no path from a root reaches is dead even when its name is referenced, e.g. a
+// header that only an unbuilt source includes. Dead C sources and headers are
+// grouped into clusters (connected over edges in either direction) so that a
+// dead subsystem is reported as one unit.
+
+static bool is_build_root(const char *path) {
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    return strcmp(base, "CMakeLists.txt") == 0 || ends_with(path, ".cmake");
+}
+
+// Whether a path lies in a test directory: a "test" or "tests" component.
+static bool is_test_path(const char *path) {
+    for (const char *p = path; (p = strstr(p, "test")) != NULL; p++) {
+        const char *end = p[4] == 's' ? p + 5 : p + 4;
+        if ((p == path || p[-1] == '/') && *end == '/') return true;
+    }
+    return false;
+}
+
+// Tests: C sources and CMake files in a test directory (Unity/CMock), C
+// sources named test_*.c, and Python files named test_*.py or *_test.py.
+static bool is_test_file(const char *path) {
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    if (ends_with(path, ".py")) return strncmp(base, "test_", 5) == 0 || ends_with(base, "_test.py");
+    if (ends_with(path, ".c")) return strncmp(base, "test_", 5) == 0 || is_test_path(path);
+    return is_build_root(path) && is_test_path(path);
+}
+
+// Reverse CSR: rev_sources[rev_offsets[v] .. rev_offsets[v + 1]) reference v.
+static void ensure_reverse_edges(IncludeGraph *graph) {
+    if (graph->rev_offsets) return;
+    int n = graph->file_count;
+    graph->rev_offsets = (int *)large_alloc((n + 1) * sizeof(int));
+    graph->rev_sources = (int *)large_alloc((graph->edge_count + 1) * sizeof(int));
+    int *fill = (int *)malloc((n + 1) * sizeof(int));
+    if (!fill) pj_out_of_memory();
+    for (int e = 0; e < graph->edge_count; e++) graph->rev_offsets[graph->edge_targets[e] + 1]++;
+    for (int v = 0; v < n; v++) graph->rev_offsets[v + 1] += graph->rev_offsets[v];
+    memcpy(fill, graph->rev_offsets, n * sizeof(int));
+    for (int v = 0; v < n; v++) {
+        for (int e = graph->edge_offsets[v]; e < graph->edge_offsets[v + 1]; e++) {
+            graph->rev_sources[fill[graph->edge_targets[e]]++] = v;
+        }
+    }
+    free(fill);
+}
+
+#define BIT_TEST(bits, i) (((bits)[(i) / 64] >> ((i) % 64)) & 1)
+#define BIT_SET(bits, i) ((bits)[(i) / 64] |= 1ULL << ((i) % 64))
+
+// Level-synchronous BFS from every build root; returns the number of roots.
+static int mark_reachable(const IncludeGraph *graph, uint64_t *reached) {
+    int n = graph->file_count;
+    int *frontier = (int *)malloc((n + 1) * sizeof(int));
+    int *next = (int *)malloc((n + 1) * sizeof(int));
+    if (!frontier || !next) pj_out_of_memory();
+    int frontier_count = 0;
+    for (int v = 0; v < n; v++) {
+        if (!is_build_root(graph->paths[v])) continue;
+        BIT_SET(reached, v);
+        frontier[frontier_count++] = v;
+    }
+    int roots = frontier_count;
+    while (frontier_count > 0) {
+        int next_count = 0;
+        for (int i = 0; i < frontier_count; i++) {
+            int v = frontier[i];
+            for (int e = graph->edge_offsets[v]; e < graph->edge_offsets[v + 1]; e++) {
+                int w = graph->edge_targets[e];
+                if (BIT_TEST(reached, w)) continue;
+                BIT_SET(reached, w);
+                next[next_count++] = w;
+            }
+        }
+        int *swap = frontier;
+        frontier = next;
+        next = swap;
+        frontier_count = next_count;
+    }
+    free(frontier);
+    free(next);
+    return roots;
+}
+
+typedef struct {
+    int start;      // into the member array
+    int count;
+    int edges;      // edges between members
+} DeadCluster;
+
+static int compare_ints(const void *a, const void *b) {
+    int i1 = *(const int *)a, i2 = *(const int *)b;
+    return i1 < i2 ? -1 : i1 > i2;
+}
+
+static int compare_dead_clusters(const void *a, const void *b) {
+    const DeadCluster *c1 = (const DeadCluster *)a;
+    const DeadCluster *c2 = (const DeadCluster *)b;
+    if (c1->count != c2->count) return c1->count < c2->count ? 1 : -1;
+    return c1->start - c2->start;
+}
+
+static void report_unreachable_files(ProjanitorContext *ctx, IncludeGraph *graph, FILE *out) {
+    int n = graph->file_count;
+    int words = n / 64 + 1;
+    uint64_t *reached = (uint64_t *)calloc(words, sizeof(uint64_t));
+    int *cluster_of = (int *)malloc((n + 1) * sizeof(int));
+    int *members = (int *)malloc((n + 1) * sizeof(int));
+    DeadCluster *clusters = (DeadCluster *)malloc((n + 1) * sizeof(DeadCluster));
+    if (!reached || !cluster_of || !members || !clusters) pj_out_of_memory();
+
+    fprintf(out, "\n=== Reachability ===\n");
+    int roots = mark_reachable(graph, reached);
+    if (roots == 0) {
+        fprintf(out, "(Skipped: no CMakeLists.txt or .cmake among the scanned files)\n");
+        free(reached);
+        free(cluster_of);
+        free(members);
+        free(clusters);
+        return;
+    }
+    ensure_reverse_edges(graph);
+
+    // Clusters: BFS over dead C sources and headers, following both directions.
+    // `members` doubles as the queue; each cluster is a contiguous run of it.
+    int reachable = 0, member_count = 0, cluster_count = 0;
+    for (int v = 0; v < n; v++) {
+        cluster_of[v] = -1;
+        if (BIT_TEST(reached, v)) reachable++;
+    }
+    for (int v = 0; v < n; v++) {
+        if (BIT_TEST(reached, v) || cluster_of[v] >= 0) continue;
+        if (!ends_with(graph->paths[v], ".c") && !ends_with(graph->paths[v], ".h")) continue;
+        DeadCluster *cluster = &clusters[cluster_count];
+        cluster->start = member_count;
+        cluster->edges = 0;
+        cluster_of[v] = cluster_count;
+        members[member_count++] = v;
+        for (int head = cluster->start; head < member_count; head++) {
+            int u = members[head];
+            for (int pass = 0; pass < 2; pass++) {
+                const int *offsets = pass ? graph->rev_offsets : graph->edge_offsets;
+                const int *ends = pass ? graph->rev_sources : graph->edge_targets;
+                for (int e = offsets[u]; e < offsets[u + 1]; e++) {
+                    int w = ends[e];
+                    if (pass == 0 && cluster_of[w] == cluster_count) cluster->edges++;
+                    if (BIT_TEST(reached, w) || cluster_of[w] >= 0) continue;
+                    if (!ends_with(graph->paths[w], ".c") && !ends_with(graph->paths[w], ".h")) continue;
+                    cluster_of[w] = cluster_count;
+                    members[member_count++] = w;
+                    if (pass == 0) cluster->edges++;
+                }
+            }
+        }
+        cluster->count = member_count - cluster->start;
+        // Ids follow path order, so this lists each cluster alphabetically
+        qsort(members + cluster->start, cluster->count, sizeof(int), compare_ints);
+        cluster_count++;
+    }
+    qsort(clusters, cluster_count, sizeof(DeadCluster), compare_dead_clusters);
+
+    int named = 0;
+    for (int i = 0; i < member_count; i++) {
+        const char *path = graph->paths[members[i]];
+        const char *base = strrchr(path, '/');
+        if (get_from_hash_map(ctx->referenced_files, base ? base + 1 : path)) named++;
+    }
+    fprintf(out, "Build roots: %d, reachable files: %d of %d\n", roots, reachable, n);
+    fprintf(out, "Unreachable C sources and headers: %d in %d clusters (%d of them referenced by name)\n", member_count, cluster_count, named);
+    if (cluster_count == 0) fprintf(out, "(None)\n");
+    for (int c = 0; c < cluster_count; c++) {
+        const DeadCluster *cluster = &clusters[c];
+        fprintf(out, "Cluster %d: %d files, %d references inside\n", c + 1, cluster->count, cluster->edges);
+        for (int i = cluster->start; i < cluster->start + cluster->count; i++) {
+            const char *path = graph->paths[members[i]];
+            const char *base = strrchr(path, '/');
+            bool is_named = get_from_hash_map(ctx->referenced_files, base ? base + 1 : path) != NULL;
+            fprintf(out, "  - %s%s\n", path, is_named ? "  [referenced by name]" : "");
+        }
+    }
+
+    free(reached);
+    free(cluster_of);
+    free(members);
+    free(clusters);
+}
+
+// --- Trigram Index Files ---
+//
+// pj_write_trigram_index() stores the table as one file that queries mmap:
+//
+//   TrigramIndexHeader
+//   TrigramEntry[trigram_count]   sorted by trigram
+//   uint64_t[file_count]          offset of each name in the names block
+//   names                         NUL-terminated, relative to the project root
+//   postings                      per entry, file id + 1 deltas as LEB128 varints
+//
+// Integers are in host byte order; the magic carries the format version.
+// A query looks up the trigrams of the string, intersects their lists starting
+// with the rarest and then reads only the surviving files to confirm matches.
+
+typedef struct {
+    char magic[8];
+    uint32_t file_count;
+    uint32_t trigram_count;
+    uint64_t table_offset;
+    uint64_t paths_offset;
+    uint64_t names_offset;
+    uint64_t postings_offset;
+    uint64_t file_size;
+} TrigramIndexHeader;
+
+typedef struct {
+    uint32_t trigram;
+    uint32_t count;
+    uint64_t offset;   // into the postings block
+    uint64_t len;
+} TrigramEntry;
+
+typedef struct {
+    void *base;
+    size_t size;
+    const TrigramIndexHeader *header;
+    const TrigramEntry *entries;
+    const uint64_t *name_offsets;
+    const char *names;
+    const uint8_t *postings;
+} TrigramIndexMap;
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint32_t remaining;
+    uint32_t current;  // last file id + 1
+} PostingCursor;
+
+static int compare_trigram_entries(const void *a, const void *b) {
+    uint32_t t1 = ((const TrigramEntry *)a)->trigram;
+    uint32_t t2 = ((const TrigramEntry *)b)->trigram;
+    return t1 < t2 ? -1 : t1 > t2;
+}
+
+static int compare_entry_counts(const void *a, const void *b) {
+    uint32_t c1 = (*(const TrigramEntry *const *)a)->count;
+    uint32_t c2 = (*(const TrigramEntry *const *)b)->count;
+    return c1 < c2 ? -1 : c1 > c2;
+}
+
+static const char* path_relative_to_root(const char *root_path, const char *path) {
+    size_t root_len = strlen(root_path);
+    if (strncmp(path, root_path, root_len) == 0 && path[root_len] == '/') return path + root_len + 1;
+    return path;
+}
+
+// `path` if given, else <root>/.projanitor_cache/<name>.
+static pj_status cache_file_path(ProjanitorContext *ctx, const char *path, const char *name, bool create_dir, char *out, size_t out_len) {
+    if (path) {
+        if (snprintf(out, out_len, "%s", path) >= (int)out_len) return fail(ctx, PJ_ERR_INVALID, "Path too long: %s", path);
+        return PJ_OK;
+    }
+    if (snprintf(out, out_len, "%s/.projanitor_cache", ctx->root_path) + strlen(name) + 1 >= out_len) {
+        return fail(ctx, PJ_ERR_INVALID, "Path too long: %s/.projanitor_cache/%s", ctx->root_path, name);
+    }
+    if (create_dir && !make_directories(out)) return fail(ctx, PJ_ERR_IO, "Cannot create %s: %s", out, strerror(errno));
+    strcat(out, "/");
+    strcat(out, name);
+    return PJ_OK;
+}
+
+// Default cache files sit in their project's root, so a query started anywhere
+// inside the project finds the root by walking up, without the marker search.
+static bool find_cache_root(ProjanitorContext *ctx, const char *name) {
+    char dir[MAX_PATH_LEN];
+    if (ctx->start_dir[0]) snprintf(dir, sizeof(dir), "%s", ctx->start_dir);
+    else if (!getcwd(dir, sizeof(dir))) return false;
+    for (;;) {
+        char candidate[MAX_PATH_LEN];
+        struct stat st;
+        if (snprintf(candidate, sizeof(candidate), "%s/.projanitor_cache/%s", strcmp(dir, "/") == 0 ? "" : dir, name) < (int)sizeof(candidate) &&
+            stat(candidate, &st) == 0 && S_ISREG(st.st_mode)) {
+            strcpy(ctx->root_path, dir);
+            ctx->root_known = true;
+            pj_log(ctx, PJ_LOG_INFO, "Using %s", candidate);
+            return true;
+        }
+        char *slash = strrchr(dir, '/');
+        if (!slash || slash == dir) return false;
+        *slash = '\0';
+    }
+}
+
+static pj_status write_trigram_index(ProjanitorContext *ctx, const char *index_path, FILE *out) {
+    TrigramTable *table = &ctx->trigrams;
+    const FileTable *files = &ctx->files;
+    char path[MAX_PATH_LEN];
+    char tmp_path[MAX_PATH_LEN + 4];
+    pj_status status = cache_file_path(ctx, index_path, "trigrams.idx", true, path, sizeof(path));
+    if (status != PJ_OK) return status;
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    TrigramEntry *entries = (TrigramEntry *)malloc((table->count + 1) * sizeof(TrigramEntry));
+    if (!entries) pj_out_of_memory();
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < table->slot_count; i++) {
+        const TrigramPosting *posting = &table->slots[i];
+        if (!posting->count) continue;
+        entries[n].trigram = posting->trigram;
+        entries[n].count = posting->count;
+        entries[n].len = posting->len;
+        n++;
+    }
+    if (n > 1) qsort(entries, n, sizeof(TrigramEntry), compare_trigram_entries);
+
+    TrigramIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRIGRAM_INDEX_MAGIC, sizeof(header.magic));
+    header.file_count = (uint32_t)files->count;
+    header.trigram_count = n;
+    header.table_offset = sizeof(header);
+    header.paths_offset = header.table_offset + (uint64_t)n * sizeof(TrigramEntry);
+    header.names_offset = header.paths_offset + (uint64_t)files->count * sizeof(uint64_t);
+    uint64_t names_len = 0;
+    for (int i = 0; i < files->count; i++) names_len += strlen(path_relative_to_root(ctx->root_path, files->paths[i])) + 1;
+    header.postings_offset = header.names_offset + names_len;
+    uint64_t postings_len = 0;
+    for (uint32_t k = 0; k < n; k++) {
+        entries[k].offset = postings_len;
+        postings_len += entries[k].len;
+    }
+    header.file_size = header.postings_offset + postings_len;
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        free(entries);
+        return fail(ctx, PJ_ERR_IO, "Cannot create %s: %s", tmp_path, strerror(errno));
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(entries, sizeof(TrigramEntry), n, file) == n;
+    uint64_t offset = 0;
+    for (int i = 0; ok && i < files->count; i++) {
+        ok = fwrite(&offset, sizeof(offset), 1, file) == 1;
+        offset += strlen(path_relative_to_root(ctx->root_path, files->paths[i])) + 1;
+    }
+    for (int i = 0; ok && i < files->count; i++) {
+        const char *name = path_relative_to_root(ctx->root_path, files->paths[i]);
+        ok = fwrite(name, strlen(name) + 1, 1, file) == 1;
+    }
+    for (uint32_t k = 0; ok && k < n; k++) {
+        const TrigramPosting *posting = trigram_lookup(table, entries[k].trigram);
+        ok = fwrite(posting->bytes, 1, posting->len, file) == posting->len;
+    }
+    free(entries);
+    status = commit_temp_file(ctx, file, tmp_path, path);
+    if (status != PJ_OK) return status;
+
+    fprintf(out, "\n=== Trigram Index ===\n");
+    fprintf(out, "Files: %u, trigrams: %u, postings: %llu bytes, index: %llu bytes\n",
+            header.file_count, n, (unsigned long long)postings_len, (unsigned long long)header.file_size);
+    fprintf(out, "Written to %s\n", path);
+    return PJ_OK;
+}
+
+static pj_status map_trigram_index(ProjanitorContext *ctx, const char *path, TrigramIndexMap *map) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return fail(ctx, PJ_ERR_IO, "Cannot open trigram index %s: %s", path, strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(TrigramIndexHeader)) {
+        close(fd);
+        return fail(ctx, PJ_ERR_IO, "%s is not a trigram index", path);
+    }
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return fail(ctx, PJ_ERR_IO, "Cannot map %s: %s", path, strerror(errno));
+
+    const TrigramIndexHeader *h = (const TrigramIndexHeader *)base;
+    const uint8_t *bytes = (const uint8_t *)base;
+    bool valid = memcmp(h->magic, TRIGRAM_INDEX_MAGIC, sizeof(h->magic)) == 0 &&
+                 h->file_size == (uint64_t)st.st_size &&
+                 h->table_offset == sizeof(TrigramIndexHeader) &&
+                 h->paths_offset == h->table_offset + (uint64_t)h->trigram_count * sizeof(TrigramEntry) &&
+                 h->names_offset == h->paths_offset + (uint64_t)h->file_count * sizeof(uint64_t) &&
+                 h->names_offset <= h->postings_offset && h->postings_offset <= h->file_size &&
+                 (h->file_count == 0 || (h->postings_offset > h->names_offset && bytes[h->postings_offset - 1] == '\0'));
+    if (!valid) {
+        munmap(base, (size_t)st.st_size);
+        return fail(ctx, PJ_ERR_IO, "%s is not a trigram index (or was written by another version)", path);
+    }
+    map->base = base;
+    map->size = (size_t)st.st_size;
+    map->header = h;
+    map->entries = (const TrigramEntry *)(bytes + h->table_offset);
+    map->name_offsets = (const uint64_t *)(bytes + h->paths_offset);
+    map->names = (const char *)(bytes + h->names_offset);
+    map->postings = bytes + h->postings_offset;
+    return PJ_OK;
+}
+
+static bool posting_begin(const TrigramIndexMap *map, const TrigramEntry *entry, PostingCursor *cursor) {
+    uint64_t avail = map->header->file_size - map->header->postings_offset;
+    if (entry->offset > avail || entry->len > avail - entry->offset) return false;
+    cursor->p = map->postings + entry->offset;
+    cursor->end = cursor->p + entry->len;
+    cursor->remaining = entry->count;
+    cursor->current = 0;
+    return true;
+}
+
+// 1: *id is the next file id, 0: end of list, -1: corrupt list.
+static int posting_next(PostingCursor *cursor, uint32_t file_count, uint32_t *id) {
+    if (cursor->remaining == 0) return 0;
+    uint32_t delta = 0;
+    int shift = 0;
+    uint8_t byte;
+    do {
+        if (cursor->p == cursor->end || shift > 28) return -1;
+        byte = *cursor->p++;
+        delta |= (uint32_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    if (delta == 0 || delta > file_count - cursor->current) return -1;
+    cursor->current += delta;
+    cursor->remaining--;
+    *id = cursor->current - 1;
+    return 1;
+}
+
+// Keep the candidates that also appear in `entry`; both lists are ascending.
+static int intersect_postings(const TrigramIndexMap *map, const TrigramEntry *entry, uint32_t *candidates, uint32_t count) {
+    PostingCursor cursor;
+    if (!posting_begin(map, entry, &cursor)) return -1;
+    uint32_t kept = 0, id = 0;
+    int rc = posting_next(&cursor, map->header->file_count, &id);
+    for (uint32_t i = 0; i < count && rc == 1; i++) {
+        while (rc == 1 && id < candidates[i]) rc = posting_next(&cursor, map->header->file_count, &id);
+        if (rc == 1 && id == candidates[i]) candidates[kept++] = id;
+    }
+    return rc < 0 ? -1 : (int)kept;
+}
+
+static const char* find_bytes(const char *hay, size_t hay_len, const char *needle, size_t len) {
+    if (len > hay_len) return NULL;
+    const char *last = hay + hay_len - len;
+    for (const char *p = hay; p <= last; p++) {
+        p = (const char *)memchr(p, needle[0], (size_t)(last - p) + 1);
+        if (!p) return NULL;
+        if (memcmp(p, needle, len) == 0) return p;
+    }
+    return NULL;
+}
+
+// Print every line of `full_path` that contains `needle` as name:line:text.
+static size_t grep_file(ProjanitorContext *ctx, const char *full_path, const char *name, const char *needle, FILE *out) {
+    int fd = open(full_path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (ctx->verbose) pj_log(ctx, PJ_LOG_WARNING, "Could not open file %s: %s", full_path, strerror(errno));
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+    size_t size = (size_t)st.st_size;
+    char *buffer = (char *)malloc(size + 1);
+    if (!buffer) {
+        close(fd);
+        pj_out_of_memory();
+    }
+    size_t got = 0;
+    while (got < size) {
+        ssize_t r = read(fd, buffer + got, size - got);
+        if (r <= 0) break;
+        got += (size_t)r;
+    }
+    close(fd);
+
+    size_t needle_len = strlen(needle), lines = 0;
+    const char *end = buffer + got, *counted = buffer, *pos = buffer;
+    int line_no = 1;
+    const char *hit;
+    while (pos < end && (hit = find_bytes(pos, (size_t)(end - pos), needle, needle_len))) {
+        const char *line_start = hit;
+        while (line_start > buffer && line_start[-1] != '\n') line_start--;
+        const char *line_end = (const char *)memchr(hit, '\n', (size_t)(end - hit));
+        if (!line_end) line_end = end;
+        for (; counted < line_start; counted++) {
+            if (*counted == '\n') line_no++;
+        }
+        fprintf(out, "%s:%d:%.*s\n", name, line_no, (int)(line_end - line_start), line_start);
+        lines++;
+        pos = line_end;
+    }
+    free(buffer);
+    return lines;
+}
+
+static pj_status query_trigram_index(ProjanitorContext *ctx, const char *index_path, const char *needle, FILE *out, size_t *matches) {
+    char path[MAX_PATH_LEN];
+    pj_status status = cache_file_path(ctx, index_path, "trigrams.idx", false, path, sizeof(path));
+    if (status != PJ_OK) return status;
+    TrigramIndexMap map = {0};
+    status = map_trigram_index(ctx, path, &map);
+    if (status != PJ_OK) return status;
+
+    uint32_t file_count = map.header->file_count;
+    uint32_t *candidates = (uint32_t *)malloc(((size_t)file_count + 1) * sizeof(uint32_t));
+    if (!candidates) pj_out_of_memory();
+    uint32_t count = 0;
+    size_t needle_len = strlen(needle);
+    bool corrupt = false;
+    int lists = 0;
+    if (needle_len < 3) {
+        for (uint32_t id = 0; id < file_count; id++) candidates[count++] = id;
+    } else {
+        const TrigramEntry **entries = (const TrigramEntry **)malloc((needle_len - 2) * sizeof(TrigramEntry *));
+        if (!entries) pj_out_of_memory();
+        bool absent = false;
+        for (size_t i = 0; i + 3 <= needle_len && !absent; i++) {
+            const unsigned char *c = (const unsigned char *)needle + i;
+            TrigramEntry key = {((uint32_t)c[0] << 16) | ((uint32_t)c[1] << 8) | c[2], 0, 0, 0};
+            const TrigramEntry *entry = (const TrigramEntry *)bsearch(&key, map.entries, map.header->trigram_count, sizeof(TrigramEntry), compare_trigram_entries);
+            if (!entry) {
+                absent = true;
+                break;
+            }
+            bool seen = false;
+            for (int j = 0; j < lists && !seen; j++) seen = entries[j] == entry;
+            if (!seen) entries[lists++] = entry;
+        }
+        if (!absent) {
+            qsort(entries, lists, sizeof(TrigramEntry *), compare_entry_counts);
+            PostingCursor cursor;
+            uint32_t id;
+            int rc = 0;
+            if (posting_begin(&map, entries[0], &cursor)) {
+                while ((rc = posting_next(&cursor, file_count, &id)) == 1) candidates[count++] = id;
+            }
+            corrupt = rc != 0;
+            for (int j = 1; j < lists && count > 0 && !corrupt; j++) {
+                int kept = intersect_postings(&map, entries[j], candidates, count);
+                if (kept < 0) corrupt = true;
+                else count = (uint32_t)kept;
+            }
+        }
+        free(entries);
+    }
+    if (corrupt) {
+        free(candidates);
+        munmap(map.base, map.size);
+        return fail(ctx, PJ_ERR_IO, "Corrupt posting list in %s", path);
+    }
+
+    const char **names = (const char **)malloc(((size_t)count + 1) * sizeof(char *));
+    if (!names) pj_out_of_memory();
+    uint64_t names_len = map.header->postings_offset - map.header->names_offset;
+    uint32_t named = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t offset = map.name_offsets[candidates[i]];
+        if (offset < names_len) names[named++] = map.names + offset;
+    }
+    if (named > 1) qsort(names, named, sizeof(char *), compare_strings);
+
+    size_t total = 0, matched_files = 0;
+    for (uint32_t i = 0; i < named; i++) {
+        char full_path[MAX_PATH_LEN];
+        if (snprintf(full_path, sizeof(full_path), "%s/%s", ctx->root_path, names[i]) >= (int)sizeof(full_path)) continue;
+        size_t lines = grep_file(ctx, full_path, names[i], needle, out);
+        total += lines;
+        if (lines) matched_files++;
+    }
+    pj_log(ctx, PJ_LOG_INFO, "Trigram query: %d posting lists, %u of %u files checked, %zu lines in %zu files matched",
+           lists, named, file_count, total, matched_files);
+    free(names);
+    free(candidates);
+    munmap(map.base, map.size);
+    if (matches) *matches = total;
+    return PJ_OK;
+}
+
+// --- Stale Build Artifacts ---
+
+// Whether a directory exists; the last answer is kept, since the artifacts of
+// one target share their source directory.
+typedef struct {
+    char path[MAX_PATH_LEN];
+    bool exists;
+} DirCache;
+
+static bool cached_dir_exists(DirCache *cache, const char *path) {
+    if (strcmp(cache->path, path) != 0) {
+        struct stat st;
+        snprintf(cache->path, sizeof(cache->path), "%s", path);
+        cache->exists = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+    }
+    return cache->exists;
+}
+
+// The source an artifact was compiled from, by CMake's layout:
+// <dir>/CMakeFiles/<target>.dir/<source path>.o (or .obj; depfiles add .d),
+// where <dir> mirrors the directory of the CMakeLists.txt under the root and
+// "__" stands for "..". ESP-IDF builds each component in esp-idf/<name>, whose
+// sources are main/, components/<name> or managed_components/<name> when the
+// project has them. False for other layouts and for sources outside the
+// project, such as ESP-IDF's own components.
+static bool artifact_source(const char *root_path, const char *artifact, DirCache *dirs, char *source, size_t size) {
+    const char *cmake = strstr(artifact, "CMakeFiles/");
+    while (cmake && cmake != artifact && cmake[-1] != '/') cmake = strstr(cmake + 1, "CMakeFiles/");
+    if (!cmake) return false;
+    const char *target = cmake + strlen("CMakeFiles/");
+    const char *rel = strchr(target, '/');
+    if (!rel || rel - target < 5 || strncmp(rel - 4, ".dir", 4) != 0) return false;
+    rel++;
+
+    char path[MAX_PATH_LEN];
+    snprintf(path, sizeof(path), "%s", rel);
+    // <source>.o or .obj, their depfiles <source>.o.d / .obj.d, or <source>.d
+    size_t len = strlen(path);
+    bool depfile = len > 2 && strcmp(path + len - 2, ".d") == 0;
+    if (depfile) path[len -= 2] = '\0';
+    if (len > 2 && strcmp(path + len - 2, ".o") == 0) path[len -= 2] = '\0';
+    else if (len > 4 && strcmp(path + len - 4, ".obj") == 0) path[len -= 4] = '\0';
+    else if (!depfile) return false;
+    const char *base = strrchr(path, '/');
+    if (!strchr(base ? base : path, '.')) return false;  // CMake keeps the source extension
+    for (char *seg = path; seg; seg = strchr(seg, '/') ? strchr(seg, '/') + 1 : NULL) {
+        if (strncmp(seg, "__", 2) == 0 && (seg[2] == '/' || seg[2] == '\0')) seg[0] = seg[1] = '.';
+    }
+
+    char dir[MAX_PATH_LEN];
+    const char *idf = strncmp(artifact, "esp-idf/", 8) == 0 ? artifact + 8 : NULL;
+    if (idf && idf < cmake) {
+        int name_len = (int)(strchr(idf, '/') - idf);
+        if (name_len == 4 && strncmp(idf, "main", 4) == 0) {
+            snprintf(dir, sizeof(dir), "%s/main", root_path);
+        } else {
+            snprintf(dir, sizeof(dir), "%s/components/%.*s", root_path, name_len, idf);
+            if (!cached_dir_exists(dirs, dir)) snprintf(dir, sizeof(dir), "%s/managed_components/%.*s", root_path, name_len, idf);
+        }
+    } else {
+        snprintf(dir, sizeof(dir), "%s/%.*s", root_path, (int)(cmake - artifact), artifact);
+        normalize_path(dir);
+    }
+    if (!cached_dir_exists(dirs, dir)) return false;
+    if (snprintf(source, size, "%s/%s", dir, path) >= (int)size) return false;
+    normalize_path(source);
+    return strncmp(source, root_path, strlen(root_path)) == 0 && source[strlen(root_path)] == '/';
+}
+
+static int compare_artifacts(const void *a, const void *b) {
+    return strcmp(((const BuildArtifact *)a)->path, ((const BuildArtifact *)b)->path);
+}
+
+// Object and dependency files under build/ whose source is gone: deleted or
+// renamed sources leave them behind, and they bloat cached build directories.
+// Sources are looked up among the scanned files; only the ones not found
+// there (stale, or in excluded directories) cost a stat.
+static void report_stale_artifacts(ProjanitorContext *ctx, FILE *out) {
+    BuildArtifactArray *artifacts = &ctx->artifacts;
+    if (artifacts->count > 0) qsort(artifacts->items, artifacts->count, sizeof(BuildArtifact), compare_artifacts);
+    int *stale = (int *)malloc((artifacts->count + 1) * sizeof(int));
+    DirCache *dirs = (DirCache *)calloc(1, sizeof(DirCache));
+    if (!stale || !dirs) pj_out_of_memory();
+    int stale_count = 0, traced = 0;
+    long long total_bytes = 0, stale_bytes = 0;
+    char build_path[MAX_PATH_LEN], source[MAX_PATH_LEN];
+    for (int i = 0; i < artifacts->count; i++) {
+        const BuildArtifact *artifact = &artifacts->items[i];
+        total_bytes += artifact->size;
+        if (!artifact_source(ctx->root_path, artifact->path, dirs, source, sizeof(source))) continue;
+        traced++;
+        if (id_map_get(&ctx->graph.path_ids, source) >= 0) continue;
+        struct stat st;
+        if (stat(source, &st) == 0) continue;
+        stale[stale_count++] = i;
+        stale_bytes += artifact->size;
+    }
+
+    fprintf(out, "\n=== Stale Build Artifacts ===\n");
+    fprintf(out, "Object and dependency files in build/: %d (%lld bytes), %d traced to a source in the project\n",
+            artifacts->count, total_bytes, traced);
+    fprintf(out, "Stale (source no longer exists): %d files, %lld bytes reclaimable\n", stale_count, stale_bytes);
+    for (int i = 0; i < stale_count; i++) {
+        const BuildArtifact *artifact = &artifacts->items[stale[i]];
+        artifact_source(ctx->root_path, artifact->path, dirs, source, sizeof(source));
+        snprintf(build_path, sizeof(build_path), "build/%s", artifact->path);
+        fprintf(out, "  %10lld  %s  (%s)\n", (long long)artifact->size, build_path, path_relative_to_root(ctx->root_path, source));
+    }
+    free(stale);
+    free(dirs);
+}
+
+// --- Graph Snapshot and Why Queries ---
+//
+// pj_write_graph_snapshot() saves the resolved reference graph so later
+// queries skip the scan. The file is mapped as is:
+//
+//   GraphSnapshotHeader
+//   uint64_t[file_count]        offset of each name in the names block
+//   uint64_t[row_count * row_words]  test rows: bit i = test i depends on the file
+//   int32_t[file_count + 1]     forward CSR offsets
+//   int32_t[edge_count]         forward targets
+//   int32_t[file_count + 1]     reverse CSR offsets
+//   int32_t[edge_count]         reverse sources
+//   int32_t[edge_count]         line of each forward edge
+//   int32_t[test_count]         file of each test, in path order
+//   int32_t[file_count]         test row of each file; row 0 is empty
+//   uint8_t[edge_count]         RefKind of each forward edge
+//   names                       sorted, NUL-terminated, relative to the root
+//
+// Integers are in host byte order; the magic carries the format version.
+
+#define GRAPH_SNAPSHOT_MAGIC "PJGRAPH2"
+#define MAX_WHY_CHAINS 5
+
+typedef struct {
+    char magic[8];
+    uint32_t file_count;
+    uint32_t edge_count;
+    uint64_t name_offsets_offset;
+    uint64_t offsets_offset;
+    uint64_t targets_offset;
+    uint64_t rev_offsets_offset;
+    uint64_t rev_sources_offset;
+    uint64_t lines_offset;
+    uint64_t kinds_offset;
+    uint64_t names_offset;
+    uint64_t file_size;
+    uint32_t test_count;
+    uint32_t row_count;
+    uint32_t row_words;
+    uint32_t reserved;
+    uint64_t rows_offset;
+    uint64_t tests_offset;
+    uint64_t row_of_offset;
+} GraphSnapshotHeader;
+
+// Read-only CSR graph over either the in-memory include graph or a mapped
+// snapshot. Ids follow sorted path order in both.
+typedef struct {
+    int file_count;
+    int edge_count;
+    const int32_t *offsets;
+    const int32_t *targets;
+    const int32_t *rev_offsets;
+    const int32_t *rev_sources;
+    const int32_t *lines;
+    const uint8_t *kinds;
+    const char *const *paths;       // in memory: absolute paths
+    const uint64_t *name_offsets;   // snapshot: offsets into names
+    const char *names;
+    const char *root_path;
+    int test_count;                 // test map, see attach_test_map()
+    int row_count;
+    int row_words;
+    const int32_t *tests;
+    const uint64_t *rows;
+    const int32_t *row_of;
+    void *map_base;                 // snapshot mapping, or NULL
+    size_t map_size;
+    int32_t *owned_lines;           // in memory: built from the references
+    uint8_t *owned_kinds;
+    int32_t *owned_tests;
+    uint64_t *owned_rows;
+    int32_t *owned_row_of;
+} GraphView;
+
+static const char* view_name(const GraphView *view, int v) {
+    if (view->paths) return path_relative_to_root(view->root_path, view->paths[v]);
+    return view->names + view->name_offsets[v];
+}
+
+static void view_from_graph(ProjanitorContext *ctx, GraphView *view) {
+    ensure_include_graph(ctx);
+    IncludeGraph *graph = &ctx->graph;
+    ensure_reverse_edges(graph);
+    memset(view, 0, sizeof(*view));
+    view->file_count = graph->file_count;
+    view->edge_count = graph->edge_count;
+    view->offsets = graph->edge_offsets;
+    view->targets = graph->edge_targets;
+    view->rev_offsets = graph->rev_offsets;
+    view->rev_sources = graph->rev_sources;
+    view->paths = graph->paths;
+    view->root_path = ctx->root_path;
+    view->owned_lines = (int32_t *)malloc((graph->edge_count + 1) * sizeof(int32_t));
+    view->owned_kinds = (uint8_t *)malloc(graph->edge_count + 1);
+    if (!view->owned_lines || !view->owned_kinds) pj_out_of_memory();
+    for (int e = 0; e < graph->edge_count; e++) {
+        const Reference *ref = &ctx->references.items[graph->edge_refs[e]];
+        view->owned_lines[e] = ref->line;
+        view->owned_kinds[e] = (uint8_t)ref->kind;
+    }
+    view->lines = view->owned_lines;
+    view->kinds = view->owned_kinds;
+}
+
+static void release_graph_view(GraphView *view) {
+    free(view->owned_lines);
+    free(view->owned_kinds);
+    free(view->owned_tests);
+    free(view->owned_rows);
+    free(view->owned_row_of);
+    if (view->map_base) munmap(view->map_base, view->map_size);
+    memset(view, 0, sizeof(*view));
+}
+
+// Distinct test rows, interned so files the same tests depend on share one.
+typedef struct {
+    uint64_t *rows;
+    int words;
+    int count;
+    int capacity;
+    int *slots;         // -1 = empty
+    int slot_count;
+} RowTable;
+
+static unsigned int hash_row(const uint64_t *row, int words, int size) {
+    uint64_t h = 1469598103934665603ULL;
+    for (int k = 0; k < words; k++) {
+        h ^= row[k];
+        h *= 1099511628211ULL;
+    }
+    return (unsigned int)(h ^ (h >> 32)) & (size - 1);
+}
+
+static int intern_row(RowTable *table, const uint64_t *row) {
+    size_t bytes = (size_t)table->words * sizeof(uint64_t);
+    if ((table->count + 1) * 2 > table->slot_count) {
+        int slot_count = table->slot_count ? table->slot_count * 2 : 1024;
+        int *slots = (int *)malloc(slot_count * sizeof(int));
+        if (!slots) pj_out_of_memory();
+        memset(slots, -1, slot_count * sizeof(int));
+        for (int r = 0; r < table->count; r++) {
+            unsigned int j = hash_row(table->rows + (size_t)r * table->words, table->words, slot_count);
+            while (slots[j] >= 0) j = (j + 1) & (slot_count - 1);
+            slots[j] = r;
+        }
+        free(table->slots);
+        table->slots = slots;
+        table->slot_count = slot_count;
+    }
+    unsigned int i = hash_row(row, table->words, table->slot_count);
+    for (; table->slots[i] >= 0; i = (i + 1) & (table->slot_count - 1)) {
+        if (memcmp(table->rows + (size_t)table->slots[i] * table->words, row, bytes) == 0) return table->slots[i];
+    }
+    if (table->count == table->capacity) {
+        int capacity = table->capacity ? table->capacity * 2 : 64;
+        uint64_t *rows = (uint64_t *)realloc(table->rows, (size_t)capacity * bytes + 1);
+        if (!rows) pj_out_of_memory();
+        table->rows = rows;
+        table->capacity = capacity;
+    }
+    memcpy(table->rows + (size_t)table->count * table->words, row, bytes);
+    table->slots[i] = table->count;
+    return table->count++;
+}
+
+// The test map of the scanned graph: bit i of a file's row is set when test i
+// (is_test_file) reaches the file over references of any kind. Rows are
+// propagated over the components in topological order, so a component's row
+// is its own test bits OR the rows of the components referencing it, and each
+// reference costs one OR of a row.
+static void attach_test_map(ProjanitorContext *ctx, GraphView *view) {
+    const IncludeGraph *graph = &ctx->graph;
+    int n = view->file_count;
+    view->owned_tests = (int32_t *)malloc((n + 1) * sizeof(int32_t));
+    view->owned_row_of = (int32_t *)calloc(n + 1, sizeof(int32_t));
+    if (!view->owned_tests || !view->owned_row_of) pj_out_of_memory();
+    int tests = 0;
+    for (int v = 0; v < n; v++) {
+        if (is_test_file(view_name(view, v))) view->owned_tests[tests++] = v;
+    }
+    RowTable table = {NULL, (tests + 63) / 64, 0, 0, NULL, 0};
+    uint64_t *row = (uint64_t *)calloc(table.words + 1, sizeof(uint64_t));
+    if (!row) pj_out_of_memory();
+    intern_row(&table, row);  // row 0: no tests
+
+    if (tests > 0) {
+        int *test_bit = (int *)malloc((n + 1) * sizeof(int));
+        int *scc = (int *)malloc((n + 1) * sizeof(int));
+        if (!test_bit || !scc) pj_out_of_memory();
+        for (int v = 0; v < n; v++) test_bit[v] = -1;
+        for (int t = 0; t < tests; t++) test_bit[view->owned_tests[t]] = t;
+        int scc_count = include_sccs(graph, &ctx->references, false, scc);
+        int *scc_start, *members;
+        group_components(n, scc, scc_count, &scc_start, &members);
+        int *component_row = (int *)malloc((scc_count + 1) * sizeof(int));
+        if (!component_row) pj_out_of_memory();
+        // Referencing components have higher numbers, so they are done first.
+        for (int c = scc_count - 1; c >= 0; c--) {
+            memset(row, 0, table.words * sizeof(uint64_t));
+            for (int m = scc_start[c]; m < scc_start[c + 1]; m++) {
+                int v = members[m];
+                if (test_bit[v] >= 0) row[test_bit[v] / 64] |= 1ULL << (test_bit[v] % 64);
+                for (int e = graph->rev_offsets[v]; e < graph->rev_offsets[v + 1]; e++) {
+                    int from = scc[graph->rev_sources[e]];
+                    if (from == c || component_row[from] == 0) continue;
+                    const uint64_t *src = table.rows + (size_t)component_row[from] * table.words;
+                    for (int k = 0; k < table.words; k++) row[k] |= src[k];
+                }
+            }
+            component_row[c] = intern_row(&table, row);
+        }
+        for (int v = 0; v < n; v++) view->owned_row_of[v] = component_row[scc[v]];
+        free(component_row);
+        free(scc_start);
+        free(members);
+        free(scc);
+        free(test_bit);
+    }
+    free(row);
+    free(table.slots);
+    view->test_count = tests;
+    view->row_count = table.count;
+    view->row_words = table.words;
+    view->tests = view->owned_tests;
+    view->rows = view->owned_rows = table.rows;
+    view->row_of = view->owned_row_of;
+}
+
+static bool write_block(FILE *file, const void *data, size_t size, size_t count) {
+    return count == 0 || fwrite(data, size, count, file) == count;
+}
+
+static pj_status write_graph_snapshot(ProjanitorContext *ctx, const char *snapshot_path, FILE *out) {
+    char path[MAX_PATH_LEN];
+    char tmp_path[MAX_PATH_LEN + 4];
+    pj_status status = cache_file_path(ctx, snapshot_path, "graph.snap", true, path, sizeof(path));
+    if (status != PJ_OK) return status;
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    GraphView view;
+    view_from_graph(ctx, &view);
+    attach_test_map(ctx, &view);
+    uint32_t n = (uint32_t)view.file_count, e = (uint32_t)view.edge_count;
+    uint32_t tests = (uint32_t)view.test_count, rows = (uint32_t)view.row_count, words = (uint32_t)view.row_words;
+
+    GraphSnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, GRAPH_SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.file_count = n;
+    header.edge_count = e;
+    header.test_count = tests;
+    header.row_count = rows;
+    header.row_words = words;
+    header.name_offsets_offset = sizeof(header);
+    header.rows_offset = header.name_offsets_offset + (uint64_t)n * sizeof(uint64_t);
+    header.offsets_offset = header.rows_offset + (uint64_t)rows * words * sizeof(uint64_t);
+    header.targets_offset = header.offsets_offset + ((uint64_t)n + 1) * sizeof(int32_t);
+    header.rev_offsets_offset = header.targets_offset + (uint64_t)e * sizeof(int32_t);
+    header.rev_sources_offset = header.rev_offsets_offset + ((uint64_t)n + 1) * sizeof(int32_t);
+    header.lines_offset = header.rev_sources_offset + (uint64_t)e * sizeof(int32_t);
+    header.tests_offset = header.lines_offset + (uint64_t)e * sizeof(int32_t);
+    header.row_of_offset = header.tests_offset + (uint64_t)tests * sizeof(int32_t);
+    header.kinds_offset = header.row_of_offset + (uint64_t)n * sizeof(int32_t);
+    header.names_offset = header.kinds_offset + e;
+    uint64_t names_len = 0;
+    for (uint32_t v = 0; v < n; v++) names_len += strlen(view_name(&view, (int)v)) + 1;
+    header.file_size = header.names_offset + names_len;
+
+    FILE *file = fopen(tmp_path, "wb");
+    if (!file) {
+        release_graph_view(&view);
+        return fail(ctx, PJ_ERR_IO, "Cannot create %s: %s", tmp_path, strerror(errno));
+    }
+    bool ok = write_block(file, &header, sizeof(header), 1);
+    uint64_t offset = 0;
+    for (uint32_t v = 0; ok && v < n; v++) {
+        ok = write_block(file, &offset, sizeof(offset), 1);
+        offset += strlen(view_name(&view, (int)v)) + 1;
+    }
+    ok = ok && write_block(file, view.rows, sizeof(uint64_t), (size_t)rows * words) &&
+         write_block(file, view.offsets, sizeof(int32_t), n + 1) && write_block(file, view.targets, sizeof(int32_t), e) &&
+         write_block(file, view.rev_offsets, sizeof(int32_t), n + 1) && write_block(file, view.rev_sources, sizeof(int32_t), e) &&
+         write_block(file, view.lines, sizeof(int32_t), e) && write_block(file, view.tests, sizeof(int32_t), tests) &&
+         write_block(file, view.row_of, sizeof(int32_t), n) && write_block(file, view.kinds, 1, e);
+    for (uint32_t v = 0; ok && v < n; v++) {
+        const char *name = view_name(&view, (int)v);
+        ok = write_block(file, name, strlen(name) + 1, 1);
+    }
+    release_graph_view(&view);
+    status = commit_temp_file(ctx, file, tmp_path, path);
+    if (status != PJ_OK) return status;
+
+    fprintf(out, "\n=== Graph Snapshot ===\n");
+    fprintf(out, "Files: %u, edges: %u, tests: %u (%u distinct dependency rows), snapshot: %llu bytes\n", n, e, tests, rows,
+            (unsigned long long)header.file_size);
+    fprintf(out, "Written to %s\n", path);
+    return PJ_OK;
+}
+
+static bool valid_csr(const int32_t *offsets, const int32_t *ends, uint32_t n, uint32_t e) {
+    if (offsets[0] != 0 || offsets[n] != (int32_t)e) return false;
+    for (uint32_t v = 0; v < n; v++) {
+        if (offsets[v + 1] < offsets[v]) return false;
+    }
+    for (uint32_t i = 0; i < e; i++) {
+        if (ends[i] < 0 || (uint32_t)ends[i] >= n) return false;
+    }
+    return true;
+}
+
+static pj_status map_graph_snapshot(ProjanitorContext *ctx, const char *path, GraphView *view) {
+    memset(view, 0, sizeof(*view));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return fail(ctx, PJ_ERR_IO, "Cannot open graph snapshot %s: %s", path, strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(GraphSnapshotHeader)) {
+        close(fd);
+        return fail(ctx, PJ_ERR_IO, "%s is not a graph snapshot", path);
+    }
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return fail(ctx, PJ_ERR_IO, "Cannot map %s: %s", path, strerror(errno));
+    view->map_base = base;
+    view->map_size = (size_t)st.st_size;
+
+    const GraphSnapshotHeader *h = (const GraphSnapshotHeader *)base;
+    const uint8_t *bytes = (const uint8_t *)base;
+    uint64_t n = h->file_count, e = h->edge_count, tests = h->test_count, rows = h->row_count, words = h->row_words;
+    bool valid = memcmp(h->magic, GRAPH_SNAPSHOT_MAGIC, sizeof(h->magic)) == 0 &&
+                 n < INT_MAX && e < INT_MAX && h->file_size == (uint64_t)st.st_size &&
+                 tests <= n && words == (tests + 63) / 64 && rows >= 1 && rows <= n + 1 &&
+                 h->name_offsets_offset == sizeof(GraphSnapshotHeader) &&
+                 h->rows_offset == h->name_offsets_offset + n * sizeof(uint64_t) &&
+                 h->offsets_offset == h->rows_offset + rows * words * sizeof(uint64_t) &&
+                 h->targets_offset == h->offsets_offset + (n + 1) * sizeof(int32_t) &&
+                 h->rev_offsets_offset == h->targets_offset + e * sizeof(int32_t) &&
+                 h->rev_sources_offset == h->rev_offsets_offset + (n + 1) * sizeof(int32_t) &&
+                 h->lines_offset == h->rev_sources_offset + e * sizeof(int32_t) &&
+                 h->tests_offset == h->lines_offset + e * sizeof(int32_t) &&
+                 h->row_of_offset == h->tests_offset + tests * sizeof(int32_t) &&
+                 h->kinds_offset == h->row_of_offset + n * sizeof(int32_t) &&
+                 h->names_offset == h->kinds_offset + e && h->names_offset <= h->file_size &&
+                 (n == 0 || (h->file_size > h->names_offset && bytes[h->file_size - 1] == '\0'));
+    if (valid) {
+        view->file_count = (int)n;
+        view->edge_count = (int)e;
+        view->name_offsets = (const uint64_t *)(bytes + h->name_offsets_offset);
+        view->offsets = (const int32_t *)(bytes + h->offsets_offset);
+        view->targets = (const int32_t *)(bytes + h->targets_offset);
+        view->rev_offsets = (const int32_t *)(bytes + h->rev_offsets_offset);
+        view->rev_sources = (const int32_t *)(bytes + h->rev_sources_offset);
+        view->lines = (const int32_t *)(bytes + h->lines_offset);
+        view->kinds = bytes + h->kinds_offset;
+        view->test_count = (int)tests;
+        view->row_count = (int)rows;
+        view->row_words = (int)words;
+        view->rows = (const uint64_t *)(bytes + h->rows_offset);
+        view->tests = (const int32_t *)(bytes + h->tests_offset);
+        view->row_of = (const int32_t *)(bytes + h->row_of_offset);
+        view->names = (const char *)(bytes + h->names_offset);
+        view->root_path = ctx->root_path;
+        uint64_t names_len = h->file_size - h->names_offset;
+        valid = valid_csr(view->offsets, view->targets, (uint32_t)n, (uint32_t)e) &&
+                valid_csr(view->rev_offsets, view->rev_sources, (uint32_t)n, (uint32_t)e);
+        for (uint64_t v = 0; valid && v < n; v++) valid = view->name_offsets[v] < names_len && (uint32_t)view->row_of[v] < rows;
+        for (uint64_t t = 0; valid && t < tests; t++) valid = (uint32_t)view->tests[t] < n;
+    }
+    if (!valid) {
+        release_graph_view(view);
+        return fail(ctx, PJ_ERR_IO, "%s is not a graph snapshot (or was written by another version)", path);
+    }
+    return PJ_OK;
+}
+
+// Exact root-relative path first, then a unique "/<name>" suffix; -1 if none,
+// -2 if the suffix is ambiguous.
+static int find_view_file(const GraphView *view, const char *name) {
+    int lo = 0, hi = view->file_count - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(view_name(view, mid), name);
+        if (cmp == 0) return mid;
+        if (cmp < 0) lo = mid + 1;
+        else hi = mid - 1;
+    }
+    size_t len = strlen(name);
+    int found = -1;
+    for (int v = 0; v < view->file_count; v++) {
+        const char *path = view_name(view, v);
+        size_t path_len = strlen(path);
+        if (path_len > len && path[path_len - len - 1] == '/' && strcmp(path + path_len - len, name) == 0) {
+            if (found >= 0) return -2;
+            found = v;
+        }
+    }
+    return found;
+}
+
+// The edge from -> to (the first one, if the file references it twice).
+static int find_edge(const GraphView *view, int from, int to) {
+    for (int e = view->offsets[from]; e < view->offsets[from + 1]; e++) {
+        if (view->targets[e] == to) return e;
+    }
+    return -1;
+}
+
+static void print_chain(const GraphView *view, const int *parent_f, const int *parent_b, int meet, int *chain, FILE *out) {
+    int length = 0;
+    for (int v = meet; v >= 0; v = parent_f[v]) chain[length++] = v;
+    for (int i = 0; i < length / 2; i++) {
+        int swap = chain[i];
+        chain[i] = chain[length - 1 - i];
+        chain[length - 1 - i] = swap;
+    }
+    for (int v = parent_b[meet]; v >= 0; v = parent_b[v]) chain[length++] = v;
+    for (int i = 0; i + 1 < length; i++) {
+        int e = find_edge(view, chain[i], chain[i + 1]);
+        const char *verb = e >= 0 && view->kinds[e] == REF_CMAKE_SRC ? "lists" : "includes";
+        fprintf(out, "  %s:%d %s %s\n", view_name(view, chain[i]), e >= 0 ? view->lines[e] : 0, verb, view_name(view, chain[i + 1]));
+    }
+}
+
+// Bidirectional BFS: all build roots forwards, the target backwards, always
+// growing the smaller frontier one full level. Once a level meets the other
+// side, the smallest total distance seen is the shortest chain; every meeting
+// file at that distance gives one such chain.
+static int why_file(const GraphView *view, int target, FILE *out) {
+    int n = view->file_count;
+    int *dist_f = (int *)malloc((n + 1) * sizeof(int));
+    int *dist_b = (int *)malloc((n + 1) * sizeof(int));
+    int *parent_f = (int *)malloc((n + 1) * sizeof(int));
+    int *parent_b = (int *)malloc((n + 1) * sizeof(int));
+    int *front_f = (int *)malloc((n + 1) * sizeof(int));
+    int *front_b = (int *)malloc((n + 1) * sizeof(int));
+    int *next = (int *)malloc((n + 1) * sizeof(int));
+    int *meets = (int *)malloc((n + 1) * sizeof(int));
+    if (!dist_f || !dist_b || !parent_f || !parent_b || !front_f || !front_b || !next || !meets) pj_out_of_memory();
+    for (int v = 0; v < n; v++) {
+        dist_f[v] = dist_b[v] = -1;
+        parent_f[v] = parent_b[v] = -1;
+    }
+    int count_f = 0, count_b = 0, meet_count = 0, best = INT_MAX;
+    for (int v = 0; v < n; v++) {
+        if (!is_build_root(view_name(view, v))) continue;
+        dist_f[v] = 0;
+        front_f[count_f++] = v;
+    }
+    int roots = count_f;
+    dist_b[target] = 0;
+    front_b[count_b++] = target;
+    if (dist_f[target] == 0) {
+        best = 0;
+        meets[meet_count++] = target;
+    }
+
+    while (best == INT_MAX && count_f > 0 && count_b > 0) {
+        bool forward = count_f <= count_b;
+        int *frontier = forward ? front_f : front_b;
+        int count = forward ? count_f : count_b;
+        int *dist = forward ? dist_f : dist_b;
+        int *parent = forward ? parent_f : parent_b;
+        const int *other = forward ? dist_b : dist_f;
+        const int32_t *offsets = forward ? view->offsets : view->rev_offsets;
+        const int32_t *ends = forward ? view->targets : view->rev_sources;
+        int next_count = 0;
+        for (int i = 0; i < count; i++) {
+            int v = frontier[i];
+            for (int e = offsets[v]; e < offsets[v + 1]; e++) {
+                int w = ends[e];
+                if (dist[w] >= 0) continue;
+                dist[w] = dist[v] + 1;
+                parent[w] = v;
+                next[next_count++] = w;
+                if (other[w] >= 0 && dist[w] + other[w] <= best) {
+                    if (dist[w] + other[w] < best) meet_count = 0;
+                    best = dist[w] + other[w];
+                    meets[meet_count++] = w;
+                }
+            }
+        }
+        memcpy(frontier, next, next_count * sizeof(int));
+        if (forward) count_f = next_count;
+        else count_b = next_count;
+    }
+
+    if (roots == 0) {
+        fprintf(out, "(No build roots: no CMakeLists.txt or .cmake in the graph)\n");
+    } else if (best == INT_MAX) {
+        fprintf(out, "Not reachable from any of the %d build root%s\n", roots, roots == 1 ? "" : "s");
+    } else if (best == 0) {
+        fprintf(out, "It is a build root\n");
+    } else {
+        int shown = meet_count < MAX_WHY_CHAINS ? meet_count : MAX_WHY_CHAINS;
+        fprintf(out, "Shortest chain: %d reference%s (%d found, %d shown)\n", best, best == 1 ? "" : "s", meet_count, shown);
+        for (int i = 0; i < shown; i++) {
+            fprintf(out, "Chain %d:\n", i + 1);
+            print_chain(view, parent_f, parent_b, meets[i], next, out);
+        }
+    }
+    free(dist_f);
+    free(dist_b);
+    free(parent_f);
+    free(parent_b);
+    free(front_f);
+    free(front_b);
+    free(next);
+    free(meets);
+    return best == INT_MAX ? 0 : meet_count;
+}
+
+// A file named by the caller: a path relative to the working directory or to
+// the root, or a unique trailing part of one; -1 or -2 as find_view_file().
+static int find_query_file(const ProjanitorContext *ctx, const GraphView *view, const char *file) {
+    char resolved[PATH_MAX];
+    const char *name = path_relative_to_root(ctx->root_path, file);  // files deleted since
+    if (realpath(file, resolved)) name = path_relative_to_root(ctx->root_path, resolved);
+    while (strncmp(name, "./", 2) == 0) name += 2;
+    return find_view_file(view, name);
+}
+
+static pj_status why_query(ProjanitorContext *ctx, const GraphView *view, const char *file, FILE *out, size_t *chains) {
+    int target = find_query_file(ctx, view, file);
+    if (target == -2) return fail(ctx, PJ_ERR_INVALID, "%s matches several files; give more of its path", file);
+    if (target < 0) return fail(ctx, PJ_ERR_INVALID, "%s is not a scanned file", file);
+    fprintf(out, "\n=== Why: %s ===\n", view_name(view, target));
+    int found = why_file(view, target, out);
+    if (chains) *chains = (size_t)found;
+    return PJ_OK;
+}
+
+enum { IMPACT_REACHED = 1, IMPACT_CHANGED = 2 };
+
+// Everything that references a changed file, directly or transitively, by a
+// breadth-first walk of the reverse edges. A changed CMake file also rebuilds
+// the sources it lists. The walk touches only the affected files; the listing
+// is one pass over the marks, which come out in sorted path order.
+static int impact_query(ProjanitorContext *ctx, const GraphView *view, const char *const *files, size_t count, FILE *out) {
+    int n = view->file_count;
+    uint8_t *mark = (uint8_t *)calloc(n + 1, 1);
+    int *queue = (int *)malloc((n + 1) * sizeof(int));
+    if (!mark || !queue) pj_out_of_memory();
+    StringArray unknown;
+    init_string_array(&unknown);
+    int tail = 0;
+    for (size_t i = 0; i < count; i++) {
+        int v = find_query_file(ctx, view, files[i]);
+        if (v < 0) {
+            add_to_string_array(&unknown, path_relative_to_root(ctx->root_path, files[i]));
+        } else if (!mark[v]) {
+            mark[v] = IMPACT_REACHED | IMPACT_CHANGED;
+            queue[tail++] = v;
+        }
+    }
+    int changed = tail;
+    for (int i = 0; i < changed; i++) {
+        int v = queue[i];
+        if (!is_build_root(view_name(view, v))) continue;
+        for (int e = view->offsets[v]; e < view->offsets[v + 1]; e++) {
+            int w = view->targets[e];
+            if (view->kinds[e] != REF_CMAKE_SRC || mark[w]) continue;
+            mark[w] = IMPACT_REACHED;
+            queue[tail++] = w;
+        }
+    }
+    for (int head = 0; head < tail; head++) {
+        int v = queue[head];
+        for (int e = view->rev_offsets[v]; e < view->rev_offsets[v + 1]; e++) {
+            int w = view->rev_sources[e];
+            if (mark[w]) continue;
+            mark[w] = IMPACT_REACHED;
+            queue[tail++] = w;
+        }
+    }
+
+    int units = 0, build_files = 0, test_files = 0;
+    for (int v = 0; v < n; v++) {
+        if (!mark[v]) continue;
+        const char *name = view_name(view, v);
+        if (ends_with(name, ".c")) units++;
+        else if (is_build_root(name)) build_files++;
+        else continue;
+        if (is_test_path(name)) test_files++;
+    }
+    fprintf(out, "\n=== Impact ===\n");
+    fprintf(out, "Changed: %d file%s in the graph, %d not; %d file%s affected\n", changed, changed == 1 ? "" : "s",
+            unknown.count, tail, tail == 1 ? "" : "s");
+    for (int i = 0; i < unknown.count; i++) fprintf(out, "  not in the graph: %s\n", unknown.items[i]);
+    fprintf(out, "Translation units to rebuild: %d\n", units);
+    for (int v = 0; v < n; v++) {
+        const char *name = mark[v] ? view_name(view, v) : NULL;
+        if (name && ends_with(name, ".c")) fprintf(out, "  %s%s\n", name, is_test_path(name) ? " [test]" : "");
+    }
+    fprintf(out, "CMake files listing affected sources: %d\n", build_files);
+    for (int v = 0; v < n; v++) {
+        const char *name = mark[v] ? view_name(view, v) : NULL;
+        if (name && is_build_root(name)) fprintf(out, "  %s%s\n", name, is_test_path(name) ? " [test]" : "");
+    }
+    fprintf(out, "In test directories: %d\n", test_files);
+    free_string_array(&unknown);
+    free(mark);
+    free(queue);
+    return units + build_files;
+}
+
+static void or_row(uint64_t *selected, const GraphView *view, int row) {
+    const uint64_t *bits = view->rows + (size_t)row * view->row_words;
+    for (int k = 0; k < view->row_words; k++) selected[k] |= bits[k];
+}
+
+// The tests that depend on a changed file: the OR of the changed files' rows
+// of the test map, plus the rows of the sources a changed CMake file lists.
+// The cost is one row per changed file and one bit test per test.
+static int select_tests(ProjanitorContext *ctx, const GraphView *view, const char *const *files, size_t count, FILE *out) {
+    uint64_t *selected = (uint64_t *)calloc(view->row_words + 1, sizeof(uint64_t));
+    if (!selected) pj_out_of_memory();
+    StringArray unknown;
+    init_string_array(&unknown);
+    int changed = 0;
+    for (size_t i = 0; i < count; i++) {
+        int v = find_query_file(ctx, view, files[i]);
+        if (v < 0) {
+            add_to_string_array(&unknown, path_relative_to_root(ctx->root_path, files[i]));
+            continue;
+        }
+        changed++;
+        or_row(selected, view, view->row_of[v]);
+        if (!is_build_root(view_name(view, v))) continue;
+        for (int e = view->offsets[v]; e < view->offsets[v + 1]; e++) {
+            if (view->kinds[e] == REF_CMAKE_SRC) or_row(selected, view, view->row_of[view->targets[e]]);
+        }
+    }
+
+    int targets = 0, sources = 0;
+    for (int t = 0; t < view->test_count; t++) {
+        if (!(selected[t / 64] >> (t % 64) & 1)) continue;
+        if (is_build_root(view_name(view, view->tests[t]))) targets++;
+        else sources++;
+    }
+    fprintf(out, "\n=== Test Selection ===\n");
+    fprintf(out, "Changed: %d file%s in the graph, %d not; %d of %d tests selected\n", changed, changed == 1 ? "" : "s",
+            unknown.count, targets + sources, view->test_count);
+    for (int i = 0; i < unknown.count; i++) fprintf(out, "  not in the graph: %s\n", unknown.items[i]);
+    fprintf(out, "Test targets (CMake files): %d\n", targets);
+    for (int t = 0; t < view->test_count; t++) {
+        const char *name = view_name(view, view->tests[t]);
+        if ((selected[t / 64] >> (t % 64) & 1) && is_build_root(name)) fprintf(out, "  %s\n", name);
+    }
+    fprintf(out, "Test sources: %d\n", sources);
+    for (int t = 0; t < view->test_count; t++) {
+        const char *name = view_name(view, view->tests[t]);
+        if ((selected[t / 64] >> (t % 64) & 1) && !is_build_root(name)) fprintf(out, "  %s\n", name);
+    }
+    free_string_array(&unknown);
+    free(selected);
+    return targets + sources;
+}
+
+// --- SQLite Export ---
+//
+// Writes the scan as normalized tables for ad-hoc SQL. Every row goes through
+// one prepared statement per table inside a single transaction, with journal
+// and sync off (the database is built under a temporary name and renamed into
+// place), and the indexes are built once the tables are full. SQLite itself is
+// the amalgamation vendored by `make sqlite`; without it the export reports
+// that it was not built in.
+
+#ifdef PJ_WITH_SQLITE
+
+static const char *const export_schema =
+    "CREATE TABLE meta(key TEXT PRIMARY KEY, value TEXT);"
+    "CREATE TABLE directories(id INTEGER PRIMARY KEY, path TEXT NOT NULL);"
+    "CREATE TABLE files(id INTEGER PRIMARY KEY, directory_id INTEGER NOT NULL REFERENCES directories(id),"
+    " name TEXT NOT NULL, type TEXT, size INTEGER NOT NULL, mtime INTEGER NOT NULL);"
+    "CREATE TABLE refs(id INTEGER PRIMARY KEY, file_id INTEGER NOT NULL REFERENCES files(id),"
+    " line INTEGER NOT NULL, kind TEXT NOT NULL, name TEXT NOT NULL, target_id INTEGER REFERENCES files(id));"
+    "CREATE TABLE orphans(file_id INTEGER PRIMARY KEY REFERENCES files(id));"
+    "CREATE TABLE duplicates(name TEXT NOT NULL, file_id INTEGER NOT NULL REFERENCES files(id));"
+    "CREATE TABLE missing(name TEXT NOT NULL, file_id INTEGER NOT NULL REFERENCES files(id));"
+    "CREATE VIEW file_paths AS SELECT files.id AS id, directories.path || '/' || files.name AS path"
+    " FROM files JOIN directories ON directories.id = files.directory_id;";
+
+static const char *const export_indexes =
+    "CREATE INDEX files_directory ON files(directory_id);"
+    "CREATE INDEX files_name ON files(name);"
+    "CREATE INDEX refs_file ON refs(file_id);"
+    "CREATE INDEX refs_target ON refs(target_id);"
+    "CREATE INDEX refs_name ON refs(name);"
+    "CREATE INDEX duplicates_name ON duplicates(name);"
+    "CREATE INDEX missing_name ON missing(name);";
+
+typedef struct {
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+    bool ok;
+} SqlExport;
+
+static void sql_exec(SqlExport *ex, const char *sql) {
+    if (ex->ok) ex->ok = sqlite3_exec(ex->db, sql, NULL, NULL, NULL) == SQLITE_OK;
+}
+
+static void sql_begin_insert(SqlExport *ex, const char *sql) {
+    if (ex->ok) ex->ok = sqlite3_prepare_v2(ex->db, sql, -1, &ex->stmt, NULL) == SQLITE_OK;
+}
+
+static void sql_bind_text(SqlExport *ex, int column, const char *text) {
+    if (ex->ok) ex->ok = sqlite3_bind_text(ex->stmt, column, text, -1, SQLITE_STATIC) == SQLITE_OK;
+}
+
+static void sql_bind_int(SqlExport *ex, int column, int64_t value) {
+    if (ex->ok) ex->ok = sqlite3_bind_int64(ex->stmt, column, value) == SQLITE_OK;
+}
+
+// Bind NULL for negative ids.
+static void sql_bind_id(SqlExport *ex, int column, int id) {
+    if (!ex->ok) return;
+    ex->ok = (id < 0 ? sqlite3_bind_null(ex->stmt, column) : sqlite3_bind_int64(ex->stmt, column, id)) == SQLITE_OK;
+}
+
+static void sql_insert(SqlExport *ex) {
+    if (ex->ok) ex->ok = sqlite3_step(ex->stmt) == SQLITE_DONE;
+    sqlite3_reset(ex->stmt);
+}
+
+static void sql_end_insert(SqlExport *ex) {
+    sqlite3_finalize(ex->stmt);
+    ex->stmt = NULL;
+}
+
+// Rows of one MISSING or DUPLICATES group list, by file id.
+static int export_groups(SqlExport *ex, const char *sql, const ResultGroupArray *groups, const IncludeGraph *graph) {
+    int rows = 0;
+    sql_begin_insert(ex, sql);
+    for (int g = 0; ex->ok && g < groups->count; g++) {
+        const ResultGroup *group = &groups->items[g];
+        for (int i = 0; ex->ok && i < group->paths.count; i++) {
+            int node = id_map_get(&graph->path_ids, group->paths.items[i]);
+            if (node < 0) continue;
+            sql_bind_text(ex, 1, group->name);
+            sql_bind_int(ex, 2, graph->file_ids[node]);
+            sql_insert(ex);
+            rows++;
+        }
+    }
+    sql_end_insert(ex);
+    return rows;
+}
+
+static pj_status export_sqlite(ProjanitorContext *ctx, const char *db_path, FILE *out) {
+    char tmp_path[MAX_PATH_LEN + 4];
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", db_path) >= (int)sizeof(tmp_path)) {
+        return fail(ctx, PJ_ERR_INVALID, "Path too long: %s", db_path);
+    }
+    ensure_include_graph(ctx);
+    const FileTable *files = &ctx->files;
+    const ReferenceArray *refs = &ctx->references;
+    const IncludeGraph *graph = &ctx->graph;
+    int *targets = (int *)malloc((refs->count + 1) * sizeof(int));
+    if (!targets) pj_out_of_memory();
+    for (int r = 0; r < refs->count; r++) targets[r] = -1;
+    for (int e = 0; e < graph->edge_count; e++) targets[graph->edge_refs[e]] = graph->file_ids[graph->edge_targets[e]];
+
+    unlink(tmp_path);
+    SqlExport ex = {NULL, NULL, true};
+    ex.ok = sqlite3_open(tmp_path, &ex.db) == SQLITE_OK;
+    sql_exec(&ex, "PRAGMA journal_mode=OFF; PRAGMA synchronous=OFF; PRAGMA locking_mode=EXCLUSIVE;"
+                  "PRAGMA temp_store=MEMORY; PRAGMA cache_size=-65536;");
+    sql_exec(&ex, "BEGIN");
+    sql_exec(&ex, export_schema);
+
+    sql_begin_insert(&ex, "INSERT INTO meta VALUES(?, ?)");
+    const char *meta[][2] = {{"root", ctx->root_path}, {"project", ctx->project_name}, {"version", PJ_VERSION}};
+    for (size_t i = 0; i < sizeof(meta) / sizeof(*meta); i++) {
+        sql_bind_text(&ex, 1, meta[i][0]);
+        sql_bind_text(&ex, 2, meta[i][1]);
+        sql_insert(&ex);
+    }
+    sql_end_insert(&ex);
+
+    sql_begin_insert(&ex, "INSERT INTO directories VALUES(?, ?)");
+    for (int d = 0; ex.ok && d < files->dir_count; d++) {
+        sql_bind_int(&ex, 1, d);
+        sql_bind_text(&ex, 2, files->dir_paths[d]);
+        sql_insert(&ex);
+    }
+    sql_end_insert(&ex);
+
+    int orphans = 0;
+    sql_begin_insert(&ex, "INSERT INTO files VALUES(?, ?, ?, ?, ?, ?)");
+    for (int id = 0; ex.ok && id < files->count; id++) {
+        sql_bind_int(&ex, 1, id);
+        sql_bind_int(&ex, 2, files->dir_ids[id]);
+        sql_bind_text(&ex, 3, files->names[files->name_ids[id]]);
+        sql_bind_text(&ex, 4, files->types[id] < PJ_TYPE_COUNT ? file_type_names[files->types[id]] : NULL);
+        sql_bind_int(&ex, 5, files->sizes[id]);
+        sql_bind_int(&ex, 6, files->mtimes[id]);
+        sql_insert(&ex);
+        if (!(files->flags[id] & FILE_REFERENCED)) orphans++;
+    }
+    sql_end_insert(&ex);
+
+    sql_begin_insert(&ex, "INSERT INTO refs VALUES(?, ?, ?, ?, ?, ?)");
+    for (int r = 0; ex.ok && r < refs->count; r++) {
+        const Reference *ref = &refs->items[r];
+        sql_bind_int(&ex, 1, r);
+        sql_bind_int(&ex, 2, ref->from);
+        sql_bind_int(&ex, 3, ref->line);
+        sql_bind_text(&ex, 4, ref->kind == REF_INCLUDE ? "include" : "cmake_src");
+        sql_bind_text(&ex, 5, ref->name);
+        sql_bind_id(&ex, 6, targets[r]);
+        sql_insert(&ex);
+    }
+    sql_end_insert(&ex);
+    free(targets);
+
+    sql_begin_insert(&ex, "INSERT INTO orphans VALUES(?)");
+    for (int id = 0; ex.ok && id < files->count; id++) {
+        if (files->flags[id] & FILE_REFERENCED) continue;
+        sql_bind_int(&ex, 1, id);
+        sql_insert(&ex);
+    }
+    sql_end_insert(&ex);
+
+    int duplicates = export_groups(&ex, "INSERT INTO duplicates VALUES(?, ?)", &ctx->duplicates, graph);
+    int missing = export_groups(&ex, "INSERT INTO missing VALUES(?, ?)", &ctx->missing, graph);
+    sql_exec(&ex, export_indexes);
+    sql_exec(&ex, "COMMIT");
+
+    char error[MAX_ERROR_LEN] = "";
+    bool nomem = false;
+    if (!ex.ok) {
+        snprintf(error, sizeof(error), "%s", ex.db ? sqlite3_errmsg(ex.db) : "cannot open database");
+        nomem = ex.db && sqlite3_errcode(ex.db) == SQLITE_NOMEM;
+    }
+    if (sqlite3_close(ex.db) != SQLITE_OK && ex.ok) {
+        ex.ok = false;
+        snprintf(error, sizeof(error), "cannot close database");
+    }
+    if (ex.ok && rename(tmp_path, db_path) != 0) {
+        ex.ok = false;
+        snprintf(error, sizeof(error), "%s", strerror(errno));
+    }
+    if (!ex.ok) {
+        unlink(tmp_path);
+        if (nomem) pj_out_of_memory();
+        return fail(ctx, PJ_ERR_IO, "Cannot write %s: %s", db_path, error);
+    }
+
+    fprintf(out, "\n=== SQLite Export ===\n");
+    fprintf(out, "Files: %d, references: %d, orphans: %d, duplicate rows: %d, missing rows: %d\n",
+            files->count, refs->count, orphans, duplicates, missing);
+    fprintf(out, "Written to %s\n", db_path);
+    return PJ_OK;
+}
+
+#else
+
+static pj_status export_sqlite(ProjanitorContext *ctx, const char *db_path, FILE *out) {
+    (void)db_path;
+    (void)out;
+    return fail(ctx, PJ_ERR_INVALID, "Built without SQLite support (run `make sqlite`, then rebuild)");
+}
+
+#endif // PJ_WITH_SQLITE
+
+// --- HTML Report ---
+//
+// One self-contained page: styles and markup first, then the data as gzip
+// members of tab-separated rows, each base64-encoded in its own <script> tag,
+// then the viewer. The viewer decodes a chunk only when one of its rows scrolls
+// into view (sorting and filtering decode the whole table), and the writer
+// holds one chunk at a time, so neither side materializes the full report.
+// The encoder is deflate with the fixed Huffman codes, which keeps it small;
+// report rows are repetitive enough that the matches do most of the work.
+
+#define HTML_CHUNK_BYTES (1 << 20)
+#define HTML_CHUNK_ROWS 20000
+// A row is at most two text fields, each cut below MAX_PATH_LEN bytes and
+// doubled by escaping at worst, and four numbers. Chunks are flushed once they
+// reach HTML_CHUNK_BYTES, so the buffers are sized up front and never grow
+// while the report file is open.
+#define HTML_MAX_ROW_BYTES (4 * MAX_PATH_LEN + 4 * 24)
+#define DEFLATE_WINDOW 32768
+#define DEFLATE_HASH_BITS 15
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_MAX_CHAIN 32
+
+static const uint16_t deflate_length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t deflate_length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t deflate_dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+    4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t deflate_dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static const char html_report_style[] =
+    "<!DOCTYPE html>\n"
+    "<html lang=\"en\">\n"
+    "<head>\n"
+    "<meta charset=\"utf-8\">\n"
+    "<meta name=\"generator\" content=\"projanitor\">\n"
+    "<style>\n"
+    "body { margin: 0; font: 13px system-ui, sans-serif; color: #222; display: flex; flex-direction: column; height: 100vh; }\n"
+    "header { padding: 8px 12px; background: #f4f4f4; border-bottom: 1px solid #ccc; }\n"
+    "header h1 { font-size: 16px; margin: 0 0 4px; }\n"
+    "nav { display: flex; gap: 4px; padding: 6px 12px; align-items: center; border-bottom: 1px solid #ccc; }\n"
+    "nav button.tab { border: 1px solid #bbb; background: #fff; padding: 3px 10px; cursor: pointer; }\n"
+    "nav button.tab.active { background: #335; color: #fff; }\n"
+    "nav input { margin-left: auto; width: 280px; padding: 3px 6px; }\n"
+    "#status { margin-left: 8px; color: #777; }\n"
+    "#view { flex: 1; overflow: auto; position: relative; }\n"
+    ".head, .row { display: grid; white-space: nowrap; height: 22px; line-height: 22px; }\n"
+    ".head { position: sticky; top: 0; z-index: 1; background: #e8e8ee; font-weight: 600; border-bottom: 1px solid #bbb; }\n"
+    ".head div { cursor: pointer; }\n"
+    ".head div, .row div { overflow: hidden; text-overflow: ellipsis; padding: 0 6px; }\n"
+    ".row:nth-child(even) { background: #fafafa; }\n"
+    ".row .num { text-align: right; }\n"
+    ".row .dir { cursor: pointer; font-weight: 600; }\n"
+    ".orphan { color: #b33; }\n"
+    ".pending { color: #aaa; }\n"
+    "</style>\n";
+
+static const char html_report_script[] =
+    "(function () {\n"
+    "'use strict';\n"
+    "var ROW = 22, MAX_HEIGHT = 8000000;\n"
+    "var TYPES = ['c', 'h', 'CMakeLists.txt', 'cmake', 'sh', 'json', 'py', 'md', ''];\n"
+    "\n"
+    "// Chunks are gzip members of tab-separated rows, decoded on first use.\n"
+    "var tables = {};\n"
+    "document.querySelectorAll('script[type=\"application/x-projanitor-chunk\"]').forEach(function (node) {\n"
+    "  var name = node.dataset.table, first = +node.dataset.first, rows = +node.dataset.rows;\n"
+    "  var table = tables[name] || (tables[name] = {rows: 0, chunks: []});\n"
+    "  table.chunks.push({first: first, rows: rows, node: node, data: null, pending: null});\n"
+    "  table.rows = Math.max(table.rows, first + rows);\n"
+    "});\n"
+    "function table(name) { return tables[name] || {rows: 0, chunks: []}; }\n"
+    "function unescapeField(s) {\n"
+    "  return s.indexOf('\\\\') < 0 ? s : s.replace(/\\\\(.)/g, function (m, c) { return c === 't' ? '\\t' : c === 'n' ? '\\n' : c; });\n"
+    "}\n"
+    "function decode(chunk) {\n"
+    "  if (!chunk.pending) {\n"
+    "    var text = atob(chunk.node.textContent.trim()), bytes = new Uint8Array(text.length);\n"
+    "    for (var i = 0; i < text.length; i++) bytes[i] = text.charCodeAt(i);\n"
+    "    chunk.pending = new Response(new Blob([bytes]).stream().pipeThrough(new DecompressionStream('gzip'))).text()\n"
+    "      .then(function (rows) {\n"
+    "        var lines = rows.split('\\n');\n"
+    "        lines.pop();\n"
+    "        chunk.data = lines.map(function (line) { return line.split('\\t').map(unescapeField); });\n"
+    "        chunk.node.textContent = '';\n"
+    "        return chunk.data;\n"
+    "      });\n"
+    "  }\n"
+    "  return chunk.pending;\n"
+    "}\n"
+    "function chunkOf(t, i) {\n"
+    "  var lo = 0, hi = t.chunks.length - 1;\n"
+    "  while (lo < hi) {\n"
+    "    var mid = (lo + hi + 1) >> 1;\n"
+    "    if (t.chunks[mid].first <= i) lo = mid; else hi = mid - 1;\n"
+    "  }\n"
+    "  return t.chunks[lo];\n"
+    "}\n"
+    "// Row i of a table, or null while its chunk decodes (the view redraws then).\n"
+    "function row(t, i) {\n"
+    "  var chunk = chunkOf(t, i);\n"
+    "  if (chunk.data) return chunk.data[i - chunk.first];\n"
+    "  decode(chunk).then(schedule);\n"
+    "  return null;\n"
+    "}\n"
+    "function loadAll(t) {\n"
+    "  return Promise.all(t.chunks.map(decode)).then(function () {\n"
+    "    var all = [];\n"
+    "    t.chunks.forEach(function (chunk) { Array.prototype.push.apply(all, chunk.data); });\n"
+    "    return all;\n"
+    "  });\n"
+    "}\n"
+    "\n"
+    "function esc(s) {\n"
+    "  return String(s).replace(/[&<>\"]/g, function (c) { return {'&': '&amp;', '<': '&lt;', '>': '&gt;', '\"': '&quot;'}[c]; });\n"
+    "}\n"
+    "function bytes(n) {\n"
+    "  n = +n;\n"
+    "  return n < 1024 ? n + ' B' : n < 1048576 ? (n / 1024).toFixed(1) + ' KiB' : (n / 1048576).toFixed(1) + ' MiB';\n"
+    "}\n"
+    "function date(t) { return t ? new Date(t * 1000).toISOString().slice(0, 16).replace('T', ' ') : ''; }\n"
+    "function status(s) { return (s.indexOf('o') >= 0 ? 'orphan ' : '') + (s.indexOf('d') >= 0 ? 'duplicate' : ''); }\n"
+    "\n"
+    "// dirs: path, files, bytes, first file row. files: name, dir, type, size, mtime, status.\n"
+    "var dirs = [];\n"
+    "function filePath(f) { var d = dirs[+f[1]][0]; return d === '.' ? f[0] : d + '/' + f[0]; }\n"
+    "\n"
+    "var views = {\n"
+    "  files: {\n"
+    "    title: 'Files', table: 'files', columns: ['Path', 'Type', 'Size', 'Modified', 'Status'], grid: '1fr 110px 90px 130px 130px',\n"
+    "    key: function (f, c) { return c === 0 ? filePath(f) : c === 1 ? TYPES[+f[2]] : c === 2 ? +f[3] : c === 3 ? +f[4] : f[5]; },\n"
+    "    text: function (f) { return filePath(f); },\n"
+    "    cells: function (f, depth) {\n"
+    "      var indent = depth === undefined ? '' : ' style=\"padding-left:' + (6 + 16 * depth) + 'px\"';\n"
+    "      return '<div' + indent + ' title=\"' + esc(filePath(f)) + '\">' + esc(depth === undefined ? filePath(f) : f[0]) + '</div><div>' +\n"
+    "        esc(TYPES[+f[2]]) + '</div><div class=\"num\">' + bytes(f[3]) + '</div><div>' + date(+f[4]) + '</div><div class=\"' +\n"
+    "        (f[5].indexOf('o') >= 0 ? 'orphan' : '') + '\">' + status(f[5]) + '</div>';\n"
+    "    }\n"
+    "  },\n"
+    "  orphans: {\n"
+    "    title: 'Orphans', table: 'orphans', columns: ['Path', 'Type', 'Size'], grid: '1fr 110px 90px',\n"
+    "    key: function (r, c) { return c === 2 ? +r[2] : c === 1 ? TYPES[+r[1]] : r[0]; },\n"
+    "    text: function (r) { return r[0]; },\n"
+    "    cells: function (r) { return '<div>' + esc(r[0]) + '</div><div>' + esc(TYPES[+r[1]]) + '</div><div class=\"num\">' + bytes(r[2]) + '</div>'; }\n"
+    "  },\n"
+    "  duplicates: {\n"
+    "    title: 'Duplicates', table: 'duplicates', columns: ['Name', 'Path'], grid: '240px 1fr',\n"
+    "    key: function (r, c) { return r[c]; },\n"
+    "    text: function (r) { return r[0] + '\\t' + r[1]; },\n"
+    "    cells: function (r) { return '<div>' + esc(r[0]) + '</div><div>' + esc(r[1]) + '</div>'; }\n"
+    "  },\n"
+    "  missing: {\n"
+    "    title: 'Missing', table: 'missing', columns: ['Name', 'Referenced by'], grid: '240px 1fr',\n"
+    "    key: function (r, c) { return r[c]; },\n"
+    "    text: function (r) { return r[0] + '\\t' + r[1]; },\n"
+    "    cells: function (r) { return '<div>' + esc(r[0]) + '</div><div>' + esc(r[1]) + '</div>'; }\n"
+    "  }\n"
+    "};\n"
+    "\n"
+    "// Directory tree over the dirs table; a directory's files are a contiguous\n"
+    "// range of the files table, so expanding one decodes only the chunks it spans.\n"
+    "var root = null;\n"
+    "function buildTree() {\n"
+    "  var nodes = {'.': root = {name: '.', depth: 0, children: [], first: 0, files: 0, bytes: 0, open: true}};\n"
+    "  function node(path) {\n"
+    "    if (nodes[path]) return nodes[path];\n"
+    "    var cut = path.lastIndexOf('/'), parent = node(cut < 0 ? '.' : path.slice(0, cut));\n"
+    "    var n = {name: path.slice(cut + 1), depth: parent.depth + 1, children: [], first: 0, files: 0, bytes: 0, open: false};\n"
+    "    parent.children.push(n);\n"
+    "    return nodes[path] = n;\n"
+    "  }\n"
+    "  dirs.forEach(function (d) {\n"
+    "    var n = node(d[0]);\n"
+    "    n.files = +d[1];\n"
+    "    n.bytes = +d[2];\n"
+    "    n.first = +d[3];\n"
+    "  });\n"
+    "  (function total(n) {\n"
+    "    n.total = n.files;\n"
+    "    n.totalBytes = n.bytes;\n"
+    "    n.children.forEach(function (c) {\n"
+    "      total(c);\n"
+    "      n.total += c.total;\n"
+    "      n.totalBytes += c.totalBytes;\n"
+    "    });\n"
+    "  })(root);\n"
+    "}\n"
+    "function flattenTree() {\n"
+    "  var items = [];\n"
+    "  (function walk(n) {\n"
+    "    items.push(n);\n"
+    "    if (!n.open) return;\n"
+    "    n.children.forEach(walk);\n"
+    "    for (var i = 0; i < n.files; i++) items.push({file: n.first + i, depth: n.depth + 1});\n"
+    "  })(root);\n"
+    "  return items;\n"
+    "}\n"
+    "\n"
+    "var state = {view: 'files', sort: -1, desc: false, filter: '', order: null, items: null, token: 0};\n"
+    "var container = document.getElementById('view');\n"
+    "function count() { return state.order ? state.order.length : state.items ? state.items.length : table(views[state.view].table).rows; }\n"
+    "function setStatus(text) { document.getElementById('status').textContent = text; }\n"
+    "\n"
+    "// Only the rows in the viewport are in the DOM. Past MAX_HEIGHT the scroll\n"
+    "// range is scaled, since browsers cap element heights.\n"
+    "function draw() {\n"
+    "  var view = views[state.view], t = table(view.table), n = count();\n"
+    "  var scaled = n * ROW > MAX_HEIGHT, height = scaled ? MAX_HEIGHT : n * ROW;\n"
+    "  var visible = Math.ceil(container.clientHeight / ROW) + 1, first, top;\n"
+    "  if (scaled) {\n"
+    "    first = Math.floor(container.scrollTop / Math.max(height - container.clientHeight + ROW, 1) * (n - visible + 1));\n"
+    "    top = container.scrollTop;\n"
+    "  } else {\n"
+    "    first = Math.floor(container.scrollTop / ROW);\n"
+    "  }\n"
+    "  first = Math.max(0, Math.min(first, n - visible));\n"
+    "  if (!scaled) top = first * ROW;\n"
+    "  var head = '<div class=\"head\" style=\"grid-template-columns:' + view.grid + '\">' + view.columns.map(function (c, i) {\n"
+    "    return '<div data-col=\"' + i + '\">' + esc(c) + (state.sort === i ? (state.desc ? ' ▼' : ' ▲') : '') + '</div>';\n"
+    "  }).join('') + '</div>';\n"
+    "  var rows = [];\n"
+    "  for (var i = first; i < Math.min(n, first + visible); i++) {\n"
+    "    var cells;\n"
+    "    if (state.order) {\n"
+    "      cells = view.cells(state.order[i]);\n"
+    "    } else if (state.items) {\n"
+    "      var item = state.items[i];\n"
+    "      if (item.file === undefined) {\n"
+    "        cells = '<div class=\"dir\" data-item=\"' + i + '\" style=\"padding-left:' + (6 + 16 * item.depth) + 'px\">' + (item.open ? '▾ ' : '▸ ') +\n"
+    "          esc(item.name) + '</div><div>' + item.total + (item.total === 1 ? ' file' : ' files') + '</div><div class=\"num\">' + bytes(item.totalBytes) + '</div><div></div><div></div>';\n"
+    "      } else {\n"
+    "        var f = row(t, item.file);\n"
+    "        cells = f ? view.cells(f, item.depth) : '<div class=\"pending\">…</div>';\n"
+    "      }\n"
+    "    } else {\n"
+    "      var r = row(t, i);\n"
+    "      cells = r ? view.cells(r) : '<div class=\"pending\">…</div>';\n"
+    "    }\n"
+    "    rows.push('<div class=\"row\" style=\"grid-template-columns:' + view.grid + '\">' + cells + '</div>');\n"
+    "  }\n"
+    "  container.innerHTML = head + '<div style=\"position:relative;overflow:hidden;height:' + height + 'px\">' +\n"
+    "    '<div style=\"position:absolute;left:0;right:0;top:' + top + 'px\">' + rows.join('') + '</div></div>';\n"
+    "}\n"
+    "var queued = false;\n"
+    "function schedule() {\n"
+    "  if (queued) return;\n"
+    "  queued = true;\n"
+    "  requestAnimationFrame(function () { queued = false; draw(); });\n"
+    "}\n"
+    "\n"
+    "// Sorting and filtering need every row, so they decode the whole table once.\n"
+    "function refresh() {\n"
+    "  var view = views[state.view], token = ++state.token;\n"
+    "  state.order = null;\n"
+    "  state.items = state.view === 'files' && root ? flattenTree() : null;\n"
+    "  if (state.sort < 0 && !state.filter) {\n"
+    "    setStatus(count() + ' rows');\n"
+    "    draw();\n"
+    "    return;\n"
+    "  }\n"
+    "  setStatus('Loading…');\n"
+    "  loadAll(table(view.table)).then(function (all) {\n"
+    "    if (token !== state.token) return;\n"
+    "    var needle = state.filter.toLowerCase();\n"
+    "    var order = needle ? all.filter(function (r) { return view.text(r).toLowerCase().indexOf(needle) >= 0; }) : all.slice();\n"
+    "    if (state.sort >= 0) {\n"
+    "      var col = state.sort, sign = state.desc ? -1 : 1;\n"
+    "      order.sort(function (a, b) { var x = view.key(a, col), y = view.key(b, col); return x < y ? -sign : x > y ? sign : 0; });\n"
+    "    }\n"
+    "    state.order = order;\n"
+    "    state.items = null;\n"
+    "    setStatus(order.length + ' of ' + all.length + ' rows');\n"
+    "    draw();\n"
+    "  });\n"
+    "}\n"
+    "\n"
+    "var nav = document.getElementById('tabs');\n"
+    "Object.keys(views).forEach(function (name) {\n"
+    "  var button = document.createElement('button');\n"
+    "  button.className = 'tab';\n"
+    "  button.dataset.view = name;\n"
+    "  button.textContent = views[name].title + ' (' + table(views[name].table).rows + ')';\n"
+    "  nav.appendChild(button);\n"
+    "});\n"
+    "function select(name) {\n"
+    "  state.view = name;\n"
+    "  state.sort = -1;\n"
+    "  state.filter = document.getElementById('filter').value = '';\n"
+    "  nav.querySelectorAll('.tab').forEach(function (b) { b.classList.toggle('active', b.dataset.view === name); });\n"
+    "  container.scrollTop = 0;\n"
+    "  refresh();\n"
+    "}\n"
+    "nav.addEventListener('click', function (e) { if (e.target.dataset.view) select(e.target.dataset.view); });\n"
+    "container.addEventListener('scroll', schedule);\n"
+    "window.addEventListener('resize', schedule);\n"
+    "container.addEventListener('click', function (e) {\n"
+    "  var target = e.target;\n"
+    "  if (target.dataset.col !== undefined) {\n"
+    "    var col = +target.dataset.col;\n"
+    "    state.desc = state.sort === col ? !state.desc : false;\n"
+    "    state.sort = col;\n"
+    "    refresh();\n"
+    "  } else if (target.dataset.item !== undefined && state.items) {\n"
+    "    var item = state.items[+target.dataset.item];\n"
+    "    item.open = !item.open;\n"
+    "    state.items = flattenTree();\n"
+    "    setStatus(count() + ' rows');\n"
+    "    draw();\n"
+    "  }\n"
+    "});\n"
+    "var timer = 0;\n"
+    "document.getElementById('filter').addEventListener('input', function (e) {\n"
+    "  clearTimeout(timer);\n"
+    "  timer = setTimeout(function () { state.filter = e.target.value; refresh(); }, 200);\n"
+    "});\n"
+    "\n"
+    "loadAll(table('dirs')).then(function (all) {\n"
+    "  dirs = all;\n"
+    "  buildTree();\n"
+    "  select('files');\n"
+    "});\n"
+    "})();\n";
+
+typedef struct {
+    FILE *file;
+    const char *table;      // the table the pending rows belong to
+    int first;              // row index of the chunk's first row
+    int rows;
+    char *raw;              // pending rows, tab-separated
+    size_t len;
+    size_t capacity;
+    uint8_t *packed;        // gzip member of the pending rows
+    size_t packed_capacity;
+    int32_t *head;          // deflate hash chains
+    int32_t *prev;
+    uint32_t crc_table[256];
+    int chunks;
+} HtmlWriter;
+
+typedef struct {
+    uint8_t *out;
+    size_t len;
+    uint32_t bits;
+    int bit_count;
+} BitWriter;
+
+static void put_bits(BitWriter *w, uint32_t value, int count) {
+    w->bits |= value << w->bit_count;
+    w->bit_count += count;
+    while (w->bit_count >= 8) {
+        w->out[w->len++] = (uint8_t)w->bits;
+        w->bits >>= 8;
+        w->bit_count -= 8;
+    }
+}
+
+// Huffman codes go out most significant bit first.
+static void put_code(BitWriter *w, uint32_t code, int length) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++) reversed |= ((code >> i) & 1u) << (length - 1 - i);
+    put_bits(w, reversed, length);
+}
+
+static void put_symbol(BitWriter *w, int symbol) {
+    if (symbol < 144) put_code(w, 0x30 + symbol, 8);
+    else if (symbol < 256) put_code(w, 0x190 + symbol - 144, 9);
+    else if (symbol < 280) put_code(w, symbol - 256, 7);
+    else put_code(w, 0xC0 + symbol - 280, 8);
+}
+
+static void put_match(BitWriter *w, int length, int distance) {
+    int l = 28;
+    while (deflate_length_base[l] > length) l--;
+    put_symbol(w, 257 + l);
+    put_bits(w, length - deflate_length_base[l], deflate_length_extra[l]);
+    int d = 29;
+    while (deflate_dist_base[d] > distance) d--;
+    put_code(w, d, 5);
+    put_bits(w, distance - deflate_dist_base[d], deflate_dist_extra[d]);
+}
+
+static uint32_t deflate_hash(const uint8_t *p) {
+    return (((uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2]) * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+// One fixed-Huffman block over the whole input, greedy matches from hash chains.
+static size_t deflate_fixed(HtmlWriter *w, const uint8_t *in, size_t n, uint8_t *out) {
+    BitWriter bits = {out, 0, 0, 0};
+    put_bits(&bits, 1, 1);     // BFINAL
+    put_bits(&bits, 1, 2);     // BTYPE 01: fixed codes
+    for (int i = 0; i < 1 << DEFLATE_HASH_BITS; i++) w->head[i] = -1;
+    size_t i = 0;
+    while (i < n) {
+        size_t best_len = 0, best_dist = 0;
+        if (i + DEFLATE_MIN_MATCH <= n) {
+            uint32_t h = deflate_hash(in + i);
+            size_t max = n - i < DEFLATE_MAX_MATCH ? n - i : DEFLATE_MAX_MATCH;
+            int chain = DEFLATE_MAX_CHAIN;
+            for (int32_t c = w->head[h]; c >= 0 && i - (size_t)c <= DEFLATE_WINDOW && chain-- > 0;
+                 c = w->prev[c & (DEFLATE_WINDOW - 1)]) {
+                if (in[c + best_len] != in[i + best_len]) continue;
+                size_t len = 0;
+                while (len < max && in[c + len] == in[i + len]) len++;
+                if (len > best_len) {
+                    best_len = len;
+                    best_dist = i - (size_t)c;
+                    if (len == max) break;
+                }
+            }
+            w->prev[i & (DEFLATE_WINDOW - 1)] = w->head[h];
+            w->head[h] = (int32_t)i;
+        }
+        if (best_len < DEFLATE_MIN_MATCH) {
+            put_symbol(&bits, in[i++]);
+            continue;
+        }
+        put_match(&bits, (int)best_len, (int)best_dist);
+        size_t end = i + best_len;
+        for (i++; i < end; i++) {
+            if (i + DEFLATE_MIN_MATCH > n) continue;
+            uint32_t h = deflate_hash(in + i);
+            w->prev[i & (DEFLATE_WINDOW - 1)] = w->head[h];
+            w->head[h] = (int32_t)i;
+        }
+    }
+    put_symbol(&bits, 256);
+    if (bits.bit_count > 0) bits.out[bits.len++] = (uint8_t)bits.bits;
+    return bits.len;
+}
+
+static uint32_t crc32_update(const uint32_t *table, uint32_t crc, const uint8_t *data, size_t len) {
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void put_le32(uint8_t *p, uint32_t value) {
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(value >> (8 * i));
+}
+
+static void write_base64(FILE *file, const uint8_t *data, size_t len) {
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char line[4096];
+    size_t used = 0;
+    for (size_t i = 0; i < len; i += 3) {
+        uint32_t v = (uint32_t)data[i] << 16;
+        if (i + 1 < len) v |= (uint32_t)data[i + 1] << 8;
+        if (i + 2 < len) v |= data[i + 2];
+        line[used++] = digits[v >> 18];
+        line[used++] = digits[(v >> 12) & 63];
+        line[used++] = i + 1 < len ? digits[(v >> 6) & 63] : '=';
+        line[used++] = i + 2 < len ? digits[v & 63] : '=';
+        if (used + 4 > sizeof(line)) {
+            fwrite(line, 1, used, file);
+            used = 0;
+        }
+    }
+    fwrite(line, 1, used, file);
+}
+
+// Size of the gzip member of `len` raw bytes at most: fixed codes spend no
+// more than nine bits on a byte, plus the header, trailer and block framing.
+static size_t gzip_bound(size_t len) {
+    return len + len / 8 + 64;
+}
+
+static void html_flush_chunk(HtmlWriter *w) {
+    if (w->rows == 0) return;
+    static const uint8_t gzip_header[10] = {0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF};
+    memcpy(w->packed, gzip_header, sizeof(gzip_header));
+    size_t len = sizeof(gzip_header) + deflate_fixed(w, (const uint8_t *)w->raw, w->len, w->packed + sizeof(gzip_header));
+    put_le32(w->packed + len, crc32_update(w->crc_table, 0, (const uint8_t *)w->raw, w->len));
+    put_le32(w->packed + len + 4, (uint32_t)w->len);
+    len += 8;
+    fprintf(w->file, "<script type=\"application/x-projanitor-chunk\" data-table=\"%s\" data-first=\"%d\" data-rows=\"%d\">",
+            w->table, w->first, w->rows);
+    write_base64(w->file, w->packed, len);
+    fputs("</script>\n", w->file);
+    w->first += w->rows;
+    w->rows = 0;
+    w->len = 0;
+    w->chunks++;
+}
+
+static void html_begin_table(HtmlWriter *w, const char *table) {
+    html_flush_chunk(w);
+    w->table = table;
+    w->first = 0;
+}
+
+// Appends one field, escaping the separators, followed by a tab. Text past
+// MAX_PATH_LEN - 1 bytes is cut, see HTML_MAX_ROW_BYTES.
+static void html_field(HtmlWriter *w, const char *text) {
+    const char *end = text + strnlen(text, MAX_PATH_LEN - 1);
+    for (const char *p = text; p < end; p++) {
+        if (*p == '\\' || *p == '\t' || *p == '\n') {
+            w->raw[w->len++] = '\\';
+            w->raw[w->len++] = *p == '\t' ? 't' : *p == '\n' ? 'n' : '\\';
+        } else {
+            w->raw[w->len++] = *p;
+        }
+    }
+    w->raw[w->len++] = '\t';
+}
+
+static void html_number(HtmlWriter *w, int64_t value) {
+    char text[24];
+    snprintf(text, sizeof(text), "%lld", (long long)value);
+    html_field(w, text);
+}
+
+static void html_end_row(HtmlWriter *w) {
+    w->raw[w->len - 1] = '\n';
+    if (++w->rows >= HTML_CHUNK_ROWS || w->len >= HTML_CHUNK_BYTES) html_flush_chunk(w);
+}
+
+static void write_html_text(FILE *file, const char *text) {
+    for (const char *p = text; *p; p++) {
+        switch (*p) {
+            case '&': fputs("&amp;", file); break;
+            case '<': fputs("&lt;", file); break;
+            case '>': fputs("&gt;", file); break;
+            case '"': fputs("&quot;", file); break;
+            default: fputc(*p, file);
+        }
+    }
+}
+
+// Path relative to the root, "." for the root itself.
+static const char *report_relative_path(const ProjanitorContext *ctx, const char *path) {
+    size_t root_len = strlen(ctx->root_path);
+    if (strncmp(path, ctx->root_path, root_len) != 0) return path;
+    if (path[root_len] == '\0') return ".";
+    return path[root_len] == '/' ? path + root_len + 1 : path;
+}
+
+static void html_groups(HtmlWriter *w, const ProjanitorContext *ctx, const char *table, const ResultGroupArray *groups) {
+    html_begin_table(w, table);
+    for (int g = 0; g < groups->count; g++) {
+        for (int i = 0; i < groups->items[g].paths.count; i++) {
+            html_field(w, groups->items[g].name);
+            html_field(w, report_relative_path(ctx, groups->items[g].paths.items[i]));
+            html_end_row(w);
+        }
+    }
+}
+
+static pj_status write_html_report(ProjanitorContext *ctx, const char *html_path, FILE *out) {
+    char tmp_path[MAX_PATH_LEN + 4];
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", html_path) >= (int)sizeof(tmp_path)) {
+        return fail(ctx, PJ_ERR_INVALID, "Path too long: %s", html_path);
+    }
+    const FileTable *files = &ctx->files;
+
+    // Everything is allocated before the file is created, so an out-of-memory
+    // unwind never leaves it open or behind.
+    HtmlWriter w;
+    memset(&w, 0, sizeof(w));
+    w.capacity = HTML_CHUNK_BYTES + HTML_MAX_ROW_BYTES;
+    w.packed_capacity = gzip_bound(w.capacity);
+    w.raw = (char *)malloc(w.capacity);
+    w.packed = (uint8_t *)malloc(w.packed_capacity);
+    w.head = (int32_t *)malloc(sizeof(int32_t) << DEFLATE_HASH_BITS);
+    w.prev = (int32_t *)malloc(DEFLATE_WINDOW * sizeof(int32_t));
+    // Per-directory file ranges in sorted order, where each directory's files are contiguous
+    int32_t *dir_rows = (int32_t *)malloc((files->dir_count + 1) * sizeof(int32_t));
+    if (!w.raw || !w.packed || !w.head || !w.prev || !dir_rows) {
+        free(w.raw);
+        free(w.packed);
+        free(w.head);
+        free(w.prev);
+        free(dir_rows);
+        pj_out_of_memory();
+    }
+    FILE *file = fopen(tmp_path, "w");
+    if (!file) {
+        free(w.raw);
+        free(w.packed);
+        free(w.head);
+        free(w.prev);
+        free(dir_rows);
+        return fail(ctx, PJ_ERR_IO, "Cannot create %s: %s", tmp_path, strerror(errno));
+    }
+    w.file = file;
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        w.crc_table[n] = c;
+    }
+
+    fputs(html_report_style, file);
+    fputs("<title>projanitor: ", file);
+    write_html_text(file, ctx->project_name);
+    fputs("</title>\n</head>\n<body>\n<header><h1>", file);
+    write_html_text(file, ctx->project_name);
+    fputs("</h1><div>", file);
+    write_html_text(file, ctx->root_path);
+    fprintf(file, " &middot; %d files &middot; %d orphans &middot; %d duplicate names &middot; %d missing</div></header>\n",
+            files->count, ctx->orphans.count, ctx->duplicates.count, ctx->missing.count);
+    fputs("<nav id=\"tabs\"><input id=\"filter\" type=\"search\" placeholder=\"Filter\"><span id=\"status\"></span></nav>\n"
+          "<div id=\"view\"></div>\n", file);
+
+    // dirs: path, files, bytes, first file row
+    int dir_count = 0;
+    for (int d = 0; d < files->dir_count; d++) dir_rows[d] = -1;
+    html_begin_table(&w, "dirs");
+    for (int i = 0; i < files->count;) {
+        int d = files->dir_ids[files->sorted[i]];
+        int end = i;
+        int64_t bytes = 0;
+        while (end < files->count && files->dir_ids[files->sorted[end]] == d) bytes += files->sizes[files->sorted[end++]];
+        dir_rows[d] = dir_count++;
+        html_field(&w, report_relative_path(ctx, files->dir_paths[d]));
+        html_number(&w, end - i);
+        html_number(&w, bytes);
+        html_number(&w, i);
+        html_end_row(&w);
+        i = end;
+    }
+
+    // files: name, dir, type, size, mtime, status (o: orphan, d: duplicate name)
+    html_begin_table(&w, "files");
+    for (int i = 0; i < files->count; i++) {
+        int id = files->sorted[i];
+        char status[3] = "";
+        int s = 0;
+        if (!(files->flags[id] & FILE_REFERENCED)) status[s++] = 'o';
+        if (files->name_sizes[files->name_ids[id]] > 1) status[s++] = 'd';
+        status[s] = '\0';
+        html_field(&w, files->names[files->name_ids[id]]);
+        html_number(&w, dir_rows[files->dir_ids[id]]);
+        html_number(&w, files->types[id]);
+        html_number(&w, files->sizes[id]);
+        html_number(&w, files->mtimes[id]);
+        html_field(&w, status);
+        html_end_row(&w);
+    }
+    free(dir_rows);
+
+    // orphans: path, type, size
+    html_begin_table(&w, "orphans");
+    for (int i = 0; i < files->count; i++) {
+        int id = files->sorted[i];
+        if (files->flags[id] & FILE_REFERENCED) continue;
+        html_field(&w, report_relative_path(ctx, files->paths[id]));
+        html_number(&w, files->types[id]);
+        html_number(&w, files->sizes[id]);
+        html_end_row(&w);
+    }
+    html_groups(&w, ctx, "duplicates", &ctx->duplicates);
+    html_groups(&w, ctx, "missing", &ctx->missing);
+    html_flush_chunk(&w);
+
+    fputs("<script>\n", file);
+    fputs(html_report_script, file);
+    fputs("</script>\n</body>\n</html>\n", file);
+    free(w.raw);
+    free(w.packed);
+    free(w.head);
+    free(w.prev);
+
+    pj_status status = commit_temp_file(ctx, file, tmp_path, html_path);
+    if (status != PJ_OK) return status;
+
+    fprintf(out, "\n=== HTML Report ===\n");
+    fprintf(out, "Files: %d, directories: %d, data chunks: %d\n", files->count, dir_count, w.chunks);
+    fprintf(out, "Written to %s\n", html_path);
+    return PJ_OK;
+}
+
+// --- Graph Export ---
+//
+// The reference graph as DOT or GraphML, optionally collapsed to one node per
+// directory or component. Every file node gets a group id up front (directory
+// ids already are integers; components are derived once per directory), then a
+// single pass over the edges folds them into weighted group edges through an
+// open-addressed table keyed by the (source, target) pair.
+
+typedef struct {
+    uint64_t *keys;         // source << 32 | target, 0 for an empty slot (keys are stored + 1)
+    int *edges;             // index into the output edge list
+    int size;
+} GroupEdgeTable;
+
+typedef struct {
+    int source;
+    int target;
+    int weight;             // references folded into the edge
+    uint8_t kinds;          // 1 << RefKind
+} GroupEdge;
+
+// "components/<name>" (at any depth) for ESP-IDF style trees, else the
+// top-level directory; "." for the root.
+static void component_of(const char *dir, char *component, size_t size) {
+    const char *p = dir;
+    while (p) {
+        if (strncmp(p, "components/", 11) == 0) {
+            const char *end = strchr(p + 11, '/');
+            size_t len = end ? (size_t)(end - dir) : strlen(dir);
+            snprintf(component, size, "%.*s", (int)len, dir);
+            return;
+        }
+        p = strchr(p, '/');
+        if (p) p++;
+    }
+    const char *slash = strchr(dir, '/');
+    snprintf(component, size, "%.*s", slash ? (int)(slash - dir) : (int)strlen(dir), dir);
+}
+
+static void write_xml_text(FILE *file, const char *text) {
+    for (const char *p = text; *p; p++) {
+        switch (*p) {
+            case '&': fputs("&amp;", file); break;
+            case '<': fputs("&lt;", file); break;
+            case '>': fputs("&gt;", file); break;
+            case '"': fputs("&quot;", file); break;
+            default: fputc(*p, file);
+        }
+    }
+}
+
+static void write_dot_text(FILE *file, const char *text) {
+    for (const char *p = text; *p; p++) {
+        if (*p == '"' || *p == '\\') fputc('\\', file);
+        fputc(*p, file);
+    }
+}
+
+static pj_status export_graph(ProjanitorContext *ctx, const char *graph_path, pj_graph_format format,
+                              pj_graph_aggregate aggregate, FILE *out) {
+    char tmp_path[MAX_PATH_LEN + 4];
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", graph_path) >= (int)sizeof(tmp_path)) {
+        return fail(ctx, PJ_ERR_INVALID, "Path too long: %s", graph_path);
+    }
+    ensure_include_graph(ctx);
+    const IncludeGraph *graph = &ctx->graph;
+    const FileTable *files = &ctx->files;
+    const ReferenceArray *refs = &ctx->references;
+    int n = graph->file_count;
+
+    // Group of every node, group labels and sizes
+    int *group_of = (int *)large_alloc((n + 1) * sizeof(int));
+    int *dir_group = (int *)malloc((files->dir_count + 1) * sizeof(int));
+    const char **labels = (const char **)malloc((n + 1) * sizeof(char *));
+    int *group_files = (int *)calloc(n + 1, sizeof(int));
+    if (!dir_group || !labels || !group_files) pj_out_of_memory();
+    StringArena label_strings;
+    memset(&label_strings, 0, sizeof(label_strings));
+    IdMap component_ids;
+    init_id_map(&component_ids, aggregate == PJ_AGGREGATE_COMPONENT ? files->dir_count : 0);
+    int group_count = 0;
+    for (int d = 0; d < files->dir_count; d++) dir_group[d] = -1;
+    for (int v = 0; v < n; v++) {
+        int id = graph->file_ids[v];
+        int d = files->dir_ids[id];
+        int g;
+        if (aggregate == PJ_AGGREGATE_NONE) {
+            g = group_count++;
+            labels[g] = report_relative_path(ctx, graph->paths[v]);
+        } else if (dir_group[d] >= 0) {
+            g = dir_group[d];
+        } else if (aggregate == PJ_AGGREGATE_DIRECTORY) {
+            g = dir_group[d] = group_count++;
+            labels[g] = report_relative_path(ctx, files->dir_paths[d]);
+        } else {
+            char component[MAX_PATH_LEN];
+            component_of(report_relative_path(ctx, files->dir_paths[d]), component, sizeof(component));
+            g = id_map_get(&component_ids, component);
+            if (g < 0) {
+                g = group_count++;
+                labels[g] = arena_strdup(&label_strings, component);
+                id_map_put(&component_ids, labels[g], g);
+            }
+            dir_group[d] = g;
+        }
+        group_of[v] = g;
+        group_files[g]++;
+    }
+
+    // One pass over the edges; edges inside a group vanish when aggregating
+    GroupEdgeTable table;
+    table.size = 16;
+    while (table.size < graph->edge_count * 2) table.size *= 2;
+    table.keys = (uint64_t *)large_alloc(table.size * sizeof(uint64_t));
+    table.edges = (int *)large_alloc(table.size * sizeof(int));
+    GroupEdge *edges = (GroupEdge *)large_alloc((graph->edge_count + 1) * sizeof(GroupEdge));
+    int edge_count = 0;
+    for (int v = 0; v < n; v++) {
+        int source = group_of[v];
+        for (int e = graph->edge_offsets[v]; e < graph->edge_offsets[v + 1]; e++) {
+            int target = group_of[graph->edge_targets[e]];
+            if (aggregate != PJ_AGGREGATE_NONE && source == target) continue;
+            uint64_t key = ((uint64_t)source << 32 | (uint32_t)target) + 1;
+            uint32_t i = (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (uint32_t)(table.size - 1);
+            while (table.keys[i] && table.keys[i] != key) i = (i + 1) & (uint32_t)(table.size - 1);
+            if (!table.keys[i]) {
+                table.keys[i] = key;
+                table.edges[i] = edge_count;
+                edges[edge_count++] = (GroupEdge){source, target, 0, 0};
+            }
+            GroupEdge *edge = &edges[table.edges[i]];
+            edge->weight++;
+            edge->kinds |= (uint8_t)(1u << refs->items[graph->edge_refs[e]].kind);
+        }
+    }
+    large_free(table.keys);
+    large_free(table.edges);
+    large_free(group_of);
+    free(dir_group);
+    free_id_map(&component_ids);
+
+    FILE *file = fopen(tmp_path, "w");
+    if (!file) {
+        large_free(edges);
+        free(labels);
+        free(group_files);
+        free_string_arena(&label_strings);
+        return fail(ctx, PJ_ERR_IO, "Cannot create %s: %s", tmp_path, strerror(errno));
+    }
+    static const char *const kind_names[] = {"include", "cmake_src", "mixed"};
+    if (format == PJ_GRAPH_DOT) {
+        fputs("digraph \"", file);
+        write_dot_text(file, ctx->project_name);
+        fputs("\" {\n  node [shape=box];\n", file);
+        for (int g = 0; g < group_count; g++) {
+            fprintf(file, "  n%d [label=\"", g);
+            write_dot_text(file, labels[g]);
+            if (aggregate != PJ_AGGREGATE_NONE) fprintf(file, "\\n%d file%s", group_files[g], group_files[g] == 1 ? "" : "s");
+            fputs("\"];\n", file);
+        }
+        for (int i = 0; i < edge_count; i++) {
+            const GroupEdge *edge = &edges[i];
+            fprintf(file, "  n%d -> n%d [weight=%d", edge->source, edge->target, edge->weight);
+            if (edge->weight > 1) fprintf(file, ", label=\"%d\"", edge->weight);
+            if (edge->kinds == 1u << REF_CMAKE_SRC) fputs(", style=dashed", file);
+            fputs("];\n", file);
+        }
+        fputs("}\n", file);
+    } else {
+        fputs("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+              "<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\">\n"
+              "  <key id=\"label\" for=\"node\" attr.name=\"label\" attr.type=\"string\"/>\n"
+              "  <key id=\"files\" for=\"node\" attr.name=\"files\" attr.type=\"int\"/>\n"
+              "  <key id=\"weight\" for=\"edge\" attr.name=\"weight\" attr.type=\"int\"/>\n"
+              "  <key id=\"kind\" for=\"edge\" attr.name=\"kind\" attr.type=\"string\"/>\n"
+              "  <graph id=\"", file);
+        write_xml_text(file, ctx->project_name);
+        fputs("\" edgedefault=\"directed\">\n", file);
+        for (int g = 0; g < group_count; g++) {
+            fprintf(file, "    <node id=\"n%d\"><data key=\"label\">", g);
+            write_xml_text(file, labels[g]);
+            fprintf(file, "</data><data key=\"files\">%d</data></node>\n", group_files[g]);
+        }
+        for (int i = 0; i < edge_count; i++) {
+            const GroupEdge *edge = &edges[i];
+            int kind = edge->kinds == 1u << REF_INCLUDE ? 0 : edge->kinds == 1u << REF_CMAKE_SRC ? 1 : 2;
+            fprintf(file, "    <edge source=\"n%d\" target=\"n%d\"><data key=\"weight\">%d</data><data key=\"kind\">%s</data></edge>\n",
+                    edge->source, edge->target, edge->weight, kind_names[kind]);
+        }
+        fputs("  </graph>\n</graphml>\n", file);
+    }
+    large_free(edges);
+    free(labels);
+    free(group_files);
+    free_string_arena(&label_strings);
+
+    pj_status status = commit_temp_file(ctx, file, tmp_path, graph_path);
+    if (status != PJ_OK) return status;
+
+    fprintf(out, "\n=== Graph Export ===\n");
+    fprintf(out, "Nodes: %d, edges: %d (from %d files and %d resolved references)\n", group_count, edge_count, n, graph->edge_count);
+    fprintf(out, "Written to %s\n", graph_path);
+    return PJ_OK;
+}
+
+// --- Metrics ---
+//
+// Prometheus text exposition of the last scan's findings and cost, for the
+// node-exporter textfile collector. The file is written under a temporary name
+// (which the collector ignores, as it does not end in .prom) and renamed into
+// place, so a scrape never sees a partial file. Every value describes one run,
+// so every metric is a gauge.
+
+static void write_metric_label(FILE *file, const char *value) {
+    for (const char *p = value; *p; p++) {
+        if (*p == '\\' || *p == '"') fputc('\\', file);
+        if (*p == '\n') {
+            fputs("\\n", file);
+        } else {
+            fputc(*p, file);
+        }
+    }
+}
+
+// # HELP / # TYPE lines of a gauge.
+static void write_metric_header(FILE *file, const char *name, const char *help) {
+    fprintf(file, "# HELP %s %s\n# TYPE %s gauge\n", name, help, name);
+}
+
+// `name{project="...",<label>="<value>"} ` with an optional extra label.
+static void write_metric_name(FILE *file, const ProjanitorContext *ctx, const char *name, const char *label, const char *value) {
+    fprintf(file, "%s{project=\"", name);
+    write_metric_label(file, ctx->project_name);
+    if (label) {
+        fprintf(file, "\",%s=\"", label);
+        write_metric_label(file, value);
+    }
+    fputs("\"} ", file);
+}
+
+static pj_status write_metrics(ProjanitorContext *ctx, const char *metrics_path, FILE *out) {
+    char tmp_path[MAX_PATH_LEN + 4];
+    if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", metrics_path) >= (int)sizeof(tmp_path)) {
+        return fail(ctx, PJ_ERR_INVALID, "Path too long: %s", metrics_path);
+    }
+    static const char *const phase_names[PHASE_COUNT] = {"discover", "build_files", "tree", "results", "graph"};
+    const ScanStats *stats = &ctx->stats;
+    struct rusage usage;
+    long long peak_rss = getrusage(RUSAGE_SELF, &usage) == 0 ? (long long)usage.ru_maxrss * 1024 : -1;
+
+    FILE *file = fopen(tmp_path, "w");
+    if (!file) return fail(ctx, PJ_ERR_IO, "Cannot create %s: %s", tmp_path, strerror(errno));
+
+    write_metric_header(file, "projanitor_files", "Files of interest found by the scan.");
+    write_metric_name(file, ctx, "projanitor_files", NULL, NULL);
+    fprintf(file, "%d\n", ctx->files.count);
+    write_metric_header(file, "projanitor_files_by_type", "Files of interest by type.");
+    for (int t = 0; t < PJ_TYPE_COUNT; t++) {
+        write_metric_name(file, ctx, "projanitor_files_by_type", "type", file_type_names[t]);
+        fprintf(file, "%zu\n", ctx->type_counts[t]);
+    }
+    write_metric_header(file, "projanitor_orphaned_files", "Files whose name no reference mentions.");
+    write_metric_name(file, ctx, "projanitor_orphaned_files", NULL, NULL);
+    fprintf(file, "%d\n", ctx->orphans.count);
+    write_metric_header(file, "projanitor_missing_names", "Referenced names that match no file.");
+    write_metric_name(file, ctx, "projanitor_missing_names", NULL, NULL);
+    fprintf(file, "%d\n", ctx->missing.count);
+    write_metric_header(file, "projanitor_duplicate_names", "Basenames found more than once.");
+    write_metric_name(file, ctx, "projanitor_duplicate_names", NULL, NULL);
+    fprintf(file, "%d\n", ctx->duplicates.count);
+
+    write_metric_header(file, "projanitor_phase_seconds", "Wall time of each phase of the scan.");
+    double total = 0;
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        write_metric_name(file, ctx, "projanitor_phase_seconds", "phase", phase_names[p]);
+        fprintf(file, "%.6f\n", stats->phase_seconds[p]);
+        total += stats->phase_seconds[p];
+    }
+    write_metric_header(file, "projanitor_scan_seconds", "Wall time of all phases.");
+    write_metric_name(file, ctx, "projanitor_scan_seconds", NULL, NULL);
+    fprintf(file, "%.6f\n", total);
+    write_metric_header(file, "projanitor_read_bytes", "Bytes of file contents read by the scan.");
+    write_metric_name(file, ctx, "projanitor_read_bytes", NULL, NULL);
+    fprintf(file, "%llu\n", (unsigned long long)stats->bytes_read);
+    write_metric_header(file, "projanitor_syscalls", "Filesystem calls made by the scan (read: whole process, from /proc/self/io).");
+    const struct { const char *call; long long count; } calls[] = {
+        {"stat", (long long)stats->stat_calls},
+        {"opendir", (long long)stats->opendir_calls},
+        {"open", (long long)stats->open_calls},
+        {"read", (long long)stats->read_calls}
+    };
+    for (size_t i = 0; i < sizeof(calls) / sizeof(*calls); i++) {
+        if (calls[i].count < 0) continue;
+        write_metric_name(file, ctx, "projanitor_syscalls", "call", calls[i].call);
+        fprintf(file, "%lld\n", calls[i].count);
+    }
+    if (peak_rss >= 0) {
+        write_metric_header(file, "projanitor_peak_rss_bytes", "Peak resident set size of the process.");
+        write_metric_name(file, ctx, "projanitor_peak_rss_bytes", NULL, NULL);
+        fprintf(file, "%lld\n", peak_rss);
+    }
+    write_metric_header(file, "projanitor_last_run_timestamp_seconds", "When these metrics were written.");
+    write_metric_name(file, ctx, "projanitor_last_run_timestamp_seconds", NULL, NULL);
+    fprintf(file, "%lld\n", (long long)time(NULL));
+
+    pj_status status = commit_temp_file(ctx, file, tmp_path, metrics_path);
+    if (status != PJ_OK) return status;
+
+    fprintf(out, "\n=== Metrics ===\n");
+    fprintf(out, "Scan: %.3f s, %llu bytes read, peak RSS %lld KiB\n", total, (unsigned long long)stats->bytes_read,
+            peak_rss >= 0 ? peak_rss / 1024 : 0);
+    fprintf(out, "Written to %s\n", metrics_path);
+    return PJ_OK;
+}
+
+// --- Scan Results ---
+
+// Top-level directories never listed as key subfolders, whatever the scan excludes.
+// Buckets are fixed; only the default directory excludes are hidden from the report.
+static pj_file_type classify_file(const char *file) {
+    const char *base = strrchr(file, '/');
+    base = base ? base + 1 : file;
+    const ClassEntry *entry = lookup_default_class(base);
+    if (entry && entry->type != PJ_TYPE_COUNT) return (pj_file_type)entry->type;
+    const char *ext = strrchr(base, '.');
+    entry = ext ? lookup_default_class(ext) : NULL;
+    return entry ? (pj_file_type)entry->type : PJ_TYPE_COUNT;
+}
+
+static bool is_report_excluded_dir(const char *name) {
+    const ClassEntry *entry = lookup_default_class(name);
+    return entry && (entry->flags & CLASS_EXCLUDED);
+}
+
+static void sort_result_groups(ResultGroupArray *groups) {
+    if (groups->count > 1) qsort(groups->items, groups->count, sizeof(ResultGroup), compare_result_groups);
+}
+
+static void release_scan_results(ProjanitorContext *ctx) {
+    free(ctx->project_name);
+    free_string_array(&ctx->build_files);
+    free_id_map(&ctx->build_file_set);
+    for (int i = 0; i < ctx->artifacts.count; i++) free(ctx->artifacts.items[i].path);
+    free(ctx->artifacts.items);
+    memset(&ctx->artifacts, 0, sizeof(ctx->artifacts));
+    free_classes(ctx);
+    free_file_table(&ctx->files);
+    free_hash_map(ctx->referenced_files);
+    free_reference_array(&ctx->references);
+    free_symbol_table(&ctx->symbols);
+    free_trigram_table(&ctx->trigrams);
+    free_include_graph(&ctx->graph);
+    free_string_array(&ctx->subfolders);
+    free_string_array(&ctx->directories);
+    free_string_array(&ctx->excluded);
+    free_string_array(&ctx->orphans);
+    free_result_groups(&ctx->missing);
+    free_result_groups(&ctx->duplicates);
+    free_result_groups(&ctx->referenced);
+    free_result_groups(&ctx->basenames);
+    ctx->project_name = NULL;
+    ctx->referenced_files = NULL;
+    ctx->graph_built = false;
+    ctx->scanned = false;
+    memset(ctx->type_counts, 0, sizeof(ctx->type_counts));
+}
+
+// Sort the catalog and derive everything the iterators expose.
+static void compute_scan_results(ProjanitorContext *ctx) {
+    FileTable *files = &ctx->files;
+    const char *root_path = ctx->root_path;
+    sort_file_table(files);
+
+    // Collect subfolders (excluding no-go areas)
+    ctx->stats.opendir_calls++;
+    DIR *dir = opendir(root_path);
+    if (dir) {
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+            char full_path[MAX_PATH_LEN];
+            if (strlen(root_path) + strlen(entry->d_name) + 1 >= sizeof(full_path)) continue;
+            snprintf(full_path, sizeof(full_path), "%s/%s", root_path, entry->d_name);
+            struct stat st;
+            ctx->stats.stat_calls++;
+            if (stat(full_path, &st) == 0 && S_ISDIR(st.st_mode) && !is_report_excluded_dir(entry->d_name)) {
+                add_to_string_array(&ctx->subfolders, entry->d_name);
+            }
+        }
+        closedir(dir);
+    }
+    qsort(ctx->subfolders.items, ctx->subfolders.count, sizeof(char *), compare_paths);
+
+    // Statistics and orphans: one lookup per distinct basename, then column passes
+    bool *name_referenced = (bool *)malloc((files->name_count + 1) * sizeof(bool));
+    if (!name_referenced) pj_out_of_memory();
+    for (int n = 0; n < files->name_count; n++) {
+        name_referenced[n] = get_from_hash_map(ctx->referenced_files, files->names[n]) != NULL;
+    }
+    for (int i = 0; i < files->count; i++) {
+        if (files->types[i] != PJ_TYPE_COUNT) ctx->type_counts[files->types[i]]++;
+        if (name_referenced[files->name_ids[i]]) files->flags[i] |= FILE_REFERENCED;
+    }
+    free(name_referenced);
+    for (int i = 0; i < files->count; i++) {
+        int id = files->sorted[i];
+        if (!(files->flags[id] & FILE_REFERENCED)) add_to_string_array(&ctx->orphans, files->paths[id]);
+    }
+
+    qsort(ctx->directories.items, ctx->directories.count, sizeof(char *), compare_paths);
+    qsort(ctx->excluded.items, ctx->excluded.count, sizeof(char *), compare_paths);
+
+    // Missing references and duplicate basenames
+    for (int i = 0; i < ctx->referenced_files->size; i++) {
+        for (Node *node = ctx->referenced_files->buckets[i]; node; node = node->next) {
+            add_result_group(&ctx->referenced, node->key, &node->values);
+            if (id_map_get(&files->name_index, node->key) < 0) {
+                add_result_group(&ctx->missing, node->key, &node->values);
+            }
+        }
+    }
+    for (int n = 0; n < files->name_count; n++) {
+        add_file_group(&ctx->basenames, files, n);
+        if (files->name_sizes[n] > 1) add_file_group(&ctx->duplicates, files, n);
+    }
+    sort_result_groups(&ctx->referenced);
+    sort_result_groups(&ctx->missing);
+    sort_result_groups(&ctx->basenames);
+    sort_result_groups(&ctx->duplicates);
+}
+
+static double monotonic_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Adds the time since *start to a phase and starts the next one.
+static void end_phase(ProjanitorContext *ctx, int phase, double *start) {
+    double now = monotonic_seconds();
+    ctx->stats.phase_seconds[phase] += now - *start;
+    *start = now;
+}
+
+// read() family calls of the whole process so far, or -1 (Linux only).
+static int64_t read_syscalls(void) {
+    FILE *file = fopen("/proc/self/io", "r");
+    if (!file) return -1;
+    char line[128];
+    long long count = -1;
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "syscr: %lld", &count) == 1) break;
+    }
+    fclose(file);
+    return count;
+}
+
+static pj_status discover_root(ProjanitorContext *ctx) {
+    if (ctx->root_known) return PJ_OK;
+    // A discovery starts the stats of the scan that follows it
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    ctx->stats_discovered = true;
+    double start = monotonic_seconds();
+    bool found = find_project_root(ctx, ctx->root_path);
+    end_phase(ctx, PHASE_DISCOVER, &start);
+    if (!ctx->root_path[0]) return fail(ctx, PJ_ERR_IO, "Cannot get current directory: %s", strerror(errno));
+    ctx->root_known = true;
+    if (!found) return fail(ctx, PJ_ERR_NO_ROOT, "Project root could not be found; using %s", ctx->root_path);
+    return PJ_OK;
+}
+
+static pj_status scan_project(ProjanitorContext *ctx) {
+    if (!ctx->stats_discovered) memset(&ctx->stats, 0, sizeof(ctx->stats));
+    ctx->stats_discovered = false;
+    int64_t reads_before = read_syscalls();
+    pj_status status = discover_root(ctx);
+    if (status != PJ_OK && status != PJ_ERR_NO_ROOT) return status;
+    ctx->stats_discovered = false;
+    double start = monotonic_seconds();
+    const char *root_path = ctx->root_path;
+    struct stat st;
+    ctx->stats.stat_calls++;
+    if (stat(root_path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return fail(ctx, PJ_ERR_IO, "Cannot open project root %s: %s", root_path, strerror(errno));
+    }
+
+    release_scan_results(ctx);
+    init_string_array(&ctx->build_files);
+    init_file_table(&ctx->files);
+    ctx->referenced_files = create_hash_map(HASH_MAP_SIZE);
+    init_reference_array(&ctx->references);
+    init_string_array(&ctx->subfolders);
+    init_string_array(&ctx->directories);
+    init_string_array(&ctx->excluded);
+    init_string_array(&ctx->orphans);
+    if (ctx->features & PJ_FEATURE_SYMBOLS) init_symbol_table(&ctx->symbols);
+    if (ctx->features & PJ_FEATURE_TRIGRAMS) init_trigram_table(&ctx->trigrams);
+
+    ctx->project_name = get_project_name(ctx, root_path);
+    if (!ctx->project_name) {
+        ctx->project_name = strdup("Unknown");
+        if (!ctx->project_name) pj_out_of_memory();
+    }
+
+    // Collect system-generated files from build directory
+    char build_path[MAX_PATH_LEN];
+    if (snprintf(build_path, sizeof(build_path), "%s/build", root_path) >= (int)sizeof(build_path)) {
+        pj_log(ctx, PJ_LOG_WARNING, "Build path too long: %s/build", root_path);
+    } else {
+        pj_log(ctx, PJ_LOG_INFO, "Collecting build files from %s", build_path);
+        collect_build_files(ctx, build_path, "");
+    }
+    init_id_map(&ctx->build_file_set, ctx->build_files.count);
+    for (int i = 0; i < ctx->build_files.count; i++) id_map_put(&ctx->build_file_set, ctx->build_files.items[i], i);
+    end_phase(ctx, PHASE_BUILD_FILES, &start);
+
+    init_classes(ctx);
+    if (ctx->network_fs > 0) {
+        scan_network_fs(ctx, root_path, add_dir(&ctx->files, root_path));
+    } else {
+        analyze_project_files(ctx, root_path, add_dir(&ctx->files, root_path));
+    }
+    free_classes(ctx);
+    end_phase(ctx, PHASE_TREE, &start);
+    compute_scan_results(ctx);
+    end_phase(ctx, PHASE_RESULTS, &start);
+    int64_t reads_after = read_syscalls();
+    ctx->stats.read_calls = reads_before >= 0 && reads_after >= reads_before ? reads_after - reads_before : -1;
+    ctx->scanned = true;
+    return PJ_OK;
+}
+
+static void ensure_include_graph(ProjanitorContext *ctx) {
+    if (ctx->graph_built) return;
+    double start = monotonic_seconds();
+    build_include_graph(ctx, &ctx->graph, ctx->root_path, &ctx->files, &ctx->references);
+    end_phase(ctx, PHASE_GRAPH, &start);
+    ctx->graph_built = true;
+}
+
+// --- Public API ---
+
+// Wraps the body of an entry point: allocation failure inside `call` unwinds
+// here, runs `cleanup` and reports PJ_ERR_NOMEM.
+#define PJ_GUARDED(ctx, call, cleanup)                                  \
+    do {                                                                \
+        OomGuard guard_;                                                \
+        oom_enter(&guard_);                                             \
+        if (setjmp(guard_.env) != 0) {                                  \
+            oom_leave(&guard_);                                         \
+            cleanup;                                                    \
+            return fail((ctx), PJ_ERR_NOMEM, "Out of memory");          \
+        }                                                               \
+        guard_.huge_pages = (ctx)->huge_pages;                          \
+        pj_status status_ = (call);                                     \
+        oom_leave(&guard_);                                             \
+        return status_;                                                 \
+    } while (0)
+
+static void fill_string_array(StringArray *arr, const char *const *items, size_t count) {
+    init_string_array(arr);
+    for (size_t i = 0; i < count; i++) add_to_string_array(arr, items[i]);
+}
+
+static pj_status fill_defaults(ProjanitorContext *ctx) {
+    fill_string_array(&ctx->extensions, default_extensions, sizeof(default_extensions) / sizeof(*default_extensions));
+    fill_string_array(&ctx->exclude_dirs, default_exclude_dirs, sizeof(default_exclude_dirs) / sizeof(*default_exclude_dirs));
+    fill_string_array(&ctx->marker_files, default_marker_files, sizeof(default_marker_files) / sizeof(*default_marker_files));
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    ctx->jobs = ncpu > 0 ? (int)ncpu : 1;
+    return PJ_OK;
+}
+
+static pj_status init_context(ProjanitorContext *ctx) {
+    PJ_GUARDED(ctx, fill_defaults(ctx), (void)0);
+}
+
+ProjanitorContext *pj_context_new(void) {
+    ProjanitorContext *ctx = (ProjanitorContext *)calloc(1, sizeof(ProjanitorContext));
+    if (!ctx) return NULL;
+    if (init_context(ctx) != PJ_OK) {
+        pj_context_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+void pj_context_free(ProjanitorContext *ctx) {
+    if (!ctx) return;
+    release_scan_results(ctx);
+    free_string_array(&ctx->extensions);
+    free_string_array(&ctx->exclude_dirs);
+    free_string_array(&ctx->marker_files);
+    free(ctx);
+}
+
+const char *pj_last_error(const ProjanitorContext *ctx) {
+    return ctx ? ctx->error : "No context";
+}
+
+void pj_set_log_callback(ProjanitorContext *ctx, pj_log_fn fn, void *user) {
+    if (!ctx) return;
+    ctx->log_fn = fn;
+    ctx->log_user = user;
+}
+
+void pj_set_verbose(ProjanitorContext *ctx, bool verbose) {
+    if (ctx) ctx->verbose = verbose;
+}
+
+void pj_set_features(ProjanitorContext *ctx, unsigned features) {
+    if (ctx) ctx->features = features;
+}
+
+void pj_set_jobs(ProjanitorContext *ctx, int jobs) {
+    if (ctx) ctx->jobs = jobs < 1 ? 1 : jobs;
+}
+
+void pj_set_network_fs(ProjanitorContext *ctx, int threads) {
+    if (ctx) ctx->network_fs = threads < 0 ? 0 : threads;
+}
+
+void pj_set_huge_pages(ProjanitorContext *ctx, bool enabled) {
+    if (ctx) ctx->huge_pages = enabled;
+}
+
+// Replace a configuration list; the old list survives an allocation failure.
+static pj_status replace_string_array(ProjanitorContext *ctx, StringArray *target, const char *const *items, size_t count) {
+    if (!ctx || (!items && count > 0)) return ctx ? fail(ctx, PJ_ERR_INVALID, "Null item list") : PJ_ERR_INVALID;
+    StringArray fresh = {0};
+    OomGuard guard;
+    oom_enter(&guard);
+    if (setjmp(guard.env) != 0) {
+        oom_leave(&guard);
+        free_string_array(&fresh);
+        return fail(ctx, PJ_ERR_NOMEM, "Out of memory");
+    }
+    fill_string_array(&fresh, items, count);
+    oom_leave(&guard);
+    free_string_array(target);
+    *target = fresh;
+    return PJ_OK;
+}
+
+pj_status pj_set_extensions(ProjanitorContext *ctx, const char *const *items, size_t count) {
+    return replace_string_array(ctx, ctx ? &ctx->extensions : NULL, items, count);
+}
+
+pj_status pj_set_exclude_dirs(ProjanitorContext *ctx, const char *const *items, size_t count) {
+    return replace_string_array(ctx, ctx ? &ctx->exclude_dirs : NULL, items, count);
+}
+
+pj_status pj_set_marker_files(ProjanitorContext *ctx, const char *const *items, size_t count) {
+    return replace_string_array(ctx, ctx ? &ctx->marker_files : NULL, items, count);
+}
+
+// Store an absolute, existing directory; relative paths are resolved now so a
+// later chdir() by the caller does not change their meaning.
+static pj_status set_directory(ProjanitorContext *ctx, char *target, const char *path) {
+    if (!ctx) return PJ_ERR_INVALID;
+    if (!path) return fail(ctx, PJ_ERR_INVALID, "Null directory");
+    char resolved[PATH_MAX];
+    if (!realpath(path, resolved)) return fail(ctx, PJ_ERR_IO, "Cannot resolve %s: %s", path, strerror(errno));
+    if (strlen(resolved) >= MAX_PATH_LEN) return fail(ctx, PJ_ERR_INVALID, "Path too long: %s", resolved);
+    strcpy(target, resolved);
+    return PJ_OK;
+}
+
+pj_status pj_set_start_dir(ProjanitorContext *ctx, const char *path) {
+    pj_status status = set_directory(ctx, ctx ? ctx->start_dir : NULL, path);
+    if (status == PJ_OK) ctx->root_known = false;
+    return status;
+}
+
+pj_status pj_set_root(ProjanitorContext *ctx, const char *path) {
+    pj_status status = set_directory(ctx, ctx ? ctx->root_path : NULL, path);
+    if (status == PJ_OK) ctx->root_known = true;
+    return status;
+}
+
+pj_status pj_discover_root(ProjanitorContext *ctx) {
+    if (!ctx) return PJ_ERR_INVALID;
+    PJ_GUARDED(ctx, discover_root(ctx), (void)0);
+}
+
+pj_status pj_scan(ProjanitorContext *ctx) {
+    if (!ctx) return PJ_ERR_INVALID;
+    PJ_GUARDED(ctx, scan_project(ctx), release_scan_results(ctx));
+}
+
+const char *pj_root_path(const ProjanitorContext *ctx) {
+    return ctx && ctx->root_known ? ctx->root_path : NULL;
+}
+
+const char *pj_project_name(const ProjanitorContext *ctx) {
+    return ctx && ctx->scanned ? ctx->project_name : NULL;
+}
+
+size_t pj_file_type_count(const ProjanitorContext *ctx, pj_file_type type) {
+    if (!ctx || !ctx->scanned || (int)type < 0 || type >= PJ_TYPE_COUNT) return 0;
+    return ctx->type_counts[type];
+}
+
+size_t pj_result_count(const ProjanitorContext *ctx, pj_result_kind kind) {
+    if (!ctx || !ctx->scanned) return 0;
+    switch (kind) {
+        case PJ_RESULT_FILES:      return (size_t)ctx->files.count;
+        case PJ_RESULT_ORPHANS:    return (size_t)ctx->orphans.count;
+        case PJ_RESULT_MISSING:    return (size_t)ctx->missing.count;
+        case PJ_RESULT_DUPLICATES: return (size_t)ctx->duplicates.count;
+        case PJ_RESULT_SUBFOLDERS: return (size_t)ctx->subfolders.count;
+        case PJ_RESULT_REFERENCED: return (size_t)ctx->referenced.count;
+        case PJ_RESULT_BASENAMES:  return (size_t)ctx->basenames.count;
+        case PJ_RESULT_DIRECTORIES: return (size_t)ctx->directories.count;
+        case PJ_RESULT_EXCLUDED:   return (size_t)ctx->excluded.count;
+    }
+    return 0;
+}
+
+pj_iter pj_iter_begin(const ProjanitorContext *ctx, pj_result_kind kind) {
+    pj_iter it = {ctx, kind, 0};
+    return it;
+}
+
+bool pj_iter_next(pj_iter *it, pj_entry *entry) {
+    if (!it || !entry || it->next >= pj_result_count(it->ctx, it->kind)) return false;
+    const ProjanitorContext *ctx = it->ctx;
+    size_t i = it->next++;
+    entry->paths = NULL;
+    entry->path_count = 0;
+    const ResultGroup *group = NULL;
+    switch (it->kind) {
+        case PJ_RESULT_FILES:      entry->name = ctx->files.paths[ctx->files.sorted[i]]; break;
+        case PJ_RESULT_ORPHANS:    entry->name = ctx->orphans.items[i]; break;
+        case PJ_RESULT_SUBFOLDERS: entry->name = ctx->subfolders.items[i]; break;
+        case PJ_RESULT_DIRECTORIES: entry->name = ctx->directories.items[i]; break;
+        case PJ_RESULT_EXCLUDED:   entry->name = ctx->excluded.items[i]; break;
+        case PJ_RESULT_MISSING:    group = &ctx->missing.items[i]; break;
+        case PJ_RESULT_DUPLICATES: group = &ctx->duplicates.items[i]; break;
+        case PJ_RESULT_REFERENCED: group = &ctx->referenced.items[i]; break;
+        case PJ_RESULT_BASENAMES:  group = &ctx->basenames.items[i]; break;
+    }
+    if (group) {
+        entry->name = group->name;
+        entry->paths = (const char *const *)group->paths.items;
+        entry->path_count = (size_t)group->paths.count;
+    }
+    return true;
+}
+
+static pj_status require_scan(ProjanitorContext *ctx) {
+    if (!ctx) return PJ_ERR_INVALID;
+    if (!ctx->scanned) return fail(ctx, PJ_ERR_INVALID, "No completed scan");
+    return PJ_OK;
+}
+
+static pj_status run_redundant_includes(ProjanitorContext *ctx, FILE *out) {
+    ensure_include_graph(ctx);
+    report_redundant_includes(&ctx->graph, &ctx->references, out);
+    return PJ_OK;
+}
+
+pj_status pj_report_redundant_includes(ProjanitorContext *ctx, FILE *out) {
+    pj_status status = require_scan(ctx);
+    if (status != PJ_OK) return status;
+    if (!out) return fail(ctx, PJ_ERR_INVALID, "Null output stream");
+    PJ_GUARDED(ctx, run_redundant_includes(ctx, out), (void)0);
+}
+
+static pj_status run_unused_includes(ProjanitorContext *ctx, FILE *out) {
+    ensure_include_graph(ctx);
+    report_unused_includes(ctx, out);
+    return PJ_OK;
+}
+
+pj_status pj_report_unused_includes(ProjanitorContext *ctx, FILE *out) {
+    pj_status status = require_scan(ctx);
+    if (status != PJ_OK) return status;
+    if (!out) return fail(ctx, PJ_ERR_INVALID, "Null output stream");
+    PJ_GUARDED(ctx, run_unused_includes(ctx, out), (void)0);
+}
+
+static pj_status run_stale_artifacts(ProjanitorContext *ctx, FILE *out) {
+    ensure_include_graph(ctx);
+    report_stale_artifacts(ctx, out);
+    return PJ_OK;
+}
+
+pj_status pj_report_stale_artifacts(ProjanitorContext *ctx, FILE *out) {
+    pj_status status = require_scan(ctx);
+    if (status != PJ_OK) return status;
+    if (!out) return fail(ctx, PJ_ERR_INVALID, "Null output stream");
+    PJ_GUARDED(ctx, run_stale_artifacts(ctx, out), (void)0);
+}
+
+static pj_status run_include_guards(ProjanitorContext *ctx, FILE *out) {
+    ensure_include_graph(ctx);
+    report_include_guards(&ctx->graph, &ctx->references, &ctx->files, out);
+    return PJ_OK;
+}
+
+pj_status pj_report_include_guards(ProjanitorContext *ctx, FILE *out) {
+    pj_status status = require_scan(ctx);
+    if (status != PJ_OK) return status;
+    if (!out) return fail(ctx, PJ_ERR_INVALID, "Null output stream");
+    PJ_GUARDED(ctx, run_include_guards(ctx, out), (void)0);
+}
+
+static pj_status run_layering(ProjanitorContext *ctx, const char *rules_path, FILE *out, size_t *violations) {
+    ensure_include_graph(ctx);
+    size_t found = 0;
+    pj_status status = check_layering(ctx, &ctx->graph, &ctx->references, ctx->root_path, rules_path, out, &found);
+    if (violations) *violations = found;
+    return status;
+}
+
+pj_status pj_check_layering(ProjanitorContext *ctx, const char *rules_path, FILE *out, size_t *violations) {
+    pj_status status = require_scan(ctx);
+    if (status != PJ_OK) return status;
+    if (!rules_path || !out) return fail(ctx, PJ_ERR_INVALID, "Null rules path or output stream");
+    if (violations) *violations = 0;
+    PJ_GUARDED(ctx, run_layering(ctx, rules_path, out, violations), (void)0);
+}
+
+static pj_status run_unused_symbols(ProjanitorContext *ctx, FILE *out) {
+    report_unused_symbols(&ctx->symbols, out);
+    return PJ_OK;
+}
+
+pj_status pj_report_unused_symbols(ProjanitorContext *ctx, FILE *out) {
+    pj_status status = require_scan(ctx);
+    if (status != PJ_OK) return status;
+    if (!out) return fail(ctx, PJ_ERR_INVALID, "Null output stream");
+    if (!ctx->symbols.items) return fail(ctx, PJ_ERR_INVALID, "Scan ran without PJ_FEATURE_SYMBOLS");
+    PJ_GUARDED(ctx, run_unused_symbols(ctx, out), (void)0);
+}
+
+static pj_status run_unreachable_files(ProjanitorContext *ctx, FILE *out) {
+    ensure_include_graph(ctx);
+    report_unreachable_files(ctx, &ctx->graph, out);
+    return PJ_OK;
+}
+
+pj_status pj_report_unreachable_files(ProjanitorContext *ctx, FILE *out) {
+    pj_status status = require_scan(ctx);
+    if (status != PJ_OK) return status;
+    if (!out) return fail(ctx, PJ_ERR_INVALID, "Null output stream");
+    PJ_GUARDED(ctx, run_unreachable_files(ctx, out), (void)0);
+}
+
+static pj_status run_write_graph_snapshot(ProjanitorContext *ctx, const char *snapshot_path, FILE *out) {
+    return write_graph_snapshot(ctx, snapshot_path, out);
+}
+
+pj_status pj_write_graph_snapshot(ProjanitorContext *ctx, const char *snapshot_path, FILE *out) {
+    pj_status status = require_scan(ctx);
+    if (status != PJ_OK) return status;
+    if (!out) return fail(ctx, PJ_ERR_INVALID, "Null output stream");
+    PJ_GUARDED(ctx, run_write_graph_snapshot(ctx, snapshot_path, out), (void)0);
+}
+
+static pj_status run_export_sqlite(ProjanitorContext *ctx, const char *db_path, FILE *out) {
+    return export_sqlite(ctx, db_path, out);
+}
+
+pj_status pj_export_sqlite(ProjanitorContext *ctx, const char *db_path, FILE *out) {
+    pj_status status = require_scan(ctx);
+    if (status != PJ_OK) return status;
+    if (!db_path || !db_path[0] || !out) return fail(ctx, PJ_ERR_INVALID, "Null database path or output stream");
+    PJ_GUARDED(ctx, run_export_sqlite(ctx, db_path, out), (void)0);
+}
+
+static pj_status run_write_html_report(ProjanitorContext *ctx, const char *html_path, FILE *out) {
+    return write_html_report(ctx, html_path, out);
+}
+
+pj_status pj_write_html_report(ProjanitorContext *ctx, const char *html_path, FILE *out) {
+    pj_status status = require_scan(ctx);
+    if (status != PJ_OK) return status;
+    if (!html_path || !html_path[0] || !out) return fail(ctx, PJ_ERR_INVALID, "Null report path or output stream");
+    PJ_GUARDED(ctx, run_write_html_report(ctx, html_path, out), (void)0);
+}
+
+static pj_status run_export_graph(ProjanitorContext *ctx, const char *graph_path, pj_graph_format format,
+                                  pj_graph_aggregate aggregate, FILE *out) {
+    return export_graph(ctx, graph_path, format, aggregate, out);
+}
+
+pj_status pj_export_graph(ProjanitorContext *ctx, const char *graph_path, pj_graph_format format,
+                          pj_graph_aggregate aggregate, FILE *out) {
+    pj_status status = require_scan(ctx);
+    if (status != PJ_OK) return status;
+    if (!graph_path || !graph_path[0] || !out) return fail(ctx, PJ_ERR_INVALID, "Null graph path or output stream");
+    if ((unsigned)format > PJ_GRAPH_GRAPHML || (unsigned)aggregate > PJ_AGGREGATE_COMPONENT) {
+        return fail(ctx, PJ_ERR_INVALID, "Unknown graph format or aggregation");
+    }
+    PJ_GUARDED(ctx, run_export_graph(ctx, graph_path, format, aggregate, out), (void)0);
+}
+
+static pj_status run_write_metrics(ProjanitorContext *ctx, const char *metrics_path, FILE *out) {
+    return write_metrics(ctx, metrics_path, out);
+}
+
+pj_status pj_write_metrics(ProjanitorContext *ctx, const char *metrics_path, FILE *out) {
+    pj_status status = require_scan(ctx);
+    if (status != PJ_OK) return status;
+    if (!metrics_path || !metrics_path[0] || !out) return fail(ctx, PJ_ERR_INVALID, "Null metrics path or output stream");
+    PJ_GUARDED(ctx, run_write_metrics(ctx, metrics_path, out), (void)0);
+}
+
+// The scanned graph after pj_scan(), otherwise the snapshot.
+static pj_status load_graph_view(ProjanitorContext *ctx, const char *snapshot_path, GraphView *view) {
+    if (ctx->scanned) {
+        view_from_graph(ctx, view);
+        return PJ_OK;
+    }
+    if (!ctx->root_known && !(snapshot_path == NULL && find_cache_root(ctx, "graph.snap"))) {
+        pj_status status = discover_root(ctx);
+        if (status != PJ_OK && status != PJ_ERR_NO_ROOT) return status;
+    }
+    char path[MAX_PATH_LEN];
+    pj_status status = cache_file_path(ctx, snapshot_path, "graph.snap", false, path, sizeof(path));
+    if (status == PJ_OK) status = map_graph_snapshot(ctx, path, view);
+    return status;
+}
+
+static pj_status run_why(ProjanitorContext *ctx, const char *snapshot_path, const char *file, FILE *out, size_t *chains) {
+    GraphView view;
+    pj_status status = load_graph_view(ctx, snapshot_path, &view);
+    if (status != PJ_OK) return status;
+    status = why_query(ctx, &view, file, out, chains);
+    release_graph_view(&view);
+    return status;
+}
+
+pj_status pj_why(ProjanitorContext *ctx, const char *snapshot_path, const char *file, FILE *out, size_t *chains) {
+    if (!ctx) return PJ_ERR_INVALID;
+    if (chains) *chains = 0;
+    if (!file || !file[0] || !out) return fail(ctx, PJ_ERR_INVALID, "Null file or output stream");
+    PJ_GUARDED(ctx, run_why(ctx, snapshot_path, file, out, chains), (void)0);
+}
+
+static pj_status run_impact(ProjanitorContext *ctx, const char *snapshot_path, const char *const *files, size_t count, FILE *out, size_t *affected) {
+    GraphView view;
+    pj_status status = load_graph_view(ctx, snapshot_path, &view);
+    if (status != PJ_OK) return status;
+    int found = impact_query(ctx, &view, files, count, out);
+    if (affected) *affected = (size_t)found;
+    release_graph_view(&view);
+    return PJ_OK;
+}
+
+pj_status pj_impact(ProjanitorContext *ctx, const char *snapshot_path, const char *const *files, size_t count, FILE *out, size_t *affected) {
+    if (!ctx) return PJ_ERR_INVALID;
+    if (affected) *affected = 0;
+    if ((!files && count > 0) || !out) return fail(ctx, PJ_ERR_INVALID, "Null file list or output stream");
+    for (size_t i = 0; i < count; i++) {
+        if (!files[i] || !files[i][0]) return fail(ctx, PJ_ERR_INVALID, "Empty name in the changed-file list");
+    }
+    PJ_GUARDED(ctx, run_impact(ctx, snapshot_path, files, count, out, affected), (void)0);
+}
+
+static pj_status run_select_tests(ProjanitorContext *ctx, const char *snapshot_path, const char *const *files, size_t count, FILE *out, size_t *selected) {
+    GraphView view;
+    pj_status status = load_graph_view(ctx, snapshot_path, &view);
+    if (status != PJ_OK) return status;
+    if (ctx->scanned) attach_test_map(ctx, &view);
+    int found = select_tests(ctx, &view, files, count, out);
+    if (selected) *selected = (size_t)found;
+    release_graph_view(&view);
+    return PJ_OK;
+}
+
+pj_status pj_select_tests(ProjanitorContext *ctx, const char *snapshot_path, const char *const *files, size_t count, FILE *out, size_t *selected) {
+    if (!ctx) return PJ_ERR_INVALID;
+    if (selected) *selected = 0;
+    if ((!files && count > 0) || !out) return fail(ctx, PJ_ERR_INVALID, "Null file list or output stream");
+    for (size_t i = 0; i < count; i++) {
+        if (!files[i] || !files[i][0]) return fail(ctx, PJ_ERR_INVALID, "Empty name in the changed-file list");
+    }
+    PJ_GUARDED(ctx, run_select_tests(ctx, snapshot_path, files, count, out, selected), (void)0);
+}
+
+static pj_status run_write_trigram_index(ProjanitorContext *ctx, const char *index_path, FILE *out) {
+    return write_trigram_index(ctx, index_path, out);
+}
+
+pj_status pj_write_trigram_index(ProjanitorContext *ctx, const char *index_path, FILE *out) {
+    pj_status status = require_scan(ctx);
+    if (status != PJ_OK) return status;
+    if (!out) return fail(ctx, PJ_ERR_INVALID, "Null output stream");
+    if (!ctx->trigrams.slots) return fail(ctx, PJ_ERR_INVALID, "Scan ran without PJ_FEATURE_TRIGRAMS");
+    PJ_GUARDED(ctx, run_write_trigram_index(ctx, index_path, out), (void)0);
+}
+
+static pj_status run_trigram_query(ProjanitorContext *ctx, const char *index_path, const char *needle, FILE *out, size_t *matches) {
+    if (!ctx->root_known && !(index_path == NULL && find_cache_root(ctx, "trigrams.idx"))) {
+        pj_status status = discover_root(ctx);
+        if (status != PJ_OK && status != PJ_ERR_NO_ROOT) return status;
+    }
+    return query_trigram_index(ctx, index_path, needle, out, matches);
+}
+
+pj_status pj_query_trigram_index(ProjanitorContext *ctx, const char *index_path, const char *needle, FILE *out, size_t *matches) {
+    if (!ctx) return PJ_ERR_INVALID;
+    if (matches) *matches = 0;
+    if (!needle || !needle[0] || strchr(needle, '\n')) return fail(ctx, PJ_ERR_INVALID, "Query must be a non-empty single line");
+    if (!out) return fail(ctx, PJ_ERR_INVALID, "Null output stream");
+    PJ_GUARDED(ctx, run_trigram_query(ctx, index_path, needle, out, matches), (void)0);
+}
+
+static pj_status run_pp_profile(ProjanitorContext *ctx, const char *compile_db, const char *cache_dir, int top, FILE *out) {
+    pj_status status = discover_root(ctx);
+    if (status != PJ_OK && status != PJ_ERR_NO_ROOT) return status;
+    return profile_preprocessed_sizes(ctx, compile_db, cache_dir, top, out);
+}
+
+pj_status pj_profile_preprocessed_sizes(ProjanitorContext *ctx, const char *compile_db, const char *cache_dir, int top, FILE *out) {
+    if (!ctx) return PJ_ERR_INVALID;
+    if (!out || top < 1) return fail(ctx, PJ_ERR_INVALID, "Null output stream or non-positive top");
+    PJ_GUARDED(ctx, run_pp_profile(ctx, compile_db, cache_dir, top, out), (void)0);
+}
+
+// --- Data Structure Implementations ---
+
+static void init_string_array(StringArray *arr) {
+    if (!arr) return;
+    arr->items = (char **)malloc(INITIAL_ARRAY_CAPACITY * sizeof(char *));
+    if (!arr->items) pj_out_of_memory();
+    arr->count = 0;
+    arr->capacity = INITIAL_ARRAY_CAPACITY;
+    arr->borrowed = false;
+}
+
+static void add_to_string_array(StringArray *arr, const char *item) {
+    if (!arr || !item) return;
+    if (arr->count >= arr->capacity) {
+        arr->capacity *= 2;
+        char **new_items = (char **)realloc(arr->borrowed ? NULL : arr->items, arr->capacity * sizeof(char *));
+        if (!new_items) pj_out_of_memory();
+        if (arr->borrowed) memcpy(new_items, arr->items, arr->count * sizeof(char *));
+        arr->items = new_items;
+        arr->borrowed = false;
+    }
+    arr->items[arr->count] = strdup(item);
+    if (!arr->items[arr->count]) pj_out_of_memory();
+    arr->count++;
+}
+
+static void free_string_array(StringArray *arr) {
+    if (!arr) return;
+    if (arr->items) {
+        for (int i = 0; i < arr->count; i++) {
+            free(arr->items[i]);
+            arr->items[i] = NULL; // Prevent double-free
+        }
+        if (!arr->borrowed) free(arr->items);
+        arr->items = NULL;
+    }
+    arr->count = 0;
+    arr->capacity = 0;
+    arr->borrowed = false;
+}
+
+static unsigned int hash(const char *key, int size) {
+    if (!key) return 0;
+    unsigned int hash_val = 5381;
+    int c;
+    while ((c = *key++)) {
+        hash_val = ((hash_val << 5) + hash_val) + c;
+    }
+    return hash_val % size;
+}
+
+static HashMap* create_hash_map(int size) {
+    HashMap *map = (HashMap*)malloc(sizeof(HashMap));
+    if (!map) pj_out_of_memory();
+    map->size = size;
+    map->buckets = (Node**)calloc(size, sizeof(Node*));
+    if (!map->buckets) pj_out_of_memory();
+    return map;
+}
+
+static void add_to_hash_map(HashMap *map, const char *key, const char *value) {
+    if (!map || !key || !value) return;
+    unsigned int index = hash(key, map->size);
+    Node *head = map->buckets[index];
+    for (Node *curr = head; curr; curr = curr->next) {
+        if (strcmp(curr->key, key) == 0) {
+            add_to_string_array(&curr->values, value);
+            return;
+        }
+    }
+
+    size_t key_len = strlen(key);
+    Node *newNode = (Node*)malloc(sizeof(Node) + key_len + 1);
+    if (!newNode) pj_out_of_memory();
+    memcpy(newNode->key, key, key_len + 1);
+    newNode->values.items = newNode->inline_values;
+    newNode->values.count = 0;
+    newNode->values.capacity = VALUE_INLINE_CAPACITY;
+    newNode->values.borrowed = true;
+    add_to_string_array(&newNode->values, value);
+    newNode->next = head;
+    map->buckets[index] = newNode;
+}
+
+static StringArray* get_from_hash_map(const HashMap *map, const char *key) {
+    if (!map || !key) return NULL;
+    unsigned int index = hash(key, map->size);
+    for (Node *curr = map->buckets[index]; curr; curr = curr->next) {
+        if (strcmp(curr->key, key) == 0) {
+            return &curr->values;
+        }
+    }
+    return NULL;
+}
+
+static void free_hash_map(HashMap *map) {
+    if (!map) return;
+    for (int i = 0; i < map->size; i++) {
+        Node *head = map->buckets[i];
+        while (head) {
+            Node *temp = head;
+            head = head->next;
+            free_string_array(&temp->values);
+            free(temp);
+        }
+    }
+    free(map->buckets);
+    free(map);
+}
+
+static void init_reference_array(ReferenceArray *refs) {
+    if (!refs) return;
+    refs->items = (Reference *)large_alloc(INITIAL_ARRAY_CAPACITY * sizeof(Reference));
+    memset(&refs->names, 0, sizeof(refs->names));
+    refs->count = 0;
+    refs->capacity = INITIAL_ARRAY_CAPACITY;
+}
+
+static void add_reference(ReferenceArray *refs, int from, const char *name, int line, RefKind kind) {
+    if (!refs || from < 0 || !name) return;
+    if (refs->count >= refs->capacity) {
+        refs->capacity *= 2;
+        refs->items = (Reference *)large_realloc(refs->items, refs->capacity * sizeof(Reference));
+    }
+    Reference *ref = &refs->items[refs->count];
+    ref->from = from;
+    ref->name = arena_strdup(&refs->names, name);
+    ref->line = line;
+    ref->kind = kind;
+    refs->count++;
+}
+
+static void free_reference_array(ReferenceArray *refs) {
+    if (!refs) return;
+    free_string_arena(&refs->names);
+    large_free(refs->items);
+    refs->items = NULL;
+    refs->count = 0;
+    refs->capacity = 0;
+}
+
+static void init_id_map(IdMap *map, int expected) {
+    int size = 16;
+    while (size < expected * 2) size *= 2;
+    map->keys = (const char **)large_alloc(size * sizeof(char *));
+    map->values = (int *)large_alloc(size * sizeof(int));
+    map->size = size;
+    map->count = 0;
+}
+
+static int id_map_get(const IdMap *map, const char *key) {
+    if (!map || !map->keys || !key) return -1;
+    unsigned int mask = map->size - 1;
+    unsigned int i = hash(key, map->size) & mask;
+    while (map->keys[i]) {
+        if (strcmp(map->keys[i], key) == 0) return map->values[i];
+        i = (i + 1) & mask;
+    }
+    return -1;
+}
+
+static void id_map_put(IdMap *map, const char *key, int value) {
+    if ((map->count + 1) * 2 > map->size) {
+        IdMap grown;
+        init_id_map(&grown, map->size);
+        for (int i = 0; i < map->size; i++) {
+            if (map->keys[i]) id_map_put(&grown, map->keys[i], map->values[i]);
+        }
+        free_id_map(map);
+        *map = grown;
+    }
+    unsigned int mask = map->size - 1;
+    unsigned int i = hash(key, map->size) & mask;
+    while (map->keys[i]) {
+        if (strcmp(map->keys[i], key) == 0) {
+            map->values[i] = value;
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    map->keys[i] = key;
+    map->values[i] = value;
+    map->count++;
+}
+
+static void free_id_map(IdMap *map) {
+    if (!map) return;
+    large_free((void *)map->keys);
+    large_free(map->values);
+    map->keys = NULL;
+    map->values = NULL;
+    map->size = map->count = 0;
+}
+
+
+// Resize one column of the file table.
+static void *resize_column(void *column, int capacity, size_t item_size) {
+    return large_realloc(column, (size_t)capacity * item_size);
+}
+
+static void init_file_table(FileTable *files) {
+    memset(files, 0, sizeof(*files));
+    init_id_map(&files->name_index, INITIAL_ARRAY_CAPACITY);
+}
+
+static int add_dir(FileTable *files, const char *path) {
+    if (files->dir_count >= files->dir_capacity) {
+        files->dir_capacity = files->dir_capacity ? files->dir_capacity * 2 : INITIAL_ARRAY_CAPACITY;
+        files->dir_paths = (const char **)resize_column(files->dir_paths, files->dir_capacity, sizeof(char *));
+    }
+    files->dir_paths[files->dir_count] = path;
+    return files->dir_count++;
+}
+
+static int intern_name(FileTable *files, const char *name) {
+    int id = id_map_get(&files->name_index, name);
+    if (id >= 0) return id;
+    if (files->name_count >= files->name_capacity) {
+        int capacity = files->name_capacity ? files->name_capacity * 2 : INITIAL_ARRAY_CAPACITY;
+        files->names = (const char **)resize_column(files->names, capacity, sizeof(char *));
+        files->name_heads = (int32_t *)resize_column(files->name_heads, capacity, sizeof(int32_t));
+        files->name_sizes = (int32_t *)resize_column(files->name_sizes, capacity, sizeof(int32_t));
+        files->name_capacity = capacity;
+    }
+    id = files->name_count++;
+    files->names[id] = name;
+    files->name_heads[id] = -1;
+    files->name_sizes[id] = 0;
+    id_map_put(&files->name_index, name, id);
+    return id;
+}
+
+static int add_file(FileTable *files, const char *path, int dir_id, const struct stat *st) {
+    if (files->count >= files->capacity) {
+        int capacity = files->capacity ? files->capacity * 2 : INITIAL_ARRAY_CAPACITY;
+        files->paths = (char **)resize_column(files->paths, capacity, sizeof(char *));
+        files->dir_ids = (int32_t *)resize_column(files->dir_ids, capacity, sizeof(int32_t));
+        files->name_ids = (int32_t *)resize_column(files->name_ids, capacity, sizeof(int32_t));
+        files->next_same_name = (int32_t *)resize_column(files->next_same_name, capacity, sizeof(int32_t));
+        files->types = (uint8_t *)resize_column(files->types, capacity, sizeof(uint8_t));
+        files->flags = (uint8_t *)resize_column(files->flags, capacity, sizeof(uint8_t));
+        files->guards = (uint8_t *)resize_column(files->guards, capacity, sizeof(uint8_t));
+        files->guard_issues = (const char **)resize_column(files->guard_issues, capacity, sizeof(char *));
+        files->sizes = (int64_t *)resize_column(files->sizes, capacity, sizeof(int64_t));
+        files->mtimes = (int64_t *)resize_column(files->mtimes, capacity, sizeof(int64_t));
+        files->inodes = (uint64_t *)resize_column(files->inodes, capacity, sizeof(uint64_t));
+        files->capacity = capacity;
+    }
+    int id = files->count;
+    char *copy = arena_strdup(&files->strings, path);
+    const char *base = strrchr(copy, '/');
+    int name_id = intern_name(files, base ? base + 1 : copy);
+    files->paths[id] = copy;
+    files->dir_ids[id] = dir_id;
+    files->name_ids[id] = name_id;
+    files->next_same_name[id] = -1;
+    files->types[id] = (uint8_t)classify_file(copy);
+    files->flags[id] = 0;
+    files->guards[id] = GUARD_NOT_HEADER;
+    files->guard_issues[id] = NULL;
+    files->sizes[id] = (int64_t)st->st_size;
+    files->mtimes[id] = (int64_t)st->st_mtime;
+    files->inodes[id] = (uint64_t)st->st_ino;
+    files->name_sizes[name_id]++;
+    files->count++;
+    return id;
+}
+
+typedef struct {
+    const char *dir;
+    const char *name;
+    int id;
+} FileSortKey;
+
+static int compare_file_keys(const void *a, const void *b) {
+    const FileSortKey *k1 = (const FileSortKey *)a;
+    const FileSortKey *k2 = (const FileSortKey *)b;
+    int cmp = strcmp(k1->dir, k2->dir);
+    return cmp ? cmp : strcmp(k1->name, k2->name);
+}
+
+// compare_paths order from the dir and name columns, without re-parsing any
+// path; then chain the files of each basename in that order.
+static void sort_file_table(FileTable *files) {
+    int n = files->count;
+    FileSortKey *keys = (FileSortKey *)malloc((n + 1) * sizeof(FileSortKey));
+    if (!keys) pj_out_of_memory();
+    files->sorted = (int *)large_alloc((n + 1) * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        keys[i].dir = files->dir_paths[files->dir_ids[i]];
+        keys[i].name = files->names[files->name_ids[i]];
+        keys[i].id = i;
+    }
+    qsort(keys, n, sizeof(FileSortKey), compare_file_keys);
+    for (int i = 0; i < n; i++) files->sorted[i] = keys[i].id;
+    for (int i = n - 1; i >= 0; i--) {
+        int id = files->sorted[i];
+        int name_id = files->name_ids[id];
+        files->next_same_name[id] = files->name_heads[name_id];
+        files->name_heads[name_id] = id;
+    }
+    free(keys);
+}
+
+static void free_file_table(FileTable *files) {
+    free_string_arena(&files->strings);
+    large_free(files->paths);
+    large_free(files->dir_ids);
+    large_free(files->name_ids);
+    large_free(files->next_same_name);
+    large_free(files->types);
+    large_free(files->flags);
+    large_free(files->guards);
+    large_free((void *)files->guard_issues);
+    large_free(files->sizes);
+    large_free(files->mtimes);
+    large_free(files->inodes);
+    large_free(files->sorted);
+    large_free((void *)files->dir_paths);
+    large_free((void *)files->names);
+    large_free(files->name_heads);
+    large_free(files->name_sizes);
+    free_id_map(&files->name_index);
+    memset(files, 0, sizeof(*files));
+}
+
+// One row of the BASENAMES or DUPLICATES results: the files of a name, which
+// sort_file_table() already chained in sorted order.
+static void add_file_group(ResultGroupArray *groups, const FileTable *files, int name_id) {
+    if (groups->count >= groups->capacity) {
+        int capacity = groups->capacity ? groups->capacity * 2 : INITIAL_ARRAY_CAPACITY;
+        ResultGroup *grown = (ResultGroup *)realloc(groups->items, capacity * sizeof(ResultGroup));
+        if (!grown) pj_out_of_memory();
+        groups->items = grown;
+        groups->capacity = capacity;
+    }
+    ResultGroup *group = &groups->items[groups->count];
+    group->name = strdup(files->names[name_id]);
+    if (!group->name) pj_out_of_memory();
+    group->paths.capacity = files->name_sizes[name_id];
+    group->paths.items = (char **)malloc(group->paths.capacity * sizeof(char *));
+    if (!group->paths.items) pj_out_of_memory();
+    group->paths.count = 0;
+    group->paths.borrowed = false;
+    groups->count++;
+    for (int id = files->name_heads[name_id]; id >= 0; id = files->next_same_name[id]) {
+        add_to_string_array(&group->paths, files->paths[id]);
+    }
+}
+
+static void add_result_group(ResultGroupArray *groups, const char *name, const StringArray *paths) {
+    if (groups->count >= groups->capacity) {
+        int capacity = groups->capacity ? groups->capacity * 2 : INITIAL_ARRAY_CAPACITY;
+        ResultGroup *grown = (ResultGroup *)realloc(groups->items, capacity * sizeof(ResultGroup));
+        if (!grown) pj_out_of_memory();
+        groups->items = grown;
+        groups->capacity = capacity;
+    }
+    ResultGroup *group = &groups->items[groups->count];
+    group->name = strdup(name);
+    if (!group->name) pj_out_of_memory();
+    // Exactly sized: groups are copies of hash-map value lists and never grow
+    group->paths.capacity = paths->count > 0 ? paths->count : 1;
+    group->paths.items = (char **)malloc(group->paths.capacity * sizeof(char *));
+    if (!group->paths.items) pj_out_of_memory();
+    group->paths.count = 0;
+    group->paths.borrowed = false;
+    groups->count++;
+    for (int i = 0; i < paths->count; i++) add_to_string_array(&group->paths, paths->items[i]);
+    qsort(group->paths.items, group->paths.count, sizeof(char *), compare_paths);
+}
+
+static void free_result_groups(ResultGroupArray *groups) {
+    for (int i = 0; i < groups->count; i++) {
+        free(groups->items[i].name);
+        free_string_array(&groups->items[i].paths);
+    }
+    free(groups->items);
+    memset(groups, 0, sizeof(*groups));
+}
@@ -4,774 +4,593 @@
  *
  * This tool audits software development projects by identifying the project root,
  * cataloging relevant files, and generating a report on duplicate, orphaned,
- * and missing source files. It is designed to be a lightweight, single-file
- * utility with no external dependencies beyond the standard C library.
+ * and missing source files. It is a thin command-line front end over the
+ * libprojanitor engine (projanitor.h, libprojanitor.c); `projanitor --help`
+ * lists the optional analyses and the query subcommands.
  *
- * @version 1.0.0 
+ * @version 1.1.0
  * @date 2025-07-14
  *
- * To Compile:
- * gcc -std=c99 -Wall -o projanitor projanitor3.c
+ * To Compile (or run `make` in the repository root):
+ * gcc -std=c99 -O2 -o gen_classifier gen_classifier.c && ./gen_classifier > classifier_table.h
+ * gcc -std=c99 -Wall -O2 -o projanitor projanitor.c libprojanitor.c -lpthread
  *
  * To Run (from your project directory):
  * ./projanitor [--verbose]
  */
-#define _XOPEN_SOURCE 700 // Enable POSIX extensions for strdup, strtok_r, lstat
+#define _XOPEN_SOURCE 700 // Enable POSIX extensions for strdup, strtok_r
 #define _POSIX_C_SOURCE 200809L
 
+#include "projanitor.h"
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <unistd.h>
-#include <dirent.h>
-#include <sys/stat.h>
 #include <getopt.h>
-#include <libgen.h>
-#include <ctype.h>
 #include <errno.h>
+#include <limits.h>
+#include <libgen.h>
 
-#define MAX_PATH_LEN 4096
-#define MAX_LINE_LEN 2048
-#define INITIAL_ARRAY_CAPACITY 64
-#define HASH_MAP_SIZE 1024
-#define MAX_SEARCH_DEPTH 3
-#define MAX_SRC_BUFFER (MAX_LINE_LEN * 100) // Further increased buffer for safety
-
-// --- Data Structures ---
-
-typedef struct {
-    char **items;
-    int count;
-    int capacity;
-} StringArray;
-
-typedef struct Node {
-    char *key;
-    StringArray *values;
-    struct Node *next;
-} Node;
+#define DEFAULT_PP_TOP 20
+#define DEFAULT_NETWORK_FS_THREADS 32
 
 typedef struct {
-    Node **buckets;
-    int size;
-} HashMap;
+    bool verbose;
+    // Preprocessed-size profiler (--pp-profile)
+    bool pp_profile;
+    const char *pp_compile_db;  // NULL: look in <root>/build, then <root>
+    const char *pp_cache_dir;   // NULL: <root>/.projanitor_cache/pp
+    int pp_top;
+    bool redundant_includes;
+    bool unused_includes;
+    bool stale_artifacts;
+    bool guard_check;
+    const char *layer_rules;
+    bool unused_symbols;
+    bool reachability;
+    bool trigram_index;
+    const char *trigram_index_path; // NULL: <root>/.projanitor_cache/trigrams.idx
+    bool graph_snapshot;
+    const char *graph_snapshot_path; // NULL: <root>/.projanitor_cache/graph.snap
+    const char *export_sqlite_path;
+    const char *html_report_path;
+    const char *export_graph_path;
+    pj_graph_aggregate graph_aggregate;
+    const char *metrics_path;
+    bool rescan;                     // why: scan instead of reading the snapshot
+} Options;
 
 // --- Forward Declarations ---
-void init_string_array(StringArray *arr);
-void add_to_string_array(StringArray *arr, const char *item);
-bool string_array_contains(const StringArray *arr, const char *item);
-void free_string_array(StringArray *arr);
-int compare_paths(const void *a, const void *b);
-
-HashMap* create_hash_map(int size);
-void add_to_hash_map(HashMap *map, const char *key, const char *value);
-StringArray* get_from_hash_map(const HashMap *map, const char *key);
-void free_hash_map(HashMap *map);
+void usage(FILE *stream, const char *prog);
+void parse_arguments(int argc, char *argv[], ProjanitorContext *ctx, Options *opts);
+void log_to_stderr(void *user, pj_log_level level, const char *message);
+void generate_report(const ProjanitorContext *ctx);
+int run_query(ProjanitorContext *ctx, const Options *opts, const char *needle);
+int run_why(ProjanitorContext *ctx, const Options *opts, const char *file);
+int run_impact(ProjanitorContext *ctx, const Options *opts, bool tests, int count, char **names);
 
-void parse_arguments(int argc, char *argv[], StringArray *extensions, StringArray *exclude_dirs, StringArray *marker_files, bool *verbose);
-bool find_project_root(char *root_path, const StringArray *marker_files, bool verbose);
-char* get_project_name(const char *root_path);
-void collect_build_files(const char *build_path, StringArray *build_files, bool verbose);
-void analyze_project_files(const char *base_path, const StringArray *extensions, const StringArray *exclude_dirs, const StringArray *build_files, bool verbose, StringArray *all_files, HashMap *referenced_files, HashMap *found_files_map);
-void parse_file_for_references(const char *file_path, HashMap *referenced_files, bool verbose);
-void generate_report(const char *root_path, const char *project_name, const StringArray *all_files, const HashMap *referenced_files, const HashMap *found_files_map);
-
-// --- Utility: Safe string 'ends_with' check ---
-bool ends_with(const char *str, const char *suffix) {
-    if (!str || !suffix) return false;
-    size_t len_str = strlen(str);
-    size_t len_suffix = strlen(suffix);
-    if (len_suffix > len_str) return false;
-    return strcmp(str + len_str - len_suffix, suffix) == 0;
-}
+// --- Main Execution ---
 
-// --- Utility: Path comparison for sorting ---
-int compare_paths(const void *a, const void *b) {
-    const char *path1 = *(const char **)a;
-    const char *path2 = *(const char **)b;
-    if (!path1 || !path2) {
-        fprintf(stderr, "Warning: Null path in compare_paths\n");
-        return path1 ? 1 : (path2 ? -1 : 0);
-    }
-    char *path1_copy = strdup(path1);
-    char *path2_copy = strdup(path2);
-    if (!path1_copy || !path2_copy) {
-        fprintf(stderr, "Warning: Memory allocation failed in compare_paths\n");
-        free(path1_copy);
-        free(path2_copy);
-        return strcmp(path1, path2);
-    }
-    char *dir1 = strdup(path1);
-    char *dir2 = strdup(path2);
-    if (!dir1 || !dir2) {
-        fprintf(stderr, "Warning: Memory allocation failed for dir in compare_paths\n");
-        free(path1_copy);
-        free(path2_copy);
-        free(dir1);
-        free(dir2);
-        return strcmp(path1, path2);
-    }
-    char *dir1_copy = dirname(dir1);
-    char *dir2_copy = dirname(dir2);
-    char *base1 = basename(path1_copy);
-    char *base2 = basename(path2_copy);
-    if (!dir1_copy || !dir2_copy || !base1 || !base2) {
-        fprintf(stderr, "Warning: basename/dirname failed in compare_paths\n");
-        free(path1_copy);
-        free(path2_copy);
-        free(dir1);
-        free(dir2);
-        return strcmp(path1, path2);
-    }
-    int dir_cmp = strcmp(dir1_copy, dir2_copy);
-    int result = dir_cmp ? dir_cmp : strcmp(base1, base2);
-    free(path1_copy);
-    free(path2_copy);
-    free(dir1);
-    free(dir2);
-    return result;
+// Reports a failed analysis or output; its section of the report may be cut short.
+static bool succeeded(const ProjanitorContext *ctx, pj_status status) {
+    if (status == PJ_OK) return true;
+    fprintf(stderr, "❌ Error: %s\n", pj_last_error(ctx));
+    return false;
 }
 
-// --- Main Execution ---
-
 int main(int argc, char *argv[]) {
-    // Default configurations
-    StringArray extensions, exclude_dirs, marker_files;
-    init_string_array(&extensions);
-    init_string_array(&exclude_dirs);
-    init_string_array(&marker_files);
-
-    // Updated extensions per spec
-    add_to_string_array(&extensions, ".c");
-    add_to_string_array(&extensions, ".h");
-    add_to_string_array(&extensions, ".json");
-    add_to_string_array(&extensions, ".py");
-    add_to_string_array(&extensions, ".cmake");
-    add_to_string_array(&extensions, ".md");
-    add_to_string_array(&extensions, ".sh");
-    add_to_string_array(&extensions, "CMakeLists.txt");
-
-    // Updated exclude directories per spec
-    add_to_string_array(&exclude_dirs, ".git");
-    add_to_string_array(&exclude_dirs, "build");
-    add_to_string_array(&exclude_dirs, "build_logs");
-    add_to_string_array(&exclude_dirs, "doc");
-
-    // Marker files per spec
-    add_to_string_array(&marker_files, "LICENSE");
-    add_to_string_array(&marker_files, "sdkconfig");
-    add_to_string_array(&marker_files, "dependencies.lock");
-    add_to_string_array(&marker_files, "CMakeLists.txt");
-
-    bool verbose = false;
-    parse_arguments(argc, argv, &extensions, &exclude_dirs, &marker_files, &verbose);
-
-    char root_path[MAX_PATH_LEN];
-    if (!find_project_root(root_path, &marker_files, verbose)) {
+    ProjanitorContext *ctx = pj_context_new();
+    if (!ctx) {
+        fprintf(stderr, "❌ Error: Memory allocation failed for context\n");
+        return 1;
+    }
+    pj_set_log_callback(ctx, log_to_stderr, NULL);
+
+    bool query = argc > 1 && strcmp(argv[1], "query") == 0;
+    bool why = argc > 1 && strcmp(argv[1], "why") == 0;
+    bool impact = argc > 1 && strcmp(argv[1], "impact") == 0;
+    bool tests = argc > 1 && strcmp(argv[1], "tests") == 0;
+    if (query || why || impact || tests) {
+        argc--;
+        argv++;
+    }
+    Options opts = {0};
+    opts.pp_top = DEFAULT_PP_TOP;
+    parse_arguments(argc, argv, ctx, &opts);
+    pj_set_verbose(ctx, opts.verbose);
+    if (query) {
+        int rc = run_query(ctx, &opts, optind == argc - 1 ? argv[optind] : NULL);
+        pj_context_free(ctx);
+        return rc;
+    }
+    if (why) {
+        int rc = run_why(ctx, &opts, optind == argc - 1 ? argv[optind] : NULL);
+        pj_context_free(ctx);
+        return rc;
+    }
+    if (impact || tests) {
+        int rc = run_impact(ctx, &opts, tests, argc - optind, argv + optind);
+        pj_context_free(ctx);
+        return rc;
+    }
+    unsigned features = 0;
+    if (opts.unused_symbols) features |= PJ_FEATURE_SYMBOLS;
+    if (opts.trigram_index) features |= PJ_FEATURE_TRIGRAMS;
+    pj_set_features(ctx, features);
+
+    pj_status status = pj_discover_root(ctx);
+    if (status == PJ_ERR_NO_ROOT) {
         fprintf(stderr, "⚠️ Warning: Project root could not be found. Using current directory as fallback.\n");
-        if (getcwd(root_path, sizeof(root_path)) == NULL) {
-            fprintf(stderr, "❌ Error: Cannot get current directory: %s\n", strerror(errno));
-            free_string_array(&extensions);
-            free_string_array(&exclude_dirs);
-            free_string_array(&marker_files);
-            return 1;
-        }
+    } else if (status != PJ_OK) {
+        fprintf(stderr, "❌ Error: %s\n", pj_last_error(ctx));
+        pj_context_free(ctx);
+        return 1;
     }
+    const char *root_path = pj_root_path(ctx);
     printf("✅ Project root set to: %s\n", root_path);
 
     // Change to root directory
     if (chdir(root_path) != 0) {
         fprintf(stderr, "❌ Error: Cannot change to project root %s: %s\n", root_path, strerror(errno));
-        free_string_array(&extensions);
-        free_string_array(&exclude_dirs);
-        free_string_array(&marker_files);
+        pj_context_free(ctx);
         return 1;
     }
 
-    // Get project name
-    char *project_name = get_project_name(root_path);
-    if (!project_name) {
-        project_name = strdup("Unknown");
-        if (!project_name) {
-            fprintf(stderr, "❌ Error: Memory allocation failed for project name\n");
-            free_string_array(&extensions);
-            free_string_array(&exclude_dirs);
-            free_string_array(&marker_files);
-            return 1;
-        }
+    printf("🔍 Analyzing project files...\n");
+    status = pj_scan(ctx);
+    if (status != PJ_OK) {
+        fprintf(stderr, "❌ Error: %s\n", pj_last_error(ctx));
+        pj_context_free(ctx);
+        return 1;
     }
 
-    // Collect system-generated files from build directory
-    StringArray build_files;
-    init_string_array(&build_files);
-    char build_path[MAX_PATH_LEN];
-    if (snprintf(build_path, sizeof(build_path), "%s/build", root_path) >= sizeof(build_path)) {
-        fprintf(stderr, "Warning: Build path too long: %s/build\n", root_path);
-    } else {
-        if (verbose) fprintf(stderr, "Info: Collecting build files from %s\n", build_path);
-        collect_build_files(build_path, &build_files, verbose);
+    generate_report(ctx);
+    int exit_code = 0;
+    if (opts.redundant_includes && !succeeded(ctx, pj_report_redundant_includes(ctx, stdout))) exit_code = 1;
+    if (opts.unused_includes && !succeeded(ctx, pj_report_unused_includes(ctx, stdout))) exit_code = 1;
+    if (opts.guard_check && !succeeded(ctx, pj_report_include_guards(ctx, stdout))) exit_code = 1;
+    if (opts.unused_symbols && !succeeded(ctx, pj_report_unused_symbols(ctx, stdout))) exit_code = 1;
+    if (opts.reachability && !succeeded(ctx, pj_report_unreachable_files(ctx, stdout))) exit_code = 1;
+    if (opts.stale_artifacts && !succeeded(ctx, pj_report_stale_artifacts(ctx, stdout))) exit_code = 1;
+    size_t violations = 0;
+    if (opts.layer_rules) {
+        if (!succeeded(ctx, pj_check_layering(ctx, opts.layer_rules, stdout, &violations)) || violations > 0) exit_code = 1;
+    }
+    if (opts.pp_profile && !succeeded(ctx, pj_profile_preprocessed_sizes(ctx, opts.pp_compile_db, opts.pp_cache_dir, opts.pp_top, stdout))) {
+        exit_code = 1;
+    }
+    if (opts.trigram_index && !succeeded(ctx, pj_write_trigram_index(ctx, opts.trigram_index_path, stdout))) exit_code = 1;
+    if (opts.graph_snapshot && !succeeded(ctx, pj_write_graph_snapshot(ctx, opts.graph_snapshot_path, stdout))) exit_code = 1;
+    if (opts.export_sqlite_path && !succeeded(ctx, pj_export_sqlite(ctx, opts.export_sqlite_path, stdout))) exit_code = 1;
+    if (opts.html_report_path && !succeeded(ctx, pj_write_html_report(ctx, opts.html_report_path, stdout))) exit_code = 1;
+    if (opts.export_graph_path) {
+        size_t len = strlen(opts.export_graph_path);
+        pj_graph_format format = len >= 8 && strcmp(opts.export_graph_path + len - 8, ".graphml") == 0 ? PJ_GRAPH_GRAPHML : PJ_GRAPH_DOT;
+        if (!succeeded(ctx, pj_export_graph(ctx, opts.export_graph_path, format, opts.graph_aggregate, stdout))) exit_code = 1;
+    }
+    if (opts.metrics_path && !succeeded(ctx, pj_write_metrics(ctx, opts.metrics_path, stdout))) exit_code = 1;
+
+    // Cleanup
+    pj_context_free(ctx);
+    return exit_code;
+}
+
+// grep-style exit status: 0 when something matched, 1 when nothing did, 2 on error.
+int run_query(ProjanitorContext *ctx, const Options *opts, const char *needle) {
+    if (!needle) {
+        fprintf(stderr, "Usage: projanitor query [--trigram-index=PATH] [--marker-files=...] [--verbose] STRING\n");
+        return 2;
+    }
+    // An explicit index path is relative to the project root, as when it was written
+    if (opts->trigram_index_path) {
+        pj_status status = pj_discover_root(ctx);
+        if (status != PJ_OK && status != PJ_ERR_NO_ROOT) {
+            fprintf(stderr, "❌ Error: %s\n", pj_last_error(ctx));
+            return 2;
+        }
+        if (chdir(pj_root_path(ctx)) != 0) {
+            fprintf(stderr, "❌ Error: Cannot change to project root %s: %s\n", pj_root_path(ctx), strerror(errno));
+            return 2;
+        }
     }
+    size_t matches = 0;
+    if (pj_query_trigram_index(ctx, opts->trigram_index_path, needle, stdout, &matches) != PJ_OK) {
+        fprintf(stderr, "❌ Error: %s\n", pj_last_error(ctx));
+        return 2;
+    }
+    return matches > 0 ? 0 : 1;
+}
 
-    StringArray all_files;
-    init_string_array(&all_files);
-    HashMap *referenced_files = create_hash_map(HASH_MAP_SIZE);
-    HashMap *found_files_map = create_hash_map(HASH_MAP_SIZE);
+// Same exit status as run_query(): 0 reachable, 1 unreachable, 2 on error.
+int run_why(ProjanitorContext *ctx, const Options *opts, const char *file) {
+    if (!file) {
+        fprintf(stderr, "Usage: projanitor why [--graph-snapshot=PATH] [--rescan] [--marker-files=...] [--verbose] FILE\n");
+        return 2;
+    }
+    // FILE is relative to the working directory; pin it down before moving to the root
+    char resolved[PATH_MAX];
+    if (realpath(file, resolved)) {
+        file = resolved;
+        // Look for the default snapshot above FILE rather than above the working directory
+        if (!opts->rescan && !opts->graph_snapshot_path) {
+            char dir[PATH_MAX];
+            strcpy(dir, resolved);
+            pj_set_start_dir(ctx, dirname(dir));
+        }
+    }
+    if (opts->rescan || opts->graph_snapshot_path) {
+        pj_status status = pj_discover_root(ctx);
+        if (status != PJ_OK && status != PJ_ERR_NO_ROOT) {
+            fprintf(stderr, "❌ Error: %s\n", pj_last_error(ctx));
+            return 2;
+        }
+        if (chdir(pj_root_path(ctx)) != 0) {
+            fprintf(stderr, "❌ Error: Cannot change to project root %s: %s\n", pj_root_path(ctx), strerror(errno));
+            return 2;
+        }
+        if (opts->rescan && pj_scan(ctx) != PJ_OK) {
+            fprintf(stderr, "❌ Error: %s\n", pj_last_error(ctx));
+            return 2;
+        }
+    }
+    size_t chains = 0;
+    pj_status status = pj_why(ctx, opts->graph_snapshot_path, file, stdout, &chains);
+    if (status != PJ_OK) {
+        fprintf(stderr, "❌ Error: %s\n", pj_last_error(ctx));
+        if (status == PJ_ERR_IO && !opts->rescan) fprintf(stderr, "   (write a snapshot with --graph-snapshot, or pass --rescan)\n");
+        return 2;
+    }
+    return chains > 0 ? 0 : 1;
+}
 
-    printf("🔍 Analyzing project files...\n");
-    analyze_project_files(root_path, &extensions, &exclude_dirs, &build_files, verbose, &all_files, referenced_files, found_files_map);
-    generate_report(root_path, project_name, &all_files, referenced_files, found_files_map);
+// Absolute form of a name relative to the working directory, also for files
+// that no longer exist.
+static char *absolute_path(const char *name) {
+    char resolved[PATH_MAX];
+    char cwd[PATH_MAX];
+    if (realpath(name, resolved)) return strdup(resolved);
+    if (name[0] == '/' || !getcwd(cwd, sizeof(cwd))) return strdup(name);
+    size_t len = strlen(cwd) + strlen(name) + 2;
+    char *path = (char *)malloc(len);
+    if (path) snprintf(path, len, "%s/%s", cwd, name);
+    return path;
+}
 
-    // Cleanup
-    free(project_name);
-    free_string_array(&extensions);
-    free_string_array(&exclude_dirs);
-    free_string_array(&marker_files);
-    free_string_array(&all_files);
-    free_string_array(&build_files);
-    free_hash_map(referenced_files);
-    free_hash_map(found_files_map);
+// `impact`, or with `tests` the `tests` subcommand. Same exit status as
+// run_query(): 0 when something must rebuild (or a test run), 1 when nothing
+// does, 2 on error.
+int run_impact(ProjanitorContext *ctx, const Options *opts, bool tests, int count, char **names) {
+    // Changed files as arguments, or one per line on stdin (none, or "-")
+    bool from_stdin = count == 0 || (count == 1 && strcmp(names[0], "-") == 0);
+    size_t capacity = from_stdin ? 64 : (size_t)count;
+    size_t changed = 0;
+    char **files = (char **)malloc(capacity * sizeof(char *));
+    if (!files) { perror("malloc"); exit(EXIT_FAILURE); }
+    char line[PATH_MAX];
+    for (int i = 0; from_stdin ? fgets(line, sizeof(line), stdin) != NULL : i < count; i++) {
+        const char *name = names[from_stdin ? 0 : i];
+        if (from_stdin) {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (!line[0]) continue;
+            name = line;
+        }
+        if (changed == capacity) {
+            capacity *= 2;
+            files = (char **)realloc(files, capacity * sizeof(char *));
+            if (!files) { perror("realloc"); exit(EXIT_FAILURE); }
+        }
+        // Pin names down before moving to the root
+        if (!(files[changed++] = absolute_path(name))) { perror("malloc"); exit(EXIT_FAILURE); }
+    }
+
+    int rc = 2;
+    if (opts->rescan || opts->graph_snapshot_path) {
+        pj_status status = pj_discover_root(ctx);
+        if (status != PJ_OK && status != PJ_ERR_NO_ROOT) {
+            fprintf(stderr, "❌ Error: %s\n", pj_last_error(ctx));
+            goto done;
+        }
+        if (chdir(pj_root_path(ctx)) != 0) {
+            fprintf(stderr, "❌ Error: Cannot change to project root %s: %s\n", pj_root_path(ctx), strerror(errno));
+            goto done;
+        }
+        if (opts->rescan && pj_scan(ctx) != PJ_OK) {
+            fprintf(stderr, "❌ Error: %s\n", pj_last_error(ctx));
+            goto done;
+        }
+    }
+    size_t affected = 0;
+    pj_status status = tests
+        ? pj_select_tests(ctx, opts->graph_snapshot_path, (const char *const *)files, changed, stdout, &affected)
+        : pj_impact(ctx, opts->graph_snapshot_path, (const char *const *)files, changed, stdout, &affected);
+    if (status != PJ_OK) {
+        fprintf(stderr, "❌ Error: %s\n", pj_last_error(ctx));
+        if (status == PJ_ERR_IO && !opts->rescan) fprintf(stderr, "   (write a snapshot with --graph-snapshot, or pass --rescan)\n");
+        goto done;
+    }
+    rc = affected > 0 ? 0 : 1;
+done:
+    for (size_t i = 0; i < changed; i++) free(files[i]);
+    free(files);
+    return rc;
+}
 
-    return 0;
+void log_to_stderr(void *user, pj_log_level level, const char *message) {
+    (void)user;
+    static const char *const prefixes[] = {"Info", "Warning", "Error"};
+    fprintf(stderr, "%s: %s\n", prefixes[level], message);
 }
 
 // --- Argument Parsing ---
-void parse_arguments(int argc, char *argv[], StringArray *extensions, StringArray *exclude_dirs, StringArray *marker_files, bool *verbose) {
+enum {
+    OPT_PP_PROFILE = 256,
+    OPT_PP_CACHE_DIR,
+    OPT_PP_TOP,
+    OPT_REDUNDANT_INCLUDES,
+    OPT_GUARD_CHECK,
+    OPT_LAYERS,
+    OPT_UNUSED_SYMBOLS,
+    OPT_REACHABILITY,
+    OPT_TRIGRAM_INDEX,
+    OPT_GRAPH_SNAPSHOT,
+    OPT_RESCAN,
+    OPT_NETWORK_FS,
+    OPT_HUGE_PAGES,
+    OPT_EXPORT_SQLITE,
+    OPT_HTML_REPORT,
+    OPT_EXPORT_GRAPH,
+    OPT_GRAPH_AGGREGATE,
+    OPT_METRICS_FILE,
+    OPT_UNUSED_INCLUDES,
+    OPT_STALE_ARTIFACTS
+};
+
+typedef pj_status (*ListSetter)(ProjanitorContext *ctx, const char *const *items, size_t count);
+
+// Split a comma-separated option value and hand the list to the engine.
+static void set_list_option(ProjanitorContext *ctx, ListSetter setter, const char *value) {
+    char *input_str_cpy = strdup(value);
+    const char **items = (const char **)malloc((strlen(value) / 2 + 1) * sizeof(char *));
+    if (!input_str_cpy || !items) { perror("malloc"); exit(EXIT_FAILURE); }
+    size_t count = 0;
+    char *saveptr;
+    for (char *token = strtok_r(input_str_cpy, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
+        items[count++] = token;
+    }
+    if (setter(ctx, items, count) != PJ_OK) {
+        fprintf(stderr, "❌ Error: %s\n", pj_last_error(ctx));
+        exit(EXIT_FAILURE);
+    }
+    free(items);
+    free(input_str_cpy);
+}
+
+void usage(FILE *stream, const char *prog) {
+    fprintf(stream,
+        "Usage: %s [OPTION]...\n"
+        "       %s query [--trigram-index=PATH] STRING\n"
+        "       %s why [--graph-snapshot=PATH] [--rescan] FILE\n"
+        "       %s impact [--graph-snapshot=PATH] [--rescan] [FILE... | -]\n"
+        "       %s tests [--graph-snapshot=PATH] [--rescan] [FILE... | -]\n"
+        "\n"
+        "Scan:\n"
+        "  -e, --extensions=LIST        file types of interest (default: c,h,json,py,cmake,md,sh,CMakeLists.txt)\n"
+        "  -d, --exclude-dirs=LIST      directories to skip (default: .git,build,build_logs,doc)\n"
+        "  -m, --marker-files=LIST      files that mark the project root\n"
+        "                               (default: LICENSE,sdkconfig,dependencies.lock,CMakeLists.txt)\n"
+        "  -j, --jobs=N                 worker threads and processes (default: online CPUs)\n"
+        "      --network-fs[=THREADS]   issue THREADS (default 32) stats and whole-file reads at once,\n"
+        "                               for NFS and other filesystems where each call is a round trip\n"
+        "      --huge-pages             back the large scan tables with huge pages\n"
+        "  -v, --verbose                log every step to stderr\n"
+        "\n"
+        "Analyses (after the report):\n"
+        "      --pp-profile[=compile_commands.json]\n"
+        "                               preprocess every TU with its compiler and rank headers by\n"
+        "                               expanded size; cached by content hash under --pp-cache-dir\n"
+        "      --pp-cache-dir=DIR       (default: .projanitor_cache/pp under the root)\n"
+        "      --pp-top=N               headers to list (default: %d)\n"
+        "      --redundant-includes     #include lines that repeat or are implied by another include\n"
+        "      --unused-includes        #include lines whose header declares nothing the file uses\n"
+        "      --guard-check            classify include guards and the re-lex cost of missing ones\n"
+        "      --layers=RULES           check includes against directory layers (\"layer <name> <dir>...\",\n"
+        "                               \"allow <a> -> <b>...\"); exit status 1 on violations\n"
+        "      --unused-symbols         external functions and variables nothing uses\n"
+        "      --reachability           sources and headers no chain of references from a CMake file reaches\n"
+        "      --stale-artifacts        .o/.obj/.d files under build/ whose sources are gone\n"
+        "\n"
+        "Outputs:\n"
+        "      --trigram-index[=PATH]   write the trigram index for `query` (default: .projanitor_cache/trigrams.idx)\n"
+        "      --graph-snapshot[=PATH]  write the reference graph for `why`, `impact` and `tests`\n"
+        "                               (default: .projanitor_cache/graph.snap)\n"
+        "      --export-sqlite=FILE     files, references and findings as SQLite tables (`make sqlite` builds)\n"
+        "      --html-report=FILE       single-file HTML report\n"
+        "      --export-graph=FILE      reference graph as GraphML (FILE ending in .graphml) or DOT\n"
+        "      --graph-aggregate=dir|component\n"
+        "                               one node per directory or component in --export-graph\n"
+        "      --metrics-file=FILE      Prometheus text-format metrics, written atomically\n"
+        "\n"
+        "Subcommands exit with 0 when something matched, is reachable, affected or selected, 1 when\n"
+        "not and 2 on error. `impact` and `tests` read changed files from stdin (e.g. `git diff\n"
+        "--name-only`) when none are given; --rescan scans instead of reading the snapshot.\n",
+        prog, prog, prog, prog, prog, DEFAULT_PP_TOP);
+}
+
+void parse_arguments(int argc, char *argv[], ProjanitorContext *ctx, Options *opts) {
     int opt;
     struct option long_options[] = {
         {"extensions", required_argument, 0, 'e'},
         {"exclude-dirs", required_argument, 0, 'd'},
         {"marker-files", required_argument, 0, 'm'},
         {"verbose", no_argument, 0, 'v'},
+        {"help", no_argument, 0, 'h'},
+        {"jobs", required_argument, 0, 'j'},
+        {"pp-profile", optional_argument, 0, OPT_PP_PROFILE},
+        {"pp-cache-dir", required_argument, 0, OPT_PP_CACHE_DIR},
+        {"pp-top", required_argument, 0, OPT_PP_TOP},
+        {"redundant-includes", no_argument, 0, OPT_REDUNDANT_INCLUDES},
+        {"unused-includes", no_argument, 0, OPT_UNUSED_INCLUDES},
+        {"stale-artifacts", no_argument, 0, OPT_STALE_ARTIFACTS},
+        {"guard-check", no_argument, 0, OPT_GUARD_CHECK},
+        {"layers", required_argument, 0, OPT_LAYERS},
+        {"unused-symbols", no_argument, 0, OPT_UNUSED_SYMBOLS},
+        {"reachability", no_argument, 0, OPT_REACHABILITY},
+        {"trigram-index", optional_argument, 0, OPT_TRIGRAM_INDEX},
+        {"graph-snapshot", optional_argument, 0, OPT_GRAPH_SNAPSHOT},
+        {"rescan", no_argument, 0, OPT_RESCAN},
+        {"network-fs", optional_argument, 0, OPT_NETWORK_FS},
+        {"huge-pages", no_argument, 0, OPT_HUGE_PAGES},
+        {"export-sqlite", required_argument, 0, OPT_EXPORT_SQLITE},
+        {"html-report", required_argument, 0, OPT_HTML_REPORT},
+        {"export-graph", required_argument, 0, OPT_EXPORT_GRAPH},
+        {"graph-aggregate", required_argument, 0, OPT_GRAPH_AGGREGATE},
+        {"metrics-file", required_argument, 0, OPT_METRICS_FILE},
         {0, 0, 0, 0}
     };
 
-    bool extensions_set = false, exclude_set = false, markers_set = false;
-    while ((opt = getopt_long(argc, argv, "e:d:m:v", long_options, NULL)) != -1) {
-        char *token;
-        char *saveptr;
-        char *input_str_cpy = NULL;
-
+    while ((opt = getopt_long(argc, argv, "e:d:m:vhj:", long_options, NULL)) != -1) {
         switch (opt) {
             case 'e':
-                if (!extensions_set) {
-                    free_string_array(extensions);
-                    init_string_array(extensions);
-                    extensions_set = true;
-                }
-                input_str_cpy = strdup(optarg);
-                if (!input_str_cpy) { perror("strdup"); exit(EXIT_FAILURE); }
-                for (token = strtok_r(input_str_cpy, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
-                    add_to_string_array(extensions, token);
-                }
-                free(input_str_cpy);
+                set_list_option(ctx, pj_set_extensions, optarg);
                 break;
             case 'd':
-                if (!exclude_set) {
-                    free_string_array(exclude_dirs);
-                    init_string_array(exclude_dirs);
-                    exclude_set = true;
-                }
-                input_str_cpy = strdup(optarg);
-                if (!input_str_cpy) { perror("strdup"); exit(EXIT_FAILURE); }
-                for (token = strtok_r(input_str_cpy, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
-                    add_to_string_array(exclude_dirs, token);
-                }
-                free(input_str_cpy);
+                set_list_option(ctx, pj_set_exclude_dirs, optarg);
                 break;
             case 'm':
-                if (!markers_set) {
-                    free_string_array(marker_files);
-                    init_string_array(marker_files);
-                    markers_set = true;
-                }
-                input_str_cpy = strdup(optarg);
-                if (!input_str_cpy) { perror("strdup"); exit(EXIT_FAILURE); }
-                for (token = strtok_r(input_str_cpy, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
-                    add_to_string_array(marker_files, token);
-                }
-                free(input_str_cpy);
+                set_list_option(ctx, pj_set_marker_files, optarg);
                 break;
             case 'v':
-                *verbose = true;
+                opts->verbose = true;
+                break;
+            case 'j':
+                pj_set_jobs(ctx, atoi(optarg));
+                break;
+            case OPT_PP_PROFILE:
+                opts->pp_profile = true;
+                opts->pp_compile_db = optarg;
                 break;
+            case OPT_PP_CACHE_DIR:
+                opts->pp_cache_dir = optarg;
+                break;
+            case OPT_PP_TOP:
+                opts->pp_top = atoi(optarg);
+                if (opts->pp_top < 1) opts->pp_top = DEFAULT_PP_TOP;
+                break;
+            case OPT_REDUNDANT_INCLUDES:
+                opts->redundant_includes = true;
+                break;
+            case OPT_UNUSED_INCLUDES:
+                opts->unused_includes = true;
+                break;
+            case OPT_STALE_ARTIFACTS:
+                opts->stale_artifacts = true;
+                break;
+            case OPT_GUARD_CHECK:
+                opts->guard_check = true;
+                break;
+            case OPT_LAYERS:
+                opts->layer_rules = optarg;
+                break;
+            case OPT_UNUSED_SYMBOLS:
+                opts->unused_symbols = true;
+                break;
+            case OPT_REACHABILITY:
+                opts->reachability = true;
+                break;
+            case OPT_TRIGRAM_INDEX:
+                opts->trigram_index = true;
+                opts->trigram_index_path = optarg;
+                break;
+            case OPT_GRAPH_SNAPSHOT:
+                opts->graph_snapshot = true;
+                opts->graph_snapshot_path = optarg;
+                break;
+            case OPT_RESCAN:
+                opts->rescan = true;
+                break;
+            case OPT_NETWORK_FS:
+                pj_set_network_fs(ctx, optarg && atoi(optarg) > 0 ? atoi(optarg) : DEFAULT_NETWORK_FS_THREADS);
+                break;
+            case OPT_HUGE_PAGES:
+                pj_set_huge_pages(ctx, true);
+                break;
+            case OPT_EXPORT_SQLITE:
+                opts->export_sqlite_path = optarg;
+                break;
+            case OPT_HTML_REPORT:
+                opts->html_report_path = optarg;
+                break;
+            case OPT_EXPORT_GRAPH:
+                opts->export_graph_path = optarg;
+                break;
+            case OPT_GRAPH_AGGREGATE:
+                if (strcmp(optarg, "dir") == 0) {
+                    opts->graph_aggregate = PJ_AGGREGATE_DIRECTORY;
+                } else if (strcmp(optarg, "component") == 0) {
+                    opts->graph_aggregate = PJ_AGGREGATE_COMPONENT;
+                } else {
+                    fprintf(stderr, "❌ Error: --graph-aggregate must be dir or component\n");
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case OPT_METRICS_FILE:
+                opts->metrics_path = optarg;
+                break;
+            case 'h':
+                usage(stdout, argv[0]);
+                exit(EXIT_SUCCESS);
             default:
-                fprintf(stderr, "Usage: %s [--extensions=c,h,json,py,cmake,md,sh,CMakeLists.txt] [--exclude-dirs=.git,build,build_logs,doc] [--marker-files=LICENSE,sdkconfig,dependencies.lock,CMakeLists.txt] [--verbose]\n", argv[0]);
+                usage(stderr, argv[0]);
                 exit(EXIT_FAILURE);
         }
     }
 }
 
-// --- Core Logic ---
+// --- Report ---
 
-bool has_valid_extension(const char *filename, const StringArray *extensions) {
-    if (!filename || !extensions) {
-        fprintf(stderr, "Warning: Null filename or extensions in has_valid_extension\n");
-        return false;
-    }
-    for (int i = 0; i < extensions->count; i++) {
-        const char *ext = extensions->items[i];
-        if (!ext) continue;
-        if (strcmp(ext, filename) == 0) return true;
-        if (ext[0] == '.' && ends_with(filename, ext)) return true;
+static void print_list(const ProjanitorContext *ctx, pj_result_kind kind, const char *prefix, const char *none) {
+    pj_iter it = pj_iter_begin(ctx, kind);
+    pj_entry entry;
+    bool any = false;
+    while (pj_iter_next(&it, &entry)) {
+        printf("%s%s\n", prefix, entry.name);
+        any = true;
     }
-    return false;
+    if (!any) printf("%s\n", none);
 }
 
-bool is_system_file(const char *filename, const StringArray *build_files) {
-    if (!filename || !build_files) {
-        fprintf(stderr, "Warning: Null filename or build_files in is_system_file\n");
-        return false;
-    }
-    char *filename_copy = strdup(filename);
-    if (!filename_copy) {
-        fprintf(stderr, "Warning: Memory allocation failed in is_system_file\n");
-        return false;
-    }
-    char *base = basename(filename_copy);
-    bool is_system = string_array_contains(build_files, base);
-    free(filename_copy);
-    return is_system;
-}
-
-bool check_marker_files(const char *path, const StringArray *marker_files, bool verbose) {
-    if (!path || !marker_files) {
-        if (verbose) fprintf(stderr, "Warning: Null path or marker_files in check_marker_files\n");
-        return false;
-    }
-    struct stat st;
-    int found_count = 0;
-    StringArray missing_files;
-    init_string_array(&missing_files);
-
-    for (int i = 0; i < marker_files->count; i++) {
-        if (!marker_files->items[i]) continue;
-        char marker_path[MAX_PATH_LEN];
-        if (strlen(path) + strlen(marker_files->items[i]) + 1 >= sizeof(marker_path)) {
-            if (verbose) fprintf(stderr, "Warning: Path too long for marker: %s/%s\n", path, marker_files->items[i]);
-            continue;
-        }
-        snprintf(marker_path, sizeof(marker_path), "%s/%s", path, marker_files->items[i]);
-        if (stat(marker_path, &st) == 0 && S_ISREG(st.st_mode)) {
-            found_count++;
-            if (verbose) fprintf(stderr, "Info: Found marker %s in %s\n", marker_files->items[i], path);
-        } else {
-            add_to_string_array(&missing_files, marker_files->items[i]);
-        }
-    }
-
-    if (verbose && found_count < marker_files->count) {
-        fprintf(stderr, "Info: Directory %s missing markers: ", path);
-        for (int i = 0; i < missing_files.count; i++) {
-            fprintf(stderr, "%s%s", missing_files.items[i], i < missing_files.count - 1 ? ", " : "\n");
-        }
-    }
-
-    free_string_array(&missing_files);
-    return found_count == marker_files->count;
-}
-
-bool find_project_root(char *root_path, const StringArray *marker_files, bool verbose) {
-    if (!root_path || !marker_files) {
-        if (verbose) fprintf(stderr, "Warning: Null root_path or marker_files in find_project_root\n");
-        return false;
-    }
-    char current_path[MAX_PATH_LEN];
-    if (getcwd(current_path, sizeof(current_path)) == NULL) {
-        if (verbose) fprintf(stderr, "Error: getcwd() failed: %s\n", strerror(errno));
-        return false;
-    }
-
-    // Search order: current, up 1-3, down 1-3
-    StringArray search_paths;
-    init_string_array(&search_paths);
-    add_to_string_array(&search_paths, current_path);
-    if (verbose) fprintf(stderr, "Info: Checking directory %s\n", current_path);
-
-    // Up 1-3 levels
-    char temp_path[MAX_PATH_LEN];
-    strcpy(temp_path, current_path);
-    for (int i = 1; i <= MAX_SEARCH_DEPTH; i++) {
-        char *last_slash = strrchr(temp_path, '/');
-        if (last_slash == temp_path) {
-            temp_path[1] = '\0';
-        } else if (last_slash != NULL) {
-            *last_slash = '\0';
-            add_to_string_array(&search_paths, temp_path);
-            if (verbose) fprintf(stderr, "Info: Checking directory %s\n", temp_path);
-        } else {
-            break;
-        }
-    }
-
-    // Down 1-3 levels
-    StringArray down_paths;
-    init_string_array(&down_paths);
-    add_to_string_array(&down_paths, current_path);
-    for (int depth = 1; depth <= MAX_SEARCH_DEPTH; depth++) {
-        for (int i = 0; i < down_paths.count; i++) {
-            if (!down_paths.items[i]) continue;
-            DIR *dir = opendir(down_paths.items[i]);
-            if (!dir) {
-                if (verbose) fprintf(stderr, "Warning: Cannot open directory %s: %s\n", down_paths.items[i], strerror(errno));
-                continue;
-            }
-            struct dirent *entry;
-            while ((entry = readdir(dir)) != NULL) {
-                if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
-                char full_path[MAX_PATH_LEN];
-                if (strlen(down_paths.items[i]) + strlen(entry->d_name) + 1 >= sizeof(full_path)) {
-                    if (verbose) fprintf(stderr, "Warning: Path too long: %s/%s\n", down_paths.items[i], entry->d_name);
-                    continue;
-                }
-                snprintf(full_path, sizeof(full_path), "%s/%s", down_paths.items[i], entry->d_name);
-                struct stat st;
-                if (stat(full_path, &st) != 0) {
-                    if (verbose) fprintf(stderr, "Warning: Cannot stat %s: %s\n", full_path, strerror(errno));
-                    continue;
-                }
-                if (S_ISDIR(st.st_mode)) {
-                    add_to_string_array(&search_paths, full_path);
-                    if (verbose) fprintf(stderr, "Info: Checking directory %s\n", full_path);
-                    if (depth < MAX_SEARCH_DEPTH) {
-                        add_to_string_array(&down_paths, full_path);
-                    }
-                }
-            }
-            closedir(dir);
-        }
-    }
-    free_string_array(&down_paths);
-
-    // Check each path for all marker files
-    for (int i = 0; i < search_paths.count; i++) {
-        if (!search_paths.items[i]) continue;
-        if (check_marker_files(search_paths.items[i], marker_files, verbose)) {
-            strcpy(root_path, search_paths.items[i]);
-            free_string_array(&search_paths);
-            return true;
-        }
-    }
-
-    free_string_array(&search_paths);
-    return false;
-}
-
-char* get_project_name(const char *root_path) {
-    if (!root_path) {
-        fprintf(stderr, "Warning: Null root_path in get_project_name\n");
-        return NULL;
-    }
-    char cmake_path[MAX_PATH_LEN];
-    if (snprintf(cmake_path, sizeof(cmake_path), "%s/CMakeLists.txt", root_path) >= sizeof(cmake_path)) {
-        fprintf(stderr, "Warning: Path too long for CMakeLists.txt: %s\n", root_path);
-        return NULL;
-    }
-    FILE *file = fopen(cmake_path, "r");
-    if (!file) {
-        fprintf(stderr, "Warning: Could not open %s: %s\n", cmake_path, strerror(errno));
-        return NULL;
-    }
-
-    char line[MAX_LINE_LEN];
-    while (fgets(line, sizeof(line), file)) {
-        char *project_pos = strstr(line, "project(");
-        if (project_pos) {
-            char *start = project_pos + strlen("project(");
-            char *end = strchr(start, ')');
-            if (end) {
-                size_t len = end - start;
-                char *name = (char *)malloc(len + 1);
-                if (!name) {
-                    fclose(file);
-                    fprintf(stderr, "Warning: Memory allocation failed in get_project_name\n");
-                    return NULL;
-                }
-                strncpy(name, start, len);
-                name[len] = '\0';
-                fclose(file);
-                return name;
-            }
-        }
-    }
-    fclose(file);
-    return NULL;
-}
-
-void collect_build_files(const char *build_path, StringArray *build_files, bool verbose) {
-    if (!build_path || !build_files) {
-        if (verbose) fprintf(stderr, "Warning: Null build_path or build_files in collect_build_files\n");
-        return;
-    }
-    DIR *dir = opendir(build_path);
-    if (!dir) {
-        if (verbose) fprintf(stderr, "Warning: Cannot open build directory %s: %s\n", build_path, strerror(errno));
-        return;
-    }
-
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
-        char full_path[MAX_PATH_LEN];
-        if (strlen(build_path) + strlen(entry->d_name) + 1 >= sizeof(full_path)) {
-            if (verbose) fprintf(stderr, "Warning: Path too long: %s/%s\n", build_path, entry->d_name);
-            continue;
-        }
-        snprintf(full_path, sizeof(full_path), "%s/%s", build_path, entry->d_name);
-        struct stat st;
-        if (stat(full_path, &st) != 0) {
-            if (verbose) fprintf(stderr, "Warning: Cannot stat %s: %s\n", full_path, strerror(errno));
-            continue;
-        }
-        if (S_ISREG(st.st_mode)) {
-            add_to_string_array(build_files, entry->d_name);
-            if (verbose) fprintf(stderr, "Info: Added build file %s\n", entry->d_name);
-        } else if (S_ISDIR(st.st_mode)) {
-            collect_build_files(full_path, build_files, verbose);
-        }
-    }
-    closedir(dir);
-}
-
-void parse_file_for_references(const char *file_path, HashMap *referenced_files, bool verbose) {
-    if (!file_path || !referenced_files) {
-        if (verbose) fprintf(stderr, "Warning: Null file_path or referenced_files in parse_file_for_references\n");
-        return;
-    }
-    if (verbose) fprintf(stderr, "Info: Parsing file %s\n", file_path);
-    FILE *file = fopen(file_path, "r");
-    if (!file) {
-        if (verbose) fprintf(stderr, "Warning: Could not open file %s: %s\n", file_path, strerror(errno));
-        return;
-    }
-
-    char line[MAX_LINE_LEN];
-    bool in_src_block = false;
-    char src_buffer[MAX_SRC_BUFFER] = {0};
-    size_t src_len = 0;
-
-    while (fgets(line, sizeof(line), file)) {
-        // Strip leading/trailing whitespace
-        char *trimmed = line;
-        while (isspace(*trimmed)) trimmed++;
-        char *end = trimmed + strlen(trimmed) - 1;
-        while (end > trimmed && isspace(*end)) *end-- = '\0';
-
-        // Handle C/C++ includes
-        if (!in_src_block && strstr(trimmed, "#include \"")) {
-            char *start = strstr(trimmed, "#include \"") + strlen("#include \"");
-            char *end_quote = strchr(start, '"');
-            if (end_quote) {
-                size_t len = end_quote - start;
-                if (len > 0 && len < MAX_PATH_LEN && !strchr(start, '<')) { // Exclude <*.h>
-                    char *ref_name = (char *)malloc(len + 1);
-                    if (!ref_name) {
-                        if (verbose) fprintf(stderr, "Error: Memory allocation failed for ref_name in %s\n", file_path);
-                        fclose(file);
-                        return;
-                    }
-                    strncpy(ref_name, start, len);
-                    ref_name[len] = '\0';
-                    add_to_hash_map(referenced_files, ref_name, file_path);
-                    if (verbose) fprintf(stderr, "Info: Found include reference %s in %s\n", ref_name, file_path);
-                    free(ref_name);
-                }
-            }
-        }
-        // Handle CMake SRC lists
-        else if (ends_with(file_path, "CMakeLists.txt") || ends_with(file_path, ".cmake")) {
-            if (strstr(trimmed, "set(SRC") || strstr(trimmed, "target_sources(")) {
-                in_src_block = true;
-                src_len = 0;
-                if (strlen(trimmed) < sizeof(src_buffer)) {
-                    strncpy(src_buffer, trimmed, sizeof(src_buffer) - 1);
-                    src_len = strlen(src_buffer);
-                    if (verbose) fprintf(stderr, "Info: Started SRC block in %s\n", file_path);
-                } else {
-                    if (verbose) fprintf(stderr, "Warning: Line too long in %s\n", file_path);
-                }
-            } else if (in_src_block) {
-                if (src_len + strlen(trimmed) + 1 < sizeof(src_buffer)) {
-                    strcat(src_buffer, " ");
-                    strcat(src_buffer, trimmed);
-                    src_len += strlen(trimmed) + 1;
-                } else {
-                    if (verbose) fprintf(stderr, "Warning: SRC buffer overflow in %s\n", file_path);
-                    in_src_block = false;
-                }
-                if (strchr(trimmed, ')')) {
-                    in_src_block = false;
-                    // Parse SRC buffer
-                    char *buffer_copy = strdup(src_buffer);
-                    if (!buffer_copy) {
-                        if (verbose) fprintf(stderr, "Error: Memory allocation failed for buffer_copy in %s\n", file_path);
-                        fclose(file);
-                        return;
-                    }
-                    char *token = strtok(buffer_copy, " \t\n");
-                    while (token) {
-                        if (token[0] != '(' && token[0] != ')' && strcmp(token, "set") != 0 && strcmp(token, "SRC") != 0 && strcmp(token, "target_sources") != 0) {
-                            char *ref_name = strdup(token);
-                            if (!ref_name) {
-                                if (verbose) fprintf(stderr, "Error: Memory allocation failed for ref_name in %s\n", file_path);
-                                free(buffer_copy);
-                                fclose(file);
-                                return;
-                            }
-                            add_to_hash_map(referenced_files, ref_name, file_path);
-                            if (verbose) fprintf(stderr, "Info: Found SRC reference %s in %s\n", ref_name, file_path);
-                            free(ref_name);
-                        }
-                        token = strtok(NULL, " \t\n");
-                    }
-                    free(buffer_copy);
-                    if (verbose) fprintf(stderr, "Info: Ended SRC block in %s\n", file_path);
-                }
-            }
-        }
-    }
-    fclose(file);
-}
-
-void analyze_project_files(const char *base_path, const StringArray *extensions, const StringArray *exclude_dirs, const StringArray *build_files, bool verbose, StringArray *all_files, HashMap *referenced_files, HashMap *found_files_map) {
-    if (!base_path || !extensions || !exclude_dirs || !build_files || !all_files || !referenced_files || !found_files_map) {
-        if (verbose) fprintf(stderr, "Warning: Invalid arguments to analyze_project_files\n");
-        return;
-    }
-    if (verbose) fprintf(stderr, "Info: Analyzing directory %s\n", base_path);
-    DIR *dir = opendir(base_path);
-    if (!dir) {
-        if (verbose) fprintf(stderr, "Warning: Cannot open directory %s: %s\n", base_path, strerror(errno));
-        return;
-    }
-
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
-        if (!entry->d_name) {
-            if (verbose) fprintf(stderr, "Warning: Null directory entry in %s\n", base_path);
-            continue;
-        }
-        char full_path[MAX_PATH_LEN];
-        if (strlen(base_path) + strlen(entry->d_name) + 1 >= sizeof(full_path)) {
-            if (verbose) fprintf(stderr, "Warning: Path too long: %s/%s\n", base_path, entry->d_name);
-            continue;
-        }
-        snprintf(full_path, sizeof(full_path), "%s/%s", base_path, entry->d_name);
-
-        struct stat st;
-        if (lstat(full_path, &st) != 0) {
-            if (verbose) fprintf(stderr, "Warning: Cannot stat %s: %s\n", full_path, strerror(errno));
-            continue;
-        }
-
-        if (S_ISDIR(st.st_mode)) {
-            if (string_array_contains(exclude_dirs, entry->d_name) && strcmp(entry->d_name, "build") != 0) {
-                if (verbose) fprintf(stderr, "Info: Skipping excluded directory: %s\n", full_path);
-                continue;
-            }
-            analyze_project_files(full_path, extensions, exclude_dirs, build_files, verbose, all_files, referenced_files, found_files_map);
-        } else if (S_ISREG(st.st_mode)) {
-            if (has_valid_extension(entry->d_name, extensions) && !is_system_file(entry->d_name, build_files)) {
-                add_to_string_array(all_files, full_path);
-                add_to_hash_map(found_files_map, entry->d_name, full_path);
-                if (verbose) fprintf(stderr, "Info: Processing file %s\n", full_path);
-                parse_file_for_references(full_path, referenced_files, verbose);
-            }
-        } else if (S_ISLNK(st.st_mode) && verbose) {
-            fprintf(stderr, "Warning: Skipping symlink: %s\n", full_path);
-        }
-    }
-    closedir(dir);
+static bool ends_with(const char *str, const char *suffix) {
+    size_t len_str = strlen(str);
+    size_t len_suffix = strlen(suffix);
+    return len_suffix <= len_str && strcmp(str + len_str - len_suffix, suffix) == 0;
 }
 
-void generate_report(const char *root_path, const char *project_name, const StringArray *all_files, const HashMap *referenced_files, const HashMap *found_files_map) {
-    if (!root_path || !project_name || !all_files || !referenced_files || !found_files_map) {
-        fprintf(stderr, "Error: Invalid arguments to generate_report\n");
-        return;
-    }
-
-    // Sort all_files for list_exist
-    qsort(all_files->items, all_files->count, sizeof(char *), compare_paths);
-
-    // Collect subfolders (excluding no-go areas)
-    StringArray subfolders;
-    init_string_array(&subfolders);
-    StringArray exclude_dirs;
-    init_string_array(&exclude_dirs);
-    add_to_string_array(&exclude_dirs, ".git");
-    add_to_string_array(&exclude_dirs, "build");
-    add_to_string_array(&exclude_dirs, "build_logs");
-    add_to_string_array(&exclude_dirs, "doc");
-
-    DIR *dir = opendir(root_path);
-    if (dir) {
-        struct dirent *entry;
-        while ((entry = readdir(dir)) != NULL) {
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
-            char full_path[MAX_PATH_LEN];
-            if (strlen(root_path) + strlen(entry->d_name) + 1 >= sizeof(full_path)) continue;
-            snprintf(full_path, sizeof(full_path), "%s/%s", root_path, entry->d_name);
-            struct stat st;
-            if (stat(full_path, &st) == 0 && S_ISDIR(st.st_mode) && !string_array_contains(&exclude_dirs, entry->d_name)) {
-                add_to_string_array(&subfolders, entry->d_name);
-            }
-        }
-        closedir(dir);
-    }
-    qsort(subfolders.items, subfolders.count, sizeof(char *), compare_paths);
-
-    // Statistics
-    int counts[8] = {0}; // .c, .h, CMakeLists.txt, .cmake, .sh, .json, .py, .md
-    for (int i = 0; i < all_files->count; i++) {
-        if (!all_files->items[i]) continue;
-        const char *file = all_files->items[i];
-        char *file_copy = strdup(file);
-        if (!file_copy) continue;
-        char *basename_result = basename(file_copy);
-        if (ends_with(file, ".c")) counts[0]++;
-        else if (ends_with(file, ".h")) counts[1]++;
-        else if (strcmp(basename_result, "CMakeLists.txt") == 0) counts[2]++;
-        else if (ends_with(file, ".cmake")) counts[3]++;
-        else if (ends_with(file, ".sh")) counts[4]++;
-        else if (ends_with(file, ".json")) counts[5]++;
-        else if (ends_with(file, ".py")) counts[6]++;
-        else if (ends_with(file, ".md")) counts[7]++;
-        free(file_copy);
-    }
+void generate_report(const ProjanitorContext *ctx) {
+    pj_entry entry;
+    pj_iter it;
 
     // --- Summary ---
     printf("\n=== Summary ===\n");
-    printf("Project name: %s\n", project_name);
-    printf("Project root folder: %s\n", root_path);
+    printf("Project name: %s\n", pj_project_name(ctx));
+    printf("Project root folder: %s\n", pj_root_path(ctx));
     printf("Key subfolders:\n");
-    if (subfolders.count == 0) {
-        printf("  (None)\n");
-    } else {
-        for (int i = 0; i < subfolders.count; i++) {
-            printf("  - %s\n", subfolders.items[i]);
-        }
-    }
+    print_list(ctx, PJ_RESULT_SUBFOLDERS, "  - ", "  (None)");
     printf("File structure:\n");
-    if (all_files->count == 0) {
-        printf("  (None)\n");
-    } else {
-        for (int i = 0; i < all_files->count; i++) {
-            printf("  - %s\n", all_files->items[i]);
-        }
-    }
+    print_list(ctx, PJ_RESULT_FILES, "  - ", "  (None)");
 
     // --- Statistics ---
     printf("\n=== Statistics ===\n");
-    printf("Total # of files of interest: %d\n", all_files->count);
-    printf("# of .c: %d\n", counts[0]);
-    printf("# of .h: %d\n", counts[1]);
-    printf("# of CMakeLists.txt: %d\n", counts[2]);
-    printf("# of .cmake files: %d\n", counts[3]);
-    printf("# of .sh: %d\n", counts[4]);
-    printf("# of .json: %d\n", counts[5]);
-    printf("# of .py: %d\n", counts[6]);
-    printf("# of .md: %d\n", counts[7]);
+    printf("Total # of files of interest: %zu\n", pj_result_count(ctx, PJ_RESULT_FILES));
+    printf("# of .c: %zu\n", pj_file_type_count(ctx, PJ_TYPE_C));
+    printf("# of .h: %zu\n", pj_file_type_count(ctx, PJ_TYPE_H));
+    printf("# of CMakeLists.txt: %zu\n", pj_file_type_count(ctx, PJ_TYPE_CMAKELISTS));
+    printf("# of .cmake files: %zu\n", pj_file_type_count(ctx, PJ_TYPE_CMAKE));
+    printf("# of .sh: %zu\n", pj_file_type_count(ctx, PJ_TYPE_SH));
+    printf("# of .json: %zu\n", pj_file_type_count(ctx, PJ_TYPE_JSON));
+    printf("# of .py: %zu\n", pj_file_type_count(ctx, PJ_TYPE_PY));
+    printf("# of .md: %zu\n", pj_file_type_count(ctx, PJ_TYPE_MD));
 
     // --- Warnings: Duplicates ---
     printf("\n=== Warnings ===\n");
@@ -779,260 +598,30 @@ void generate_report(const char *root_path, const char *project_name, const Stri
     for (int e = 0; e < 4; e++) {
         printf("%s files with identical names:\n", exts[e]);
         bool found = false;
-        for (int i = 0; i < found_files_map->size; i++) {
-            for (Node *node = found_files_map->buckets[i]; node; node = node->next) {
-                if (!node->key || !node->values) continue;
-                if (node->values->count > 1 && ends_with(node->key, exts[e])) {
-                    found = true;
-                    printf("  %s:\n", node->key);
-                    StringArray sorted_paths;
-                    init_string_array(&sorted_paths);
-                    for (int j = 0; j < node->values->count; j++) {
-                        if (node->values->items[j]) {
-                            add_to_string_array(&sorted_paths, node->values->items[j]);
-                        }
-                    }
-                    qsort(sorted_paths.items, sorted_paths.count, sizeof(char *), compare_paths);
-                    for (int j = 0; j < sorted_paths.count; j++) {
-                        printf("    %s\n", sorted_paths.items[j]);
-                    }
-                    free_string_array(&sorted_paths);
-                }
-            }
+        for (it = pj_iter_begin(ctx, PJ_RESULT_DUPLICATES); pj_iter_next(&it, &entry);) {
+            if (!ends_with(entry.name, exts[e])) continue;
+            found = true;
+            printf("  %s:\n", entry.name);
+            for (size_t j = 0; j < entry.path_count; j++) printf("    %s\n", entry.paths[j]);
         }
         if (!found) printf("  (None)\n");
     }
 
     // --- Errors: Orphan and Missing Files ---
-    StringArray orphan_files;
-    init_string_array(&orphan_files);
-    for (int i = 0; i < all_files->count; i++) {
-        if (!all_files->items[i]) continue;
-        char *dup_path = strdup(all_files->items[i]);
-        if (!dup_path) continue;
-        char *file_basename = basename(dup_path);
-        if (!file_basename) {
-            free(dup_path);
-            continue;
-        }
-        if (!get_from_hash_map(referenced_files, file_basename)) {
-            add_to_string_array(&orphan_files, all_files->items[i]);
-        }
-        free(dup_path);
-    }
-    qsort(orphan_files.items, orphan_files.count, sizeof(char *), compare_paths);
-
-    StringArray missing_files;
-    init_string_array(&missing_files);
-    HashMap *missing_refs = create_hash_map(HASH_MAP_SIZE);
-    for (int i = 0; i < referenced_files->size; i++) {
-        for (Node *node = referenced_files->buckets[i]; node; node = node->next) {
-            if (!node->key || !node->values) continue;
-            if (!get_from_hash_map(found_files_map, node->key)) {
-                add_to_string_array(&missing_files, node->key);
-                for (int j = 0; j < node->values->count; j++) {
-                    if (node->values->items[j]) {
-                        add_to_hash_map(missing_refs, node->key, node->values->items[j]);
-                    }
-                }
-            }
-        }
-    }
-    qsort(missing_files.items, missing_files.count, sizeof(char *), compare_paths);
-
     printf("\n=== Errors ===\n");
-    printf("Orphan files: %d\n", orphan_files.count);
-    printf("Missing files: %d\n", missing_files.count);
+    printf("Orphan files: %zu\n", pj_result_count(ctx, PJ_RESULT_ORPHANS));
+    printf("Missing files: %zu\n", pj_result_count(ctx, PJ_RESULT_MISSING));
 
     printf("\n=== Details of Orphan Files ===\n");
-    if (orphan_files.count > 0) {
-        for (int i = 0; i < orphan_files.count; i++) {
-            if (orphan_files.items[i]) printf("- %s\n", orphan_files.items[i]);
-        }
-    } else {
-        printf("(None)\n");
-    }
+    print_list(ctx, PJ_RESULT_ORPHANS, "- ", "(None)");
 
     printf("\n=== Details of Missing Files ===\n");
-    if (missing_files.count > 0) {
-        for (int i = 0; i < missing_files.count; i++) {
-            if (!missing_files.items[i]) continue;
-            printf("- %s\n", missing_files.items[i]);
-            printf("    referenced by:\n");
-            StringArray *refs = get_from_hash_map(missing_refs, missing_files.items[i]);
-            if (refs) {
-                StringArray sorted_refs;
-                init_string_array(&sorted_refs);
-                for (int j = 0; j < refs->count; j++) {
-                    if (refs->items[j]) {
-                        add_to_string_array(&sorted_refs, refs->items[j]);
-                    }
-                }
-                qsort(sorted_refs.items, sorted_refs.count, sizeof(char *), compare_paths);
-                for (int j = 0; j < sorted_refs.count; j++) {
-                    printf("      %s\n", sorted_refs.items[j]);
-                }
-                free_string_array(&sorted_refs);
-            }
-        }
-    } else {
-        printf("(None)\n");
-    }
-
-    free_string_array(&orphan_files);
-    free_string_array(&missing_files);
-    free_hash_map(missing_refs);
-    free_string_array(&subfolders);
-    free_string_array(&exclude_dirs);
-}
-
-// --- Data Structure Implementations ---
-
-void init_string_array(StringArray *arr) {
-    if (!arr) return;
-    arr->items = (char **)malloc(INITIAL_ARRAY_CAPACITY * sizeof(char *));
-    if (!arr->items) {
-        perror("Failed to allocate memory for string array");
-        exit(EXIT_FAILURE);
-    }
-    arr->count = 0;
-    arr->capacity = INITIAL_ARRAY_CAPACITY;
-}
-
-void add_to_string_array(StringArray *arr, const char *item) {
-    if (!arr || !item) {
-        fprintf(stderr, "Warning: Null arr or item in add_to_string_array\n");
-        return;
-    }
-    if (arr->count >= arr->capacity) {
-        arr->capacity *= 2;
-        char **new_items = (char **)realloc(arr->items, arr->capacity * sizeof(char *));
-        if (!new_items) {
-            perror("Failed to reallocate memory for string array");
-            free(arr->items);
-            exit(EXIT_FAILURE);
-        }
-        arr->items = new_items;
-    }
-    arr->items[arr->count] = strdup(item);
-    if (!arr->items[arr->count]) {
-        perror("Failed to duplicate string for array");
-        exit(EXIT_FAILURE);
-    }
-    arr->count++;
-}
-
-bool string_array_contains(const StringArray *arr, const char *item) {
-    if (!arr || !item) return false;
-    for (int i = 0; i < arr->count; i++) {
-        if (arr->items[i] && strcmp(arr->items[i], item) == 0) return true;
-    }
-    return false;
-}
-
-void free_string_array(StringArray *arr) {
-    if (!arr) return;
-    if (arr->items) {
-        for (int i = 0; i < arr->count; i++) {
-            free(arr->items[i]);
-            arr->items[i] = NULL; // Prevent double-free
-        }
-        free(arr->items);
-        arr->items = NULL;
-    }
-    arr->count = 0;
-    arr->capacity = 0;
-}
-
-unsigned int hash(const char *key, int size) {
-    if (!key) return 0;
-    unsigned int hash_val = 5381;
-    int c;
-    while ((c = *key++)) {
-        hash_val = ((hash_val << 5) + hash_val) + c;
-    }
-    return hash_val % size;
-}
-
-HashMap* create_hash_map(int size) {
-    HashMap *map = (HashMap*)malloc(sizeof(HashMap));
-    if (!map) {
-        perror("Failed to allocate memory for hash map");
-        exit(EXIT_FAILURE);
-    }
-    map->size = size;
-    map->buckets = (Node**)calloc(size, sizeof(Node*));
-    if (!map->buckets) {
-        perror("Failed to allocate memory for hash map buckets");
-        free(map);
-        exit(EXIT_FAILURE);
-    }
-    return map;
-}
-
-void add_to_hash_map(HashMap *map, const char *key, const char *value) {
-    if (!map || !key || !value) {
-        fprintf(stderr, "Warning: Null map, key, or value in add_to_hash_map\n");
-        return;
-    }
-    unsigned int index = hash(key, map->size);
-    Node *head = map->buckets[index];
-    for (Node *curr = head; curr; curr = curr->next) {
-        if (curr->key && strcmp(curr->key, key) == 0) {
-            add_to_string_array(curr->values, value);
-            return;
-        }
-    }
-
-    Node *newNode = (Node*)malloc(sizeof(Node));
-    if (!newNode) {
-        perror("Failed to allocate memory for hash map node");
-        exit(EXIT_FAILURE);
-    }
-    newNode->key = strdup(key);
-    if (!newNode->key) {
-        perror("Failed to allocate memory for hash map key");
-        free(newNode);
-        exit(EXIT_FAILURE);
-    }
-    newNode->values = (StringArray*)malloc(sizeof(StringArray));
-    if (!newNode->values) {
-        perror("Failed to allocate memory for hash map values");
-        free(newNode->key);
-        free(newNode);
-        exit(EXIT_FAILURE);
-    }
-
-    init_string_array(newNode->values);
-    add_to_string_array(newNode->values, value);
-    newNode->next = head;
-    map->buckets[index] = newNode;
-}
-
-StringArray* get_from_hash_map(const HashMap *map, const char *key) {
-    if (!map || !key) return NULL;
-    unsigned int index = hash(key, map->size);
-    for (Node *curr = map->buckets[index]; curr; curr = curr->next) {
-        if (curr->key && strcmp(curr->key, key) == 0) {
-            return curr->values;
-        }
-    }
-    return NULL;
-}
-
-void free_hash_map(HashMap *map) {
-    if (!map) return;
-    for (int i = 0; i < map->size; i++) {
-        Node *head = map->buckets[i];
-        while (head) {
-            Node *temp = head;
-            head = head->next;
-            free(temp->key);
-            free_string_array(temp->values);
-            free(temp->values);
-            free(temp);
-        }
-    }
-    free(map->buckets);
-    free(map);
+    bool any_missing = false;
+    for (it = pj_iter_begin(ctx, PJ_RESULT_MISSING); pj_iter_next(&it, &entry);) {
+        printf("- %s\n", entry.name);
+        printf("    referenced by:\n");
+        for (size_t j = 0; j < entry.path_count; j++) printf("      %s\n", entry.paths[j]);
+        any_missing = true;
+    }
+    if (!any_missing) printf("(None)\n");
 }
@@ -0,0 +1,209 @@
+/**
+ * @file projanitor.h
+ * @brief Embeddable projanitor engine (libprojanitor).
+ *
+ * All state lives in a ProjanitorContext: configure it, call pj_scan(), read
+ * the results through the iterators, and optionally run the extra analyses.
+ * A context may be scanned repeatedly; the project root is discovered once and
+ * kept, and every scan replaces the previous results. Contexts are independent,
+ * so separate contexts may be used from separate threads.
+ *
+ * The library never exits the process and never writes to stdout. Diagnostics
+ * go to the log callback (none by default). Report-style analyses write to a
+ * caller-supplied FILE *. Allocation failure inside an API call unwinds that
+ * call with PJ_ERR_NOMEM; the context stays valid and can be scanned again.
+ *
+ * Strings returned by the accessors belong to the context and stay valid until
+ * the next pj_scan() or pj_context_free().
+ */
+#ifndef PROJANITOR_H
+#define PROJANITOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PJ_VERSION "1.1.0"
+
+typedef struct ProjanitorContext ProjanitorContext;
+
+typedef enum {
+    PJ_OK = 0,
+    PJ_ERR_NOMEM,       // allocation failed; results of the call are discarded
+    PJ_ERR_INVALID,     // bad argument, or call made in the wrong state
+    PJ_ERR_IO,          // a required file or directory could not be read
+    PJ_ERR_NO_ROOT      // no directory had all marker files; the start directory is used
+} pj_status;
+
+typedef enum {
+    PJ_LOG_INFO,        // only emitted when verbose
+    PJ_LOG_WARNING,
+    PJ_LOG_ERROR
+} pj_log_level;
+
+typedef void (*pj_log_fn)(void *user, pj_log_level level, const char *message);
+
+// Optional data collected during the scan (see pj_set_features).
+enum {
+    PJ_FEATURE_SYMBOLS = 1u << 0,   // symbol index for pj_report_unused_symbols()
+    PJ_FEATURE_TRIGRAMS = 1u << 1   // trigram postings for pj_write_trigram_index()
+};
+
+typedef enum {
+    PJ_RESULT_FILES,        // every file of interest, sorted
+    PJ_RESULT_ORPHANS,      // files whose name is never referenced
+    PJ_RESULT_MISSING,      // referenced names with no file; paths = referrers
+    PJ_RESULT_DUPLICATES,   // basenames found more than once; paths = locations
+    PJ_RESULT_SUBFOLDERS,   // top-level directories of the project
+    PJ_RESULT_REFERENCED,   // every referenced name; paths = referrers
+    PJ_RESULT_BASENAMES,    // every basename found; paths = locations
+    PJ_RESULT_DIRECTORIES,  // every directory scanned below the root
+    PJ_RESULT_EXCLUDED      // directories skipped because of exclude_dirs
+} pj_result_kind;
+
+typedef enum {
+    PJ_TYPE_C,
+    PJ_TYPE_H,
+    PJ_TYPE_CMAKELISTS,
+    PJ_TYPE_CMAKE,
+    PJ_TYPE_SH,
+    PJ_TYPE_JSON,
+    PJ_TYPE_PY,
+    PJ_TYPE_MD,
+    PJ_TYPE_COUNT
+} pj_file_type;
+
+typedef enum {
+    PJ_GRAPH_DOT,
+    PJ_GRAPH_GRAPHML
+} pj_graph_format;
+
+typedef enum {
+    PJ_AGGREGATE_NONE,          // one node per file
+    PJ_AGGREGATE_DIRECTORY,     // one node per directory
+    PJ_AGGREGATE_COMPONENT      // components/<name> where present, else the top-level directory
+} pj_graph_aggregate;
+
+typedef struct {
+    const char *name;           // path, referenced name or basename, by kind
+    const char *const *paths;   // NULL for the plain path lists
+    size_t path_count;
+} pj_entry;
+
+typedef struct {
+    const ProjanitorContext *ctx;
+    pj_result_kind kind;
+    size_t next;
+} pj_iter;
+
+// --- Context ---
+ProjanitorContext *pj_context_new(void);
+void pj_context_free(ProjanitorContext *ctx);
+const char *pj_last_error(const ProjanitorContext *ctx);
+
+// --- Configuration (defaults match the CLI) ---
+void pj_set_log_callback(ProjanitorContext *ctx, pj_log_fn fn, void *user);
+void pj_set_verbose(ProjanitorContext *ctx, bool verbose);
+void pj_set_features(ProjanitorContext *ctx, unsigned features);
+void pj_set_jobs(ProjanitorContext *ctx, int jobs);
+// Scan with `threads` threads issuing stats and reads concurrently, for trees on
+// NFS and other high-latency filesystems; 0 (the default) scans serially.
+void pj_set_network_fs(ProjanitorContext *ctx, int threads);
+// Back the large tables of a scan (file table, references, indexes, graph)
+// with huge pages where the system allows, falling back to normal pages.
+void pj_set_huge_pages(ProjanitorContext *ctx, bool enabled);
+pj_status pj_set_extensions(ProjanitorContext *ctx, const char *const *items, size_t count);
+pj_status pj_set_exclude_dirs(ProjanitorContext *ctx, const char *const *items, size_t count);
+pj_status pj_set_marker_files(ProjanitorContext *ctx, const char *const *items, size_t count);
+pj_status pj_set_start_dir(ProjanitorContext *ctx, const char *path);  // default: cwd
+pj_status pj_set_root(ProjanitorContext *ctx, const char *path);       // skips discovery
+
+// --- Scanning ---
+// Finds (once) and returns the project root; PJ_ERR_NO_ROOT means the start
+// directory is used as a fallback.
+pj_status pj_discover_root(ProjanitorContext *ctx);
+pj_status pj_scan(ProjanitorContext *ctx);
+
+// --- Results ---
+const char *pj_root_path(const ProjanitorContext *ctx);
+const char *pj_project_name(const ProjanitorContext *ctx);
+size_t pj_file_type_count(const ProjanitorContext *ctx, pj_file_type type);
+size_t pj_result_count(const ProjanitorContext *ctx, pj_result_kind kind);
+pj_iter pj_iter_begin(const ProjanitorContext *ctx, pj_result_kind kind);
+bool pj_iter_next(pj_iter *it, pj_entry *entry);
+
+// --- Analyses (require a completed pj_scan) ---
+pj_status pj_report_redundant_includes(ProjanitorContext *ctx, FILE *out);
+// #include lines whose header declares nothing the includer uses, directly or
+// through the headers it includes. Tokenizes every C source and header once,
+// on pj_set_jobs() threads.
+pj_status pj_report_unused_includes(ProjanitorContext *ctx, FILE *out);
+pj_status pj_report_include_guards(ProjanitorContext *ctx, FILE *out);
+// PJ_ERR_IO if the rules file cannot be read, PJ_ERR_INVALID if any directive
+// in it is malformed or names an unknown layer; nothing is checked then.
+pj_status pj_check_layering(ProjanitorContext *ctx, const char *rules_path, FILE *out, size_t *violations);
+pj_status pj_report_unused_symbols(ProjanitorContext *ctx, FILE *out);
+// Files no path of references from a CMake file reaches, in connected clusters.
+pj_status pj_report_unreachable_files(ProjanitorContext *ctx, FILE *out);
+// .o/.obj/.d files under build/ whose source (found by CMake's object path
+// layout) no longer exists, with the bytes removing them would reclaim.
+pj_status pj_report_stale_artifacts(ProjanitorContext *ctx, FILE *out);
+// compile_db/cache_dir may be NULL for <root>/build/compile_commands.json
+// (then <root>/compile_commands.json) and <root>/.projanitor_cache/pp.
+pj_status pj_profile_preprocessed_sizes(ProjanitorContext *ctx, const char *compile_db, const char *cache_dir, int top, FILE *out);
+// index_path may be NULL for <root>/.projanitor_cache/trigrams.idx.
+pj_status pj_write_trigram_index(ProjanitorContext *ctx, const char *index_path, FILE *out);
+// Saves the reference graph for pj_why(); NULL: <root>/.projanitor_cache/graph.snap.
+pj_status pj_write_graph_snapshot(ProjanitorContext *ctx, const char *snapshot_path, FILE *out);
+// Writes files, references, orphans, duplicates and missing names as SQLite
+// tables. PJ_ERR_INVALID if the library was built without SQLite.
+pj_status pj_export_sqlite(ProjanitorContext *ctx, const char *db_path, FILE *out);
+// Writes a self-contained HTML page with the file tree and the orphan,
+// duplicate and missing tables; the data is embedded as compressed chunks
+// that the page decodes as they scroll into view.
+pj_status pj_write_html_report(ProjanitorContext *ctx, const char *html_path, FILE *out);
+// Writes the reference graph as DOT or GraphML. Aggregated graphs have one node
+// per group and one edge per connected pair of groups, weighted by the number
+// of references it stands for; references within a group are dropped.
+pj_status pj_export_graph(ProjanitorContext *ctx, const char *graph_path, pj_graph_format format,
+                          pj_graph_aggregate aggregate, FILE *out);
+// Writes the findings and the cost of the last scan (phase times, bytes read,
+// filesystem calls, peak RSS) in Prometheus text format, atomically. Call it
+// last: include-graph time counts only once something has built the graph.
+pj_status pj_write_metrics(ProjanitorContext *ctx, const char *metrics_path, FILE *out);
+
+// --- Queries (no scan needed) ---
+// Without a root or index path, the root is the nearest directory above the
+// start directory holding .projanitor_cache/trigrams.idx, then the usual
+// marker-file discovery.
+// Prints "path:line:text" for every line containing `needle`, reading only the
+// files the trigram index lists as candidates. Files changed since the index
+// was written are searched as they are now, but new files are not seen.
+pj_status pj_query_trigram_index(ProjanitorContext *ctx, const char *index_path, const char *needle, FILE *out, size_t *matches);
+// Shortest reference chains from a CMake file to `file` (a path, or a unique
+// trailing part of one). Uses the scanned graph after pj_scan(), otherwise the
+// snapshot (located like the trigram index). *chains is 0 if unreachable.
+pj_status pj_why(ProjanitorContext *ctx, const char *snapshot_path, const char *file, FILE *out, size_t *chains);
+// What must rebuild when `files` change (named as for pj_why()): every file
+// that references one of them, transitively, listed as the translation units
+// and the CMake files whose source lists are affected. Names not in the graph
+// are listed and skipped. *affected counts the units and CMake files.
+pj_status pj_impact(ProjanitorContext *ctx, const char *snapshot_path, const char *const *files, size_t count,
+                    FILE *out, size_t *affected);
+// The tests to run when `files` change: test targets (CMake files under a
+// test/ or tests/ directory) and test sources (test_*.c, *_test.py, .c files
+// under test directories) that reach a changed file through the reference
+// graph. The snapshot stores, per file, the tests depending on it as a bitset.
+// *selected counts the tests listed.
+pj_status pj_select_tests(ProjanitorContext *ctx, const char *snapshot_path, const char *const *files, size_t count,
+                          FILE *out, size_t *selected);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PROJANITOR_H
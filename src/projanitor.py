@@ -15,7 +15,13 @@ Options:
     --exclude-dirs STR  Comma-separated directories to exclude (default: .git,build,build_logs,doc)
     --marker-files STR  Comma-separated files to identify project root (default: LICENSE,sdkconfig,dependencies.lock,CMakeLists.txt)
     --verbose           Enable detailed warning messages
+    -j, --jobs N        Worker processes for reference scanning (default: CPU count)
 Requires Python 3.6+.
+
+When the _projanitor extension module is importable (build it with `make python`),
+the scan runs in the C engine with the GIL released, and the C engine's reference
+rules apply (#include "..." lines and CMake SRC lists). Set PROJANITOR_PURE_PYTHON=1
+to force the pure-Python scan.
 """
 import argparse
 import os
@@ -25,6 +31,13 @@ from pathlib import Path
 from collections import defaultdict, Counter
 from typing import List, Set, Dict, Optional, Tuple
 
+try:
+    import _projanitor
+except ImportError:
+    _projanitor = None
+if os.environ.get("PROJANITOR_PURE_PYTHON"):
+    _projanitor = None
+
 
 # --- Configurable Constants ---
 DEFAULT_FILES_OF_INTEREST = [
@@ -78,6 +91,13 @@ def parse_args() -> argparse.Namespace:
         action="store_true",
         help="Enable detailed warning messages",
     )
+    parser.add_argument(
+        "-j",
+        "--jobs",
+        type=int,
+        default=os.cpu_count() or 1,
+        help="Worker processes for reference scanning (default: CPU count)",
+    )
     return parser.parse_args()
 
 def find_project_root(start_path: Path, marker_files: List[str], verbose: bool) -> Optional[Path]:
@@ -154,15 +174,110 @@ def get_project_name(root_path: Path, verbose: bool) -> str:
 
 def matches_interest_patterns(file_path: Path) -> bool:
     """Check if a file matches the patterns of interest."""
-    return file_path.name in VALID_FILENAMES or file_path.suffix in VALID_EXTENSIONS
+    return matches_interest_name(file_path.name)
+
+def matches_interest_name(name: str) -> bool:
+    """matches_interest_patterns() on a bare file name."""
+    return name in VALID_FILENAMES or os.path.splitext(name)[1] in VALID_EXTENSIONS
+
+# Reference patterns, applied to a whole file at once. Horizontal whitespace
+# only, so a match never spans lines (as with the former per-line scan).
+INCLUDE_RE = re.compile(r'#[ \t]*include[ \t]*"([^"\n]+)"')
+CMAKE_REF_RE = re.compile(r'\b([a-zA-Z0-9][a-zA-Z0-9_.-]*?\.(?:c|h|sh|py|json|md|cmake))\b')
+PY_IMPORT_RE = re.compile(r'from[ \t]+([a-zA-Z0-9_.-]+)[ \t]+import')
+PARALLEL_MIN_FILES = 256  # below this a process pool costs more than it saves
+
+def reference_kind(name: str) -> Optional[str]:
+    """Which reference syntax a file uses: "c", "cmake", "py", or None."""
+    suffix = os.path.splitext(name)[1]
+    if suffix in (".c", ".h"):
+        return "c"
+    if name.lower().endswith((".cmake", "cmakelists.txt")):
+        return "cmake"
+    if suffix == ".py":
+        return "py"
+    return None
 
-def analyze_project_files(
+def scan_references(path: str) -> Tuple[str, List[str], List[str]]:
+    """Read one file and return (path, referenced basenames, warnings)."""
+    kind = reference_kind(os.path.basename(path))
+    refs: List[str] = []
+    warnings: List[str] = []
+    try:
+        with open(path, "r", encoding="utf-8") as f:
+            text = f.read()
+    except UnicodeDecodeError:
+        return path, refs, [f"Warning: Could not decode {path} as UTF-8, skipping"]
+    except PermissionError as e:
+        return path, refs, [f"Warning: Permission denied reading {path}: {e}"]
+    except FileNotFoundError:
+        return path, refs, [f"Warning: File {path} not found, skipping"]
+
+    if kind == "py":
+        return path, [f"{ref}.py" for ref in PY_IMPORT_RE.findall(text)], warnings
+    parent = Path(path).parent
+    for ref in (INCLUDE_RE if kind == "c" else CMAKE_REF_RE).findall(text):
+        try:
+            refs.append((parent / ref).resolve().name)
+        except (FileNotFoundError, RuntimeError):
+            warnings.append(f"Warning: Reference {ref} in {path} not found")
+    return path, refs, warnings
+
+def scan_references_chunk(paths: List[str]) -> List[Tuple[str, List[str], List[str]]]:
+    """Process-pool task: scan a batch of files."""
+    return [scan_references(path) for path in paths]
+
+def scan_references_parallel(paths: List[str], jobs: int) -> List[Tuple[str, List[str], List[str]]]:
+    """scan_references over all paths, chunked across up to `jobs` processes."""
+    if jobs <= 1 or len(paths) < PARALLEL_MIN_FILES:
+        return scan_references_chunk(paths)
+    from concurrent.futures import ProcessPoolExecutor
+    # A few chunks per worker keeps them busy without paying per-file IPC.
+    chunk_size = max(32, len(paths) // (jobs * 4) + 1)
+    chunks = [paths[i:i + chunk_size] for i in range(0, len(paths), chunk_size)]
+    results: List[Tuple[str, List[str], List[str]]] = []
+    try:
+        with ProcessPoolExecutor(max_workers=jobs) as pool:
+            for batch in pool.map(scan_references_chunk, chunks):
+                results.extend(batch)
+    except (OSError, ImportError, NotImplementedError):
+        # No working multiprocessing (e.g. no /dev/shm): stay single-process.
+        return scan_references_chunk(paths)
+    return results
+
+def analyze_project_files_native(
     root_path: Path, exclude_dirs: Set[str], verbose: bool
+) -> Tuple[List[Path], Dict[str, Set[Path]], Dict[str, List[Path]], Dict[str, Path], List[str]]:
+    """Same contract as analyze_project_files, computed by the _projanitor extension."""
+    result = _projanitor.scan(
+        root=str(root_path),
+        extensions=sorted(VALID_EXTENSIONS) + sorted(VALID_FILENAMES),
+        exclude_dirs=sorted(exclude_dirs),
+        verbose=verbose,
+    )
+    list_exist = [Path(p) for p in result["files"]]
+    list_referenced: Dict[str, Set[Path]] = defaultdict(set)
+    for name, referrers in result["referenced"].items():
+        # Keyed by basename, like the resolved references of the Python scan
+        list_referenced[os.path.basename(name)].update(Path(p) for p in referrers)
+    found_files_map: Dict[str, List[Path]] = defaultdict(list)
+    for name, paths in result["basenames"].items():
+        found_files_map[name].extend(Path(p) for p in paths)
+    key_subfolders = {str(Path(p).relative_to(root_path)): Path(p) for p in result["directories"]}
+    return list_exist, list_referenced, found_files_map, key_subfolders, list(result["excluded"])
+
+def analyze_project_files(
+    root_path: Path, exclude_dirs: Set[str], verbose: bool, jobs: int = 1
 ) -> Tuple[List[Path], Dict[str, Set[Path]], Dict[str, List[Path]], Dict[str, Path], List[str]]:
     """
     Walk the project to compile file lists and statistics in a single pass.
-    Excludes specified directories and parses file references.
+    Excludes specified directories and parses file references of the files of
+    interest, using up to `jobs` worker processes.
     """
+    if _projanitor is not None:
+        print("\nAnalyzing project files...")
+        return analyze_project_files_native(root_path, exclude_dirs, verbose)
+
     list_exist: List[Path] = []
     list_referenced: Dict[str, Set[Path]] = defaultdict(set)
     found_files_map: Dict[str, List[Path]] = defaultdict(list)
@@ -170,76 +285,43 @@ def analyze_project_files(
     no_go_areas: List[str] = []
 
     print("\nAnalyzing project files...")
-    for dirpath, dirnames, filenames in os.walk(root_path, topdown=True):
-        current_path = Path(dirpath)
-        # Prune excluded directories
-        original_dirs = list(dirnames)
-        dirnames[:] = [d for d in dirnames if d not in exclude_dirs]
-        for pruned_dir in set(original_dirs) - set(dirnames):
-            no_go_areas.append(str(current_path / pruned_dir))
-
-        # Skip processing in excluded directories
-        if any(x in current_path.parts for x in exclude_dirs):
-            continue
-
-        # Collect subfolders
-        if current_path != root_path:
-            rel = str(current_path.relative_to(root_path))
-            key_subfolders[rel] = current_path
-
-        # Process files
-        for filename in filenames:
-            file_path = current_path / filename
-            if file_path.is_symlink():
-                if verbose:
-                    print(f"Warning: Skipping symlink {file_path}", file=sys.stderr)
-                continue
-
-            if matches_interest_patterns(file_path):
-                list_exist.append(file_path)
-                found_files_map[file_path.name].append(file_path)
-
-            # Parse file content for references
-            try:
-                with file_path.open("r", encoding="utf-8") as f:
-                    for line in f:
-                        # C/C++ includes
-                        if file_path.suffix in [".c", ".h"]:
-                            refs = re.findall(r'#\s*include\s*"([^"]+)"', line)
-                            for ref in refs:
-                                try:
-                                    ref_path = (file_path.parent / ref).resolve().name
-                                    list_referenced[ref_path].add(file_path)
-                                except FileNotFoundError:
-                                    if verbose:
-                                        print(f"Warning: Reference {ref} in {file_path} not found", file=sys.stderr)
-                        # CMake references
-                        elif file_path.name.lower().endswith((".cmake", "cmakelists.txt")):
-                            refs = re.findall(
-                                r'\b([a-zA-Z0-9][a-zA-Z0-9_.-]*?\.(?:c|h|sh|py|json|md|cmake))\b',
-                                line,
-                            )
-                            for ref in refs:
-                                try:
-                                    ref_path = (file_path.parent / ref).resolve().name
-                                    list_referenced[ref_path].add(file_path)
-                                except FileNotFoundError:
-                                    if verbose:
-                                        print(f"Warning: Reference {ref} in {file_path} not found", file=sys.stderr)
-                        # Python imports
-                        elif file_path.suffix == ".py":
-                            refs = re.findall(r'from\s+([a-zA-Z0-9_.-]+)\s+import', line)
-                            for ref in refs:
-                                list_referenced[f"{ref}.py"].add(file_path)
-            except UnicodeDecodeError:
-                if verbose:
-                    print(f"Warning: Could not decode {file_path} as UTF-8, skipping", file=sys.stderr)
-            except PermissionError as e:
-                if verbose:
-                    print(f"Warning: Permission denied reading {file_path}: {e}", file=sys.stderr)
-            except FileNotFoundError:
-                if verbose:
-                    print(f"Warning: File {file_path} not found, skipping", file=sys.stderr)
+    # Directory walk: os.scandir exposes d_type, so no per-entry stat is needed
+    # except for the rare DT_UNKNOWN entry.
+    # Visits directories in os.walk(topdown=True) order.
+    pending = [str(root_path)]
+    while pending:
+        current = pending.pop()
+        subdirs: List[str] = []
+        try:
+            with os.scandir(current) as entries:
+                for entry in entries:
+                    if entry.is_dir(follow_symlinks=False):
+                        if entry.name in exclude_dirs:
+                            no_go_areas.append(entry.path)
+                        else:
+                            key_subfolders[os.path.relpath(entry.path, root_path)] = Path(entry.path)
+                            subdirs.append(entry.path)
+                    elif entry.is_symlink():
+                        if verbose:
+                            print(f"Warning: Skipping symlink {entry.path}", file=sys.stderr)
+                    elif entry.is_file(follow_symlinks=False) and matches_interest_name(entry.name):
+                        file_path = Path(entry.path)
+                        list_exist.append(file_path)
+                        found_files_map[entry.name].append(file_path)
+        except OSError as e:
+            if verbose:
+                print(f"Warning: Error accessing {current}: {e}", file=sys.stderr)
+        pending.extend(reversed(subdirs))
+
+    # Reference extraction: one read per file of interest, spread over a
+    # process pool in chunks once the tree is large enough to pay for it.
+    paths = [str(p) for p in list_exist if reference_kind(p.name)]
+    for path, refs, warnings in scan_references_parallel(paths, jobs):
+        for ref in refs:
+            list_referenced[ref].add(Path(path))
+        if verbose:
+            for warning in warnings:
+                print(warning, file=sys.stderr)
 
     return list_exist, list_referenced, found_files_map, key_subfolders, no_go_areas
 
@@ -342,7 +424,7 @@ def main() -> None:
 
     project_name = get_project_name(root_path, args.verbose)
     list_exist, list_referenced, found_files_map, key_subfolders, no_go_areas = analyze_project_files(
-        root_path, exclude_dirs, args.verbose
+        root_path, exclude_dirs, args.verbose, max(1, args.jobs)
     )
 
     generate_report(
@@ -0,0 +1,519 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+Behavior checks for projanitor's optional analyses and subcommands.
+
+Each case copies a fixture tree from tests/analyses/ to a scratch directory,
+runs the projanitor binary there and checks its exit status and output.
+Paths under the scratch root are printed relative to it, so expected lines
+read like the tree: "- drivers/uart.c:2: ...". Every `expect` line must
+appear in stdout as a whole line, in order; `reject` lines must not appear
+anywhere, and `stderr` strings must occur somewhere in stderr.
+
+Cases marked `sqlite` run the binary given by --sqlite-binary, one built
+with PJ_WITH_SQLITE (`make check` builds tests/projanitor-sqlite), and are
+skipped without it.
+
+Usage:
+    python3 tests/analyses.py [--binary PATH] [--sqlite-binary PATH] [--verbose] [CASE...]
+Exit status is 1 when any case fails.
+"""
+import argparse
+import base64
+import gzip
+import json
+import os
+import re
+import shutil
+import sqlite3
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+from typing import Callable, Dict, List, NamedTuple, Optional, Sequence
+
+REPO = Path(__file__).resolve().parent.parent
+TREES = REPO / "tests" / "analyses"
+
+# Root discovery stops at the tree's own CMakeLists.txt.
+COMMON_ARGS = ["--marker-files=CMakeLists.txt"]
+
+
+class Case(NamedTuple):
+    name: str
+    tree: str
+    args: Sequence[str]
+    status: int
+    expect: Sequence[str] = ()
+    reject: Sequence[str] = ()
+    stderr: Sequence[str] = ()
+    stdin: Optional[str] = None
+    setup: Optional[Callable[[Path], None]] = None
+    subcommand: Optional[str] = None
+    before: Sequence[str] = ()   # a scan run first (e.g. to write a snapshot)
+    check: Optional[Callable[[Path], List[str]]] = None  # inspects the tree afterwards, returns problems
+    sqlite: bool = False         # needs the --sqlite-binary build
+
+
+def write_build_artifacts(root: Path) -> None:
+    """A CMake build/ tree: objects and depfiles of live and deleted sources."""
+    for rel, size in [
+        ("CMakeFiles/app.dir/src/main.c.o", 100),
+        ("CMakeFiles/app.dir/src/main.c.o.d", 10),
+        ("CMakeFiles/app.dir/src/gone.c.o", 200),     # src/gone.c was deleted
+        ("CMakeFiles/app.dir/src/gone.c.o.d", 20),
+        ("CMakeFiles/app.dir/src/gone.c.d", 5),
+        ("test/CMakeFiles/test_util.dir/__/src/util.c.o", 40),
+        ("test/CMakeFiles/test_util.dir/__/src/old.c.obj", 7),
+        ("third_party/foo.o", 3),                     # no CMake layout: not traced
+    ]:
+        path = root / "build" / rel
+        path.parent.mkdir(parents=True, exist_ok=True)
+        path.write_bytes(b"\0" * size)
+
+
+# Stands in for a compiler's -E: expands #include "..." (honouring #pragma
+# once) with GCC-style line markers and fails when the source is missing.
+STUB_COMPILER = r"""#!/bin/sh
+for arg; do case $arg in *.c) src=$arg;; esac; done
+[ -f "$src" ] || exit 1
+exec awk -v src="$src" '
+function expand(file, flag,   line, n, name, dir) {
+    if (file in once) return
+    print "# 1 \"" file "\"" flag
+    dir = file; sub(/[^\/]*$/, "", dir)
+    n = 0
+    while ((getline line < file) > 0) {
+        n++
+        if (line == "#pragma once") { once[file] = 1; continue }
+        if (line ~ /^#include "/) {
+            name = line; sub(/^#include "/, "", name); sub(/".*/, "", name)
+            expand(dir name, " 1")
+            print "# " n + 1 " \"" file "\" 2"
+        } else print line
+    }
+    close(file)
+}
+BEGIN { expand(src, "") }'
+"""
+
+
+def write_compile_commands(root: Path) -> None:
+    """compile_commands.json for src/*.c built by a stub compiler, plus a TU
+    whose source is missing, so its preprocessing fails."""
+    cc = root / "cc"
+    cc.write_text(STUB_COMPILER)
+    cc.chmod(0o755)
+    commands = [{"directory": str(root), "file": "src/%s" % name,
+                 "arguments": [str(cc), "-Isrc", "-c", "src/%s" % name, "-o", "%s.o" % name]}
+                for name in ("main.c", "shapes.c", "gone.c")]
+    (root / "compile_commands.json").write_text(json.dumps(commands))
+
+
+def file_lines(path: str, expect: Sequence[str], reject: Sequence[str] = ()) -> Callable[[Path], List[str]]:
+    """Checks a written file like stdout: `expect` lines whole and in order
+    (leading spaces ignored), no `reject` substring anywhere."""
+    def check(root: Path) -> List[str]:
+        text = (root / path).read_text()
+        lines = [line.strip() for line in text.splitlines()]
+        problems, pos = [], 0
+        for want in expect:
+            try:
+                pos = lines.index(want, pos) + 1
+            except ValueError:
+                problems.append("%s: missing (or out of order): %r" % (path, want))
+        problems.extend("%s: unexpected: %r" % (path, unwanted) for unwanted in reject if unwanted in text)
+        return problems
+    return check
+
+
+def sqlite_rows(path: str, queries: Sequence[tuple]) -> Callable[[Path], List[str]]:
+    """Runs each (sql, rows) query on the exported database; text values
+    have the root prefix stripped, as in stdout."""
+    def check(root: Path) -> List[str]:
+        prefix = os.path.realpath(str(root)) + "/"
+        problems = []
+        db = sqlite3.connect(str(root / path))
+        try:
+            for sql, want in queries:
+                got = [tuple(v.replace(prefix, "") if isinstance(v, str) else v for v in row)
+                       for row in db.execute(sql)]
+                if got != list(want):
+                    problems.append("%s\n  returned %r\n  expected %r" % (sql, got, list(want)))
+        except sqlite3.Error as e:
+            problems.append("%s: %s" % (path, e))
+        finally:
+            db.close()
+        return problems
+    return check
+
+
+HTML_CHUNK = re.compile(r'<script type="application/x-projanitor-chunk" data-table="(\w+)" '
+                        r'data-first="(\d+)" data-rows="(\d+)">([^<]*)</script>')
+HTML_COLUMNS = {"dirs": 4, "files": 6, "orphans": 3, "duplicates": 2, "missing": 2}
+
+
+def html_rows(report: str, expected: Dict[str, int]) -> Callable[[Path], List[str]]:
+    """Decodes every gzip chunk of the HTML report and checks it against its
+    data-first/data-rows attributes and the row count of each table."""
+    def check(root: Path) -> List[str]:
+        problems = []
+        rows: Dict[str, int] = {}
+        for match in HTML_CHUNK.finditer((root / report).read_text()):
+            table, first, count = match.group(1), int(match.group(2)), int(match.group(3))
+            try:
+                text = gzip.decompress(base64.b64decode(match.group(4))).decode("utf-8")
+            except (OSError, ValueError) as e:
+                problems.append("%s chunk at row %d does not decode: %s" % (table, first, e))
+                continue
+            lines = text.splitlines()
+            if first != rows.get(table, 0) or len(lines) != count:
+                problems.append("%s chunk claims rows %d+%d, holds %d after %d"
+                                % (table, first, count, len(lines), rows.get(table, 0)))
+            for line in lines:
+                if len(line.split("\t")) != HTML_COLUMNS[table]:
+                    problems.append("%s row has the wrong column count: %r" % (table, line))
+            rows[table] = rows.get(table, 0) + len(lines)
+        if rows != expected:
+            problems.append("rows per table %r, expected %r" % (rows, expected))
+        if (root / (report + ".tmp")).exists():
+            problems.append("%s.tmp left behind" % report)
+        return problems
+    return check
+
+
+METRIC_SAMPLE = re.compile(r'^(\w+)\{(.*)\} (\S+)$')
+METRIC_NAMES = {
+    "projanitor_files", "projanitor_files_by_type", "projanitor_orphaned_files", "projanitor_missing_names",
+    "projanitor_duplicate_names", "projanitor_phase_seconds", "projanitor_scan_seconds", "projanitor_read_bytes",
+    "projanitor_syscalls", "projanitor_peak_rss_bytes", "projanitor_last_run_timestamp_seconds",
+}
+
+
+def metrics_samples(path: str, project: str, expect: Sequence[str]) -> Callable[[Path], List[str]]:
+    """Checks the metrics file: the set of metric names, HELP and TYPE before
+    each one's samples, the project label on every sample, and `expect`
+    sample lines verbatim."""
+    def check(root: Path) -> List[str]:
+        problems = []
+        lines = (root / path).read_text().splitlines()
+        described, names = set(), set()
+        for line in lines:
+            if line.startswith("# TYPE "):
+                described.add(line.split()[2])
+                continue
+            if line.startswith("#"):
+                continue
+            match = METRIC_SAMPLE.match(line)
+            if not match:
+                problems.append("malformed sample: %r" % line)
+                continue
+            names.add(match.group(1))
+            if match.group(1) not in described:
+                problems.append("sample before its TYPE line: %r" % line)
+            if not match.group(2).startswith('project="%s"' % project):
+                problems.append("sample without the project label: %r" % line)
+        if names != METRIC_NAMES:
+            problems.append("metric names %r, expected %r" % (sorted(names), sorted(METRIC_NAMES)))
+        problems.extend("missing sample: %r" % want for want in expect if want not in lines)
+        if (root / (path + ".tmp")).exists():
+            problems.append("%s.tmp left behind" % path)
+        return problems
+    return check
+
+
+CASES: List[Case] = [
+    # --- Layering (--layers) ---
+    Case("layers-violation", "layers", ["--layers=rules.txt"], 1,
+         expect=["Violations:",
+                 '- drivers/uart.c:2: #include "app_config.h" (drivers -> app)',
+                 "Layers: 2, files assigned: 4, includes checked: 4, violations: 1"]),
+    Case("layers-clean", "layers", ["--layers=permissive_rules.txt"], 0,
+         expect=["Layers: 2, files assigned: 4, includes checked: 4, violations: 0", "(None)"]),
+    Case("layers-missing-rules", "layers", ["--layers=no_such_rules.txt"], 1,
+         reject=["=== Layering ==="], stderr=["Cannot open layer rules no_such_rules.txt"]),
+    Case("layers-unknown-layer", "layers", ["--layers=bad_rules.txt"], 1,
+         reject=["=== Layering ==="], stderr=["bad_rules.txt:3: unknown layer 'driver'"]),
+
+    # --- Redundant includes (--redundant-includes) ---
+    Case("redundant-includes", "includes", ["--redundant-includes"], 0,
+         expect=["Redundant #include lines: 2 (duplicates: 1, transitively implied: 1)",
+                 '- src/main.c:3: #include "shapes.h" duplicates line 1',
+                 '- src/main.c:2: #include "types.h" already provided by "shapes.h" (line 1)'],
+         reject=['src/shapes.c:1:']),
+
+    # --- Unused includes (--unused-includes) ---
+    # types.h is used through shapes.h; log.h declares nothing shapes.c uses.
+    Case("unused-includes", "includes", ["--unused-includes"], 0,
+         expect=["Headers indexed: 3 (3 distinct names declared); #include lines checked: 5, unused: 1",
+                 '- src/shapes.c:2: #include "log.h" is unused: nothing it declares, or its includes declare, is used here'],
+         reject=['#include "shapes.h" is unused', '#include "types.h" is unused']),
+
+    # --- Include guards (--guard-check) ---
+    # bare.h has no guard and is reached three times in main.c's TU (directly,
+    # via once.h and guarded.h) and twice in other.c's: 3 repeats x 19 bytes.
+    # mismatch.h defines a different macro than it tests.
+    Case("guard-check", "guards", ["--guard-check"], 0,
+         expect=["Headers: 4 (#pragma once: 1, guard macro: 1, broken guard: 1, none: 1)",
+                 "Estimated bytes re-lexed by repeated inclusion: 57",
+                 "          57      3      4       19  src/bare.h  [no guard]",
+                 "           0      0      1       87  src/mismatch.h  [broken: #define does not match the #ifndef macro]"],
+         reject=["once.h  [", "guarded.h  ["]),
+
+    # --- Unused external symbols (--unused-symbols) ---
+    # Static, extern, prototypes and initializer uses do not count as unused
+    # external definitions
+    Case("unused-symbols", "symbols", ["--unused-symbols"], 0,
+         expect=["External definitions: 6, never used: 2 (identifiers indexed: 11)",
+                 "- src/lib.c:7: lib_unused_var (variable)",
+                 "- src/lib.c:13: lib_unused (function)"],
+         reject=["helper", "hidden_total", "lib_counter (", "lib_never_defined", "lib_in_initializer",
+                 "lib_table", "lib_used ("]),
+
+    # --- Reachability (--reachability) and CMake source lists ---
+    # Sources listed by add_executable, add_library, target_sources and
+    # idf_component_register are built: neither orphans, missing nor dead.
+    Case("reachability-cmake-targets", "targets", ["--reachability"], 0,
+         expect=["Orphan files: 4", "Missing files: 0",
+                 "- CMakeLists.txt", "- components/net/CMakeLists.txt", "- src/dead.c", "- test/CMakeLists.txt",
+                 "Build roots: 3, reachable files: 11 of 13",
+                 "Unreachable C sources and headers: 2 in 1 clusters (1 of them referenced by name)",
+                 "Cluster 1: 2 files, 1 references inside", "  - src/dead.c", "  - src/dead.h  [referenced by name]"]),
+
+    # --- why ---
+    Case("why-built-source", "targets", ["--rescan", "src/main.c"], 0, subcommand="why",
+         expect=["=== Why: src/main.c ===", "Shortest chain: 1 reference (1 found, 1 shown)",
+                 "  CMakeLists.txt:4 lists src/main.c"]),
+    Case("why-from-snapshot", "targets", ["components/net/include/net.h"], 0, subcommand="why",
+         before=["--graph-snapshot"],
+         expect=["Shortest chain: 2 references (1 found, 1 shown)",
+                 "  components/net/CMakeLists.txt:1 lists components/net/net.c",
+                 "  components/net/net.c:1 includes components/net/include/net.h"]),
+    Case("why-unreachable", "targets", ["--rescan", "src/dead.h"], 1, subcommand="why",
+         expect=["Not reachable from any of the 3 build roots"]),
+    Case("why-unknown-file", "targets", ["--rescan", "src/nosuch.c"], 2, subcommand="why",
+         stderr=["src/nosuch.c is not a scanned file"]),
+    Case("why-no-snapshot", "targets", ["src/main.c"], 2, subcommand="why",
+         stderr=["--graph-snapshot, or pass --rescan"]),
+
+    # --- impact ---
+    Case("impact-target-source", "targets", ["--rescan", "lib/legacy.c"], 0, subcommand="impact",
+         expect=["Changed: 1 file in the graph, 0 not; 2 files affected",
+                 "Translation units to rebuild: 1", "  lib/legacy.c",
+                 "CMake files listing affected sources: 1", "  CMakeLists.txt"]),
+    Case("impact-header-from-stdin", "targets", ["--rescan"], 0, subcommand="impact", stdin="src/util.h\n",
+         expect=["Translation units to rebuild: 4",
+                 "  src/extra.c", "  src/main.c", "  src/util.c", "  test/test_util.c [test]",
+                 "CMake files listing affected sources: 2", "  CMakeLists.txt", "  test/CMakeLists.txt [test]",
+                 "In test directories: 2"]),
+    Case("impact-cmake-file", "targets", ["components/net/CMakeLists.txt"], 0, subcommand="impact",
+         before=["--graph-snapshot"],
+         expect=["Translation units to rebuild: 1", "  components/net/net.c"]),
+    Case("impact-nothing", "targets", ["--rescan", "README.md"], 1, subcommand="impact",
+         expect=["  not in the graph: README.md", "Translation units to rebuild: 0"]),
+
+    # --- tests (CTest layout: test/CMakeLists.txt with add_executable + add_test) ---
+    Case("tests-shared-source", "targets", ["--rescan", "src/util.c"], 0, subcommand="tests",
+         expect=["Changed: 1 file in the graph, 0 not; 1 of 2 tests selected",
+                 "Test targets (CMake files): 1", "  test/CMakeLists.txt", "Test sources: 0"]),
+    Case("tests-header-from-snapshot", "targets", ["-"], 0, subcommand="tests", stdin="src/util.h\n",
+         before=["--graph-snapshot"],
+         expect=["Changed: 1 file in the graph, 0 not; 2 of 2 tests selected",
+                 "Test targets (CMake files): 1", "  test/CMakeLists.txt",
+                 "Test sources: 1", "  test/test_util.c"]),
+    Case("tests-test-source", "targets", ["--rescan", "test/test_util.c"], 0, subcommand="tests",
+         expect=["Test targets (CMake files): 1", "  test/CMakeLists.txt", "Test sources: 1", "  test/test_util.c"]),
+    Case("tests-none-selected", "targets", ["--rescan", "lib/legacy.c"], 1, subcommand="tests",
+         expect=["Changed: 1 file in the graph, 0 not; 0 of 2 tests selected"]),
+
+    # --- query (--trigram-index) ---
+    # Needles of three or more bytes are narrowed down by the index; shorter
+    # ones fall back to reading every indexed file.
+    Case("query-indexed", "targets", ["util_add("], 0, subcommand="query", before=["--trigram-index"],
+         expect=["src/main.c:4:    return util_add(1, 2) + extra_value();",
+                 "src/util.c:3:int util_add(int a, int b) {",
+                 "src/util.h:2:int util_add(int a, int b);",
+                 "test/test_util.c:4:    return util_add(2, 2) == 4 ? 0 : 1;"],
+         reject=["CMakeLists.txt"]),
+    Case("query-short-needle", "targets", ["ab"], 0, subcommand="query", before=["--trigram-index"],
+         expect=["CMakeLists.txt:4:add_executable(app src/main.c src/util.c)  # the application (main.c)",
+                 "CMakeLists.txt:12:enable_testing()",
+                 "test/CMakeLists.txt:1:add_executable(test_util"],
+         reject=[".c:", ".h:"]),
+    Case("query-no-match", "targets", ["no_such_identifier"], 1, subcommand="query", before=["--trigram-index"],
+         reject=[":"]),
+    Case("query-no-index", "targets", ["util_add"], 2, subcommand="query",
+         stderr=["Cannot open trigram index"]),
+
+    # --- Stale build artifacts (--stale-artifacts) ---
+    Case("stale-artifacts", "targets", ["--stale-artifacts"], 0, setup=write_build_artifacts,
+         expect=["Object and dependency files in build/: 8 (385 bytes), 7 traced to a source in the project",
+                 "Stale (source no longer exists): 4 files, 232 bytes reclaimable",
+                 "           5  build/CMakeFiles/app.dir/src/gone.c.d  (src/gone.c)",
+                 "         200  build/CMakeFiles/app.dir/src/gone.c.o  (src/gone.c)",
+                 "          20  build/CMakeFiles/app.dir/src/gone.c.o.d  (src/gone.c)",
+                 "           7  build/test/CMakeFiles/test_util.dir/__/src/old.c.obj  (src/old.c)"],
+         reject=["main.c.o", "util.c.o"]),
+
+    # --- Preprocessed-size profiler ---
+    Case("pp-profile", "includes", ["--pp-profile", "-j2"], 0, setup=write_compile_commands,
+         expect=["Translation units: 3 (0 cached, 2 preprocessed, 1 failed)",
+                 "Total preprocessed bytes: 389",
+                 "Distinct headers: 3",
+                 "           176         76      2   1  src/shapes.h",
+                 "           100        100      2   2  src/types.h",
+                 "            36         36      1   1  src/log.h"],
+         stderr=["Preprocessing src/gone.c failed"]),
+    Case("pp-profile-cached", "includes", ["--pp-profile", "-j2"], 0, setup=write_compile_commands,
+         before=["--pp-profile"],
+         expect=["Translation units: 3 (2 cached, 0 preprocessed, 1 failed)",
+                 "Total preprocessed bytes: 389"]),
+
+    # --- Graph export (--export-graph) ---
+    # One node per component; edges inside a group are dropped and the rest
+    # are folded into weighted group edges. test -> src mixes an include and
+    # a CMake source.
+    Case("export-graph-dot-component", "targets", ["--export-graph=graph.dot", "--graph-aggregate=component"], 0,
+         expect=["Nodes: 5, edges: 3 (from 13 files and 13 resolved references)"],
+         check=file_lines("graph.dot", [
+             'n1 [label="components/net\\n3 files"];',
+             'n3 [label="src\\n6 files"];',
+             'n0 -> n3 [weight=3, label="3", style=dashed];',
+             'n0 -> n2 [weight=1, style=dashed];',
+             'n4 -> n3 [weight=2, label="2"];',
+             "}"],
+             reject=["n1 -> ", "n3 -> ", "n4 -> n4", "net.h"])),
+    Case("export-graph-graphml-component", "targets", ["--export-graph=graph.graphml", "--graph-aggregate=component"], 0,
+         expect=["Nodes: 5, edges: 3 (from 13 files and 13 resolved references)"],
+         check=file_lines("graph.graphml", [
+             '<node id="n1"><data key="label">components/net</data><data key="files">3</data></node>',
+             '<edge source="n0" target="n3"><data key="weight">3</data><data key="kind">cmake_src</data></edge>',
+             '<edge source="n0" target="n2"><data key="weight">1</data><data key="kind">cmake_src</data></edge>',
+             '<edge source="n4" target="n3"><data key="weight">2</data><data key="kind">mixed</data></edge>',
+             "</graphml>"],
+             reject=['source="n1"', 'source="n3"', 'source="n4" target="n4"', "net.h"])),
+
+    # --- SQLite export (--export-sqlite) ---
+    Case("export-sqlite", "targets", ["--export-sqlite=scan.db"], 0, sqlite=True,
+         expect=["Files: 13, references: 13, orphans: 4, duplicate rows: 3, missing rows: 0"],
+         check=sqlite_rows("scan.db", [
+             ("SELECT value FROM meta WHERE key = 'project'", [("targets C",)]),
+             ("SELECT COUNT(*) FROM files", [(13,)]),
+             ("SELECT p.path FROM orphans JOIN file_paths p ON p.id = orphans.file_id ORDER BY 1",
+              [("CMakeLists.txt",), ("components/net/CMakeLists.txt",), ("src/dead.c",), ("test/CMakeLists.txt",)]),
+             ("SELECT f.path, r.line, r.kind, r.name, t.path FROM refs r JOIN file_paths f ON f.id = r.file_id"
+              " JOIN file_paths t ON t.id = r.target_id WHERE f.path LIKE '%/test/%' ORDER BY 1, 4",
+              [("test/CMakeLists.txt", 1, "cmake_src", "../src/util.c", "src/util.c"),
+               ("test/CMakeLists.txt", 1, "cmake_src", "test_util.c", "test/test_util.c"),
+               ("test/test_util.c", 1, "include", "util.h", "src/util.h")]),
+             ("SELECT COUNT(*) FROM refs WHERE target_id IS NULL", [(0,)]),
+             ("SELECT DISTINCT name FROM duplicates", [("CMakeLists.txt",)]),
+             ("SELECT COUNT(*) FROM missing", [(0,)])])),
+
+    # --- HTML report (--html-report) ---
+    Case("html-report", "targets", ["--html-report=report.html"], 0,
+         expect=["Files: 13, directories: 6, data chunks: 4", "Written to report.html"],
+         check=html_rows("report.html", {"dirs": 6, "files": 13, "orphans": 4, "duplicates": 3})),
+
+    # --- Prometheus metrics (--metrics-file) ---
+    Case("metrics-file", "targets", ["--metrics-file=scan.prom"], 0,
+         expect=["Written to scan.prom"],
+         check=metrics_samples("scan.prom", "targets C", [
+             'projanitor_files{project="targets C"} 13',
+             'projanitor_files_by_type{project="targets C",type="c"} 7',
+             'projanitor_files_by_type{project="targets C",type="h"} 3',
+             'projanitor_files_by_type{project="targets C",type="CMakeLists.txt"} 3',
+             'projanitor_files_by_type{project="targets C",type="json"} 0',
+             'projanitor_orphaned_files{project="targets C"} 4',
+             'projanitor_missing_names{project="targets C"} 0',
+             'projanitor_duplicate_names{project="targets C"} 1'])),
+
+    # --- Failed analyses set the exit status ---
+    Case("pp-profile-cache-dir-too-long", "layers", ["--pp-profile", "--pp-cache-dir=/" + "x" * 4100], 1,
+         expect=["=== Errors ==="], stderr=["Preprocessing cache directory path too long"]),
+]
+
+
+def run_case(binary: Path, case: Case, workdir: Path, verbose: bool) -> List[str]:
+    """Returns the problems found, empty when the case passes."""
+    root = workdir / case.name
+    shutil.copytree(str(TREES / case.tree), str(root))
+    if case.setup:
+        case.setup(root)
+    real_root = os.path.realpath(str(root))
+
+    def run(args: Sequence[str], stdin: Optional[str]) -> subprocess.CompletedProcess:
+        return subprocess.run([str(binary)] + list(args), cwd=str(root), input=(stdin or "").encode(),
+                              stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+
+    problems = []
+    if case.before:
+        proc = run(COMMON_ARGS + list(case.before), None)
+        if proc.returncode != 0:
+            problems.append("setup scan exited with status %d" % proc.returncode)
+    prefix = [case.subcommand] if case.subcommand else []
+    proc = run(prefix + COMMON_ARGS + list(case.args), case.stdin)
+    out = proc.stdout.decode("utf-8", "surrogateescape").replace(real_root + "/", "")
+    err = proc.stderr.decode("utf-8", "surrogateescape").replace(real_root + "/", "")
+    lines = [line.rstrip() for line in out.splitlines()]
+
+    if proc.returncode != case.status:
+        problems.append("exit status %d, expected %d" % (proc.returncode, case.status))
+    pos = 0
+    for want in case.expect:
+        try:
+            pos = lines.index(want, pos) + 1
+        except ValueError:
+            problems.append("missing (or out of order): %r" % want)
+    for unwanted in case.reject:
+        if unwanted in out:
+            problems.append("unexpected: %r" % unwanted)
+    for want in case.stderr:
+        if want not in err:
+            problems.append("missing on stderr: %r" % want)
+    if case.check:
+        problems.extend(case.check(root))
+    if problems and verbose:
+        problems.append("stdout:\n" + out + "stderr:\n" + err)
+    return problems
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--binary", default=str(REPO / "projanitor"), help="C binary to test (default: ./projanitor)")
+    parser.add_argument("--sqlite-binary", help="C binary built with PJ_WITH_SQLITE, for the sqlite cases")
+    parser.add_argument("--verbose", action="store_true", help="print the output of failing cases")
+    parser.add_argument("cases", nargs="*", help="names of the cases to run (default: all)")
+    args = parser.parse_args()
+
+    binary = Path(args.binary).resolve()
+    if not binary.is_file():
+        print("error: %s not found (run `make`)" % binary, file=sys.stderr)
+        return 1
+    sqlite_binary = Path(args.sqlite_binary).resolve() if args.sqlite_binary else None
+    if sqlite_binary and not sqlite_binary.is_file():
+        print("error: %s not found (run `make %s`)" % (sqlite_binary, args.sqlite_binary), file=sys.stderr)
+        return 1
+    selected = [c for c in CASES if not args.cases or c.name in args.cases]
+    failures = skipped = 0
+    workdir = Path(tempfile.mkdtemp(prefix="projanitor-analyses-"))
+    try:
+        for case in selected:
+            if case.sqlite and not sqlite_binary:
+                print("%-32s %s" % (case.name, "skipped (no --sqlite-binary)"))
+                skipped += 1
+                continue
+            problems = run_case(sqlite_binary if case.sqlite else binary, case, workdir, args.verbose)
+            print("%-32s %s" % (case.name, "FAIL" if problems else "ok"))
+            for problem in problems:
+                print("    " + problem.replace("\n", "\n    "))
+            failures += bool(problems)
+    finally:
+        shutil.rmtree(str(workdir), ignore_errors=True)
+    print("%d of %d cases passed" % (len(selected) - failures - skipped, len(selected))
+          + (", %d skipped" % skipped if skipped else ""))
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1 @@
+int bare_fn(void);
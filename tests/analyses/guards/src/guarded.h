@@ -0,0 +1,5 @@
+#ifndef GUARDED_H
+#define GUARDED_H
+#include "bare.h"
+int guarded_fn(void);
+#endif
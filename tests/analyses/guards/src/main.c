@@ -0,0 +1,7 @@
+#include "once.h"
+#include "guarded.h"
+#include "bare.h"
+
+int main(void) {
+    return once_fn() + guarded_fn() + bare_fn();
+}
@@ -0,0 +1,5 @@
+#ifndef MISMATCH_H
+#define MISMATCH_HH
+#include "bare.h"
+int mismatch_fn(void);
+#endif
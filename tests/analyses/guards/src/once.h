@@ -0,0 +1,3 @@
+#pragma once
+#include "bare.h"
+int once_fn(void);
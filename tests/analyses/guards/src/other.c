@@ -0,0 +1,6 @@
+#include "mismatch.h"
+#include "guarded.h"
+
+int other(void) {
+    return mismatch_fn() + guarded_fn();
+}
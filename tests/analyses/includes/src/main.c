@@ -0,0 +1,9 @@
+#include "shapes.h"
+#include "types.h"
+#include "shapes.h"
+
+int main(void) {
+    point_t a = {0, 0};
+    point_t b = {2, 3};
+    return shape_area(a, b);
+}
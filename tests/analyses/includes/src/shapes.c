@@ -0,0 +1,6 @@
+#include "shapes.h"
+#include "log.h"
+
+int shape_area(point_t a, point_t b) {
+    return (b.x - a.x) * (b.y - a.y);
+}
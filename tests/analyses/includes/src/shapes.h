@@ -0,0 +1,3 @@
+#pragma once
+#include "types.h"
+int shape_area(point_t a, point_t b);
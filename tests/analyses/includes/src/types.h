@@ -0,0 +1,5 @@
+#pragma once
+typedef struct {
+    int x;
+    int y;
+} point_t;
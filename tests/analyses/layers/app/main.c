@@ -0,0 +1,6 @@
+#include "uart.h"
+#include "app_config.h"
+
+int main(void) {
+    return uart_write(APP_BAUD);
+}
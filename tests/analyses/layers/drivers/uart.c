@@ -0,0 +1,6 @@
+#include "uart.h"
+#include "app_config.h"
+
+int uart_write(int baud) {
+    return baud == APP_BAUD;
+}
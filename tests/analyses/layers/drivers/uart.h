@@ -0,0 +1,2 @@
+#pragma once
+int uart_write(int baud);
@@ -0,0 +1,19 @@
+#include "lib.h"
+
+static int helper(void) { return 1; }
+static int hidden_total = 0;
+
+int lib_counter = 0;
+int lib_unused_var = 3;
+
+int lib_used(void) {
+    return helper() + lib_counter + hidden_total;
+}
+
+int lib_unused(void) {
+    return 0;
+}
+
+static int lib_via_table(void) { return 2; }
+int lib_in_initializer(void) { return 3; }
+int (*const lib_table[])(void) = { lib_via_table, lib_in_initializer };
@@ -0,0 +1,7 @@
+#ifndef LIB_H
+#define LIB_H
+extern int lib_counter;
+extern int (*const lib_table[])(void);
+int lib_used(void);
+int lib_never_defined(int count);
+#endif
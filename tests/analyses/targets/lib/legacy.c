@@ -0,0 +1,3 @@
+int legacy_value(void) {
+    return 4;
+}
@@ -0,0 +1,5 @@
+#include "dead.h"
+
+int dead_value(void) {
+    return DEAD_VALUE;
+}
@@ -0,0 +1,2 @@
+#pragma once
+#define DEAD_VALUE 7
@@ -0,0 +1,5 @@
+#include "util.h"
+
+int extra_value(void) {
+    return 3;
+}
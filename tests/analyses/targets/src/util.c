@@ -0,0 +1,5 @@
+#include "util.h"
+
+int util_add(int a, int b) {
+    return a + b;
+}
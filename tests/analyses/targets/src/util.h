@@ -0,0 +1,3 @@
+#pragma once
+int util_add(int a, int b);
+int extra_value(void);
@@ -0,0 +1,5 @@
+#include "util.h"
+
+int main(void) {
+    return util_add(2, 2) == 4 ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+/**
+ * @file bench_huge_pages.c
+ * @brief Lookup-phase benchmark for pj_set_huge_pages().
+ *
+ * Builds the tables of a synthetic million-file scan (file table columns and
+ * path arena, basename index, sorted path -> node map as the include graph
+ * uses) and times random path and basename lookups against them, first on
+ * normal pages and then with huge pages. The engine is compiled in, so the
+ * benchmark drives the same static tables the scan does.
+ *
+ * To Compile (or run `make bench`):
+ * gcc -std=c99 -O2 -o bench_huge_pages bench_huge_pages.c -lpthread
+ *
+ * To Run:
+ * ./bench_huge_pages [FILES] [LOOKUPS]
+ */
+#include "../src/libprojanitor.c"
+
+#include <time.h>
+
+#define DEFAULT_FILES 1000000
+#define DEFAULT_LOOKUPS 8000000
+#define ROUNDS 3
+
+static volatile long sink;  // keeps the lookups from being optimized away
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// AnonHugePages of the process, in kB.
+static long anon_huge_kb(void) {
+    FILE *file = fopen("/proc/self/smaps_rollup", "r");
+    if (!file) return -1;
+    char line[256];
+    long kb = -1;
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) break;
+    }
+    fclose(file);
+    return kb;
+}
+
+typedef struct {
+    double build;
+    double lookup;
+    long huge_kb;
+    long checksum;
+} Round;
+
+static Round run_round(int file_count, int lookups, bool huge) {
+    Round round = {0, 0, 0, 0};
+    OomGuard guard;
+    oom_enter(&guard);
+    if (setjmp(guard.env) != 0) {
+        fputs("bench_huge_pages: out of memory\n", stderr);
+        exit(1);
+    }
+    guard.huge_pages = huge;
+
+    double start = now();
+    FileTable files;
+    init_file_table(&files);
+    StringArray dirs;
+    init_string_array(&dirs);
+    char path[MAX_PATH_LEN];
+    for (int d = 0; d < file_count / 100 + 1; d++) {
+        snprintf(path, sizeof(path), "/bench/components/group_%03d/module_%05d", d % 1000, d);
+        add_to_string_array(&dirs, path);
+    }
+    for (int d = 0; d < dirs.count; d++) add_dir(&files, dirs.items[d]);
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    for (int i = 0; i < file_count; i++) {
+        int d = i / 100;
+        snprintf(path, sizeof(path), "%s/source_file_%07d.%s", dirs.items[d], i, i % 3 ? "c" : "h");
+        add_file(&files, path, d, &st);
+    }
+    sort_file_table(&files);
+    IdMap path_ids;
+    init_id_map(&path_ids, files.count);
+    for (int i = 0; i < files.count; i++) id_map_put(&path_ids, files.paths[files.sorted[i]], i);
+    round.build = now() - start;
+
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    start = now();
+    for (int i = 0; i < lookups; i++) {
+        int id = (int)(next_random(&state) % (uint64_t)files.count);
+        round.checksum += id_map_get(&path_ids, files.paths[id]);
+        round.checksum += id_map_get(&files.name_index, files.names[files.name_ids[id]]);
+    }
+    round.lookup = now() - start;
+    round.huge_kb = anon_huge_kb();
+
+    free_id_map(&path_ids);
+    free_file_table(&files);
+    free_string_array(&dirs);
+    oom_leave(&guard);
+    return round;
+}
+
+int main(int argc, char *argv[]) {
+    int file_count = argc > 1 ? atoi(argv[1]) : DEFAULT_FILES;
+    int lookups = argc > 2 ? atoi(argv[2]) : DEFAULT_LOOKUPS;
+    if (file_count < 1 || lookups < 1) {
+        fprintf(stderr, "Usage: %s [FILES] [LOOKUPS]\n", argv[0]);
+        return 2;
+    }
+    printf("%d files, %d path + %d basename lookups, best of %d\n", file_count, lookups, lookups, ROUNDS);
+    printf("  %-12s %10s %10s %12s %14s\n", "pages", "build s", "lookup s", "ns/lookup", "AnonHuge kB");
+    double base = 0;
+    for (int huge = 0; huge <= 1; huge++) {
+        Round best = {0, 0, 0, 0};
+        for (int r = 0; r < ROUNDS; r++) {
+            Round round = run_round(file_count, lookups, huge);
+            if (r == 0 || round.lookup < best.lookup) best = round;
+        }
+        double ns = best.lookup * 1e9 / (2.0 * lookups);
+        if (!huge) base = best.lookup;
+        printf("  %-12s %10.3f %10.3f %12.1f %14ld", huge ? "huge" : "normal", best.build, best.lookup, ns, best.huge_kb);
+        if (huge) printf("   (%.2fx)", base / best.lookup);
+        printf("\n");
+        sink += best.checksum;
+    }
+    return 0;
+}
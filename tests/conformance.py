@@ -0,0 +1,326 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+Cross-engine conformance and speed suite for projanitor.
+
+Runs every available engine over the checked-in fixture trees and over
+generated trees, reduces each result to one normalized model (files, orphans,
+missing references, duplicate names; paths relative to the tree), and diffs it
+against the engine's reference:
+
+    c            projanitor binary (text report parsed back)       reference
+    c-native     _projanitor.scan(), the CPython binding           must match c
+    c-nfs        projanitor binary, --network-fs=8 parallel scan   must match c
+    c-huge-pages projanitor binary, --huge-pages tables            must match c
+    py           projanitor.py, pure Python, one process           reference
+    py-parallel  projanitor.py, pure Python, process pool forced   must match py
+
+The C and Python engines use different parsing rules, so c vs py differences
+are printed as known divergences and only fail the run with --strict.
+A fast path (threaded, cached, ...) is added by appending to ENGINES with the
+engine it must reproduce as its reference.
+
+Usage:
+    python3 tests/conformance.py [--binary PATH] [--repeat N] [--generate N[,N...]]
+                                 [--seed N] [--strict] [--verbose]
+Exit status is 1 when any engine disagrees with its reference.
+"""
+import argparse
+import contextlib
+import difflib
+import io
+import json
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+from pathlib import Path
+from typing import Callable, Dict, List, Optional, Sequence
+
+REPO = Path(__file__).resolve().parent.parent
+FIXTURES = REPO / "tests" / "fixtures"
+SRC = REPO / "src"
+
+# Options shared by all engines so that they audit the same thing.
+EXTENSIONS = [".c", ".h", ".json", ".py", ".cmake", ".md", ".sh", "CMakeLists.txt"]
+EXCLUDE_DIRS = [".git", "build", "build_logs", "doc"]
+MARKER_FILES = ["CMakeLists.txt"]
+DUPLICATE_EXTS = (".c", ".h", ".py", ".sh")  # the ones both reports list
+
+
+def normalize(root: Path, files, orphans, missing, duplicates) -> dict:
+    """Common model: sorted lists of root-relative paths."""
+    def rel(path) -> str:
+        return os.path.relpath(str(path), str(root))
+
+    return {
+        "files": sorted(rel(p) for p in files),
+        "orphans": sorted(rel(p) for p in orphans),
+        "missing": {name: sorted(rel(p) for p in refs) for name, refs in sorted(missing.items())},
+        "duplicates": {
+            name: sorted(rel(p) for p in paths)
+            for name, paths in sorted(duplicates.items())
+            if name.endswith(DUPLICATE_EXTS) and len(paths) > 1
+        },
+    }
+
+
+# --- Engines ---
+
+def parse_c_report(text: str) -> dict:
+    """Pull the result lists back out of the C tool's text report."""
+    files, orphans = [], []
+    missing: Dict[str, List[str]] = {}
+    duplicates: Dict[str, List[str]] = {}
+    section, current = None, None
+    for line in text.splitlines():
+        if line.startswith("=== "):
+            section = line.strip("= ")
+            current = None
+            continue
+        if line == "File structure:":
+            section = "Files"
+            continue
+        if section == "Files" and line.startswith("  - "):
+            files.append(line[4:])
+        elif section == "Warnings":
+            if line.startswith("    "):
+                duplicates[current].append(line.strip())
+            elif line.startswith("  ") and line.endswith(":"):
+                current = line.strip()[:-1]
+                duplicates[current] = []
+        elif section == "Details of Orphan Files" and line.startswith("- "):
+            orphans.append(line[2:])
+        elif section == "Details of Missing Files":
+            if line.startswith("- "):
+                current = line[2:]
+                missing[current] = []
+            elif line.startswith("      "):
+                missing[current].append(line.strip())
+    return {"files": files, "orphans": orphans, "missing": missing, "duplicates": duplicates}
+
+
+def run_c_binary(binary: Path, root: Path, extra_args: Sequence[str] = ()) -> dict:
+    cmd = [
+        str(binary),
+        "--extensions=" + ",".join(EXTENSIONS),
+        "--exclude-dirs=" + ",".join(EXCLUDE_DIRS),
+        "--marker-files=" + ",".join(MARKER_FILES),
+    ] + list(extra_args)
+    proc = subprocess.run(cmd, cwd=str(root), stdout=subprocess.PIPE, stderr=subprocess.DEVNULL)
+    if proc.returncode != 0:
+        raise RuntimeError(f"{binary} exited with status {proc.returncode}")
+    report = parse_c_report(proc.stdout.decode("utf-8", "surrogateescape"))
+    return normalize(root, **report)
+
+
+def load_python_module():
+    """Import src/projanitor.py (and _projanitor when it was built)."""
+    sys.path.insert(0, str(SRC))
+    try:
+        import projanitor
+    finally:
+        sys.path.pop(0)
+    projanitor.VALID_EXTENSIONS = {e for e in EXTENSIONS if e.startswith(".")}
+    projanitor.VALID_FILENAMES = {e for e in EXTENSIONS if not e.startswith(".")}
+    return projanitor
+
+
+def run_native(native, root: Path) -> dict:
+    result = native.scan(root=str(root), extensions=EXTENSIONS, exclude_dirs=EXCLUDE_DIRS,
+                         marker_files=MARKER_FILES)
+    return normalize(root, result["files"], result["orphans"], result["missing"], result["duplicates"])
+
+
+def run_python(module, root: Path, jobs: int, parallel_min: Optional[int] = None) -> dict:
+    """The pure-Python engine, whether or not the extension was built."""
+    saved = (module._projanitor, module.PARALLEL_MIN_FILES)
+    module._projanitor = None
+    if parallel_min is not None:
+        module.PARALLEL_MIN_FILES = parallel_min
+    try:
+        with contextlib.redirect_stdout(io.StringIO()):
+            files, referenced, found, _, _ = module.analyze_project_files(root, set(EXCLUDE_DIRS), False, jobs)
+    finally:
+        module._projanitor, module.PARALLEL_MIN_FILES = saved
+    # Same set arithmetic as projanitor.py's generate_report()
+    exist_names = {p.name for p in files}
+    orphans = [p for name in exist_names - set(referenced) for p in found[name]]
+    missing = {name: referenced[name] for name in set(referenced) - exist_names}
+    return normalize(root, files, orphans, missing, found)
+
+
+class Engine:
+    def __init__(self, name: str, reference: Optional[str], run: Callable[[Path], dict]):
+        self.name = name
+        self.reference = reference  # engine whose output this one must reproduce
+        self.run = run
+
+
+def available_engines(binary: Path, jobs: int) -> List[Engine]:
+    engines: List[Engine] = []
+    if binary.is_file():
+        engines.append(Engine("c", None, lambda root: run_c_binary(binary, root)))
+        engines.append(Engine("c-nfs", "c", lambda root: run_c_binary(binary, root, ["--network-fs=8"])))
+        engines.append(Engine("c-huge-pages", "c", lambda root: run_c_binary(binary, root, ["--huge-pages"])))
+    else:
+        print(f"note: {binary} not found, skipping the C binary (run `make`)", file=sys.stderr)
+    module = load_python_module()
+    native = module._projanitor
+    if native is not None:
+        engines.append(Engine("c-native", "c", lambda root: run_native(native, root)))
+    else:
+        print("note: _projanitor not built, skipping c-native (run `make python`)", file=sys.stderr)
+    engines.append(Engine("py", None, lambda root: run_python(module, root, 1)))
+    engines.append(Engine("py-parallel", "py", lambda root: run_python(module, root, jobs, parallel_min=0)))
+    return engines
+
+
+# --- Corpora ---
+
+def generate_tree(root: Path, file_count: int, seed: int) -> None:
+    """A synthetic project exercising everything both engines look at."""
+    rng = random.Random(seed)
+    dirs = ["components/%s/%s" % (c, s) for c in ("core", "net", "ui", "hal") for s in ("src", "include")]
+    dirs += ["tools", "scripts", "cmake", "build", "doc"]
+    for d in dirs:
+        (root / d).mkdir(parents=True, exist_ok=True)
+    headers, sources = [], []
+    for i in range(file_count):
+        kind = rng.random()
+        comp = rng.choice(("core", "net", "ui", "hal"))
+        # A small pool of names guarantees duplicates across components.
+        stem = "mod%d" % (rng.randrange(file_count // 3 + 1) if rng.random() < 0.1 else i)
+        if kind < 0.4:
+            path = root / "components" / comp / "include" / (stem + ".h")
+            headers.append(path)
+        elif kind < 0.8:
+            path = root / "components" / comp / "src" / (stem + ".c")
+            sources.append(path)
+        elif kind < 0.9:
+            path = root / "tools" / (stem + ".py")
+        elif kind < 0.95:
+            path = root / "scripts" / (stem + ".sh")
+        else:
+            path = root / rng.choice(("doc", "build")) / (stem + ".md")
+        path.write_text("")
+    for path in headers + sources:
+        lines = []
+        if path.suffix == ".h":
+            guard = path.stem.upper() + "_H"
+            lines += ["#ifndef " + guard, "#define " + guard]
+        for _ in range(rng.randrange(6)):
+            if headers and rng.random() < 0.9:
+                lines.append('#include "%s"' % rng.choice(headers).name)
+            else:
+                lines.append('#include "missing%d.h"' % rng.randrange(20))
+        lines.append("#include <stdio.h>")
+        lines.append("int %s_%d(void) { return %d; }" % (path.stem, rng.randrange(1000), rng.randrange(10)))
+        if path.suffix == ".h":
+            lines.append("#endif")
+        path.write_text("\n".join(lines) + "\n")
+    pys = sorted((root / "tools").glob("*.py"))
+    for path in pys:
+        if pys and rng.random() < 0.7:
+            path.write_text("from %s import main\n" % rng.choice(pys).stem)
+    listed = rng.sample(sources, min(len(sources), max(1, len(sources) // 2)))
+    (root / "CMakeLists.txt").write_text(
+        "cmake_minimum_required(VERSION 3.10)\nproject(generated)\n"
+        "target_sources(app PRIVATE\n" +
+        "".join("    %s\n" % os.path.relpath(str(p), str(root)) for p in listed) + ")\n"
+    )
+
+
+def corpora(args, workdir: Path) -> List[Path]:
+    trees = sorted(p for p in FIXTURES.iterdir() if p.is_dir())
+    for count in args.generate:
+        root = workdir / ("generated-%d" % count)
+        root.mkdir()
+        generate_tree(root, count, args.seed)
+        trees.append(root)
+    return trees
+
+
+# --- Runner ---
+
+def label(root: Path) -> str:
+    return root.name if root.parent != FIXTURES else "fixtures/" + root.name
+
+
+def show_diff(expected: dict, actual: dict, from_name: str, to_name: str) -> int:
+    a = json.dumps(expected, indent=1, sort_keys=True).splitlines()
+    b = json.dumps(actual, indent=1, sort_keys=True).splitlines()
+    diff = list(difflib.unified_diff(a, b, from_name, to_name, lineterm="", n=1))
+    for line in diff[:60]:
+        print("    " + line)
+    if len(diff) > 60:
+        print("    ... (%d more diff lines)" % (len(diff) - 60))
+    return len(diff)
+
+
+def main() -> int:
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--binary", default=str(REPO / "projanitor"), help="C binary to test (default: ./projanitor)")
+    parser.add_argument("--repeat", type=int, default=3, help="timed runs per engine and corpus (best is shown)")
+    parser.add_argument("--generate", default="300,3000",
+                        help="comma-separated file counts of generated trees (empty for none)")
+    parser.add_argument("--seed", type=int, default=1, help="seed for the generated trees")
+    parser.add_argument("--jobs", type=int, default=4, help="workers for the parallel engines")
+    parser.add_argument("--strict", action="store_true", help="also fail on C vs Python divergences")
+    parser.add_argument("--verbose", action="store_true", help="show the diff of known divergences too")
+    args = parser.parse_args()
+    args.generate = [int(n) for n in args.generate.split(",") if n]
+
+    engines = available_engines(Path(args.binary), args.jobs)
+    failures = 0
+    workdir = Path(tempfile.mkdtemp(prefix="projanitor-conformance-"))
+    try:
+        trees = corpora(args, workdir)
+        header = "%-22s %6s" % ("corpus", "files") + "".join(" %12s" % e.name for e in engines)
+        print(header)
+        print("-" * len(header))
+        notes = []
+        for root in trees:
+            results, timings = {}, {}
+            for engine in engines:
+                best = None
+                for _ in range(max(1, args.repeat)):
+                    start = time.perf_counter()
+                    results[engine.name] = engine.run(root)
+                    elapsed = time.perf_counter() - start
+                    best = elapsed if best is None else min(best, elapsed)
+                timings[engine.name] = best
+            count = len(results[engines[0].name]["files"])
+            print("%-22s %6d" % (label(root), count) + "".join(" %10.1fms" % (timings[e.name] * 1000) for e in engines))
+
+            for engine in engines:
+                if engine.reference in results and results[engine.reference] != results[engine.name]:
+                    failures += 1
+                    notes.append((root, engine.reference, engine.name, True))
+            if "c" in results and "py" in results and results["c"] != results["py"]:
+                if args.strict:
+                    failures += 1
+                notes.append((root, "c", "py", args.strict))
+
+        print()
+        for root, ref, name, fatal in notes:
+            kind = "MISMATCH" if fatal else "divergence (known: different parsing rules)"
+            print("%s: %s vs %s: %s" % (label(root), ref, name, kind))
+            if fatal or args.verbose:
+                results_ref = next(e for e in engines if e.name == ref).run(root)
+                results_new = next(e for e in engines if e.name == name).run(root)
+                show_diff(results_ref, results_new, ref, name)
+        checked = [e.name for e in engines if e.reference and any(r.name == e.reference for r in engines)]
+        print("%s; %d mismatch(es)" % (
+            "checked " + ", ".join(checked) + " against their references" if checked else "no engine pairs to check",
+            failures))
+    finally:
+        shutil.rmtree(str(workdir), ignore_errors=True)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
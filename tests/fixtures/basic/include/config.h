@@ -0,0 +1,3 @@
+#pragma once
+#include "types.h"
+#define CONFIG_LEVEL 3
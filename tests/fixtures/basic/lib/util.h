@@ -0,0 +1,3 @@
+#ifndef LIB_UTIL_H
+#define LIB_UTIL_H
+#endif
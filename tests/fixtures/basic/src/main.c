@@ -0,0 +1,8 @@
+#include <stdio.h>
+#include "util.h"
+#include "config.h"
+
+int main(void) {
+    printf("%d\n", util_answer());
+    return 0;
+}
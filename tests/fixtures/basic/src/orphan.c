@@ -0,0 +1,3 @@
+int orphan_value(void) {
+    return 0;
+}
@@ -0,0 +1,5 @@
+#include "util.h"
+
+int util_answer(void) {
+    return 42;
+}
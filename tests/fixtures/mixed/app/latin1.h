@@ -0,0 +1,2 @@
+/* caf */
+#include "net.h"
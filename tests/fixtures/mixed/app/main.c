@@ -0,0 +1,6 @@
+#include "net.h"
+# include "legacy.h"
+
+int main(void) {
+    return net_start();
+}
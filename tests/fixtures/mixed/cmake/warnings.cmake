@@ -0,0 +1 @@
+add_compile_options(-Wall -Wextra)
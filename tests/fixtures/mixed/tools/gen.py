@@ -0,0 +1,3 @@
+from helpers import render
+
+print(render())